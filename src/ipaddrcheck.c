@@ -18,9 +18,24 @@
  *
  */
 
+/* isatty() */
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
 #include "config.h"
+#include "ipaddrcheck_classify.h"
+#include "ipaddrcheck_coverage.h"
+#include "ipaddrcheck_expand.h"
 #include "ipaddrcheck_functions.h"
+#include "ipaddrcheck_host_set.h"
+#include "ipaddrcheck_ipam.h"
+#include "ipaddrcheck_lpm.h"
+#include "ipaddrcheck_policy.h"
+#include "ipaddrcheck_prefix_set.h"
+#include "ipaddrcheck_set.h"
+#include "ipaddrcheck_reload.h"
 
 /* Option codes */
 #define IS_VALID              10
@@ -60,6 +75,48 @@
 
 #define NO_ACTION             500
 
+/* Options that only have a long form.
+ * Their codes lie outside of the character range,
+ * since there are few short option letters left.
+ */
+#define OPT_LPM_TABLE         1000
+#define OPT_POLICY            1010
+#define OPT_WATCH             1020
+#define OPT_STATS             1030
+#define OPT_IN_LIST           1040
+#define OPT_MEMORY_REPORT     1050
+#define OPT_UNION             1060
+#define OPT_INTERSECT         1070
+#define OPT_SUBTRACT          1080
+#define OPT_LIST_ADDRESSES    1090
+#define OPT_SYMMETRIC_DIFFERENCE 1100
+#define OPT_HOST_LIST         1110
+#define OPT_COMPILE           1120
+#define OPT_FILTER_RATE       1130
+#define OPT_NEXT_FREE         1140
+#define OPT_ALLOCATIONS       1150
+#define OPT_HOW_MANY          1160
+#define OPT_BEST_FIT          1170
+#define OPT_PLAN              1180
+#define OPT_POOL_USAGE        1190
+#define OPT_REDUNDANT         1200
+#define OPT_SHADOWED          1210
+#define OPT_CONTAINS          1220
+#define OPT_OVERLAPS          1230
+#define OPT_SAME_SUBNET       1240
+#define OPT_EQUAL             1250
+#define OPT_COUNT             1260
+#define OPT_COUNT_UNIT        1270
+#define OPT_EXPAND            1280
+#define OPT_EXPAND_PREFIXES   1290
+#define OPT_CLASSIFY          1300
+
+/* Relations between two addresses, all of the given ones must hold */
+#define RELATION_CONTAINS     1
+#define RELATION_OVERLAPS     2
+#define RELATION_SAME_SUBNET  4
+#define RELATION_EQUAL        8
+
 static const struct option options[] =
 {
     { "is-valid",              no_argument, NULL, 'a' },
@@ -89,21 +146,152 @@ static const struct option options[] =
     { "is-ipv4-range",         no_argument, NULL, 'F' },
     { "is-ipv6-range",         no_argument, NULL, 'G' },
     { "range-prefix-length",   required_argument, NULL, 'H' },
+    { "contains",              no_argument, NULL, OPT_CONTAINS },
+    { "overlaps",              no_argument, NULL, OPT_OVERLAPS },
+    { "same-subnet",           no_argument, NULL, OPT_SAME_SUBNET },
+    { "equal",                 no_argument, NULL, OPT_EQUAL },
+    { "lpm-table",             required_argument, NULL, OPT_LPM_TABLE },
+    { "policy",                required_argument, NULL, OPT_POLICY },
+    { "watch",                 no_argument, NULL, OPT_WATCH },
+    { "stats",                 no_argument, NULL, OPT_STATS },
+    { "in-list",               required_argument, NULL, OPT_IN_LIST },
+    { "memory-report",         no_argument, NULL, OPT_MEMORY_REPORT },
+    { "host-list",             required_argument, NULL, OPT_HOST_LIST },
+    { "compile",               required_argument, NULL, OPT_COMPILE },
+    { "filter-rate",           required_argument, NULL, OPT_FILTER_RATE },
+    { "next-free",             required_argument, NULL, OPT_NEXT_FREE },
+    { "allocations",           required_argument, NULL, OPT_ALLOCATIONS },
+    { "how-many",              required_argument, NULL, OPT_HOW_MANY },
+    { "best-fit",              no_argument, NULL, OPT_BEST_FIT },
+    { "plan",                  required_argument, NULL, OPT_PLAN },
+    { "pool-usage",            required_argument, NULL, OPT_POOL_USAGE },
+    { "union",                 required_argument, NULL, OPT_UNION },
+    { "intersect",             required_argument, NULL, OPT_INTERSECT },
+    { "subtract",              required_argument, NULL, OPT_SUBTRACT },
+    { "symmetric-difference",  required_argument, NULL, OPT_SYMMETRIC_DIFFERENCE },
+    { "list-addresses",        no_argument, NULL, OPT_LIST_ADDRESSES },
+    { "redundant",             required_argument, NULL, OPT_REDUNDANT },
+    { "shadowed",              required_argument, NULL, OPT_SHADOWED },
+    { "count",                 no_argument, NULL, OPT_COUNT },
+    { "count-unit",            required_argument, NULL, OPT_COUNT_UNIT },
+    { "expand",                no_argument, NULL, OPT_EXPAND },
+    { "expand-prefixes",       required_argument, NULL, OPT_EXPAND_PREFIXES },
+    { "classify",              no_argument, NULL, OPT_CLASSIFY },
     { "version",               no_argument, NULL, 'z' },
     { "help",                  no_argument, NULL, '?' },
     { "verbose",               no_argument, NULL, 'V' },
     { NULL,                    no_argument, NULL, 0   }
 };
 
+/* Handlers for modes that process every line of standard input */
+typedef int (*input_handler)(const void* context, char* input_str, int verbose);
+
+/* Handlers for modes that process the lines of standard input a batch at a time */
+typedef int (*batch_handler)(const void* context, char** inputs, size_t count, int verbose);
+
+/* Lines of standard input handed to a batch handler at once */
+#define INPUT_BATCH_SIZE 16
+
+/* A set operation and the file with its right operand */
+typedef struct
+{
+    int operation;
+    const char* path;
+} set_operand;
+
+/* A range check for every input of --is-ipv4-range or --is-ipv6-range */
+typedef struct
+{
+    int proto;
+    int prefix_length;
+} range_check;
+
+/* What block_from_str() found */
+#define BLOCK_MALFORMED 0
+#define BLOCK_PREFIX    1
+#define BLOCK_RANGE     2
+
+/* What --expand writes for every input */
+typedef struct
+{
+    expand_writer* writer;
+    int pflen;      /* length of the prefixes to write, -1 for host addresses */
+} expand_request;
+
+/* Handlers for modes that look addresses up in a table:
+   they print the entry that matched an input, if any */
+typedef int (*table_handler)(const char* address_str, int malformed, const lpm_entry* entry);
+
 /* Auxiliary functions */
 static void print_help(const char* program_name);
 static void print_version(void);
+static int process_inputs(char* address_str, input_handler handler, const void* context, int verbose);
+static int process_input_batches(char* address_str, batch_handler handler, const void* context,
+                                 size_t batch_size, int verbose);
+static int print_lpm_match(const char* address_str, int malformed, const lpm_entry* entry);
+static int print_policy_verdict(const char* address_str, int malformed, const lpm_entry* entry);
+static int run_table_lookups(const char* path, lpm_table_loader loader, table_handler handler,
+                             char* address_str, int watch, int stats, int verbose);
+static int check_in_list(const char* list_path, char* address_str, int memory_report,
+                         int filter_bits, int stats, int verbose);
+static int check_host_list(const char* host_list_path, const char* compile_path, char* address_str,
+                           int memory_report, int filter_bits, int stats, int verbose);
+static int combine_set_files(const set_operand* operands, int operand_count, int list_addresses);
+static int check_relations(int relations, char* left_str, char* right_str, char* length_str, int verbose);
+static int check_range(const void* context, char* range_str, int verbose);
+static int print_redundant_entries(const char* group_path, int verbose);
+static int print_shadowed_rules(const char* acl_path, int verbose);
+static int allocate_from_pool(char* pool_str, const char* allocations_path, int strategy,
+                              long how_many, char* length_str, int verbose);
+static int plan_subnets(const char* plan_path, char* parent_str, int verbose);
+static int count_pool_usage(const char* pools_path, const char* leases_path, int verbose);
+static int count_addresses(char* input_str, int unit_length, int verbose);
+static int expand_blocks(char* input_str, int pflen, int verbose);
+static int print_address_classes(const void* context, char** inputs, size_t count, int verbose);
+
+/*
+ * Run ipaddrcheck with the given command line and return its exit status.
+ * The program calls it once from main(), the bash builtin once per command,
+ * so everything it allocates is freed before it returns.
+ */
+static int run_command(int argc, char* argv[], int* actions, set_operand* set_operands);
+
+int ipaddrcheck_main(int argc, char* argv[])
+{
+    int* actions = NULL;              /* Array of all given actions */
+    set_operand* set_operands = NULL; /* Set operations, in command line order */
+    int result = RESULT_INT_ERROR;
+
+    actions = (int*)calloc(argc, sizeof(int));
+    set_operands = (set_operand*)calloc(argc, sizeof(set_operand));
+    if( (actions == NULL) || (set_operands == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+    }
+    else
+    {
+        /* Make GNU getopt start over, it keeps state from the previous command */
+        optind = 0;
+        result = run_command(argc, argv, actions, set_operands);
+    }
+
+    free(actions);
+    free(set_operands);
+
+    return(result);
+}
 
+#ifndef IPADDRCHECK_BUILTIN
 int main(int argc, char* argv[])
+{
+    return ipaddrcheck_main(argc, argv);
+}
+#endif
+
+static int run_command(int argc, char* argv[], int* actions, set_operand* set_operands)
 {
     char *address_str = "";    /* IP address string obtained from arguments */
     int action = 0;            /* Action associated with given check option */
-    int* actions;              /* Array of all given actions */
     int action_count = 0;      /* Actions array size */
 
     int option_index = 0;      /* Number of the current option for getopt call */
@@ -121,6 +309,43 @@ int main(int argc, char* argv[])
     int ipv4_range_check = 0;
     int ipv6_range_check = 0;
 
+    /* Relations take two addresses instead of one */
+    int relations = 0;
+
+    /* Longest prefix match lookups and policy checks take their addresses
+     * either from the argument or from standard input.
+     */
+    const char* lpm_table_path = NULL;
+    const char* policy_path = NULL;
+    int watch = 0;      /* Reload the table when its file changes */
+    int stats = 0;      /* Print table statistics on exit */
+    const char* list_path = NULL;
+    int memory_report = 0;
+    const char* host_list_path = NULL;
+    const char* compile_path = NULL;
+    int filter_bits = 0;  /* Fingerprint width of the approximate membership filter */
+
+    /* Allocation of free prefixes from a pool */
+    char* pool_str = NULL;
+    const char* allocations_path = NULL;
+    long how_many = 1;
+    int strategy = ALLOCATE_LOWEST;
+    const char* plan_path = NULL;
+    const char* pools_path = NULL;
+
+    /* Set operations between files, applied from left to right */
+    int set_operand_count = 0;
+    int list_addresses = 0;
+
+    /* Analysis of address groups and policies */
+    const char* group_path = NULL;
+    const char* acl_path = NULL;
+    int count = 0;
+    int unit_length = -1;   /* Count whole prefixes of this length too */
+    int expand = 0;
+    int expand_length = -1; /* Expand into prefixes of this length instead of addresses */
+    int classify = 0;
+
     int verbose = 0;
 
     const char* program_name = argv[0]; /* Program name for use in messages */
@@ -128,14 +353,6 @@ int main(int argc, char* argv[])
 
     /* Parse options, convert to action codes, store in an array. */
 
-    /* Try to allocate memory for the actions array, abort if the attempt fails. */
-    actions = (int*)calloc(argc, sizeof(int));
-    if( errno == ENOMEM )
-    {
-        fprintf(stderr, "Error: could not allocate memory!\n");
-        return(RESULT_INT_ERROR);
-    }
-
     while( (optc = getopt_long(argc, argv, "acdefghijklmnoprstuzABCDEFGHV?", options, &option_index)) != -1 )
     {
          switch(optc)
@@ -244,6 +461,159 @@ int main(int argc, char* argv[])
              case 'V':
                  verbose = 1;
                  break;
+             case OPT_CONTAINS:
+                 relations |= RELATION_CONTAINS;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_OVERLAPS:
+                 relations |= RELATION_OVERLAPS;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_SAME_SUBNET:
+                 relations |= RELATION_SAME_SUBNET;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_EQUAL:
+                 relations |= RELATION_EQUAL;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_LPM_TABLE:
+                 lpm_table_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_POLICY:
+                 policy_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_WATCH:
+#ifdef IPADDRCHECK_BUILTIN
+                 /* The watcher takes over SIGHUP and SIGUSR1 and starts a thread,
+                    which a shell must not have done to it behind its back */
+                 fprintf(stderr, "Error: --watch is not available in the shell builtin!\n");
+                 return(RESULT_INT_ERROR);
+#else
+                 watch = 1;
+                 no_action = NO_ACTION;
+                 break;
+#endif
+             case OPT_STATS:
+                 stats = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_IN_LIST:
+                 list_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_HOST_LIST:
+                 host_list_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_COMPILE:
+                 compile_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_FILTER_RATE:
+                 filter_bits = filter_bits_for_rate(optarg);
+                 if( filter_bits < 0 )
+                 {
+                     fprintf(stderr, "Error: false positive rate must be a number between 0 and 1!\n");
+                     return(RESULT_INT_ERROR);
+                 }
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_MEMORY_REPORT:
+                 memory_report = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_UNION:
+             case OPT_INTERSECT:
+             case OPT_SUBTRACT:
+             case OPT_SYMMETRIC_DIFFERENCE:
+                 set_operands[set_operand_count].operation = (optc == OPT_UNION) ? SET_UNION :
+                                                             (optc == OPT_INTERSECT) ? SET_INTERSECTION :
+                                                             (optc == OPT_SUBTRACT) ? SET_DIFFERENCE :
+                                                             SET_SYMMETRIC_DIFFERENCE;
+                 set_operands[set_operand_count].path = optarg;
+                 set_operand_count++;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_LIST_ADDRESSES:
+                 list_addresses = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_REDUNDANT:
+                 group_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_SHADOWED:
+                 acl_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_NEXT_FREE:
+                 pool_str = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_ALLOCATIONS:
+                 allocations_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_HOW_MANY:
+             {
+                 char* count_end = "";
+
+                 errno = 0;
+                 how_many = strtol(optarg, &count_end, 10);
+                 if( (errno != 0) || (count_end == optarg) || (*count_end != '\0') || (how_many < 1) )
+                 {
+                     fprintf(stderr, "Error: \"%s\" is not a positive number\n", optarg);
+                     return(RESULT_INT_ERROR);
+                 }
+                 no_action = NO_ACTION;
+                 break;
+             }
+             case OPT_BEST_FIT:
+                 strategy = ALLOCATE_BEST_FIT;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_PLAN:
+                 plan_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_POOL_USAGE:
+                 pools_path = optarg;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_COUNT:
+                 count = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_EXPAND:
+                 expand = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_EXPAND_PREFIXES:
+                 expand = 1;
+                 expand_length = prefix_length_from_str(optarg);
+                 if( expand_length < 0 )
+                 {
+                     fprintf(stderr, "Error: \"%s\" is not a valid prefix length\n", optarg);
+                     return(RESULT_INT_ERROR);
+                 }
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_CLASSIFY:
+                 classify = 1;
+                 no_action = NO_ACTION;
+                 break;
+             case OPT_COUNT_UNIT:
+                 unit_length = prefix_length_from_str(optarg);
+                 if( unit_length < 0 )
+                 {
+                     fprintf(stderr, "Error: \"%s\" is not a valid prefix length\n", optarg);
+                     return(RESULT_INT_ERROR);
+                 }
+                 no_action = NO_ACTION;
+                 break;
              case '?':
                  print_help(program_name);
                  return(EXIT_SUCCESS);
@@ -275,11 +645,67 @@ int main(int argc, char* argv[])
         return(RESULT_INT_ERROR);
     }
 
+    /* Set operations take no arguments, only files */
+    if( set_operand_count > 0 )
+    {
+        if( (argc - optind) != 0 )
+        {
+            fprintf(stderr, "Error: set operations take no arguments besides files!\n");
+            print_help(program_name);
+            return(RESULT_INT_ERROR);
+        }
+        /* The first file is where the operations start from, nothing is combined with it */
+        if( set_operands[0].operation != SET_UNION )
+        {
+            fprintf(stderr, "Error: the first set file must be given with --union!\n");
+            return(RESULT_INT_ERROR);
+        }
+        return combine_set_files(set_operands, set_operand_count, list_addresses);
+    }
+
+    /* So does the analysis of a group or a policy */
+    if( (group_path != NULL) || (acl_path != NULL) )
+    {
+        if( (argc - optind) != 0 )
+        {
+            fprintf(stderr, "Error: analysis options take no arguments besides files!\n");
+            print_help(program_name);
+            return(RESULT_INT_ERROR);
+        }
+        if( group_path != NULL )
+        {
+            return print_redundant_entries(group_path, verbose);
+        }
+        return print_shadowed_rules(acl_path, verbose);
+    }
+
+    /* Relations take two addresses, --same-subnet optionally a prefix length too */
+    if( relations != 0 )
+    {
+        int argument_count = argc - optind;
+
+        if( (argument_count != 2) && !((relations == RELATION_SAME_SUBNET) && (argument_count == 3)) )
+        {
+            fprintf(stderr, "Error: wrong number of arguments, two addresses required!\n");
+            print_help(program_name);
+            return(RESULT_INT_ERROR);
+        }
+        return check_relations(relations, argv[optind], argv[optind + 1],
+                               (argument_count == 3) ? argv[optind + 2] : NULL, verbose);
+    }
+
     /* Get non-option arguments */
     if( (argc - optind) == 1 )
     {
          address_str = argv[optind];
     }
+    else if( ((argc - optind) == 0) &&
+             ((lpm_table_path != NULL) || (policy_path != NULL) || (list_path != NULL) ||
+              (host_list_path != NULL) || (pool_str != NULL) || (pools_path != NULL) ||
+              ipv4_range_check || ipv6_range_check || count || expand || classify) )
+    {
+         address_str = NULL;
+    }
     else
     {
          fprintf(stderr, "Error: wrong number of arguments, one argument required!\n");
@@ -287,43 +713,75 @@ int main(int argc, char* argv[])
          return(RESULT_INT_ERROR);
     }
 
-    /* If the argument is a range, use special functions that can handle it. */
-    if( ipv4_range_check )
+    if( lpm_table_path != NULL )
     {
-        if( range_prefix_length > 32 )
-        {
-            fprintf(stderr, "Error: prefix length cannot exceed 32 for IPv4!\n");
-            return(RESULT_INT_ERROR);
-        }
+        return run_table_lookups(lpm_table_path, lpm_table_load, print_lpm_match,
+                                 address_str, watch, stats, verbose);
+    }
 
-        int result = is_ipv4_range(address_str, range_prefix_length, verbose);
-        if( result == RESULT_SUCCESS )
-        {
-            return(EXIT_SUCCESS);
-        }
-        else
-        {
-            return(EXIT_FAILURE);
-        }
+    if( list_path != NULL )
+    {
+        return check_in_list(list_path, address_str, memory_report, filter_bits, stats, verbose);
+    }
+
+    if( host_list_path != NULL )
+    {
+        return check_host_list(host_list_path, compile_path, address_str, memory_report,
+                               filter_bits, stats, verbose);
+    }
+
+    if( policy_path != NULL )
+    {
+        return run_table_lookups(policy_path, policy_load_compiled, print_policy_verdict,
+                                 address_str, watch, stats, verbose);
+    }
+
+    if( pool_str != NULL )
+    {
+        return allocate_from_pool(pool_str, allocations_path, strategy, how_many, address_str, verbose);
+    }
+
+    if( plan_path != NULL )
+    {
+        return plan_subnets(plan_path, address_str, verbose);
+    }
+
+    if( pools_path != NULL )
+    {
+        return count_pool_usage(pools_path, (address_str != NULL) ? address_str : "-", verbose);
+    }
+
+    if( count )
+    {
+        return count_addresses(address_str, unit_length, verbose);
+    }
+
+    if( expand )
+    {
+        return expand_blocks(address_str, expand_length, verbose);
     }
 
-    if( ipv6_range_check )
+    if( classify )
     {
-        if( range_prefix_length > 128 )
+        return process_input_batches(address_str, print_address_classes, NULL, INPUT_BATCH_SIZE, verbose);
+    }
+
+    /* If the argument is a range, use special functions that can handle it.
+       Without an argument, check every range read from standard input. */
+    if( ipv4_range_check || ipv6_range_check )
+    {
+        range_check check;
+
+        check.proto = ipv4_range_check ? CIDR_IPV4 : CIDR_IPV6;
+        check.prefix_length = range_prefix_length;
+        if( range_prefix_length > ip_bits(check.proto) )
         {
-            fprintf(stderr, "Error: prefix length cannot exceed 32 for IPv4!\n");
+            fprintf(stderr, "Error: prefix length cannot exceed %d for %s!\n",
+                    ip_bits(check.proto), ipv4_range_check ? "IPv4" : "IPv6");
             return(RESULT_INT_ERROR);
         }
 
-        int result = is_ipv6_range(address_str, range_prefix_length, verbose);
-        if( result == RESULT_SUCCESS )
-        {
-            return(EXIT_SUCCESS);
-        }
-        else
-        {
-            return(EXIT_FAILURE);
-        }
+        return process_inputs(address_str, check_range, &check, verbose);
     }
 
    /* If ipaddrcheck is called with options other than --is-ipv4-range or --is-ipv6-range,
@@ -344,6 +802,7 @@ int main(int argc, char* argv[])
         {
             printf("Malformed address %s\n", address_str);
         }
+        cidr_free(address);
         return(EXIT_FAILURE);
     }
 
@@ -353,6 +812,7 @@ int main(int argc, char* argv[])
         {
             printf("More than one \"::\" is not allowed in IPv6 addresses\n");
         }
+        cidr_free(address);
         return(EXIT_FAILURE);
     }
 
@@ -613,7 +1073,6 @@ int main(int argc, char* argv[])
     }
 
     /* Clean up */
-    free(actions);
     cidr_free(address);
 
     if( result == RESULT_SUCCESS )
@@ -661,8 +1120,10 @@ Address checking options:\n\
   --is-ipv6-link-local       Check if STRING is an IPv6 link-local address \n\
   --is-valid-intf-address    Check if STRING is an IPv4 or IPv6 address that \n\
                                can be assigned to a network interface \n\
-  --is-ipv4-range            Check if STRING is a valid IPv4 address range\n\
-  --is-ipv6-range            Check if STRING is a valid IPv6 address range\n\
+  --is-ipv4-range            Check if STRING is a valid IPv4 address range,\n\
+                               or every range on standard input without STRING\n\
+  --is-ipv6-range            Check if STRING is a valid IPv6 address range,\n\
+                               or every range on standard input without STRING\n\
   \n\
 Behavior options:\n\
   --allow-loopback             When used with --is-valid-intf-address,\n\
@@ -671,6 +1132,130 @@ Behavior options:\n\
                                  requires the range boundaries to lie within\n\
                                  a prefix of given length\n\
 \n\
+Relation options, for two addresses A and B given instead of STRING:\n\
+  --contains                   Check if B lies entirely within the prefix A\n\
+  --overlaps                   Check if prefixes A and B share any address\n\
+  --same-subnet                Check if A and B lie within the same prefix\n\
+                                 of the length given as a third argument,\n\
+                                 such as 24 or /24, or else of the prefix\n\
+                                 length of A\n\
+  --equal                      Check if A and B are the same address\n\
+                                 with the same prefix length, however written\n\
+\n");
+    printf("\
+Lookup options:\n\
+  --lpm-table <FILE>           Print the longest prefix from FILE that covers\n\
+                                 STRING, and its label. FILE consists of\n\
+                                 \"<prefix> <label>\" lines. If STRING is omitted,\n\
+                                 addresses are read from standard input,\n\
+                                 one per line\n\
+  --policy <FILE>              Check if STRING is permitted by the policy in FILE,\n\
+                                 made of \"<permit|deny> <prefix|class>\" lines.\n\
+                                 The first matching rule wins, addresses that\n\
+                                 match no rule are denied. Classes are: any, ipv4,\n\
+                                 ipv6, [ipv4-|ipv6-]multicast, [ipv4-|ipv6-]loopback,\n\
+                                 [ipv4-|ipv6-]link-local, rfc1918,\n\
+                                 ipv4-this-network, ipv4-limited-broadcast.\n\
+                                 If STRING is omitted, addresses are read\n\
+                                 from standard input, one per line\n\
+  --watch                      When reading standard input with --lpm-table\n\
+                                 or --policy, reload FILE whenever it changes\n\
+                                 or on SIGHUP, without stopping lookups.\n\
+                                 SIGUSR1 prints table statistics\n\
+  --stats                      Print table version, reload count and time,\n\
+                                 and lookup count to standard error on exit,\n\
+                                 or hit and miss counts with --in-list and\n\
+                                 --host-list, split by the filter with --filter-rate\n\
+  --in-list <FILE>             Print STRING if the address or prefix lies\n\
+                                 within the prefixes listed in FILE,\n\
+                                 one per line. If STRING is omitted, addresses\n\
+                                 are read from standard input, one per line\n\
+  --host-list <FILE>           Print STRING if it is one of the addresses\n\
+                                 listed in FILE, one per line, or stored in FILE\n\
+                                 by --compile. If STRING is omitted, addresses\n\
+                                 are read from standard input, one per line\n\
+  --compile <OUTPUT>           Store the list given with --host-list\n\
+                                 in a compressed form in OUTPUT, which is\n\
+                                 mapped into memory instead of parsed on load\n\
+  --memory-report              When used with --in-list or --host-list,\n\
+                                 print the size of the compiled set and\n\
+                                 its parts instead\n\
+  --filter-rate <RATE>         Reject most non-members of --in-list or\n\
+                                 --host-list with a filter whose false\n\
+                                 positive rate is at most RATE\n\
+\n");
+    printf("\
+Set options:\n\
+  --union <FILE>               Combine the sets of IPv4 and IPv6 addresses\n\
+  --intersect <FILE>             and prefixes listed in each FILE, one per\n\
+  --subtract <FILE>              line, from left to right starting with\n\
+  --symmetric-difference <FILE>  the first FILE, and print the result as\n\
+                                 the smallest list of prefixes. The check\n\
+                                 passes if the result is not empty. The\n\
+                                 first FILE must be given with --union\n\
+  --list-addresses             Print the resulting set as single addresses\n\
+\n\
+Analysis options:\n\
+  --redundant <FILE>           Print every address or network in FILE, one\n\
+                                 per line, that another one covers, and the\n\
+                                 one that covers it. Dropping them leaves the\n\
+                                 same addresses. The check fails if there are\n\
+                                 any\n\
+  --shadowed <FILE>            Print the rules of the policy in FILE, in the\n\
+                                 format of --policy, that earlier rules cover\n\
+                                 entirely, so that they never match, as\n\
+                                 \"<line> <status> <rule> <covering line>\".\n\
+                                 A rule is shadowed if some of the rules over\n\
+                                 it have the other verdict, and the last of\n\
+                                 those is given, or else redundant, and the\n\
+                                 last of the rules over it is given. The check\n\
+                                 fails if there are any\n\
+  --count                      Print the number of addresses and of usable\n\
+                                 host addresses in the prefix or range STRING,\n\
+                                 or in the prefixes, addresses and ranges\n\
+                                 on standard input if it is omitted, merged,\n\
+                                 one line per address family. The network and\n\
+                                 IPv4 broadcast addresses of prefixes shorter\n\
+                                 than /31 or /127 are not usable\n\
+  --count-unit <LENGTH>        Also print the number of whole prefixes\n\
+                                 of LENGTH, such as 64 or /64, among them\n\
+  --expand                     Print every usable host address of the prefix\n\
+                                 or range STRING, one per line, or of each\n\
+                                 prefix or range on standard input if it is\n\
+                                 omitted. Usable is meant as with --count\n\
+  --expand-prefixes <LENGTH>   Print the whole prefixes of LENGTH within them\n\
+                                 instead, the check fails if there are none\n\
+  --classify                   Print the classes of STRING, or of each address\n\
+                                 on standard input if it is omitted: multicast,\n\
+                                 loopback, link-local, rfc1918, this-network\n\
+                                 and limited-broadcast, or - if it has none.\n\
+                                 A prefix has a class if it lies entirely in it\n\
+\n");
+    printf("\
+Allocation options:\n\
+  --next-free <POOL>           Print a free prefix of length STRING, such as\n\
+                                 29 or /29, within POOL and allocate it, the\n\
+                                 lowest one unless --best-fit is given.\n\
+                                 If STRING is omitted, lengths are read from\n\
+                                 standard input, one per line\n\
+  --allocations <FILE>         Prefixes of POOL already allocated, one per line,\n\
+                                 the others in FILE are ignored\n\
+  --how-many <N>               Print N free prefixes for each length\n\
+  --best-fit                   Carve prefixes from the smallest free blocks\n\
+                                 they fit in rather than the lowest ones\n\
+  --plan <FILE>                Split the prefix STRING into the subnets\n\
+                                 requested in FILE, \"<length> [label]\" lines,\n\
+                                 and print them with their labels in the same\n\
+                                 order. The check fails if they do not fit\n\
+  --pool-usage <FILE>          Count the leases in each of the DHCP ranges\n\
+                                 listed in FILE, \"<first>-<last> [label]\"\n\
+                                 lines. Leases are the first field of each\n\
+                                 line of the file STRING, or of standard input\n\
+                                 if it is omitted. Prints the range, its size,\n\
+                                 used and free addresses, duplicate leases and\n\
+                                 the label, then the leases outside all ranges.\n\
+                                 The check fails if a lease is malformed\n\
+\n\
 Other options:\n\
   --version                  Print version information and exit \n\
   --help                     Print help message and exit\n\
@@ -692,3 +1277,1298 @@ License GPLv2+: GNU GPL version 2 or later <http://gnu.org/licenses/gpl.html>\n\
 This is free software: you are free to change and redistribute it.\n\
 There is NO WARRANTY, to the extent permitted by law.\n");
 }
+
+/*
+ * Run a handler on the argument, or on the first field of every line
+ * of standard input if there is no argument.
+ * The check passes if the handler succeeds for all of them.
+ */
+static int process_inputs(char* address_str, input_handler handler, const void* context, int verbose)
+{
+    int result = RESULT_SUCCESS;
+
+    if( address_str != NULL )
+    {
+        result = handler(context, address_str, verbose);
+    }
+    else
+    {
+        list_reader reader;
+        char* line = NULL;
+
+        list_reader_open(&reader, "-");
+        while( (line = list_reader_next(&reader)) != NULL )
+        {
+            if( handler(context, list_next_field(&line), verbose) != RESULT_SUCCESS )
+            {
+                result = RESULT_FAILURE;
+            }
+        }
+        list_reader_close(&reader);
+    }
+
+    if( result == RESULT_SUCCESS )
+    {
+        return(EXIT_SUCCESS);
+    }
+    else
+    {
+        return(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Like process_inputs, but hand the lines of standard input
+ * to the handler batch_size at a time, so that it can overlap
+ * the work on several of them
+ */
+static int process_input_batches(char* address_str, batch_handler handler, const void* context,
+                                 size_t batch_size, int verbose)
+{
+    int result = RESULT_SUCCESS;
+
+    if( address_str != NULL )
+    {
+        result = handler(context, &address_str, 1, verbose);
+    }
+    else
+    {
+        list_reader reader;
+        char* inputs[INPUT_BATCH_SIZE];
+        size_t sizes[INPUT_BATCH_SIZE];
+        size_t count = 0;
+        size_t i = 0;
+        char* line = NULL;
+
+        for( i = 0; i < INPUT_BATCH_SIZE; i++ )
+        {
+            inputs[i] = NULL;
+            sizes[i] = 0;
+        }
+
+        list_reader_open(&reader, "-");
+        do
+        {
+            line = list_reader_next(&reader);
+            if( line != NULL )
+            {
+                /* The reader reuses its line buffer, keep a copy */
+                char* field = list_next_field(&line);
+                size_t size = strlen(field) + 1;
+
+                if( size > sizes[count] )
+                {
+                    char* input = realloc(inputs[count], size);
+                    if( input == NULL )
+                    {
+                        fprintf(stderr, "Error: could not allocate memory!\n");
+                        result = RESULT_INT_ERROR;
+                        break;
+                    }
+                    inputs[count] = input;
+                    sizes[count] = size;
+                }
+                memcpy(inputs[count++], field, size);
+            }
+
+            if( (count == batch_size) || ((line == NULL) && (count > 0)) )
+            {
+                if( handler(context, inputs, count, verbose) != RESULT_SUCCESS )
+                {
+                    result = RESULT_FAILURE;
+                }
+                count = 0;
+            }
+        } while( line != NULL );
+        list_reader_close(&reader);
+
+        for( i = 0; i < INPUT_BATCH_SIZE; i++ )
+        {
+            free(inputs[i]);
+        }
+    }
+
+    if( result == RESULT_SUCCESS )
+    {
+        return(EXIT_SUCCESS);
+    }
+    else if( result == RESULT_INT_ERROR )
+    {
+        return(RESULT_INT_ERROR);
+    }
+    else
+    {
+        return(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Batch inputs only when nobody waits for the answer to each line:
+ * a person at a terminal, or a consumer of --watch output
+ */
+static size_t input_batch_size(int interactive)
+{
+    if( interactive || isatty(STDIN_FILENO) )
+    {
+        return 1;
+    }
+    return INPUT_BATCH_SIZE;
+}
+
+/* Parse a single address given as input to a lookup */
+static int parse_lookup_address(char* address_str, ip_prefix* address, int verbose)
+{
+    if( (is_any_single(address_str) != RESULT_SUCCESS) ||
+        (ip_prefix_from_str(address_str, address) != RESULT_SUCCESS) )
+    {
+        if( verbose )
+        {
+            printf("Malformed address %s\n", address_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Print the address looked up in a longest prefix match table,
+ * the matching prefix and its label, with dashes in place of the latter
+ * if nothing matches
+ */
+static int print_lpm_match(const char* address_str, int malformed, const lpm_entry* entry)
+{
+    char prefix_str[PREFIX_STR_MAX];
+
+    if( malformed || (entry == NULL) )
+    {
+        printf("%s\t-\t-\n", address_str);
+        return(RESULT_FAILURE);
+    }
+
+    printf("%s\t%s\t%s\n", address_str, ip_prefix_to_str(&entry->prefix, prefix_str), entry->label);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Print the verdict of a policy compiled to a lookup table for a single address,
+ * malformed addresses get a dash
+ */
+static int print_policy_verdict(const char* address_str, int malformed, const lpm_entry* entry)
+{
+    if( malformed )
+    {
+        printf("%s\t-\n", address_str);
+        return(RESULT_FAILURE);
+    }
+
+    if( (entry == NULL) || (entry->value != POLICY_PERMIT) )
+    {
+        printf("%s\t%s\n", address_str, policy_verdict_name(POLICY_DENY));
+        return(RESULT_FAILURE);
+    }
+
+    printf("%s\t%s\n", address_str, policy_verdict_name(POLICY_PERMIT));
+
+    return(RESULT_SUCCESS);
+}
+
+/* A table handler bound to the reader slot it uses */
+typedef struct
+{
+    lpm_handle* handle;
+    int reader;
+    table_handler handler;
+} table_lookup;
+
+/*
+ * Look a batch of addresses up in whatever table is current at the moment
+ * and run the table handler on the outcome of each
+ */
+static int lookup_current_table(const void* context, char** inputs, size_t count, int verbose)
+{
+    const table_lookup* lookup = context;
+    const lpm_table* table = NULL;
+    ip_prefix addresses[INPUT_BATCH_SIZE];
+    const lpm_entry* entries[INPUT_BATCH_SIZE];
+    int malformed[INPUT_BATCH_SIZE];
+    size_t parsed = 0;
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    for( i = 0; i < count; i++ )
+    {
+        malformed[i] = (parse_lookup_address(inputs[i], &addresses[parsed], verbose) != RESULT_SUCCESS);
+        if( !malformed[i] )
+        {
+            parsed++;
+        }
+    }
+
+    table = lpm_handle_read_begin(lookup->handle, lookup->reader);
+    lpm_lookup_batch(table, addresses, parsed, entries);
+    for( i = 0, parsed = 0; i < count; i++ )
+    {
+        const lpm_entry* entry = malformed[i] ? NULL : entries[parsed++];
+
+        if( lookup->handler(inputs[i], malformed[i], entry) != RESULT_SUCCESS )
+        {
+            result = RESULT_FAILURE;
+        }
+    }
+    lpm_handle_read_end(lookup->handle, lookup->reader);
+    __atomic_add_fetch(&lookup->handle->lookups, count, __ATOMIC_RELAXED);
+
+    return(result);
+}
+
+/*
+ * Look up the argument or every line of standard input in the table
+ * built from a file, the check passes if the handler succeeds for all of them.
+ *
+ * When reading standard input with watch enabled, the table is rebuilt
+ * whenever the file changes or on SIGHUP, without interrupting lookups.
+ * A file with errors leaves the current table in place.
+ */
+static int run_table_lookups(const char* path, lpm_table_loader loader, table_handler handler,
+                             char* address_str, int watch, int stats, int verbose)
+{
+    lpm_handle handle;
+    lpm_watcher watcher;
+    table_lookup lookup;
+    lpm_table* table = loader(path);
+    int watching = 0;
+    int result = EXIT_SUCCESS;
+
+    if( table == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( lpm_handle_init(&handle, table) != RESULT_SUCCESS )
+    {
+        lpm_table_free(table);
+        return(RESULT_INT_ERROR);
+    }
+
+    lookup.handle = &handle;
+    lookup.reader = lpm_handle_register_reader(&handle);
+    lookup.handler = handler;
+
+    if( watch && (address_str == NULL) )
+    {
+        /* Whoever is on the other end of the pipe
+           wants the answers as soon as they are ready */
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        if( lpm_watcher_start(&watcher, &handle, path, loader, verbose) != RESULT_SUCCESS )
+        {
+            lpm_handle_destroy(&handle);
+            return(RESULT_INT_ERROR);
+        }
+        watching = 1;
+    }
+
+    result = process_input_batches(address_str, lookup_current_table, &lookup,
+                                   input_batch_size(watching), verbose);
+
+    if( watching )
+    {
+        lpm_watcher_stop(&watcher);
+    }
+    lpm_handle_unregister_reader(&handle, lookup.reader);
+
+    if( stats )
+    {
+        lpm_handle_print_stats(&handle, stderr);
+    }
+    lpm_handle_destroy(&handle);
+
+    return(result);
+}
+
+/* A filtered set and the counters of its lookups */
+typedef struct
+{
+    const void* set;
+    filter_stats* stats;
+} set_lookup;
+
+/*
+ * Print the address or prefix if it lies entirely within the set
+ */
+static int print_set_member(const void* context, char* address_str, int verbose)
+{
+    const set_lookup* lookup = context;
+    ip_prefix address;
+
+    if( ip_prefix_from_str(address_str, &address) != RESULT_SUCCESS )
+    {
+        if( verbose )
+        {
+            printf("Malformed address %s\n", address_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    if( prefix_set_lookup(lookup->set, &address, lookup->stats) != RESULT_SUCCESS )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    printf("%s\n", address_str);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Print the argument or the lines of standard input that lie within
+ * the prefixes listed in a file, the check passes if all of them do.
+ * With memory_report, describe the set instead.
+ */
+static int check_in_list(const char* list_path, char* address_str, int memory_report,
+                         int filter_bits, int stats, int verbose)
+{
+    prefix_set* set = prefix_set_load(list_path, filter_bits);
+    filter_stats counters;
+    set_lookup lookup;
+    int result = EXIT_SUCCESS;
+
+    if( set == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( memory_report )
+    {
+        prefix_set_print_report(set, stdout);
+    }
+    else
+    {
+        memset(&counters, 0, sizeof(counters));
+        lookup.set = set;
+        lookup.stats = &counters;
+        result = process_inputs(address_str, print_set_member, &lookup, verbose);
+        if( stats )
+        {
+            filter_stats_print(&counters, stderr);
+        }
+    }
+    prefix_set_free(set);
+
+    return(result);
+}
+
+/*
+ * Print the addresses of a batch that are members of the host set
+ */
+static int print_host_members(const void* context, char** inputs, size_t count, int verbose)
+{
+    const set_lookup* lookup = context;
+    ip_prefix addresses[INPUT_BATCH_SIZE] = { { 0 } };
+    int malformed[INPUT_BATCH_SIZE];
+    int found[INPUT_BATCH_SIZE];
+    size_t parsed = 0;
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    for( i = 0; i < count; i++ )
+    {
+        malformed[i] = (ip_prefix_from_str(inputs[i], &addresses[parsed]) != RESULT_SUCCESS) ||
+                       (addresses[parsed].pflen != ip_bits(addresses[parsed].proto));
+        if( malformed[i] )
+        {
+            if( verbose )
+            {
+                printf("%s is not a single address\n", inputs[i]);
+            }
+            result = RESULT_FAILURE;
+        }
+        else
+        {
+            parsed++;
+        }
+    }
+
+    host_set_lookup_batch(lookup->set, addresses, parsed, found, lookup->stats);
+    for( i = 0, parsed = 0; i < count; i++ )
+    {
+        if( malformed[i] )
+        {
+            continue;
+        }
+        if( found[parsed++] == RESULT_SUCCESS )
+        {
+            printf("%s\n", inputs[i]);
+        }
+        else
+        {
+            result = RESULT_FAILURE;
+        }
+    }
+
+    return(result);
+}
+
+/*
+ * Print the argument or the lines of standard input that are members
+ * of a host list, the check passes if all of them are.
+ * With compile_path, store the list in compiled form instead,
+ * with memory_report, describe it.
+ */
+static int check_host_list(const char* host_list_path, const char* compile_path, char* address_str,
+                           int memory_report, int filter_bits, int stats, int verbose)
+{
+    host_set* set = host_set_load(host_list_path, filter_bits);
+    filter_stats counters;
+    set_lookup lookup;
+    int result = EXIT_SUCCESS;
+
+    if( set == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( compile_path != NULL )
+    {
+        if( host_set_save(set, compile_path) != RESULT_SUCCESS )
+        {
+            result = RESULT_INT_ERROR;
+        }
+        if( memory_report )
+        {
+            host_set_print_report(set, stdout);
+        }
+    }
+    else if( memory_report )
+    {
+        host_set_print_report(set, stdout);
+    }
+    else
+    {
+        memset(&counters, 0, sizeof(counters));
+        lookup.set = set;
+        lookup.stats = &counters;
+        result = process_input_batches(address_str, print_host_members, &lookup,
+                                       input_batch_size(0), verbose);
+        if( stats )
+        {
+            filter_stats_print(&counters, stderr);
+        }
+    }
+    host_set_free(set);
+
+    return(result);
+}
+
+static void print_prefix(const ip_prefix* prefix, void* context)
+{
+    char prefix_str[PREFIX_STR_MAX];
+
+    printf("%s\n", ip_prefix_to_str(prefix, prefix_str));
+}
+
+static void print_range_prefixes(uint32_t first, uint32_t last, void* context)
+{
+    ip_value first_value = { 0, first };
+    ip_value last_value = { 0, last };
+
+    ip_range_to_prefixes(CIDR_IPV4, first_value, last_value, print_prefix, context);
+}
+
+static void print_range_addresses(uint32_t first, uint32_t last, void* context)
+{
+    uint64_t address = 0;
+    char address_str[PREFIX_STR_MAX];
+
+    for( address = first; address <= last; address++ )
+    {
+        ip_value value = { 0, address };
+        printf("%s\n", ip_addr_to_str(CIDR_IPV4, value, address_str));
+    }
+}
+
+static void print_interval_addresses(const interval_list* list)
+{
+    char address_str[PREFIX_STR_MAX];
+    size_t i = 0;
+
+    for( i = 0; i < list->count; i++ )
+    {
+        ip_value address = list->intervals[i].first;
+
+        for( ;; )
+        {
+            printf("%s\n", ip_addr_to_str(list->proto, address, address_str));
+            if( ip_value_eq(address, list->intervals[i].last) )
+            {
+                break;
+            }
+            address = ip_value_next(address);
+        }
+    }
+}
+
+/*
+ * Combine the sets of addresses listed in files, starting from the first one,
+ * and print the result as the smallest list of prefixes, or as addresses.
+ * The check passes if the result is not empty.
+ */
+static int combine_set_files(const set_operand* operands, int operand_count, int list_addresses)
+{
+    address_set* result = address_set_load(operands[0].path);
+    int exit_code = EXIT_SUCCESS;
+    int i = 0;
+
+    if( result == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    for( i = 1; i < operand_count; i++ )
+    {
+        address_set* operand = address_set_load(operands[i].path);
+        address_set* combined = NULL;
+
+        if( operand != NULL )
+        {
+            combined = address_set_combine(result, operand, operands[i].operation);
+            if( combined == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+            }
+        }
+        address_set_free(operand);
+        address_set_free(result);
+        result = combined;
+
+        if( result == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+    }
+
+    if( list_addresses )
+    {
+        ipv4_set_ranges(result->ipv4, print_range_addresses, NULL);
+        print_interval_addresses(result->ipv6);
+    }
+    else
+    {
+        ipv4_set_ranges(result->ipv4, print_range_prefixes, NULL);
+        interval_list_prefixes(result->ipv6, print_prefix, NULL);
+    }
+    if( address_set_is_empty(result) )
+    {
+        exit_code = EXIT_FAILURE;
+    }
+    address_set_free(result);
+
+    return(exit_code);
+}
+
+/*
+ * Check the relations between two addresses or prefixes. They are compared
+ * with masks over their native forms, the way a prefix list would be.
+ */
+static int check_relations(int relations, char* left_str, char* right_str, char* length_str, int verbose)
+{
+    ip_prefix left;
+    ip_prefix right;
+    int pflen = 0;
+
+    if( ip_prefix_from_str(left_str, &left) != RESULT_SUCCESS )
+    {
+        if( verbose )
+        {
+            printf("Malformed address %s\n", left_str);
+        }
+        return(EXIT_FAILURE);
+    }
+    if( ip_prefix_from_str(right_str, &right) != RESULT_SUCCESS )
+    {
+        if( verbose )
+        {
+            printf("Malformed address %s\n", right_str);
+        }
+        return(EXIT_FAILURE);
+    }
+
+    pflen = left.pflen;
+    if( length_str != NULL )
+    {
+        pflen = prefix_length_from_str(length_str);
+        if( (pflen < 0) || (pflen > ip_bits(left.proto)) )
+        {
+            fprintf(stderr, "Error: \"%s\" is not a valid prefix length for %s\n", length_str, left_str);
+            return(RESULT_INT_ERROR);
+        }
+    }
+
+    if( left.proto != right.proto )
+    {
+        if( verbose )
+        {
+            printf("%s and %s belong to different address families\n", left_str, right_str);
+        }
+        return(EXIT_FAILURE);
+    }
+
+    if( (relations & RELATION_CONTAINS) && (ip_prefix_contains(&left, &right) != RESULT_SUCCESS) )
+    {
+        if( verbose )
+        {
+            printf("%s does not contain %s\n", left_str, right_str);
+        }
+        return(EXIT_FAILURE);
+    }
+    if( (relations & RELATION_OVERLAPS) && (ip_prefix_overlaps(&left, &right) != RESULT_SUCCESS) )
+    {
+        if( verbose )
+        {
+            printf("%s and %s do not overlap\n", left_str, right_str);
+        }
+        return(EXIT_FAILURE);
+    }
+    if( (relations & RELATION_SAME_SUBNET) && (ip_prefix_same_subnet(&left, &right, pflen) != RESULT_SUCCESS) )
+    {
+        if( verbose )
+        {
+            printf("%s and %s are not in the same /%d\n", left_str, right_str, pflen);
+        }
+        return(EXIT_FAILURE);
+    }
+    if( (relations & RELATION_EQUAL) && (ip_prefix_cmp(&left, &right) != 0) )
+    {
+        if( verbose )
+        {
+            printf("%s and %s are not equal\n", left_str, right_str);
+        }
+        return(EXIT_FAILURE);
+    }
+
+    return(EXIT_SUCCESS);
+}
+
+/* Check a single range for process_inputs() */
+static int check_range(const void* context, char* range_str, int verbose)
+{
+    const range_check* check = context;
+
+    if( check->proto == CIDR_IPV4 )
+    {
+        return is_ipv4_range(range_str, check->prefix_length, verbose);
+    }
+    return is_ipv6_range(range_str, check->prefix_length, verbose);
+}
+
+/*
+ * Print the entries of a group covered by other entries, with the entry
+ * that covers each one. The check fails if there are any.
+ */
+static int print_redundant_entries(const char* group_path, int verbose)
+{
+    group_entry* entries = NULL;
+    size_t count = 0;
+    size_t redundant_count = 0;
+    size_t i = 0;
+
+    entries = group_entries_load(group_path, &count);
+    if( entries == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( find_redundant_entries(entries, count, &redundant_count) != RESULT_SUCCESS )
+    {
+        group_entries_free(entries, count);
+        return(RESULT_INT_ERROR);
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        if( entries[i].covered_by != COVERAGE_NONE )
+        {
+            printf("%s\t%s\n", entries[i].text, entries[entries[i].covered_by].text);
+        }
+    }
+
+    if( verbose && (redundant_count > 0) )
+    {
+        fprintf(stderr, "%zu of %zu entries in %s are covered by other entries\n",
+                redundant_count, count, group_path);
+    }
+    group_entries_free(entries, count);
+
+    return (redundant_count == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Print the rules of a policy that earlier rules cover entirely,
+ * with the line of a rule that covers each one. The check fails
+ * if there are any.
+ */
+static int print_shadowed_rules(const char* acl_path, int verbose)
+{
+    address_policy* policy = NULL;
+    policy_rule_analysis* results = NULL;
+    char match_str[PREFIX_STR_MAX];
+    size_t covered_count = 0;
+    size_t i = 0;
+
+    policy = policy_load(acl_path);
+    if( policy == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    results = malloc((policy->rule_count > 0 ? policy->rule_count : 1) * sizeof(policy_rule_analysis));
+    if( results == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        policy_free(policy);
+        return(RESULT_INT_ERROR);
+    }
+
+    if( policy_analyze(policy, results) != RESULT_SUCCESS )
+    {
+        free(results);
+        policy_free(policy);
+        return(RESULT_INT_ERROR);
+    }
+
+    for( i = 0; i < policy->rule_count; i++ )
+    {
+        const policy_rule* rule = &policy->rules[i];
+
+        if( results[i].status == POLICY_RULE_EFFECTIVE )
+        {
+            continue;
+        }
+        printf("%d\t%s\t%s %s\t%d\n", rule->line_number, policy_rule_status_name(results[i].status),
+               policy_verdict_name(rule->verdict), policy_rule_match_str(rule, match_str),
+               policy->rules[results[i].covering_rule].line_number);
+        covered_count++;
+    }
+
+    if( verbose && (covered_count > 0) )
+    {
+        fprintf(stderr, "%zu of %zu rules in %s never match\n", covered_count, policy->rule_count, acl_path);
+    }
+    free(results);
+    policy_free(policy);
+
+    return (covered_count == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* A pool and how to allocate from it */
+typedef struct
+{
+    free_space* space;
+    int strategy;
+    long how_many;
+} allocation_request;
+
+/*
+ * Allocate prefixes of the given length from the pool and print them,
+ * the check fails if there is not enough room left
+ */
+static int print_allocations(const void* context, char* length_str, int verbose)
+{
+    const allocation_request* request = context;
+    const ip_prefix* pool = &request->space->pool;
+    int pflen = prefix_length_from_str(length_str);
+    char prefix_str[PREFIX_STR_MAX];
+    ip_prefix prefix;
+    long i = 0;
+
+    if( (pflen < 0) || (pflen > ip_bits(pool->proto)) )
+    {
+        if( verbose )
+        {
+            printf("\"%s\" is not a valid prefix length\n", length_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    for( i = 0; i < request->how_many; i++ )
+    {
+        int result = free_space_allocate(request->space, pflen, request->strategy, &prefix);
+
+        if( result != RESULT_SUCCESS )
+        {
+            if( verbose && (result == RESULT_FAILURE) )
+            {
+                printf("No free /%d left in %s\n", pflen, ip_prefix_to_str(pool, prefix_str));
+            }
+            return(RESULT_FAILURE);
+        }
+        printf("%s\n", ip_prefix_to_str(&prefix, prefix_str));
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Allocate free prefixes from a pool, of the length given as the argument
+ * or of each length read from standard input in turn. The free space
+ * is built once, so that every request costs time proportional
+ * to the prefix length only.
+ */
+static int allocate_from_pool(char* pool_str, const char* allocations_path, int strategy,
+                              long how_many, char* length_str, int verbose)
+{
+    allocation_request request;
+    ip_prefix pool;
+    int result = EXIT_SUCCESS;
+
+    if( ip_prefix_from_str(pool_str, &pool) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: \"%s\" is not a valid prefix!\n", pool_str);
+        return(RESULT_INT_ERROR);
+    }
+    if( ip_prefix_is_network(&pool) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: %s is a host address, not a network address!\n", pool_str);
+        return(RESULT_INT_ERROR);
+    }
+
+    request.space = free_space_load(&pool, allocations_path);
+    request.strategy = strategy;
+    request.how_many = how_many;
+    if( request.space == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    result = process_inputs(length_str, print_allocations, &request, verbose);
+    free_space_free(request.space);
+
+    return(result);
+}
+
+/*
+ * Assign a subnet of the parent prefix to every request listed in a file
+ * and print them in the order of the file
+ */
+static int plan_subnets(const char* plan_path, char* parent_str, int verbose)
+{
+    plan_request* requests = NULL;
+    ip_prefix parent;
+    char prefix_str[PREFIX_STR_MAX];
+    size_t count = 0;
+    size_t i = 0;
+
+    if( ip_prefix_from_str(parent_str, &parent) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: \"%s\" is not a valid prefix!\n", parent_str);
+        return(RESULT_INT_ERROR);
+    }
+    if( ip_prefix_is_network(&parent) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: %s is a host address, not a network address!\n", parent_str);
+        return(RESULT_INT_ERROR);
+    }
+
+    requests = plan_requests_load(plan_path, &parent, &count);
+    if( requests == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( subnet_plan(&parent, requests, count) != RESULT_SUCCESS )
+    {
+        if( verbose )
+        {
+            fprintf(stderr, "The requested subnets do not fit in %s\n", parent_str);
+        }
+        plan_requests_free(requests, count);
+        return(EXIT_FAILURE);
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        ip_prefix_to_str(&requests[i].prefix, prefix_str);
+        if( requests[i].label != NULL )
+        {
+            printf("%s\t%s\n", prefix_str, requests[i].label);
+        }
+        else
+        {
+            printf("%s\n", prefix_str);
+        }
+    }
+    plan_requests_free(requests, count);
+
+    return(EXIT_SUCCESS);
+}
+
+/*
+ * Count the leases of every DHCP range in a single pass over the lease list:
+ * each lease is marked in the bitmap of its range, so that a lease seen
+ * again counts as a duplicate rather than as another used address.
+ * A malformed lease is skipped, and fails the check like malformed input
+ * of the other modes.
+ */
+static int count_pool_usage(const char* pools_path, const char* leases_path, int verbose)
+{
+    list_reader reader;
+    pool_usage* usage = NULL;
+    char first_str[PREFIX_STR_MAX];
+    char last_str[PREFIX_STR_MAX];
+    char* line = NULL;
+    int result = EXIT_SUCCESS;
+    size_t i = 0;
+
+    if( (strcmp(pools_path, "-") == 0) && (strcmp(leases_path, "-") == 0) )
+    {
+        fprintf(stderr, "Error: ranges and leases cannot both be read from standard input!\n");
+        return(RESULT_INT_ERROR);
+    }
+
+    usage = pool_usage_load(pools_path);
+    if( usage == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    if( list_reader_open(&reader, leases_path) != RESULT_SUCCESS )
+    {
+        pool_usage_free(usage);
+        return(RESULT_INT_ERROR);
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* lease_str = list_next_field(&line);
+        const char* end = NULL;
+        uint32_t address = 0;
+
+        if( (ipv4_value_from_str(lease_str, &end, &address) != RESULT_SUCCESS) || (*end != '\0') )
+        {
+            list_reader_error(&reader, "\"%s\" is not a valid IPv4 address", lease_str);
+            result = EXIT_FAILURE;
+            continue;
+        }
+        pool_usage_add_lease(usage, address);
+    }
+    list_reader_close(&reader);
+
+    for( i = 0; i < usage->count; i++ )
+    {
+        const lease_pool* pool = &usage->pools[i];
+        ip_value first = { 0, pool->first };
+        ip_value last = { 0, pool->last };
+        uint64_t size = (uint64_t)(pool->last - pool->first) + 1;
+
+        printf("%s-%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64,
+               ip_addr_to_str(CIDR_IPV4, first, first_str), ip_addr_to_str(CIDR_IPV4, last, last_str),
+               size, pool->used, size - pool->used, pool->duplicates);
+        if( pool->label != NULL )
+        {
+            printf("\t%s", pool->label);
+        }
+        printf("\n");
+    }
+    printf("out-of-pool\t%" PRIu64 "\n", usage->out_of_pool);
+    pool_usage_free(usage);
+
+    return(result);
+}
+
+/* Parse an address, a prefix or a range. Prefixes are stored in both forms. */
+static int block_from_str(char* input_str, ip_prefix* prefix, ip_range* range)
+{
+    if( strchr(input_str, '-') != NULL )
+    {
+        int proto = (strchr(input_str, ':') != NULL) ? CIDR_IPV6 : CIDR_IPV4;
+
+        if( ip_range_from_str(input_str, proto, range) != RANGE_VALID )
+        {
+            return BLOCK_MALFORMED;
+        }
+        return BLOCK_RANGE;
+    }
+
+    if( ip_prefix_from_str(input_str, prefix) != RESULT_SUCCESS )
+    {
+        return BLOCK_MALFORMED;
+    }
+    range->proto = prefix->proto;
+    range->first = ip_prefix_first(prefix);
+    range->last = ip_prefix_last(prefix);
+
+    return BLOCK_PREFIX;
+}
+
+/* Add an address, a prefix or a range to the counter of its family */
+static int count_input(address_counter** counters, char* input_str)
+{
+    ip_prefix prefix;
+    ip_range range;
+
+    switch( block_from_str(input_str, &prefix, &range) )
+    {
+        case BLOCK_PREFIX:
+            return address_counter_add_prefix(counters[prefix.proto == CIDR_IPV6], &prefix);
+        case BLOCK_RANGE:
+            return address_counter_add_range(counters[range.proto == CIDR_IPV6], range.first, range.last);
+        default:
+            return(RESULT_FAILURE);
+    }
+}
+
+/*
+ * Count the addresses of the argument, or of the merged inputs,
+ * with 128-bit arithmetic over their intervals, whatever their size.
+ * The check fails if there is nothing to count or an input is malformed.
+ */
+static int count_addresses(char* input_str, int unit_length, int verbose)
+{
+    address_counter* counters[2];
+    const char* family_names[2] = { "ipv4", "ipv6" };
+    int protos[2] = { CIDR_IPV4, CIDR_IPV6 };
+    int result = EXIT_FAILURE;
+    int status = RESULT_SUCCESS;
+    int i = 0;
+
+    counters[0] = address_counter_new(CIDR_IPV4);
+    counters[1] = address_counter_new(CIDR_IPV6);
+    if( (counters[0] == NULL) || (counters[1] == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        address_counter_free(counters[0]);
+        address_counter_free(counters[1]);
+        return(RESULT_INT_ERROR);
+    }
+
+    if( input_str != NULL )
+    {
+        status = count_input(counters, input_str);
+        if( status == RESULT_FAILURE )
+        {
+            fprintf(stderr, "Error: \"%s\" is not a valid address, prefix or range!\n", input_str);
+        }
+    }
+    else
+    {
+        list_reader reader;
+        char* line = NULL;
+
+        list_reader_open(&reader, "-");
+        while( (status != RESULT_INT_ERROR) && ((line = list_reader_next(&reader)) != NULL) )
+        {
+            char* field = list_next_field(&line);
+
+            if( count_input(counters, field) == RESULT_FAILURE )
+            {
+                list_reader_error(&reader, "\"%s\" is not a valid address, prefix or range", field);
+                status = RESULT_FAILURE;
+            }
+        }
+        list_reader_close(&reader);
+    }
+
+    if( status == RESULT_SUCCESS )
+    {
+        for( i = 0; i < 2; i++ )
+        {
+            address_totals totals;
+            char addresses_str[COUNT_STR_MAX];
+            char hosts_str[COUNT_STR_MAX];
+            char units_str[COUNT_STR_MAX];
+
+            if( counters[i]->intervals->count == 0 )
+            {
+                continue;
+            }
+            address_counter_totals(counters[i], (unit_length < 0) ? IPV6_BITS + 1 : unit_length, &totals);
+            printf("%s\t%s\t%s", family_names[i], ip_count_to_str(&totals.addresses, addresses_str),
+                   ip_count_to_str(&totals.hosts, hosts_str));
+            if( unit_length > ip_bits(protos[i]) )
+            {
+                printf("\t-");
+            }
+            else if( unit_length >= 0 )
+            {
+                printf("\t%s", ip_count_to_str(&totals.units, units_str));
+            }
+            printf("\n");
+            result = EXIT_SUCCESS;
+        }
+    }
+    else if( status == RESULT_INT_ERROR )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        result = RESULT_INT_ERROR;
+    }
+
+    /* Malformed inputs fail the check like in the other modes, with nothing counted */
+    if( verbose && (result == EXIT_FAILURE) && (status == RESULT_SUCCESS) )
+    {
+        printf("No addresses to count\n");
+    }
+
+    address_counter_free(counters[0]);
+    address_counter_free(counters[1]);
+
+    return(result);
+}
+
+/* Write the host addresses or the prefixes of a single input */
+static int expand_input(const void* context, char* input_str, int verbose)
+{
+    const expand_request* request = context;
+    ip_prefix prefix;
+    ip_range range;
+    int kind = block_from_str(input_str, &prefix, &range);
+
+    if( kind == BLOCK_MALFORMED )
+    {
+        if( verbose )
+        {
+            printf("Malformed address, prefix or range %s\n", input_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    if( request->pflen >= 0 )
+    {
+        int result = RESULT_FAILURE;
+
+        /* A prefix holds no shorter prefixes, a range may hold none at all */
+        if( (request->pflen <= ip_bits(range.proto)) &&
+            ((kind != BLOCK_PREFIX) || (request->pflen >= prefix.pflen)) )
+        {
+            result = expand_prefixes(request->writer, range.proto, range.first, range.last, request->pflen);
+        }
+        if( verbose && (result == RESULT_FAILURE) )
+        {
+            printf("%s has no prefixes of length %d\n", input_str, request->pflen);
+        }
+        return(result);
+    }
+
+    /* The same addresses is_ipv4_host(), is_ipv4_broadcast() and is_ipv6_host() reject */
+    if( (kind == BLOCK_PREFIX) && (prefix.pflen < ip_bits(prefix.proto) - 1) )
+    {
+        range.first = ip_value_next(range.first);
+        if( prefix.proto == CIDR_IPV4 )
+        {
+            range.last.lo--;
+        }
+    }
+    return expand_addresses(request->writer, range.proto, range.first, range.last);
+}
+
+/*
+ * Stream the host addresses, or the prefixes of the given length,
+ * of the argument or of every input line, in their order
+ */
+static int expand_blocks(char* input_str, int pflen, int verbose)
+{
+    expand_request request;
+    int result = EXIT_SUCCESS;
+
+    request.pflen = pflen;
+    request.writer = expand_writer_new(stdout);
+    if( request.writer == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return(RESULT_INT_ERROR);
+    }
+
+    result = process_inputs(input_str, expand_input, &request, verbose);
+    if( expand_writer_flush(request.writer) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: could not write the output!\n");
+        result = RESULT_INT_ERROR;
+    }
+    expand_writer_free(request.writer);
+
+    return(result);
+}
+
+/*
+ * Print the classes of every address or prefix of a batch,
+ * looked up all at once, as "<address> <class>[,<class>...]"
+ */
+static int print_address_classes(const void* context, char** inputs, size_t count, int verbose)
+{
+    ip_prefix prefixes[INPUT_BATCH_SIZE] = { { 0 } };
+    unsigned int classes[INPUT_BATCH_SIZE];
+    int malformed[INPUT_BATCH_SIZE];
+    /* IPv4 addresses are classified together, laid out for the vector kernels */
+    uint32_t ipv4_addrs[INPUT_BATCH_SIZE] = { 0 };
+    uint8_t ipv4_pflens[INPUT_BATCH_SIZE] = { 0 };
+    uint16_t ipv4_properties[INPUT_BATCH_SIZE];
+    size_t ipv4_positions[INPUT_BATCH_SIZE];
+    size_t ipv4_count = 0;
+    size_t parsed = 0;
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    for( i = 0; i < count; i++ )
+    {
+        malformed[i] = (ip_prefix_from_str(inputs[i], &prefixes[parsed]) != RESULT_SUCCESS);
+        if( malformed[i] )
+        {
+            if( verbose )
+            {
+                printf("Malformed address %s\n", inputs[i]);
+            }
+            result = RESULT_FAILURE;
+        }
+        else
+        {
+            parsed++;
+        }
+    }
+
+    for( i = 0; i < parsed; i++ )
+    {
+        if( prefixes[i].proto == CIDR_IPV4 )
+        {
+            ipv4_addrs[ipv4_count] = (uint32_t)prefixes[i].addr.lo;
+            ipv4_pflens[ipv4_count] = (uint8_t)prefixes[i].pflen;
+            ipv4_positions[ipv4_count++] = i;
+        }
+        else
+        {
+            classes[i] = ip_prefix_classes(&prefixes[i]);
+        }
+    }
+    ipv4_properties_batch(ipv4_addrs, ipv4_pflens, ipv4_count, ipv4_properties);
+    for( i = 0; i < ipv4_count; i++ )
+    {
+        classes[ipv4_positions[i]] = ipv4_properties[i] & ADDRESS_CLASSES;
+    }
+
+    for( i = 0, parsed = 0; i < count; i++ )
+    {
+        unsigned int remaining = 0;
+        const char* separator = "\t";
+
+        if( malformed[i] )
+        {
+            continue;
+        }
+
+        printf("%s", inputs[i]);
+        remaining = classes[parsed++];
+        if( remaining == 0 )
+        {
+            printf("\t-");
+        }
+        while( remaining != 0 )
+        {
+            unsigned int address_class = remaining & -remaining;
+            printf("%s%s", separator, address_class_name(address_class));
+            separator = ",";
+            remaining &= ~address_class;
+        }
+        printf("\n");
+    }
+
+    return(result);
+}
@@ -0,0 +1,762 @@
+/*
+ * ipaddrcheck.hpp: header-only C++ interface to the native address types
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Prefixes of a known family, prefix<ipv4> and prefix<ipv6>, and of either
+ * family, any_prefix, over the ip_value of ipaddrcheck_prefix.h. Parsing,
+ * containment and classification are constexpr, so constant prefixes are
+ * checked and converted by the compiler:
+ *
+ *   using namespace ipaddrcheck::literals;
+ *
+ *   constexpr auto corp = "10.0.0.0/8"_ipv4;
+ *   static_assert(corp.is_rfc1918());
+ *   static_assert(corp.contains("10.1.2.3"_ipv4));
+ *   constexpr auto any = "2001:db8::/32"_cidr;
+ *
+ * A malformed literal does not compile. In C++17 that holds for literals
+ * in constant expressions, in C++20 for all of them. At run time, parse()
+ * returns an empty std::optional instead.
+ *
+ * The parsers accept what the native parser of ip_prefix_from_str() does,
+ * which is the usual notation. The few forms only libcidr takes, such as
+ * a prefix length with leading zeros, are rejected.
+ *
+ * The predicates of prefix<ipv4> and prefix<ipv6> are specialised for
+ * their family and test only the class prefixes of that family; those of
+ * any_prefix look at the family once. Classes and properties are the
+ * ADDRESS_CLASS_* and ADDRESS_PROPERTY_* bits of ip_prefix_properties().
+ */
+
+#ifndef IPADDRCHECK_HPP
+#define IPADDRCHECK_HPP
+
+#if __cplusplus < 201703L
+#error "ipaddrcheck.hpp needs C++17 or later"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+extern "C"
+{
+#include "ipaddrcheck_classify.h"
+}
+
+/* Literals are always evaluated by the compiler where the language allows it */
+#if defined(__cpp_consteval)
+#define IPADDRCHECK_LITERAL consteval
+#else
+#define IPADDRCHECK_LITERAL constexpr
+#endif
+
+namespace ipaddrcheck
+{
+
+struct ipv4
+{
+    static constexpr int proto = CIDR_IPV4;
+    static constexpr int bits = IPV4_BITS;
+};
+
+struct ipv6
+{
+    static constexpr int proto = CIDR_IPV6;
+    static constexpr int bits = IPV6_BITS;
+};
+
+namespace detail
+{
+
+/* A character of a string, or a null byte past its end like a C string */
+constexpr char char_at(std::string_view str, std::size_t pos)
+{
+    return (pos < str.size()) ? str[pos] : '\0';
+}
+
+constexpr int hex_digit_value(char c)
+{
+    if( (c >= '0') && (c <= '9') )
+    {
+        return c - '0';
+    }
+    if( (c >= 'a') && (c <= 'f') )
+    {
+        return c - 'a' + 10;
+    }
+    if( (c >= 'A') && (c <= 'F') )
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* As ipv4_value_from_str(), pos is moved to the first character after the address */
+constexpr bool ipv4_value_from_str(std::string_view str, std::size_t& pos, ip_value& value)
+{
+    std::uint32_t address = 0;
+
+    for( int octet_count = 0; octet_count < 4; octet_count++ )
+    {
+        unsigned int octet = 0;
+        int digits = 0;
+
+        if( octet_count > 0 )
+        {
+            if( char_at(str, pos) != '.' )
+            {
+                return false;
+            }
+            pos++;
+        }
+
+        for( ; (char_at(str, pos) >= '0') && (char_at(str, pos) <= '9'); pos++, digits++ )
+        {
+            if( (digits > 0) && (octet == 0) )
+            {
+                return false;
+            }
+            octet = octet * 10 + static_cast<unsigned int>(char_at(str, pos) - '0');
+            if( octet > 255 )
+            {
+                return false;
+            }
+        }
+        if( digits == 0 )
+        {
+            return false;
+        }
+
+        address = (address << 8) | octet;
+    }
+
+    value = ip_value{ 0, address };
+    return true;
+}
+
+/* As ipv6_value_from_str(), pos is moved to the first character after the address */
+constexpr bool ipv6_value_from_str(std::string_view str, std::size_t& pos, ip_value& value)
+{
+    std::uint16_t groups[8] = { 0 };
+    int count = 0;
+    int gap = -1;
+
+    if( char_at(str, pos) == ':' )
+    {
+        if( char_at(str, pos + 1) != ':' )
+        {
+            return false;
+        }
+        gap = 0;
+        pos += 2;
+    }
+
+    while( (gap < 0) || (hex_digit_value(char_at(str, pos)) >= 0) )
+    {
+        unsigned int group = 0;
+        int digits = 0;
+        int digit = 0;
+
+        for( ; (digit = hex_digit_value(char_at(str, pos))) >= 0; pos++, digits++ )
+        {
+            if( digits == 4 )
+            {
+                return false;
+            }
+            group = (group << 4) | static_cast<unsigned int>(digit);
+        }
+        if( (digits == 0) || (count == 8) )
+        {
+            return false;
+        }
+        groups[count++] = static_cast<std::uint16_t>(group);
+
+        if( char_at(str, pos) != ':' )
+        {
+            break;
+        }
+        if( char_at(str, pos + 1) == ':' )
+        {
+            if( gap >= 0 )
+            {
+                return false;
+            }
+            gap = count;
+            pos += 2;
+        }
+        else
+        {
+            pos++;
+            if( hex_digit_value(char_at(str, pos)) < 0 )
+            {
+                return false;
+            }
+        }
+    }
+
+    /* "::" stands for at least one zero group */
+    if( (gap < 0) ? (count != 8) : (count > 7) )
+    {
+        return false;
+    }
+
+    value = ip_value{ 0, 0 };
+    for( int i = 0; i < 8; i++ )
+    {
+        std::uint64_t group = 0;
+        if( (gap < 0) || (i < gap) )
+        {
+            group = groups[i];
+        }
+        else if( i >= gap + (8 - count) )
+        {
+            group = groups[i - (8 - count)];
+        }
+
+        if( i < 4 )
+        {
+            value.hi = (value.hi << 16) | group;
+        }
+        else
+        {
+            value.lo = (value.lo << 16) | group;
+        }
+    }
+
+    return true;
+}
+
+/* The rest of the string after an address: nothing, or a prefix length
+   without leading zeros, as ip_prefix_from_native_str() takes it */
+constexpr bool prefix_length_from_str(std::string_view str, std::size_t pos, int bits, int& length)
+{
+    int digits = 0;
+
+    length = bits;
+    if( pos == str.size() )
+    {
+        return true;
+    }
+    if( str[pos] != '/' )
+    {
+        return false;
+    }
+
+    length = 0;
+    for( pos++; (char_at(str, pos) >= '0') && (char_at(str, pos) <= '9') && (digits < 3); pos++, digits++ )
+    {
+        if( (digits > 0) && (length == 0) )
+        {
+            return false;
+        }
+        length = length * 10 + (str[pos] - '0');
+    }
+
+    return (digits > 0) && (pos == str.size()) && (length <= bits);
+}
+
+/* Host part mask, as ip_host_mask() */
+constexpr ip_value host_mask(int bits, int length)
+{
+    int host_bits = bits - length;
+
+    if( host_bits <= 0 )
+    {
+        return ip_value{ 0, 0 };
+    }
+    if( host_bits < 64 )
+    {
+        return ip_value{ 0, (std::uint64_t(1) << host_bits) - 1 };
+    }
+    if( host_bits == 64 )
+    {
+        return ip_value{ 0, UINT64_MAX };
+    }
+    if( host_bits < 128 )
+    {
+        return ip_value{ (std::uint64_t(1) << (host_bits - 64)) - 1, UINT64_MAX };
+    }
+    return ip_value{ UINT64_MAX, UINT64_MAX };
+}
+
+/* A prefix that defines an address class */
+struct class_prefix
+{
+    ip_value addr;
+    int pflen;
+    unsigned int address_class;
+};
+
+/* Class prefixes are parsed from the same IPV4_* and IPV6_* strings
+   as the tables of ipaddrcheck_classify.c */
+template <typename Family>
+constexpr class_prefix make_class_prefix(std::string_view str, unsigned int address_class)
+{
+    class_prefix result = { { 0, 0 }, 0, address_class };
+    std::size_t pos = 0;
+    bool parsed = (Family::proto == CIDR_IPV4) ? ipv4_value_from_str(str, pos, result.addr)
+                                               : ipv6_value_from_str(str, pos, result.addr);
+
+    if( !parsed || !prefix_length_from_str(str, pos, Family::bits, result.pflen) )
+    {
+        throw std::logic_error("malformed class prefix");
+    }
+    return result;
+}
+
+} /* namespace detail */
+
+/* What differs between the families, specialised for each of them */
+template <typename Family>
+struct family_traits;
+
+template <>
+struct family_traits<ipv4>
+{
+    static constexpr bool address_from_str(std::string_view str, std::size_t& pos, ip_value& value)
+    {
+        return detail::ipv4_value_from_str(str, pos, value);
+    }
+
+    static constexpr detail::class_prefix class_prefixes[] =
+    {
+        detail::make_class_prefix<ipv4>(IPV4_MULTICAST,         ADDRESS_CLASS_MULTICAST),
+        detail::make_class_prefix<ipv4>(IPV4_LOOPBACK,          ADDRESS_CLASS_LOOPBACK),
+        detail::make_class_prefix<ipv4>(IPV4_LINKLOCAL,         ADDRESS_CLASS_LINK_LOCAL),
+        detail::make_class_prefix<ipv4>(IPV4_RFC1918_A,         ADDRESS_CLASS_RFC1918),
+        detail::make_class_prefix<ipv4>(IPV4_RFC1918_B,         ADDRESS_CLASS_RFC1918),
+        detail::make_class_prefix<ipv4>(IPV4_RFC1918_C,         ADDRESS_CLASS_RFC1918),
+        detail::make_class_prefix<ipv4>(IPV4_THIS,              ADDRESS_CLASS_THIS_NETWORK),
+        detail::make_class_prefix<ipv4>(IPV4_LIMITED_BROADCAST, ADDRESS_CLASS_LIMITED_BROADCAST)
+    };
+
+    /* As ipv4_properties_scalar(): the first and last addresses of
+       a prefix shorter than /31 are its network and broadcast */
+    static constexpr unsigned int properties(ip_value addr, int pflen, unsigned int classes)
+    {
+        std::uint64_t host_mask = detail::host_mask(ipv4::bits, pflen).lo;
+        std::uint64_t host_bits = addr.lo & host_mask;
+        bool short_prefix = (pflen < 31);
+        unsigned int result = classes;
+
+        if( host_bits == 0 )
+        {
+            result |= ADDRESS_PROPERTY_NETWORK;
+        }
+        if( (host_bits == host_mask) && short_prefix )
+        {
+            result |= ADDRESS_PROPERTY_BROADCAST;
+        }
+        if( (host_bits != 0) || !short_prefix )
+        {
+            result |= ADDRESS_PROPERTY_HOST;
+            if( !(result & (ADDRESS_PROPERTY_BROADCAST | ADDRESS_CLASS_MULTICAST |
+                            ADDRESS_CLASS_THIS_NETWORK | ADDRESS_CLASS_LIMITED_BROADCAST)) )
+            {
+                result |= ADDRESS_PROPERTY_INTERFACE;
+            }
+        }
+        return result;
+    }
+};
+
+template <>
+struct family_traits<ipv6>
+{
+    static constexpr bool address_from_str(std::string_view str, std::size_t& pos, ip_value& value)
+    {
+        return detail::ipv6_value_from_str(str, pos, value);
+    }
+
+    static constexpr detail::class_prefix class_prefixes[] =
+    {
+        detail::make_class_prefix<ipv6>(IPV6_MULTICAST, ADDRESS_CLASS_MULTICAST),
+        detail::make_class_prefix<ipv6>(IPV6_LINKLOCAL, ADDRESS_CLASS_LINK_LOCAL),
+        detail::make_class_prefix<ipv6>(IPV6_LOOPBACK,  ADDRESS_CLASS_LOOPBACK)
+    };
+
+    /* As ip_prefix_properties(): no broadcast, and the last two addresses
+       of a /127 or /128 are hosts */
+    static constexpr unsigned int properties(ip_value addr, int pflen, unsigned int classes)
+    {
+        ip_value host_mask = detail::host_mask(ipv6::bits, pflen);
+        bool network = ((addr.hi & host_mask.hi) == 0) && ((addr.lo & host_mask.lo) == 0);
+        unsigned int result = classes;
+
+        if( network )
+        {
+            result |= ADDRESS_PROPERTY_NETWORK;
+        }
+        if( !network || (pflen >= 127) )
+        {
+            result |= ADDRESS_PROPERTY_HOST;
+            if( !(result & (ADDRESS_CLASS_MULTICAST | ADDRESS_CLASS_LOOPBACK)) )
+            {
+                result |= ADDRESS_PROPERTY_INTERFACE;
+            }
+        }
+        return result;
+    }
+};
+
+/* An address or prefix of one family. An address is a prefix of full length. */
+template <typename Family>
+class prefix
+{
+public:
+    using family = Family;
+
+    constexpr prefix() : addr_{ 0, 0 }, length_(Family::bits)
+    {
+    }
+
+    constexpr prefix(ip_value addr, int length) : addr_(addr), length_(length)
+    {
+        if( (length < 0) || (length > Family::bits) )
+        {
+            throw std::out_of_range("prefix length out of range");
+        }
+    }
+
+    static constexpr std::optional<prefix> parse(std::string_view str) noexcept
+    {
+        ip_value addr = { 0, 0 };
+        std::size_t pos = 0;
+        int length = 0;
+
+        if( !family_traits<Family>::address_from_str(str, pos, addr) ||
+            !detail::prefix_length_from_str(str, pos, Family::bits, length) )
+        {
+            return std::nullopt;
+        }
+        return prefix(addr, length, unchecked());
+    }
+
+    static constexpr std::optional<prefix> from_native(const ip_prefix& native) noexcept
+    {
+        if( (native.proto != Family::proto) || (native.pflen < 0) || (native.pflen > Family::bits) )
+        {
+            return std::nullopt;
+        }
+        return prefix(native.addr, native.pflen, unchecked());
+    }
+
+    constexpr ip_prefix native() const noexcept
+    {
+        return ip_prefix{ Family::proto, addr_, length_ };
+    }
+
+    constexpr ip_value address() const noexcept
+    {
+        return addr_;
+    }
+
+    constexpr int length() const noexcept
+    {
+        return length_;
+    }
+
+    constexpr ip_value first() const noexcept
+    {
+        ip_value mask = detail::host_mask(Family::bits, length_);
+        return ip_value{ addr_.hi & ~mask.hi, addr_.lo & ~mask.lo };
+    }
+
+    constexpr ip_value last() const noexcept
+    {
+        ip_value mask = detail::host_mask(Family::bits, length_);
+        return ip_value{ addr_.hi | mask.hi, addr_.lo | mask.lo };
+    }
+
+    /* As ip_prefix_contains() */
+    constexpr bool contains(const prefix& inner) const noexcept
+    {
+        ip_value mask = detail::host_mask(Family::bits, length_);
+        return (length_ <= inner.length_) &&
+               ((addr_.hi & ~mask.hi) == (inner.addr_.hi & ~mask.hi)) &&
+               ((addr_.lo & ~mask.lo) == (inner.addr_.lo & ~mask.lo));
+    }
+
+    /* ADDRESS_CLASS_* bits of the class prefixes that contain this one */
+    constexpr unsigned int classes() const noexcept
+    {
+        unsigned int result = 0;
+
+        for( const detail::class_prefix& class_prefix : family_traits<Family>::class_prefixes )
+        {
+            if( prefix(class_prefix.addr, class_prefix.pflen, unchecked()).contains(*this) )
+            {
+                result |= class_prefix.address_class;
+            }
+        }
+        return result;
+    }
+
+    /* classes() with the ADDRESS_PROPERTY_* bits */
+    constexpr unsigned int properties() const noexcept
+    {
+        return family_traits<Family>::properties(addr_, length_, classes());
+    }
+
+    constexpr bool is_multicast() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_MULTICAST) != 0;
+    }
+
+    constexpr bool is_loopback() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_LOOPBACK) != 0;
+    }
+
+    constexpr bool is_link_local() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_LINK_LOCAL) != 0;
+    }
+
+    constexpr bool is_rfc1918() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_RFC1918) != 0;
+    }
+
+    constexpr bool is_network() const noexcept
+    {
+        ip_value mask = detail::host_mask(Family::bits, length_);
+        return ((addr_.hi & mask.hi) == 0) && ((addr_.lo & mask.lo) == 0);
+    }
+
+    constexpr bool is_host() const noexcept
+    {
+        return (properties() & ADDRESS_PROPERTY_HOST) != 0;
+    }
+
+    constexpr bool is_interface() const noexcept
+    {
+        return (properties() & ADDRESS_PROPERTY_INTERFACE) != 0;
+    }
+
+    /* In the form of ip_prefix_to_str(), always with the prefix length */
+    std::string to_string() const
+    {
+        char buffer[PREFIX_STR_MAX];
+        ip_prefix value = native();
+        return std::string(ip_prefix_to_str(&value, buffer));
+    }
+
+    friend constexpr bool operator==(const prefix& left, const prefix& right) noexcept
+    {
+        return (left.addr_.hi == right.addr_.hi) && (left.addr_.lo == right.addr_.lo) &&
+               (left.length_ == right.length_);
+    }
+
+    friend constexpr bool operator!=(const prefix& left, const prefix& right) noexcept
+    {
+        return !(left == right);
+    }
+
+private:
+    struct unchecked
+    {
+    };
+
+    constexpr prefix(ip_value addr, int length, unchecked) noexcept : addr_(addr), length_(length)
+    {
+    }
+
+    ip_value addr_;
+    int length_;
+};
+
+using ipv4_prefix = prefix<ipv4>;
+using ipv6_prefix = prefix<ipv6>;
+
+/* An address or prefix of either family, told apart as the command line does,
+   by whether it has a colon */
+class any_prefix
+{
+public:
+    constexpr any_prefix(const ipv4_prefix& value) noexcept : proto_(CIDR_IPV4), v4_(value), v6_()
+    {
+    }
+
+    constexpr any_prefix(const ipv6_prefix& value) noexcept : proto_(CIDR_IPV6), v4_(), v6_(value)
+    {
+    }
+
+    static constexpr std::optional<any_prefix> parse(std::string_view str) noexcept
+    {
+        if( str.find(':') == std::string_view::npos )
+        {
+            std::optional<ipv4_prefix> value = ipv4_prefix::parse(str);
+            return value ? std::optional<any_prefix>(*value) : std::nullopt;
+        }
+        std::optional<ipv6_prefix> value = ipv6_prefix::parse(str);
+        return value ? std::optional<any_prefix>(*value) : std::nullopt;
+    }
+
+    static constexpr std::optional<any_prefix> from_native(const ip_prefix& native) noexcept
+    {
+        if( native.proto == CIDR_IPV4 )
+        {
+            std::optional<ipv4_prefix> value = ipv4_prefix::from_native(native);
+            return value ? std::optional<any_prefix>(*value) : std::nullopt;
+        }
+        std::optional<ipv6_prefix> value = ipv6_prefix::from_native(native);
+        return value ? std::optional<any_prefix>(*value) : std::nullopt;
+    }
+
+    /* CIDR_IPV4 or CIDR_IPV6 */
+    constexpr int proto() const noexcept
+    {
+        return proto_;
+    }
+
+    constexpr std::optional<ipv4_prefix> as_ipv4() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? std::optional<ipv4_prefix>(v4_) : std::nullopt;
+    }
+
+    constexpr std::optional<ipv6_prefix> as_ipv6() const noexcept
+    {
+        return (proto_ == CIDR_IPV6) ? std::optional<ipv6_prefix>(v6_) : std::nullopt;
+    }
+
+    constexpr ip_prefix native() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.native() : v6_.native();
+    }
+
+    constexpr int length() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.length() : v6_.length();
+    }
+
+    /* Prefixes of different families contain nothing of each other */
+    constexpr bool contains(const any_prefix& inner) const noexcept
+    {
+        if( proto_ != inner.proto_ )
+        {
+            return false;
+        }
+        return (proto_ == CIDR_IPV4) ? v4_.contains(inner.v4_) : v6_.contains(inner.v6_);
+    }
+
+    constexpr unsigned int classes() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.classes() : v6_.classes();
+    }
+
+    constexpr unsigned int properties() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.properties() : v6_.properties();
+    }
+
+    constexpr bool is_multicast() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_MULTICAST) != 0;
+    }
+
+    constexpr bool is_loopback() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_LOOPBACK) != 0;
+    }
+
+    constexpr bool is_link_local() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_LINK_LOCAL) != 0;
+    }
+
+    constexpr bool is_rfc1918() const noexcept
+    {
+        return (classes() & ADDRESS_CLASS_RFC1918) != 0;
+    }
+
+    constexpr bool is_network() const noexcept
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.is_network() : v6_.is_network();
+    }
+
+    std::string to_string() const
+    {
+        return (proto_ == CIDR_IPV4) ? v4_.to_string() : v6_.to_string();
+    }
+
+    friend constexpr bool operator==(const any_prefix& left, const any_prefix& right) noexcept
+    {
+        if( left.proto_ != right.proto_ )
+        {
+            return false;
+        }
+        return (left.proto_ == CIDR_IPV4) ? (left.v4_ == right.v4_) : (left.v6_ == right.v6_);
+    }
+
+    friend constexpr bool operator!=(const any_prefix& left, const any_prefix& right) noexcept
+    {
+        return !(left == right);
+    }
+
+private:
+    int proto_;
+    ipv4_prefix v4_;
+    ipv6_prefix v6_;
+};
+
+namespace literals
+{
+
+IPADDRCHECK_LITERAL ipv4_prefix operator""_ipv4(const char* str, std::size_t length)
+{
+    std::optional<ipv4_prefix> value = ipv4_prefix::parse(std::string_view(str, length));
+    if( !value )
+    {
+        throw std::invalid_argument("malformed IPv4 address or prefix");
+    }
+    return *value;
+}
+
+IPADDRCHECK_LITERAL ipv6_prefix operator""_ipv6(const char* str, std::size_t length)
+{
+    std::optional<ipv6_prefix> value = ipv6_prefix::parse(std::string_view(str, length));
+    if( !value )
+    {
+        throw std::invalid_argument("malformed IPv6 address or prefix");
+    }
+    return *value;
+}
+
+IPADDRCHECK_LITERAL any_prefix operator""_cidr(const char* str, std::size_t length)
+{
+    std::optional<any_prefix> value = any_prefix::parse(std::string_view(str, length));
+    if( !value )
+    {
+        throw std::invalid_argument("malformed address or prefix");
+    }
+    return *value;
+}
+
+} /* namespace literals */
+
+} /* namespace ipaddrcheck */
+
+#endif /* IPADDRCHECK_HPP */
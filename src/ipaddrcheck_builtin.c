@@ -0,0 +1,91 @@
+/*
+ * ipaddrcheck_builtin.c: ipaddrcheck as a bash loadable builtin
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 or later as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Scripts that check addresses in a loop pay for a fork and an exec
+ * on every call of the program. Once loaded with
+ *
+ *   enable -f ipaddrcheck.so ipaddrcheck
+ *
+ * the same command runs inside the shell instead, with the same options
+ * and the same exit status.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "builtins.h"
+#include "shell.h"
+#include "common.h"
+
+/* The command line entry point of ipaddrcheck.c */
+int ipaddrcheck_main(int argc, char* argv[]);
+
+static int ipaddrcheck_builtin(WORD_LIST* list)
+{
+    char** argv = NULL;
+    int argc = 0;
+    int result = 0;
+    long position = 0;
+
+    /* Leave the first slot for the command name, like a real argv.
+       The count includes that slot. */
+    argv = strvec_from_word_list(list, 0, 1, &argc);
+    argv[0] = this_command_name;
+
+    result = ipaddrcheck_main(argc, argv);
+
+    /* The shell goes on using the same file descriptors, with other
+       redirections. Write out what is buffered, and move a file on
+       standard input back to where reading stopped: ftell() counts what
+       was read ahead, and seeking there drops it from the buffer.
+       Pipes cannot be moved back, but every mode reads them to the end. */
+    fflush(stdout);
+    fflush(stderr);
+    position = ftell(stdin);
+    if( position >= 0 )
+    {
+        fseek(stdin, position, SEEK_SET);
+    }
+    clearerr(stdin);
+
+    free(argv);
+
+    return(result);
+}
+
+static char* ipaddrcheck_doc[] =
+{
+    "Check IPv4 and IPv6 addresses.",
+    "",
+    "Takes the same options and arguments as the ipaddrcheck program,",
+    "see ipaddrcheck --help, and returns the same exit status without",
+    "starting a new process.",
+    (char*)NULL
+};
+
+struct builtin ipaddrcheck_struct =
+{
+    "ipaddrcheck",
+    ipaddrcheck_builtin,
+    BUILTIN_ENABLED,
+    ipaddrcheck_doc,
+    "ipaddrcheck [OPTIONS] [STRING]",
+    0
+};
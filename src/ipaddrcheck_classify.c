@@ -0,0 +1,507 @@
+/*
+ * ipaddrcheck_classify.c: table-driven classification of addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <assert.h>
+#include <pthread.h>
+
+#include "ipaddrcheck_classify.h"
+
+/* The vector kernels need GCC or Clang on x86-64, and are picked at run time */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(IPADDRCHECK_NO_SIMD)
+#define HAVE_VECTOR_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Every class is a handful of fixed prefixes, so the classes of an address
+ * are found in a table indexed by its leading bits. A table entry holds
+ * the classes whose prefixes cover its whole bucket, and the length of
+ * those prefixes, since a prefix that is shorter is not within the class.
+ * Class prefixes longer than the index (limited broadcast, IPv6 link-local
+ * and loopback) are kept in a short chain of refinements hanging off their
+ * bucket, which costs a second probe only for addresses in that bucket.
+ *
+ * The tables are built from the class prefixes on first use.
+ */
+
+/* Entry layout: classes, prefix length, refinement chain head plus one */
+#define ENTRY_CLASSES(entry)     ((unsigned int)(entry) & 0xff)
+#define ENTRY_LENGTH(entry)      (((int)(entry) >> 8) & 0x1f)
+#define ENTRY_REFINEMENT(entry)  (((int)(entry) >> 13) - 1)
+
+#define MAX_REFINEMENTS 7
+#define MAX_IPV4_CLASS_PREFIXES 8
+
+/* Classes that rule out an interface address, whatever the prefix length */
+#define NOT_INTERFACE_CLASSES (ADDRESS_CLASS_MULTICAST | ADDRESS_CLASS_THIS_NETWORK | \
+                               ADDRESS_CLASS_LIMITED_BROADCAST)
+
+typedef struct
+{
+    ip_value addr;
+    int pflen;
+    unsigned int classes;
+    int next;       /* next refinement of the same bucket, or -1 */
+} class_refinement;
+
+static const struct
+{
+    const char* prefix;
+    unsigned int address_class;
+} class_prefixes[] =
+{
+    { IPV4_MULTICAST,         ADDRESS_CLASS_MULTICAST },
+    { IPV4_LOOPBACK,          ADDRESS_CLASS_LOOPBACK },
+    { IPV4_LINKLOCAL,         ADDRESS_CLASS_LINK_LOCAL },
+    { IPV4_RFC1918_A,         ADDRESS_CLASS_RFC1918 },
+    { IPV4_RFC1918_B,         ADDRESS_CLASS_RFC1918 },
+    { IPV4_RFC1918_C,         ADDRESS_CLASS_RFC1918 },
+    { IPV4_THIS,              ADDRESS_CLASS_THIS_NETWORK },
+    { IPV4_LIMITED_BROADCAST, ADDRESS_CLASS_LIMITED_BROADCAST },
+    { IPV6_MULTICAST,         ADDRESS_CLASS_MULTICAST },
+    { IPV6_LINKLOCAL,         ADDRESS_CLASS_LINK_LOCAL },
+    { IPV6_LOOPBACK,          ADDRESS_CLASS_LOOPBACK },
+    { NULL,                   0 }
+};
+
+static const char* class_names[] =
+{
+    "multicast", "loopback", "link-local", "rfc1918", "this-network", "limited-broadcast"
+};
+
+static uint16_t ipv4_class_table[1 << CLASS_INDEX_BITS_IPV4];
+static uint16_t ipv6_class_table[1 << CLASS_INDEX_BITS_IPV6];
+static class_refinement class_refinements[MAX_REFINEMENTS];
+static int class_refinement_count = 0;
+
+/*
+ * The IPv4 class prefixes once more, as masks to compare whole vectors
+ * of addresses against. Vector lanes can't index a table cheaply.
+ */
+typedef struct
+{
+    uint32_t network;
+    uint32_t mask;
+    int pflen;
+    unsigned int address_class;
+} ipv4_class_prefix;
+
+static ipv4_class_prefix ipv4_class_prefixes[MAX_IPV4_CLASS_PREFIXES];
+static int ipv4_class_prefix_count = 0;
+
+static pthread_once_t class_tables_once = PTHREAD_ONCE_INIT;
+
+static inline unsigned int class_bucket(int proto, ip_value addr)
+{
+    if( proto == CIDR_IPV4 )
+    {
+        return (uint32_t)addr.lo >> (IPV4_BITS - CLASS_INDEX_BITS_IPV4);
+    }
+    return (unsigned int)(addr.hi >> (64 - CLASS_INDEX_BITS_IPV6));
+}
+
+static void add_refinement(uint16_t* entry, const ip_prefix* prefix, unsigned int address_class)
+{
+    class_refinement* refinement = &class_refinements[class_refinement_count];
+
+    /* The class prefixes are fixed, so this can only fail after a change to them */
+    assert(class_refinement_count < MAX_REFINEMENTS);
+
+    refinement->addr = ip_prefix_first(prefix);
+    refinement->pflen = prefix->pflen;
+    refinement->classes = address_class;
+    refinement->next = ENTRY_REFINEMENT(*entry);
+    class_refinement_count++;
+
+    *entry = (uint16_t)((*entry & 0x1fff) | (class_refinement_count << 13));
+}
+
+static inline unsigned int classify(const ip_prefix* prefix)
+{
+    uint16_t entry = (prefix->proto == CIDR_IPV4) ? ipv4_class_table[class_bucket(CIDR_IPV4, prefix->addr)]
+                                                  : ipv6_class_table[class_bucket(CIDR_IPV6, prefix->addr)];
+    unsigned int classes = (prefix->pflen >= ENTRY_LENGTH(entry)) ? ENTRY_CLASSES(entry) : 0;
+    int i = 0;
+
+    for( i = ENTRY_REFINEMENT(entry); i >= 0; i = class_refinements[i].next )
+    {
+        const class_refinement* refinement = &class_refinements[i];
+
+        if( (prefix->pflen >= refinement->pflen) &&
+            (ip_value_common_bits(prefix->addr, refinement->addr, ip_bits(prefix->proto)) >= refinement->pflen) )
+        {
+            classes |= refinement->classes;
+        }
+    }
+
+    return classes;
+}
+
+/*
+ * Properties of IPv4 addresses one at a time: the classes come from the
+ * table, the rest from the host part of the address.
+ */
+static void ipv4_properties_scalar(const uint32_t* addrs, const uint8_t* pflens,
+                                   size_t count, uint16_t* properties)
+{
+    size_t i = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        ip_prefix prefix = { CIDR_IPV4, { 0, addrs[i] }, pflens[i] };
+        uint32_t host_mask = (pflens[i] >= IPV4_BITS) ? 0 : (0xffffffffU >> pflens[i]);
+        uint32_t host_bits = addrs[i] & host_mask;
+        int short_prefix = (pflens[i] < 31);
+        unsigned int result = classify(&prefix);
+
+        if( host_bits == 0 )
+        {
+            result |= ADDRESS_PROPERTY_NETWORK;
+        }
+        if( (host_bits == host_mask) && short_prefix )
+        {
+            result |= ADDRESS_PROPERTY_BROADCAST;
+        }
+        if( (host_bits != 0) || !short_prefix )
+        {
+            result |= ADDRESS_PROPERTY_HOST;
+            if( !(result & (ADDRESS_PROPERTY_BROADCAST | NOT_INTERFACE_CLASSES)) )
+            {
+                result |= ADDRESS_PROPERTY_INTERFACE;
+            }
+        }
+        properties[i] = (uint16_t)result;
+    }
+}
+
+#ifdef HAVE_VECTOR_KERNELS
+
+/* Eight addresses at a time, every property is a lane mask ANDed with its bit */
+__attribute__((target("avx2")))
+static void ipv4_properties_avx2(const uint32_t* addrs, const uint8_t* pflens,
+                                 size_t count, uint16_t* properties)
+{
+    const __m256i all_ones = _mm256_set1_epi32(-1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i not_interface = _mm256_set1_epi32(NOT_INTERFACE_CLASSES);
+    size_t i = 0;
+    int k = 0;
+
+    for( i = 0; i + 8 <= count; i += 8 )
+    {
+        __m256i addr = _mm256_loadu_si256((const __m256i*)(addrs + i));
+        __m256i pflen = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pflens + i)));
+        /* Shifts by 32 or more give zero, just what a /32 needs */
+        __m256i host_mask = _mm256_srlv_epi32(all_ones, pflen);
+        __m256i host_bits = _mm256_and_si256(addr, host_mask);
+        __m256i short_prefix = _mm256_cmpgt_epi32(_mm256_set1_epi32(31), pflen);
+        __m256i network = _mm256_cmpeq_epi32(host_bits, zero);
+        __m256i broadcast = _mm256_and_si256(_mm256_cmpeq_epi32(host_bits, host_mask), short_prefix);
+        __m256i host = _mm256_andnot_si256(_mm256_and_si256(network, short_prefix), all_ones);
+        __m256i interface;
+        __m256i result = zero;
+        __m256i packed;
+
+        for( k = 0; k < ipv4_class_prefix_count; k++ )
+        {
+            const ipv4_class_prefix* class_prefix = &ipv4_class_prefixes[k];
+            __m256i in_network = _mm256_cmpeq_epi32(_mm256_and_si256(addr, _mm256_set1_epi32((int)class_prefix->mask)),
+                                                    _mm256_set1_epi32((int)class_prefix->network));
+            __m256i long_enough = _mm256_cmpgt_epi32(pflen, _mm256_set1_epi32(class_prefix->pflen - 1));
+
+            result = _mm256_or_si256(result, _mm256_and_si256(_mm256_and_si256(in_network, long_enough),
+                                                              _mm256_set1_epi32((int)class_prefix->address_class)));
+        }
+
+        interface = _mm256_andnot_si256(broadcast, host);
+        interface = _mm256_and_si256(interface, _mm256_cmpeq_epi32(_mm256_and_si256(result, not_interface), zero));
+
+        result = _mm256_or_si256(result, _mm256_and_si256(network, _mm256_set1_epi32(ADDRESS_PROPERTY_NETWORK)));
+        result = _mm256_or_si256(result, _mm256_and_si256(broadcast, _mm256_set1_epi32(ADDRESS_PROPERTY_BROADCAST)));
+        result = _mm256_or_si256(result, _mm256_and_si256(host, _mm256_set1_epi32(ADDRESS_PROPERTY_HOST)));
+        result = _mm256_or_si256(result, _mm256_and_si256(interface, _mm256_set1_epi32(ADDRESS_PROPERTY_INTERFACE)));
+
+        /* Narrow to 16 bits, the pack works within each half */
+        packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(result, result), 0x08);
+        _mm_storeu_si128((__m128i*)(properties + i), _mm256_castsi256_si128(packed));
+    }
+
+    ipv4_properties_scalar(addrs + i, pflens + i, count - i, properties + i);
+}
+
+/* Sixteen addresses at a time, with comparisons into mask registers */
+__attribute__((target("avx512f")))
+static void ipv4_properties_avx512(const uint32_t* addrs, const uint8_t* pflens,
+                                   size_t count, uint16_t* properties)
+{
+    const __m512i all_ones = _mm512_set1_epi32(-1);
+    const __m512i not_interface = _mm512_set1_epi32(NOT_INTERFACE_CLASSES);
+    size_t i = 0;
+    int k = 0;
+
+    for( i = 0; i + 16 <= count; i += 16 )
+    {
+        __m512i addr = _mm512_loadu_si512((const void*)(addrs + i));
+        __m512i pflen = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(pflens + i)));
+        __m512i host_mask = _mm512_srlv_epi32(all_ones, pflen);
+        __m512i host_bits = _mm512_and_si512(addr, host_mask);
+        __mmask16 short_prefix = _mm512_cmplt_epu32_mask(pflen, _mm512_set1_epi32(31));
+        __mmask16 network = _mm512_testn_epi32_mask(addr, host_mask);
+        __mmask16 broadcast = _mm512_cmpeq_epi32_mask(host_bits, host_mask) & short_prefix;
+        __mmask16 host = (__mmask16)~(network & short_prefix);
+        __mmask16 interface;
+        __m512i result = _mm512_setzero_si512();
+
+        for( k = 0; k < ipv4_class_prefix_count; k++ )
+        {
+            const ipv4_class_prefix* class_prefix = &ipv4_class_prefixes[k];
+            __mmask16 long_enough = _mm512_cmpge_epu32_mask(pflen, _mm512_set1_epi32(class_prefix->pflen));
+            __mmask16 in_class = _mm512_mask_cmpeq_epi32_mask(long_enough,
+                                                              _mm512_and_si512(addr, _mm512_set1_epi32((int)class_prefix->mask)),
+                                                              _mm512_set1_epi32((int)class_prefix->network));
+
+            result = _mm512_mask_or_epi32(result, in_class, result, _mm512_set1_epi32((int)class_prefix->address_class));
+        }
+
+        interface = host & (__mmask16)~broadcast & _mm512_testn_epi32_mask(result, not_interface);
+
+        result = _mm512_mask_or_epi32(result, network, result, _mm512_set1_epi32(ADDRESS_PROPERTY_NETWORK));
+        result = _mm512_mask_or_epi32(result, broadcast, result, _mm512_set1_epi32(ADDRESS_PROPERTY_BROADCAST));
+        result = _mm512_mask_or_epi32(result, host, result, _mm512_set1_epi32(ADDRESS_PROPERTY_HOST));
+        result = _mm512_mask_or_epi32(result, interface, result, _mm512_set1_epi32(ADDRESS_PROPERTY_INTERFACE));
+
+        _mm256_storeu_si256((__m256i*)(properties + i), _mm512_cvtepi32_epi16(result));
+    }
+
+    ipv4_properties_avx2(addrs + i, pflens + i, count - i, properties + i);
+}
+
+#endif /* HAVE_VECTOR_KERNELS */
+
+typedef void (*ipv4_properties_kernel)(const uint32_t* addrs, const uint8_t* pflens,
+                                       size_t count, uint16_t* properties);
+
+static ipv4_properties_kernel ipv4_properties = ipv4_properties_scalar;
+
+/* Use the widest kernel the processor supports */
+static void select_ipv4_kernel(void)
+{
+#ifdef HAVE_VECTOR_KERNELS
+    if( __builtin_cpu_supports("avx512f") )
+    {
+        ipv4_properties = ipv4_properties_avx512;
+    }
+    else if( __builtin_cpu_supports("avx2") )
+    {
+        ipv4_properties = ipv4_properties_avx2;
+    }
+#endif
+}
+
+static void build_class_tables(void)
+{
+    int i = 0;
+
+    for( i = 0; class_prefixes[i].prefix != NULL; i++ )
+    {
+        char prefix_str[PREFIX_STR_MAX];
+        ip_prefix prefix;
+        int index_bits = 0;
+        uint16_t* table = NULL;
+        unsigned int bucket = 0;
+        unsigned int bucket_count = 0;
+        unsigned int j = 0;
+
+        strcpy(prefix_str, class_prefixes[i].prefix);
+        if( ip_prefix_from_str(prefix_str, &prefix) != RESULT_SUCCESS )
+        {
+            /* Cannot happen with the constants above */
+            continue;
+        }
+
+        if( prefix.proto == CIDR_IPV4 )
+        {
+            ipv4_class_prefix* ipv4_prefix = &ipv4_class_prefixes[ipv4_class_prefix_count++];
+
+            assert(ipv4_class_prefix_count <= MAX_IPV4_CLASS_PREFIXES);
+            ipv4_prefix->network = (uint32_t)prefix.addr.lo;
+            ipv4_prefix->mask = (uint32_t)~ip_host_mask(CIDR_IPV4, prefix.pflen).lo;
+            ipv4_prefix->pflen = prefix.pflen;
+            ipv4_prefix->address_class = class_prefixes[i].address_class;
+        }
+
+        index_bits = (prefix.proto == CIDR_IPV4) ? CLASS_INDEX_BITS_IPV4 : CLASS_INDEX_BITS_IPV6;
+        table = (prefix.proto == CIDR_IPV4) ? ipv4_class_table : ipv6_class_table;
+        bucket = class_bucket(prefix.proto, ip_prefix_first(&prefix));
+
+        if( prefix.pflen > index_bits )
+        {
+            add_refinement(&table[bucket], &prefix, class_prefixes[i].address_class);
+            continue;
+        }
+
+        bucket_count = 1U << (index_bits - prefix.pflen);
+        for( j = 0; j < bucket_count; j++ )
+        {
+            uint16_t* entry = &table[bucket + j];
+
+            /* A bucket has room for the classes of a single prefix length */
+            if( (ENTRY_CLASSES(*entry) != 0) && (ENTRY_LENGTH(*entry) != prefix.pflen) )
+            {
+                add_refinement(entry, &prefix, class_prefixes[i].address_class);
+                continue;
+            }
+            *entry = (uint16_t)((*entry & 0xe000) | (prefix.pflen << 8) |
+                                ENTRY_CLASSES(*entry) | class_prefixes[i].address_class);
+        }
+    }
+
+    select_ipv4_kernel();
+}
+
+/* Classes the address belongs to, or that the prefix lies entirely within */
+unsigned int ip_prefix_classes(const ip_prefix* prefix)
+{
+    pthread_once(&class_tables_once, build_class_tables);
+    return classify(prefix);
+}
+
+void ip_prefix_classes_batch(const ip_prefix* prefixes, size_t count, unsigned int* classes)
+{
+    size_t i = 0;
+
+    pthread_once(&class_tables_once, build_class_tables);
+    for( i = 0; i < count; i++ )
+    {
+        classes[i] = classify(&prefixes[i]);
+    }
+}
+
+/* Name of a single class */
+const char* address_class_name(unsigned int address_class)
+{
+    int i = 0;
+
+    for( i = 0; i < (int)(sizeof(class_names) / sizeof(class_names[0])); i++ )
+    {
+        if( address_class == (1U << i) )
+        {
+            return class_names[i];
+        }
+    }
+    return NULL;
+}
+
+/* Classes and properties of a single address or prefix of either family */
+unsigned int ip_prefix_properties(const ip_prefix* prefix)
+{
+    uint32_t addr = 0;
+    uint8_t pflen = 0;
+    uint16_t properties = 0;
+    ip_value host_mask;
+    int network = 0;
+    unsigned int result = 0;
+
+    pthread_once(&class_tables_once, build_class_tables);
+    if( prefix->proto == CIDR_IPV4 )
+    {
+        addr = (uint32_t)prefix->addr.lo;
+        pflen = (uint8_t)prefix->pflen;
+        ipv4_properties_scalar(&addr, &pflen, 1, &properties);
+        return properties;
+    }
+
+    /* The last two addresses of an IPv6 /127 or /128 are hosts, there is no broadcast */
+    host_mask = ip_host_mask(CIDR_IPV6, prefix->pflen);
+    network = ((prefix->addr.hi & host_mask.hi) == 0) && ((prefix->addr.lo & host_mask.lo) == 0);
+    result = classify(prefix);
+    if( network )
+    {
+        result |= ADDRESS_PROPERTY_NETWORK;
+    }
+    if( !network || (prefix->pflen >= 127) )
+    {
+        result |= ADDRESS_PROPERTY_HOST;
+        if( !(result & (ADDRESS_CLASS_MULTICAST | ADDRESS_CLASS_LOOPBACK)) )
+        {
+            result |= ADDRESS_PROPERTY_INTERFACE;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Classes and properties of a batch of IPv4 addresses with their prefix
+ * lengths, kept in separate arrays so that whole vectors of them can be
+ * loaded at once.
+ */
+void ipv4_properties_batch(const uint32_t* addrs, const uint8_t* pflens, size_t count, uint16_t* properties)
+{
+    pthread_once(&class_tables_once, build_class_tables);
+    ipv4_properties(addrs, pflens, count, properties);
+}
+
+#ifdef IPADDRCHECK_TESTING
+
+/*
+ * Make ipv4_properties_batch() use the given kernel instead of the widest
+ * one, or go back to the widest one with IPV4_KERNEL_BEST. Fails, and keeps
+ * the current kernel, if the build or the processor lacks the one asked for.
+ * Not thread-safe, it is meant for the unit tests.
+ */
+int ipv4_properties_kernel_for_test(int kernel)
+{
+    pthread_once(&class_tables_once, build_class_tables);
+
+    switch( kernel )
+    {
+        case IPV4_KERNEL_BEST:
+            ipv4_properties = ipv4_properties_scalar;
+            select_ipv4_kernel();
+            return(RESULT_SUCCESS);
+        case IPV4_KERNEL_SCALAR:
+            ipv4_properties = ipv4_properties_scalar;
+            return(RESULT_SUCCESS);
+#ifdef HAVE_VECTOR_KERNELS
+        case IPV4_KERNEL_AVX2:
+            if( __builtin_cpu_supports("avx2") )
+            {
+                ipv4_properties = ipv4_properties_avx2;
+                return(RESULT_SUCCESS);
+            }
+            break;
+        case IPV4_KERNEL_AVX512:
+            if( __builtin_cpu_supports("avx512f") )
+            {
+                ipv4_properties = ipv4_properties_avx512;
+                return(RESULT_SUCCESS);
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+
+    return(RESULT_FAILURE);
+}
+
+#endif /* IPADDRCHECK_TESTING */
@@ -0,0 +1,66 @@
+/*
+ * ipaddrcheck_classify.h: table-driven classification of addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_CLASSIFY_H
+#define IPADDRCHECK_CLASSIFY_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* Address classes, one bit each. They are defined by the IPV4_* and IPV6_*
+   prefixes of ipaddrcheck_functions.h, for both families where they exist. */
+#define ADDRESS_CLASS_MULTICAST          0x01
+#define ADDRESS_CLASS_LOOPBACK           0x02
+#define ADDRESS_CLASS_LINK_LOCAL         0x04
+#define ADDRESS_CLASS_RFC1918            0x08
+#define ADDRESS_CLASS_THIS_NETWORK       0x10
+#define ADDRESS_CLASS_LIMITED_BROADCAST  0x20
+#define ADDRESS_CLASSES                  0x3f
+
+/* Properties of an address with its prefix length, next to its classes, as
+   the is_ipv4_*, is_ipv6_* and is_valid_intf_address predicates define them.
+   An IPv4 interface address may still be a loopback one, it is up to the
+   caller whether that is allowed. IPv6 has no broadcast addresses. */
+#define ADDRESS_PROPERTY_NETWORK         0x40
+#define ADDRESS_PROPERTY_BROADCAST       0x80
+#define ADDRESS_PROPERTY_HOST            0x100
+#define ADDRESS_PROPERTY_INTERFACE       0x200
+
+/* Leading address bits that index the tables of each family */
+#define CLASS_INDEX_BITS_IPV4 16
+#define CLASS_INDEX_BITS_IPV6 8
+
+unsigned int ip_prefix_classes(const ip_prefix* prefix);
+void ip_prefix_classes_batch(const ip_prefix* prefixes, size_t count, unsigned int* classes);
+const char* address_class_name(unsigned int address_class);
+unsigned int ip_prefix_properties(const ip_prefix* prefix);
+void ipv4_properties_batch(const uint32_t* addrs, const uint8_t* pflens, size_t count, uint16_t* properties);
+
+#ifdef IPADDRCHECK_TESTING
+/* Kernels of ipv4_properties_batch(), only built for the unit tests to check each of them */
+#define IPV4_KERNEL_BEST    -1
+#define IPV4_KERNEL_SCALAR   0
+#define IPV4_KERNEL_AVX2     1
+#define IPV4_KERNEL_AVX512   2
+
+int ipv4_properties_kernel_for_test(int kernel);
+#endif
+
+#endif /* IPADDRCHECK_CLASSIFY_H */
@@ -0,0 +1,328 @@
+/*
+ * ipaddrcheck_coverage.c: prefixes covered by other prefixes
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* strdup() */
+#define _POSIX_C_SOURCE 200809L
+
+#include "ipaddrcheck_coverage.h"
+
+/*
+ * A node of a path-compressed binary trie of group entries.
+ * Every node stands for a prefix: its children share its first
+ * pflen bits and differ in the next one, and an internal node with
+ * a single child is only ever there because an entry ends at it.
+ */
+typedef struct
+{
+    ip_value addr;
+    int pflen;
+    uint32_t children[2];  /* zero if there is none, the roots are never children */
+    uint32_t entry;        /* the first entry with this prefix, COVERAGE_NONE if there is none */
+} group_node;
+
+/* Nodes 0 and 1 are the roots of the IPv4 and IPv6 tries */
+typedef struct
+{
+    group_node* nodes;
+    size_t node_count;
+    size_t capacity;
+} group_trie;
+
+/*
+ * Tries of group entries
+ */
+
+static int group_trie_init(group_trie* trie)
+{
+    trie->capacity = 1024;
+    trie->node_count = 2;
+    trie->nodes = calloc(trie->capacity, sizeof(group_node));
+    if( trie->nodes == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return(RESULT_FAILURE);
+    }
+    trie->nodes[0].entry = COVERAGE_NONE;
+    trie->nodes[1].entry = COVERAGE_NONE;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Zero if the node could not be allocated */
+static uint32_t group_trie_new_node(group_trie* trie, ip_value addr, int pflen, uint32_t entry)
+{
+    group_node* node = NULL;
+
+    if( trie->node_count == trie->capacity )
+    {
+        group_node* nodes = realloc(trie->nodes, trie->capacity * 2 * sizeof(group_node));
+        if( nodes == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            return 0;
+        }
+        trie->nodes = nodes;
+        trie->capacity *= 2;
+    }
+
+    node = &trie->nodes[trie->node_count];
+    node->addr = addr;
+    node->pflen = pflen;
+    node->children[0] = 0;
+    node->children[1] = 0;
+    node->entry = entry;
+
+    return (uint32_t)trie->node_count++;
+}
+
+/*
+ * Add an entry, unless an earlier one has the same prefix.
+ * Returns RESULT_FAILURE if there was no memory for it.
+ */
+static int group_trie_insert(group_trie* trie, const ip_prefix* prefix, uint32_t entry)
+{
+    int width = ip_bits(prefix->proto);
+    uint32_t index = (prefix->proto == CIDR_IPV4) ? 0 : 1;
+
+    while( trie->nodes[index].pflen < prefix->pflen )
+    {
+        int bit = ip_value_bit(prefix->addr, width, trie->nodes[index].pflen);
+        uint32_t child = trie->nodes[index].children[bit];
+        uint32_t middle = 0;
+        ip_value mask;
+        ip_value addr;
+        int common = 0;
+
+        if( child == 0 )
+        {
+            child = group_trie_new_node(trie, prefix->addr, prefix->pflen, entry);
+            trie->nodes[index].children[bit] = child;
+            return (child != 0) ? RESULT_SUCCESS : RESULT_FAILURE;
+        }
+
+        common = ip_value_common_bits(trie->nodes[child].addr, prefix->addr, width);
+        if( common > prefix->pflen )
+        {
+            common = prefix->pflen;
+        }
+        if( common >= trie->nodes[child].pflen )
+        {
+            index = child;
+            continue;
+        }
+
+        /* The child and the entry part ways before the child ends: put a node where they do */
+        mask = ip_host_mask(prefix->proto, common);
+        addr.hi = prefix->addr.hi & ~mask.hi;
+        addr.lo = prefix->addr.lo & ~mask.lo;
+        middle = group_trie_new_node(trie, addr, common, COVERAGE_NONE);
+        if( middle == 0 )
+        {
+            return(RESULT_FAILURE);
+        }
+        trie->nodes[middle].children[ip_value_bit(trie->nodes[child].addr, width, common)] = child;
+        trie->nodes[index].children[bit] = middle;
+        index = middle;
+    }
+
+    if( trie->nodes[index].entry == COVERAGE_NONE )
+    {
+        trie->nodes[index].entry = entry;
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * The shortest entry other than the given one that covers its prefix.
+ * Among entries with the same prefix, the first one covers the others.
+ */
+static uint32_t group_trie_covering(const group_trie* trie, const ip_prefix* prefix, uint32_t entry)
+{
+    int width = ip_bits(prefix->proto);
+    uint32_t index = (prefix->proto == CIDR_IPV4) ? 0 : 1;
+
+    for( ;; )
+    {
+        const group_node* node = &trie->nodes[index];
+
+        if( (node->entry != COVERAGE_NONE) && (node->entry != entry) )
+        {
+            return node->entry;
+        }
+        if( node->pflen >= prefix->pflen )
+        {
+            return COVERAGE_NONE;
+        }
+
+        index = node->children[ip_value_bit(prefix->addr, width, node->pflen)];
+        if( (index == 0) || (trie->nodes[index].pflen > prefix->pflen) ||
+            (ip_value_common_bits(trie->nodes[index].addr, prefix->addr, width) < trie->nodes[index].pflen) )
+        {
+            return COVERAGE_NONE;
+        }
+    }
+}
+
+/*
+ * Groups
+ */
+
+/*
+ * Load the entries of a group, one address or network per line,
+ * anything after it is ignored. Returns NULL if the file has errors.
+ */
+group_entry* group_entries_load(const char* path, size_t* count)
+{
+    list_reader reader;
+    group_entry* entries = NULL;
+    size_t capacity = 0;
+    int errors = 0;
+    char* line = NULL;
+
+    *count = 0;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* entry_str = list_next_field(&line);
+        ip_prefix prefix;
+
+        if( list_reader_prefix(&reader, entry_str, &prefix) != RESULT_SUCCESS )
+        {
+            errors++;
+            continue;
+        }
+
+        if( *count == capacity )
+        {
+            group_entry* new_entries = NULL;
+            if( capacity >= COVERAGE_NONE / 2 )
+            {
+                fprintf(stderr, "Error: too many entries in %s!\n", path);
+                errors++;
+                break;
+            }
+            capacity = capacity ? capacity * 2 : 1024;
+            new_entries = realloc(entries, capacity * sizeof(group_entry));
+            if( new_entries == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+                errors++;
+                break;
+            }
+            entries = new_entries;
+        }
+
+        entries[*count].prefix = prefix;
+        entries[*count].covered_by = COVERAGE_NONE;
+        entries[*count].text = strdup(entry_str);
+        if( entries[*count].text == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+        (*count)++;
+    }
+
+    list_reader_close(&reader);
+
+    if( errors > 0 )
+    {
+        group_entries_free(entries, *count);
+        *count = 0;
+        return NULL;
+    }
+
+    /* An empty group is not an error */
+    if( entries == NULL )
+    {
+        entries = malloc(sizeof(group_entry));
+        if( entries == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+    }
+
+    return entries;
+}
+
+/*
+ * Find the entries covered by other entries: all of them go into a trie,
+ * then the path to each one shows the shortest entry that covers it.
+ * The covering entries are never redundant themselves, so dropping every
+ * redundant entry leaves a group with the same addresses.
+ */
+int find_redundant_entries(group_entry* entries, size_t count, size_t* redundant_count)
+{
+    group_trie trie;
+    size_t i = 0;
+
+    *redundant_count = 0;
+
+    if( group_trie_init(&trie) != RESULT_SUCCESS )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        if( group_trie_insert(&trie, &entries[i].prefix, (uint32_t)i) != RESULT_SUCCESS )
+        {
+            free(trie.nodes);
+            return(RESULT_FAILURE);
+        }
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        entries[i].covered_by = group_trie_covering(&trie, &entries[i].prefix, (uint32_t)i);
+        if( entries[i].covered_by != COVERAGE_NONE )
+        {
+            (*redundant_count)++;
+        }
+    }
+
+    free(trie.nodes);
+
+    return(RESULT_SUCCESS);
+}
+
+void group_entries_free(group_entry* entries, size_t count)
+{
+    size_t i = 0;
+
+    if( entries == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        free(entries[i].text);
+    }
+    free(entries);
+}
@@ -0,0 +1,42 @@
+/*
+ * ipaddrcheck_coverage.h: prefixes covered by other prefixes
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_COVERAGE_H
+#define IPADDRCHECK_COVERAGE_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* No entry */
+#define COVERAGE_NONE  UINT32_MAX
+
+/* An address or network of a group, such as a firewall address group */
+typedef struct
+{
+    ip_prefix prefix;
+    char* text;           /* the entry as it was written */
+    uint32_t covered_by;  /* the entry that covers it, COVERAGE_NONE if there is none */
+} group_entry;
+
+group_entry* group_entries_load(const char* path, size_t* count);
+int find_redundant_entries(group_entry* entries, size_t count, size_t* redundant_count);
+void group_entries_free(group_entry* entries, size_t count);
+
+#endif /* IPADDRCHECK_COVERAGE_H */
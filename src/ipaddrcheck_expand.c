@@ -0,0 +1,327 @@
+/*
+ * ipaddrcheck_expand.c: enumeration of the addresses and subnets of a block
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "ipaddrcheck_expand.h"
+
+/*
+ * Addresses are not formatted one by one. Consecutive addresses only differ
+ * in their last octet (or group) most of the time, so the text of the others
+ * is formatted once per block of 256 (or 65536) addresses, and every line
+ * is put together from two precomputed pieces with fixed-size copies.
+ */
+
+/* The text of the first three octets of an IPv4 address ("255.255.255.")
+   is kept in this many bytes and always copied as a whole */
+#define PREFIX_TEXT_SIZE 16
+
+/* Room needed for a block of IPv4 lines, including what the
+   fixed-size copies write past the end, and for any other line */
+#define IPV4_BLOCK_ROOM (256 * (PREFIX_TEXT_SIZE + 4))
+#define LINE_ROOM (PREFIX_STR_MAX + 1)
+
+/* Decimal octets followed by a newline, and their lengths */
+static char octet_text[256][4];
+static unsigned char octet_length[256];
+
+static void init_octet_text(void)
+{
+    int i = 0;
+
+    if( octet_length[255] != 0 )
+    {
+        return;
+    }
+    for( i = 0; i < 256; i++ )
+    {
+        char text[8];
+        int length = sprintf(text, "%d\n", i);
+        memcpy(octet_text[i], text, (size_t)length);
+        octet_length[i] = (unsigned char)length;
+    }
+}
+
+expand_writer* expand_writer_new(FILE* stream)
+{
+    expand_writer* writer = calloc(1, sizeof(expand_writer));
+
+    if( writer == NULL )
+    {
+        return NULL;
+    }
+    /* Some slack after the end for the fixed-size copies */
+    writer->buffer = malloc(EXPAND_BUFFER_SIZE + IPV4_BLOCK_ROOM);
+    if( writer->buffer == NULL )
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->stream = stream;
+    init_octet_text();
+
+    return writer;
+}
+
+int expand_writer_flush(expand_writer* writer)
+{
+    if( (writer->used > 0) && !writer->error )
+    {
+        if( fwrite(writer->buffer, 1, writer->used, writer->stream) != writer->used )
+        {
+            writer->error = 1;
+        }
+    }
+    writer->used = 0;
+    if( !writer->error && (fflush(writer->stream) != 0) )
+    {
+        writer->error = 1;
+    }
+
+    return writer->error ? RESULT_INT_ERROR : RESULT_SUCCESS;
+}
+
+/* Make sure there is room for the given number of bytes */
+static int expand_writer_reserve(expand_writer* writer, size_t size)
+{
+    if( writer->used + size > EXPAND_BUFFER_SIZE )
+    {
+        if( fwrite(writer->buffer, 1, writer->used, writer->stream) != writer->used )
+        {
+            writer->error = 1;
+        }
+        writer->used = 0;
+    }
+    return writer->error ? RESULT_INT_ERROR : RESULT_SUCCESS;
+}
+
+/* Lines of addresses first to last, all within the same /24 */
+static void expand_ipv4_block(expand_writer* writer, uint32_t first, uint32_t last)
+{
+    char prefix[PREFIX_TEXT_SIZE];
+    size_t prefix_length = 0;
+    char* out = writer->buffer + writer->used;
+    unsigned int octet = 0;
+
+    memset(prefix, 0, sizeof(prefix));
+    prefix_length = (size_t)sprintf(prefix, "%u.%u.%u.", (unsigned int)(first >> 24),
+                                    (unsigned int)((first >> 16) & 0xff), (unsigned int)((first >> 8) & 0xff));
+
+    for( octet = first & 0xff; octet <= (last & 0xff); octet++ )
+    {
+        memcpy(out, prefix, PREFIX_TEXT_SIZE);
+        out += prefix_length;
+        memcpy(out, octet_text[octet], 4);
+        out += octet_length[octet];
+    }
+
+    writer->used = (size_t)(out - writer->buffer);
+}
+
+static int expand_ipv4(expand_writer* writer, uint32_t first, uint32_t last)
+{
+    uint64_t address = first;
+
+    while( address <= last )
+    {
+        uint32_t block_last = (uint32_t)address | 0xff;
+
+        if( block_last > last )
+        {
+            block_last = last;
+        }
+        if( expand_writer_reserve(writer, IPV4_BLOCK_ROOM) != RESULT_SUCCESS )
+        {
+            return RESULT_INT_ERROR;
+        }
+        expand_ipv4_block(writer, (uint32_t)address, block_last);
+        address = (uint64_t)block_last + 1;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static void write_address(expand_writer* writer, int proto, ip_value address)
+{
+    char* out = writer->buffer + writer->used;
+
+    ip_addr_to_str(proto, address, out);
+    out += strlen(out);
+    *out++ = '\n';
+    writer->used = (size_t)(out - writer->buffer);
+}
+
+/*
+ * Lines of addresses first to last, all within the same /112.
+ * As long as the last group is not zero, it can't be part of the run of zero
+ * groups shortened to "::", so the text of the other seven stays the same.
+ * Addresses written with an embedded IPv4 address are formatted in full.
+ */
+static int expand_ipv6_block(expand_writer* writer, ip_value first, ip_value last)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    char prefix[PREFIX_STR_MAX];
+    size_t prefix_length = 0;
+    unsigned int group = (unsigned int)(first.lo & 0xffff);
+    unsigned int last_group = (unsigned int)(last.lo & 0xffff);
+    uint64_t upper_words = first.lo >> 32;
+    int embedded_ipv4 = (first.hi == 0) && ((upper_words == 0) || (upper_words == 0xffff));
+    ip_value address = first;
+
+    address.lo = (first.lo & ~(uint64_t)0xffff) | 1;
+    ip_addr_to_str(CIDR_IPV6, address, prefix);
+    prefix_length = strlen(prefix) - 1;
+
+    for( ; group <= last_group; group++ )
+    {
+        char* out = NULL;
+
+        if( expand_writer_reserve(writer, LINE_ROOM) != RESULT_SUCCESS )
+        {
+            return RESULT_INT_ERROR;
+        }
+        if( (group == 0) || embedded_ipv4 )
+        {
+            address.lo = (first.lo & ~(uint64_t)0xffff) | group;
+            write_address(writer, CIDR_IPV6, address);
+            continue;
+        }
+
+        out = writer->buffer + writer->used;
+        memcpy(out, prefix, prefix_length);
+        out += prefix_length;
+        if( group >= 0x1000 )
+        {
+            *out++ = hex_digits[group >> 12];
+        }
+        if( group >= 0x100 )
+        {
+            *out++ = hex_digits[(group >> 8) & 0xf];
+        }
+        if( group >= 0x10 )
+        {
+            *out++ = hex_digits[(group >> 4) & 0xf];
+        }
+        *out++ = hex_digits[group & 0xf];
+        *out++ = '\n';
+        writer->used = (size_t)(out - writer->buffer);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static int expand_ipv6(expand_writer* writer, ip_value first, ip_value last)
+{
+    ip_value address = first;
+
+    for( ;; )
+    {
+        ip_value block_last = address;
+
+        block_last.lo |= 0xffff;
+        if( ip_value_cmp(block_last, last) > 0 )
+        {
+            block_last = last;
+        }
+        if( expand_ipv6_block(writer, address, block_last) != RESULT_SUCCESS )
+        {
+            return RESULT_INT_ERROR;
+        }
+        if( ip_value_eq(block_last, last) )
+        {
+            break;
+        }
+        address = ip_value_next(block_last);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/* Write every address from first to last, one per line */
+int expand_addresses(expand_writer* writer, int proto, ip_value first, ip_value last)
+{
+    if( proto == CIDR_IPV4 )
+    {
+        return expand_ipv4(writer, (uint32_t)first.lo, (uint32_t)last.lo);
+    }
+    return expand_ipv6(writer, first, last);
+}
+
+/*
+ * Write every whole prefix of the given length from first to last, one per line.
+ * Fails without writing anything if not even one of them fits.
+ */
+int expand_prefixes(expand_writer* writer, int proto, ip_value first, ip_value last, int pflen)
+{
+    ip_value host_mask = ip_host_mask(proto, pflen);
+    ip_prefix prefix;
+
+    prefix.proto = proto;
+    prefix.pflen = pflen;
+    prefix.addr = first;
+
+    /* Start at the first prefix boundary */
+    if( ((first.hi & host_mask.hi) != 0) || ((first.lo & host_mask.lo) != 0) )
+    {
+        prefix.addr = ip_value_next(ip_prefix_last(&prefix));
+        if( (prefix.addr.hi == 0) && (prefix.addr.lo == 0) )
+        {
+            return RESULT_FAILURE;
+        }
+    }
+    if( ip_value_cmp(ip_prefix_last(&prefix), last) > 0 )
+    {
+        return RESULT_FAILURE;
+    }
+
+    while( ip_value_cmp(ip_prefix_last(&prefix), last) <= 0 )
+    {
+        ip_value prefix_last = ip_prefix_last(&prefix);
+        char* out = NULL;
+
+        if( expand_writer_reserve(writer, LINE_ROOM) != RESULT_SUCCESS )
+        {
+            return RESULT_INT_ERROR;
+        }
+        out = writer->buffer + writer->used;
+        ip_prefix_to_str(&prefix, out);
+        out += strlen(out);
+        *out++ = '\n';
+        writer->used = (size_t)(out - writer->buffer);
+
+        /* Stop here rather than wrap around at the end of the address space */
+        if( ip_value_eq(prefix_last, last) )
+        {
+            break;
+        }
+        prefix.addr = ip_value_next(prefix_last);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+void expand_writer_free(expand_writer* writer)
+{
+    if( writer == NULL )
+    {
+        return;
+    }
+    free(writer->buffer);
+    free(writer);
+}
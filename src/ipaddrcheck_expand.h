@@ -0,0 +1,45 @@
+/*
+ * ipaddrcheck_expand.h: enumeration of the addresses and subnets of a block
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_EXPAND_H
+#define IPADDRCHECK_EXPAND_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* Size of the output buffer, a write is issued whenever it fills up */
+#define EXPAND_BUFFER_SIZE (1 << 20)
+
+/* Buffered line output for address lists that can run into billions of lines */
+typedef struct
+{
+    FILE* stream;
+    char* buffer;
+    size_t used;
+    int error;      /* a write has failed, e.g. the reader went away */
+} expand_writer;
+
+expand_writer* expand_writer_new(FILE* stream);
+int expand_addresses(expand_writer* writer, int proto, ip_value first, ip_value last);
+int expand_prefixes(expand_writer* writer, int proto, ip_value first, ip_value last, int pflen);
+int expand_writer_flush(expand_writer* writer);
+void expand_writer_free(expand_writer* writer);
+
+#endif /* IPADDRCHECK_EXPAND_H */
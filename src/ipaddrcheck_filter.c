@@ -0,0 +1,483 @@
+/*
+ * ipaddrcheck_filter.c: approximate membership filters for large lists
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <inttypes.h>
+#include <math.h>
+
+#include "ipaddrcheck_filter.h"
+
+/* Segments longer than this do not make construction any more likely to succeed */
+#define FUSE_MAX_SEGMENT_LENGTH 262144
+
+/* Construction fails with a small probability, then a new seed is tried */
+#define FUSE_MAX_ATTEMPTS 100
+
+/* The finalizer of MurmurHash3 */
+static inline uint64_t mix64(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+/* High 64 bits of the product of a 64-bit and a 32-bit number */
+static inline uint64_t mul_high(uint64_t value, uint32_t factor)
+{
+    return ((value >> 32) * factor + (((value & 0xffffffffULL) * factor) >> 32)) >> 32;
+}
+
+uint64_t filter_key_address(int proto, ip_value address)
+{
+    return mix64(address.lo ^ mix64(address.hi ^ (uint64_t)proto));
+}
+
+/* The address must be the first one of the prefix */
+uint64_t filter_key_prefix(int proto, ip_value address, int pflen)
+{
+    return mix64(filter_key_address(proto, address) ^ (uint64_t)pflen);
+}
+
+/*
+ * Fingerprint width for a false positive rate given as a string,
+ * the smallest one with 2^-bits not above it, or -1 if it is not a number
+ * between 0 and 1
+ */
+int filter_bits_for_rate(const char* rate_str)
+{
+    char* end = NULL;
+    double rate = strtod(rate_str, &end);
+    double bound = 0.5;
+    int bits = FILTER_MIN_BITS;
+
+    if( (end == rate_str) || (*end != '\0') || !(rate > 0.0) || !(rate < 1.0) )
+    {
+        return -1;
+    }
+
+    while( (bound > rate) && (bits < FILTER_MAX_BITS) )
+    {
+        bound /= 2;
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * Fingerprints
+ */
+
+static inline uint32_t fingerprint_of(const fuse_filter_params* params, uint64_t hash)
+{
+    uint64_t fingerprint = hash ^ (hash >> 32);
+    return (uint32_t)(fingerprint & (((uint64_t)1 << params->fingerprint_bits) - 1));
+}
+
+static inline uint32_t fingerprint_get(const fuse_filter_params* params, const uint64_t* words, uint32_t slot)
+{
+    uint64_t position = (uint64_t)slot * params->fingerprint_bits;
+    uint64_t index = position >> 6;
+    int shift = (int)(position & 63);
+    uint64_t value = words[index] >> shift;
+
+    if( shift + (int)params->fingerprint_bits > 64 )
+    {
+        value |= words[index + 1] << (64 - shift);
+    }
+    return (uint32_t)(value & (((uint64_t)1 << params->fingerprint_bits) - 1));
+}
+
+/* The slot must still be zero */
+static void fingerprint_set(const fuse_filter_params* params, uint64_t* words, uint32_t slot, uint32_t value)
+{
+    uint64_t position = (uint64_t)slot * params->fingerprint_bits;
+    uint64_t index = position >> 6;
+    int shift = (int)(position & 63);
+
+    words[index] |= (uint64_t)value << shift;
+    if( shift + (int)params->fingerprint_bits > 64 )
+    {
+        words[index + 1] |= (uint64_t)value >> (64 - shift);
+    }
+}
+
+/* The three slots of a hash, one in each of three consecutive segments */
+static inline void fuse_positions(const fuse_filter_params* params, uint64_t hash, uint32_t positions[3])
+{
+    positions[0] = (uint32_t)mul_high(hash, params->segment_count_length);
+    positions[1] = positions[0] + params->segment_length;
+    positions[2] = positions[1] + params->segment_length;
+    positions[1] ^= (uint32_t)(hash >> 18) & params->segment_length_mask;
+    positions[2] ^= (uint32_t)hash & params->segment_length_mask;
+}
+
+size_t fuse_filter_word_count(const fuse_filter_params* params)
+{
+    return (size_t)(((uint64_t)params->array_length * params->fingerprint_bits + 63) / 64);
+}
+
+/*
+ * Construction
+ */
+
+static int u64_cmp(const void* left, const void* right)
+{
+    uint64_t l = *(const uint64_t*)left;
+    uint64_t r = *(const uint64_t*)right;
+
+    return (l > r) - (l < r);
+}
+
+/* Array dimensions for a number of keys, as recommended for 3-wise binary fuse filters */
+static void fuse_filter_size(fuse_filter_params* params, uint32_t count)
+{
+    uint32_t capacity = 0;
+    uint32_t segment_count = 0;
+
+    params->segment_length = (count == 0) ? 4 : (uint32_t)1 << (int)floor(log((double)count) / log(3.33) + 2.25);
+    if( params->segment_length > FUSE_MAX_SEGMENT_LENGTH )
+    {
+        params->segment_length = FUSE_MAX_SEGMENT_LENGTH;
+    }
+    params->segment_length_mask = params->segment_length - 1;
+
+    if( count > 1 )
+    {
+        double size_factor = 0.875 + 0.25 * log(1000000.0) / log((double)count);
+        if( size_factor < 1.125 )
+        {
+            size_factor = 1.125;
+        }
+        capacity = (uint32_t)round((double)count * size_factor);
+    }
+
+    segment_count = (capacity + params->segment_length - 1) / params->segment_length;
+    segment_count = (segment_count > 2) ? segment_count - 2 : 1;
+    params->segment_count_length = segment_count * params->segment_length;
+    params->array_length = (segment_count + 2) * params->segment_length;
+}
+
+/* Scratch space of the construction */
+typedef struct
+{
+    uint64_t* reverse_order;  /* hashes in peeling order */
+    uint8_t* reverse_slot;    /* and the slot they were peeled from */
+    uint32_t* alone;          /* cells with a single key */
+    uint8_t* t2count;
+    uint64_t* t2hash;
+} fuse_builder;
+
+/*
+ * Try to peel all keys off with the current seed: repeatedly remove a key
+ * that is alone in one of its cells. Returns the number of keys removed.
+ */
+static size_t fuse_builder_peel(fuse_builder* builder, const fuse_filter_params* params,
+                                const uint64_t* keys, size_t count)
+{
+    uint8_t* t2count = builder->t2count;
+    uint64_t* t2hash = builder->t2hash;
+    size_t queue_size = 0;
+    size_t stack_size = 0;
+    size_t i = 0;
+    int overflow = 0;
+
+    memset(t2count, 0, params->array_length);
+    memset(t2hash, 0, params->array_length * sizeof(uint64_t));
+
+    /* Every cell keeps the number of its keys times four, the xor of
+       their slot numbers (0-2) in the low bits, and the xor of their hashes */
+    for( i = 0; i < count; i++ )
+    {
+        uint64_t hash = mix64(keys[i] + params->seed);
+        uint32_t positions[3];
+        int slot = 0;
+
+        fuse_positions(params, hash, positions);
+        for( slot = 0; slot < 3; slot++ )
+        {
+            t2count[positions[slot]] += 4;
+            t2count[positions[slot]] ^= (uint8_t)slot;
+            t2hash[positions[slot]] ^= hash;
+            overflow |= (t2count[positions[slot]] < 4);
+        }
+    }
+    if( overflow )
+    {
+        return 0;
+    }
+
+    for( i = 0; i < params->array_length; i++ )
+    {
+        builder->alone[queue_size] = (uint32_t)i;
+        queue_size += ((t2count[i] >> 2) == 1);
+    }
+
+    while( queue_size > 0 )
+    {
+        uint32_t index = builder->alone[--queue_size];
+
+        if( (t2count[index] >> 2) == 1 )
+        {
+            uint64_t hash = t2hash[index];
+            int found = t2count[index] & 3;
+            uint32_t positions[3];
+            int k = 0;
+
+            builder->reverse_slot[stack_size] = (uint8_t)found;
+            builder->reverse_order[stack_size] = hash;
+            stack_size++;
+
+            fuse_positions(params, hash, positions);
+            for( k = 1; k <= 2; k++ )
+            {
+                int slot = (found + k) % 3;
+                uint32_t other = positions[slot];
+
+                builder->alone[queue_size] = other;
+                queue_size += ((t2count[other] >> 2) == 2);
+                t2count[other] -= 4;
+                t2count[other] ^= (uint8_t)slot;
+                t2hash[other] ^= hash;
+            }
+        }
+    }
+
+    return stack_size;
+}
+
+/*
+ * Build a filter from a set of keys. The keys are sorted and deduplicated
+ * in place. The seed only depends on the attempt number, so the same keys
+ * always give the same filter.
+ */
+int fuse_filter_build(fuse_filter* filter, uint64_t* keys, size_t count, int fingerprint_bits)
+{
+    fuse_filter_params* params = &filter->params;
+    fuse_builder builder;
+    size_t unique = 0;
+    size_t i = 0;
+    int attempt = 0;
+    int result = RESULT_INT_ERROR;
+
+    memset(filter, 0, sizeof(fuse_filter));
+    if( (fingerprint_bits < FILTER_MIN_BITS) || (fingerprint_bits > FILTER_MAX_BITS) || (count > UINT32_MAX / 2) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    if( count > 0 )
+    {
+        qsort(keys, count, sizeof(uint64_t), u64_cmp);
+        for( i = 1; i < count; i++ )
+        {
+            if( keys[i] != keys[unique] )
+            {
+                keys[++unique] = keys[i];
+            }
+        }
+        count = unique + 1;
+    }
+
+    params->fingerprint_bits = (uint32_t)fingerprint_bits;
+    fuse_filter_size(params, (uint32_t)count);
+
+    filter->owned_words = calloc(fuse_filter_word_count(params) + 1, sizeof(uint64_t));
+    builder.reverse_order = malloc((count + 1) * sizeof(uint64_t));
+    builder.reverse_slot = malloc(count + 1);
+    builder.alone = malloc(params->array_length * sizeof(uint32_t));
+    builder.t2count = malloc(params->array_length);
+    builder.t2hash = malloc(params->array_length * sizeof(uint64_t));
+
+    if( (filter->owned_words != NULL) && (builder.reverse_order != NULL) && (builder.reverse_slot != NULL) &&
+        (builder.alone != NULL) && (builder.t2count != NULL) && (builder.t2hash != NULL) )
+    {
+        for( attempt = 0; attempt < FUSE_MAX_ATTEMPTS; attempt++ )
+        {
+            params->seed = mix64((uint64_t)attempt + 0x9e3779b97f4a7c15ULL);
+            if( fuse_builder_peel(&builder, params, keys, count) == count )
+            {
+                break;
+            }
+        }
+        result = (attempt < FUSE_MAX_ATTEMPTS) ? RESULT_SUCCESS : RESULT_FAILURE;
+    }
+
+    /* Assign the fingerprints in the reverse peeling order, so that the slot
+       a key was peeled from is set last and makes its three slots match */
+    for( i = count; (result == RESULT_SUCCESS) && (i > 0); i-- )
+    {
+        uint64_t hash = builder.reverse_order[i - 1];
+        int found = builder.reverse_slot[i - 1];
+        uint32_t positions[3];
+        uint32_t fingerprint = 0;
+
+        fuse_positions(params, hash, positions);
+        fingerprint = fingerprint_of(params, hash) ^
+                      fingerprint_get(params, filter->owned_words, positions[(found + 1) % 3]) ^
+                      fingerprint_get(params, filter->owned_words, positions[(found + 2) % 3]);
+        fingerprint_set(params, filter->owned_words, positions[found], fingerprint);
+    }
+
+    free(builder.reverse_order);
+    free(builder.reverse_slot);
+    free(builder.alone);
+    free(builder.t2count);
+    free(builder.t2hash);
+
+    if( result == RESULT_SUCCESS )
+    {
+        filter->words = filter->owned_words;
+    }
+    else
+    {
+        fuse_filter_free(filter);
+    }
+
+    return(result);
+}
+
+/* Use a filter stored elsewhere: its parameters followed by its fingerprints */
+int fuse_filter_attach(fuse_filter* filter, const void* data, size_t size)
+{
+    const fuse_filter_params* params = data;
+
+    memset(filter, 0, sizeof(fuse_filter));
+    if( (size < sizeof(fuse_filter_params)) ||
+        (params->fingerprint_bits < FILTER_MIN_BITS) || (params->fingerprint_bits > FILTER_MAX_BITS) ||
+        (params->segment_length == 0) || (params->segment_length > FUSE_MAX_SEGMENT_LENGTH) ||
+        ((params->segment_length & params->segment_length_mask) != 0) ||
+        (params->segment_length_mask != params->segment_length - 1) ||
+        (params->segment_count_length % params->segment_length != 0) ||
+        ((uint64_t)params->segment_count_length + 2 * (uint64_t)params->segment_length > params->array_length) ||
+        ((size - sizeof(fuse_filter_params)) / sizeof(uint64_t) < fuse_filter_word_count(params)) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    filter->params = *params;
+    filter->words = (const uint64_t*)(params + 1);
+
+    return(RESULT_SUCCESS);
+}
+
+int fuse_filter_contains(const fuse_filter* filter, uint64_t key)
+{
+    const fuse_filter_params* params = &filter->params;
+    uint64_t hash = mix64(key + params->seed);
+    uint32_t positions[3];
+
+    fuse_positions(params, hash, positions);
+    if( fingerprint_of(params, hash) == (fingerprint_get(params, filter->words, positions[0]) ^
+                                          fingerprint_get(params, filter->words, positions[1]) ^
+                                          fingerprint_get(params, filter->words, positions[2])) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Fetch the slots of a key into the cache ahead of fuse_filter_contains */
+void fuse_filter_prefetch(const fuse_filter* filter, uint64_t key)
+{
+    const fuse_filter_params* params = &filter->params;
+    uint32_t positions[3];
+    int i = 0;
+
+    fuse_positions(params, mix64(key + params->seed), positions);
+    for( i = 0; i < 3; i++ )
+    {
+        __builtin_prefetch(&filter->words[((uint64_t)positions[i] * params->fingerprint_bits) >> 6]);
+    }
+}
+
+void fuse_filter_free(fuse_filter* filter)
+{
+    free(filter->owned_words);
+    filter->owned_words = NULL;
+    filter->words = NULL;
+}
+
+/*
+ * Statistics
+ */
+
+/* Without a filter, filter_passed is ignored and the lookups that fail are plain misses */
+void filter_stats_count(filter_stats* stats, int filtered, int filter_passed, int found)
+{
+    if( stats == NULL )
+    {
+        return;
+    }
+
+    stats->lookups++;
+    if( !filtered )
+    {
+        if( found )
+        {
+            stats->hits++;
+        }
+        else
+        {
+            stats->misses++;
+        }
+        return;
+    }
+
+    stats->filtered = 1;
+    if( !filter_passed )
+    {
+        stats->rejected++;
+    }
+    else if( found )
+    {
+        stats->hits++;
+    }
+    else
+    {
+        stats->false_positives++;
+    }
+}
+
+void filter_stats_print(const filter_stats* stats, FILE* stream)
+{
+    uint64_t passed = stats->lookups - stats->rejected;
+
+    fprintf(stream, "Lookups:           %" PRIu64 "\n", stats->lookups);
+    if( !stats->filtered )
+    {
+        fprintf(stream, "Hits:              %" PRIu64 "\n", stats->hits);
+        fprintf(stream, "Misses:            %" PRIu64 "\n", stats->misses);
+        return;
+    }
+    fprintf(stream, "Filter rejections: %" PRIu64 "\n", stats->rejected);
+    fprintf(stream, "Hits:              %" PRIu64 "\n", stats->hits);
+    fprintf(stream, "False positives:   %" PRIu64, stats->false_positives);
+    if( passed > 0 )
+    {
+        fprintf(stream, " (%.4f%% of filter passes)", 100.0 * stats->false_positives / passed);
+    }
+    fprintf(stream, "\n");
+}
@@ -0,0 +1,83 @@
+/*
+ * ipaddrcheck_filter.h: approximate membership filters for large lists
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_FILTER_H
+#define IPADDRCHECK_FILTER_H
+
+#include "ipaddrcheck_prefix.h"
+
+#define FILTER_MIN_BITS 1
+#define FILTER_MAX_BITS 32
+
+/*
+ * A binary fuse filter (Graf and Lemire, 2022): every key maps to three
+ * fingerprint slots in three consecutive segments of the array, and
+ * the filter is built so that the three slots of every key xor to the
+ * fingerprint of the key. Any other key matches with a probability
+ * of 2^-fingerprint_bits, and the array is about 1.125 slots per key.
+ *
+ * The parameters are stored as they are in compiled files,
+ * the packed fingerprints follow them.
+ */
+typedef struct
+{
+    uint64_t seed;
+    uint32_t segment_length;
+    uint32_t segment_length_mask;
+    uint32_t segment_count_length;
+    uint32_t array_length;
+    uint32_t fingerprint_bits;
+    uint32_t reserved;
+} fuse_filter_params;
+
+typedef struct
+{
+    fuse_filter_params params;
+    const uint64_t* words;
+    uint64_t* owned_words;    /* words allocated by the build, if any */
+} fuse_filter;
+
+/* Lookup counters of a filtered structure */
+typedef struct
+{
+    int filtered;             /* the lookups went through a filter */
+    uint64_t lookups;
+    uint64_t rejected;        /* ruled out by the filter alone */
+    uint64_t hits;
+    uint64_t false_positives; /* passed the filter, missing from the set */
+    uint64_t misses;          /* missing from a set without a filter */
+} filter_stats;
+
+uint64_t filter_key_address(int proto, ip_value address);
+uint64_t filter_key_prefix(int proto, ip_value address, int pflen);
+int filter_bits_for_rate(const char* rate_str);
+
+int fuse_filter_build(fuse_filter* filter, uint64_t* keys, size_t count, int fingerprint_bits);
+int fuse_filter_attach(fuse_filter* filter, const void* data, size_t size);
+int fuse_filter_contains(const fuse_filter* filter, uint64_t key);
+void fuse_filter_prefetch(const fuse_filter* filter, uint64_t key);
+size_t fuse_filter_word_count(const fuse_filter_params* params);
+void fuse_filter_free(fuse_filter* filter);
+
+void filter_stats_count(filter_stats* stats, int filtered, int filter_passed, int found);
+void filter_stats_print(const filter_stats* stats, FILE* stream);
+
+#endif /* IPADDRCHECK_FILTER_H */
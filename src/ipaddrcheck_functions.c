@@ -22,8 +22,11 @@
 
 #include <netinet/in.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "ipaddrcheck_functions.h"
+#include "ipaddrcheck_prefix.h"
+#include "ipaddrcheck_classify.h"
 
 /*
  * Address string functions
@@ -39,16 +42,86 @@
  * the format was.
  */
 
+/* Compiled patterns are kept for the lifetime of the process:
+ * there is only a handful of them, and list files and batch input
+ * run the same checks over and over.
+ *
+ * Lookups don't lock, since a table reload may run the checks in another
+ * thread at the same time. An entry's pattern pointer is published
+ * only after its compiled form, and new entries are added under a lock.
+ */
+#define REGEX_CACHE_SIZE 16
+
+static struct
+{
+    const char* regex;
+    pcre* re;
+} regex_cache[REGEX_CACHE_SIZE];
+
+static pthread_mutex_t regex_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pcre* find_regex(const char* regex, int* free_slot)
+{
+    const char* cached = NULL;
+    int i = 0;
+
+    for( i = 0; i < REGEX_CACHE_SIZE; i++ )
+    {
+        cached = __atomic_load_n(&regex_cache[i].regex, __ATOMIC_ACQUIRE);
+        if( cached == NULL )
+        {
+            break;
+        }
+        if( (cached == regex) || (strcmp(cached, regex) == 0) )
+        {
+            return regex_cache[i].re;
+        }
+    }
+
+    *free_slot = i;
+    return NULL;
+}
+
+static pcre* compile_regex(const char* regex)
+{
+    pcre *re;
+    const char *error;
+    int erroffset;
+    int i = 0;
+
+    re = find_regex(regex, &i);
+    if( re != NULL )
+    {
+        return re;
+    }
+
+    pthread_mutex_lock(&regex_cache_lock);
+
+    /* Another thread may have added it in the meantime */
+    re = find_regex(regex, &i);
+    if( re == NULL )
+    {
+        re = pcre_compile(regex, 0, &error, &erroffset, NULL);
+        assert(re != NULL);
+
+        /* All patterns are string constants, so keeping the pointer is safe */
+        assert(i < REGEX_CACHE_SIZE);
+        regex_cache[i].re = re;
+        __atomic_store_n(&regex_cache[i].regex, regex, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&regex_cache_lock);
+
+    return re;
+}
+
 int regex_matches(const char* regex, const char* str)
 {
     int offsets[1];
     pcre *re;
     int rc;
-    const char *error;
-    int erroffset;
 
-    re = pcre_compile(regex, 0, &error, &erroffset, NULL);
-    assert(re != NULL);
+    re = compile_regex(regex);
 
     rc = pcre_exec(re, NULL, str, strlen(str), 0, 0, offsets, 1);
 
@@ -170,13 +243,33 @@ int is_ipv4(CIDR *address)
      return(result);
 }
 
+/* Compare an address with its network or broadcast address,
+   which libcidr hands out as a fresh copy */
+static int ip_equals_network(CIDR* address)
+{
+    CIDR* network = cidr_addr_network(address);
+    int result = cidr_equals(address, network);
+
+    cidr_free(network);
+    return(result);
+}
+
+static int ip_equals_broadcast(CIDR* address)
+{
+    CIDR* broadcast = cidr_addr_broadcast(address);
+    int result = cidr_equals(address, broadcast);
+
+    cidr_free(broadcast);
+    return(result);
+}
+
 /* Is it a correct IPv4 host address (i.e., not a network address)? */
 int is_ipv4_host(CIDR *address)
 {
     int result;
 
     if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        ((cidr_equals(address, cidr_addr_network(address)) < 0) ||
+        ((ip_equals_network(address) < 0) ||
         (cidr_get_pflen(address) >= 31)) )
     {
          result = RESULT_SUCCESS;
@@ -195,7 +288,7 @@ int is_ipv4_net(CIDR *address)
     int result;
 
     if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        (cidr_equals(address, cidr_addr_network(address)) == 0) )
+        (ip_equals_network(address) == 0) )
     {
          result = RESULT_SUCCESS;
     }
@@ -215,7 +308,7 @@ int is_ipv4_broadcast(CIDR *address)
     /* The very concept of broadcast address doesn't apply to
        IPv6 and point-to-point (/31) or isolated (/32) IPv4 addresses. */
     if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        (cidr_equals(address, cidr_addr_broadcast(address)) == 0 ) &&
+        (ip_equals_broadcast(address) == 0 ) &&
         (cidr_get_pflen(address) < 31) )
     {
         result = RESULT_SUCCESS;
@@ -228,13 +321,28 @@ int is_ipv4_broadcast(CIDR *address)
     return(result);
 }
 
+/*
+ * Does the address, or the whole prefix, belong to a class?
+ * The class prefixes are looked up in a table rather than parsed
+ * and compared one by one.
+ */
+static int ip_in_class(CIDR* address, int proto, unsigned int address_class)
+{
+    ip_prefix prefix;
+
+    if( (cidr_get_proto(address) != proto) || (ip_prefix_from_cidr(address, &prefix) != RESULT_SUCCESS) )
+    {
+        return 0;
+    }
+    return (ip_prefix_classes(&prefix) & address_class) != 0;
+}
+
 /* Is it an IPv4 multicast address? */
 int is_ipv4_multicast(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        (cidr_contains(cidr_from_str(IPV4_MULTICAST), address) == 0) )
+    if( ip_in_class(address, CIDR_IPV4, ADDRESS_CLASS_MULTICAST) )
     {
         result = RESULT_SUCCESS;
     }
@@ -251,8 +359,7 @@ int is_ipv4_loopback(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        (cidr_contains(cidr_from_str(IPV4_LOOPBACK), address) == 0) )
+    if( ip_in_class(address, CIDR_IPV4, ADDRESS_CLASS_LOOPBACK) )
     {
         result = RESULT_SUCCESS;
     }
@@ -269,8 +376,7 @@ int is_ipv4_link_local(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        (cidr_contains(cidr_from_str(IPV4_LINKLOCAL), address) == 0) )
+    if( ip_in_class(address, CIDR_IPV4, ADDRESS_CLASS_LINK_LOCAL) )
     {
         result = RESULT_SUCCESS;
     }
@@ -287,10 +393,7 @@ int is_ipv4_rfc1918(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV4) &&
-        ( (cidr_contains(cidr_from_str(IPV4_RFC1918_A), address) == 0) ||
-        (cidr_contains(cidr_from_str(IPV4_RFC1918_B), address) == 0) ||
-        (cidr_contains(cidr_from_str(IPV4_RFC1918_C), address) == 0) ) )
+    if( ip_in_class(address, CIDR_IPV4, ADDRESS_CLASS_RFC1918) )
     {
         result = RESULT_SUCCESS;
     }
@@ -340,7 +443,7 @@ int is_ipv6_host(CIDR *address)
       */
 
     if( (cidr_get_proto(address) == CIDR_IPV6) &&
-        ((cidr_equals(address, cidr_addr_network(address)) < 0) ||
+        ((ip_equals_network(address) < 0) ||
         (cidr_get_pflen(address) >= 127)) )
     {
          result = RESULT_SUCCESS;
@@ -359,7 +462,7 @@ int is_ipv6_net(CIDR *address)
     int result;
 
     if( (cidr_get_proto(address) == CIDR_IPV6) &&
-        (cidr_equals(address, cidr_addr_network(address)) == 0) )
+        (ip_equals_network(address) == 0) )
     {
          result = RESULT_SUCCESS;
     }
@@ -376,8 +479,7 @@ int is_ipv6_multicast(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV6) &&
-        (cidr_contains(cidr_from_str(IPV6_MULTICAST), address) == 0) )
+    if( ip_in_class(address, CIDR_IPV6, ADDRESS_CLASS_MULTICAST) )
     {
         result = RESULT_SUCCESS;
     }
@@ -394,8 +496,7 @@ int is_ipv6_link_local(CIDR *address)
 {
     int result;
 
-    if( (cidr_get_proto(address) == CIDR_IPV6) &&
-        (cidr_contains(cidr_from_str(IPV6_LINKLOCAL), address) == 0) )
+    if( ip_in_class(address, CIDR_IPV6, ADDRESS_CLASS_LINK_LOCAL) )
     {
         result = RESULT_SUCCESS;
     }
@@ -413,15 +514,19 @@ int is_ipv6_link_local(CIDR *address)
 int is_valid_intf_address(CIDR *address, char* address_str, int allow_loopback)
 {
     int result;
+    CIDR* ipv6_loopback = cidr_from_str(IPV6_LOOPBACK);
+    CIDR* ipv4_unspecified = cidr_from_str(IPV4_UNSPECIFIED);
+    CIDR* ipv4_this = cidr_from_str(IPV4_THIS);
+    CIDR* ipv4_limited_broadcast = cidr_from_str(IPV4_LIMITED_BROADCAST);
 
     if( (is_ipv4_broadcast(address) == RESULT_FAILURE) &&
         (is_ipv4_multicast(address) == RESULT_FAILURE) &&
         (is_ipv6_multicast(address) == RESULT_FAILURE) &&
         ((is_ipv4_loopback(address) == RESULT_FAILURE) || (allow_loopback == LOOPBACK_ALLOWED)) &&
-        (cidr_equals(address, cidr_from_str(IPV6_LOOPBACK)) != 0) &&
-        (cidr_equals(address, cidr_from_str(IPV4_UNSPECIFIED)) != 0) &&
-        (cidr_contains(cidr_from_str(IPV4_THIS), address) != 0) &&
-        (cidr_equals(address, cidr_from_str(IPV4_LIMITED_BROADCAST)) != 0) &&
+        (cidr_equals(address, ipv6_loopback) != 0) &&
+        (cidr_equals(address, ipv4_unspecified) != 0) &&
+        (cidr_contains(ipv4_this, address) != 0) &&
+        (cidr_equals(address, ipv4_limited_broadcast) != 0) &&
         (is_any_host(address) == RESULT_SUCCESS) &&
         (is_any_cidr(address_str) == RESULT_SUCCESS) )
     {
@@ -432,6 +537,11 @@ int is_valid_intf_address(CIDR *address, char* address_str, int allow_loopback)
         result = RESULT_FAILURE;
     }
 
+    cidr_free(ipv6_loopback);
+    cidr_free(ipv4_unspecified);
+    cidr_free(ipv4_this);
+    cidr_free(ipv4_limited_broadcast);
+
     return(result);
 }
 
@@ -471,249 +581,67 @@ int is_any_net(CIDR *address)
     return(result);
 }
 
-/* Split a hyphen-separated range into its left and right components.
- * This function is patently unsafe,
- * whether it's safe to do what it does should be determined by its callers.
- */
-void split_range(char* range_str, char* left, char* right)
-{
-    char* ptr = left;
-    int length = strlen(range_str);
-    int pos = 0;
-    int index = 0;
-    while(pos < length)
-    {
-        if( range_str[pos] == '-' )
-        {
-            ptr[index] = '\0';
-            ptr = right;
-            index = 0;
-        }
-        else
-        {
-            ptr[index] = range_str[pos];
-            index++;
-        }
-
-        pos++;
-    }
-    ptr[index] = '\0';
-
-    return;
-}
-
-/* in6_addr fields are byte arrays, so we cannot compare them as numbers
- * and needs custom comparison logic
+/*
+ * Check a range of the given protocol.
+ * The range is parsed into native integers in a single pass,
+ * so that it is cheap enough to run over millions of ranges.
  */
-int compare_ipv6(struct in6_addr *left, struct in6_addr *right)
-{
-    int i = 0;
-    for( i = 0; i < 16; i++ )
-    {
-        if (left->s6_addr[i] < right->s6_addr[i])
-            return -1;
-        else if (left->s6_addr[i] > right->s6_addr[i])
-            return 1;
-    }
-    return 0;
-}
-
-/* Is it a valid IPv4 address range? */
-int is_ipv4_range(char* range_str, int prefix_length, int verbose)
+static int is_ip_range(char* range_str, int proto, int prefix_length, int verbose)
 {
-    int result = RESULT_SUCCESS;
-
-    int regex_check_res = regex_matches("^([0-9\\.]+\\-[0-9\\.]+)$", range_str);
+    const char* family = (proto == CIDR_IPV4) ? "IPv4" : "IPv6";
+    ip_range range;
+    int result = RESULT_FAILURE;
 
-    if( !regex_check_res )
-    {
-        if( verbose )
-        {
-            fprintf(stderr, "Malformed range %s: must be a pair of hyphen-separated IPv4 addresses\n", range_str);
-        }
-        result = RESULT_FAILURE;
-    }
-    else
+    switch( ip_range_from_str(range_str, proto, &range) )
     {
-       /* Extract sub-components from the range string. */
-
-        /* Allocate memory for the components of the range.
-           We need at most 15 characters for an IPv4 address, plus space for the terminating null byte. */
-        char left[16];
-        char right[16];
-
-        /* Split the string at the hyphen.
-           If the regex check succeeded, we know the hyphen is there. */
-        split_range(range_str, left, right);
-
-        CIDR* left_addr = cidr_from_str(left);
-        CIDR* right_addr = cidr_from_str(right);
-
-        if( !(is_ipv4_single(left) && is_valid_address(left_addr)) )
-        {
+        case RANGE_MALFORMED:
             if( verbose )
             {
-                fprintf(stderr, "Malformed range %s: %s is not a valid IPv4 address\n", range_str, left);
+                fprintf(stderr, "Malformed range %s: must be a pair of hyphen-separated %s addresses\n", range_str, family);
             }
-            result = RESULT_FAILURE;
-        }
-        else if( !(is_ipv4_single(right) && is_valid_address(right_addr)) )
-        {
+            break;
+        case RANGE_BAD_FIRST:
             if( verbose )
             {
-                fprintf(stderr, "Malformed range %s: %s is not a valid IPv4 address\n", range_str, right);
+                fprintf(stderr, "Malformed range %s: %.*s is not a valid %s address\n",
+                        range_str, (int)range.first_length, range_str, family);
             }
-            result = RESULT_FAILURE;
-        }
-        else
-        {
-            struct in_addr* left_in_addr = cidr_to_inaddr(left_addr, NULL);
-            struct in_addr* right_in_addr = cidr_to_inaddr(right_addr, NULL);
-
-            if( left_in_addr->s_addr <= right_in_addr->s_addr )
+            break;
+        case RANGE_BAD_LAST:
+            if( verbose )
             {
-                /* If non-zero prefix_length is given,
-                   check if the right address is within the network of the first one. */
-                if( prefix_length > 0 )
-                {
-                    char left_pref_str[19];
-
-                    /* XXX: Prefix length size is checked elsewhere, so it can't be more than 2 characters (32)
-                       and overflow cannot occur.
-                     */
-                    sprintf(left_pref_str, "%s/%u", left, prefix_length);
-                    CIDR* left_addr_with_pref = cidr_from_str(left_pref_str);
-                    CIDR* left_net = cidr_addr_network(left_addr_with_pref);
-                    if( cidr_contains(left_net, right_addr) == 0 )
-                    {
-                        result = RESULT_SUCCESS;
-                    }
-                    else
-                    {
-                        result = RESULT_FAILURE;
-                    }
-                    cidr_free(left_addr_with_pref);
-                    cidr_free(left_net);
-                }
-                else
-                {
-                    result = RESULT_SUCCESS;
-                }
+                fprintf(stderr, "Malformed range %s: %s is not a valid %s address\n",
+                        range_str, range_str + range.first_length + 1, family);
             }
-            else
+            break;
+        case RANGE_REVERSED:
+            if( verbose )
             {
-                if( verbose )
-                {
-                    fprintf(stderr, "Malformed IPv4 range %s: its first address is greater than the last\n", range_str);
-                }
-                result = RESULT_FAILURE;
+                fprintf(stderr, "Malformed %s range %s: its first address is greater than the last\n", family, range_str);
             }
-
-        }
-        cidr_free(left_addr);
-        cidr_free(right_addr);
+            break;
+        default:
+            /* If non-zero prefix_length is given,
+               check if the last address is within the network of the first one. */
+            if( (prefix_length == 0) || ip_range_within_prefix(&range, prefix_length) )
+            {
+                result = RESULT_SUCCESS;
+            }
+            break;
     }
 
     return(result);
 }
 
+/* Is it a valid IPv4 address range? */
+int is_ipv4_range(char* range_str, int prefix_length, int verbose)
+{
+    return is_ip_range(range_str, CIDR_IPV4, prefix_length, verbose);
+}
+
 /* Is it a valid IPv6 address range? */
 int is_ipv6_range(char* range_str, int prefix_length, int verbose)
 {
-    int result = RESULT_SUCCESS;
-
-    int regex_check_res = regex_matches("^([0-9a-fA-F:]+\\-[0-9a-fA-F:]+)$", range_str);
-
-    if( !regex_check_res )
-    {
-        if( verbose )
-        {
-            fprintf(stderr, "Malformed range %s: must be a pair of hyphen-separated IPv6 addresses\n", range_str);
-        }
-        result = RESULT_FAILURE;
-    }
-    else
-    {
-       /* Extract sub-components from the range string. */
-
-        /* Allocate memory for the components of the range.
-           We need at most 39 characters for an IPv6 address, plus space for the terminating null byte. */
-        char left[40];
-        char right[40];
-
-        /* Split the string at the hyphen.
-           If the regex check succeeded, we know the hyphen is there. */
-        split_range(range_str, left, right);
-
-        CIDR* left_addr = cidr_from_str(left);
-        CIDR* right_addr = cidr_from_str(right);
-
-        if( !(is_ipv6_single(left) &&
-              is_valid_address(left_addr) && !duplicate_double_colons(left)) )
-        {
-            if( verbose )
-            {
-                fprintf(stderr, "Malformed range %s: %s is not a valid IPv6 address\n", range_str, left);
-            }
-            result = RESULT_FAILURE;
-        }
-        else if( !(is_ipv6_single(right) &&
-                   is_valid_address(right_addr) && !duplicate_double_colons(right)) )
-        {
-            if( verbose )
-            {
-                fprintf(stderr, "Malformed range %s: %s is not a valid IPv6 address\n", range_str, right);
-            }
-            result = RESULT_FAILURE;
-        }
-        else
-        {
-            struct in6_addr* left_in6_addr = cidr_to_in6addr(left_addr, NULL);
-            struct in6_addr* right_in6_addr = cidr_to_in6addr(right_addr, NULL);
-
-            if( compare_ipv6(left_in6_addr, right_in6_addr) <= 0 )
-            {
-                /* If non-zero prefix_length is given,
-                   check if the right address is within the network of the first one. */
-                if( prefix_length > 0 )
-                {
-                    char left_pref_str[44];
-
-                    /* XXX: Prefix length size is checked elsewhere, so it can't be more than 3 characters (128)
-                       and overflow cannot occur.
-                     */
-                    sprintf(left_pref_str, "%s/%u", left, prefix_length);
-                    CIDR* left_addr_with_pref = cidr_from_str(left_pref_str);
-                    CIDR* left_net = cidr_addr_network(left_addr_with_pref);
-                    if( cidr_contains(left_net, right_addr) == 0 )
-                    {
-                        result = RESULT_SUCCESS;
-                    }
-                    else
-                    {
-                        result = RESULT_FAILURE;
-                    }
-                    cidr_free(left_addr_with_pref);
-                    cidr_free(left_net);
-                }
-                else
-                {
-                    result = RESULT_SUCCESS;
-                }
-            }
-            else
-            {
-                if( verbose )
-                {
-                    fprintf(stderr, "Malformed IPv6 range %s: its first address is greater than the last\n", range_str);
-                }
-                result = RESULT_FAILURE;
-            }
-        }
-        cidr_free(left_addr);
-        cidr_free(right_addr);
-    }
-
-    return(result);
+    return is_ip_range(range_str, CIDR_IPV6, prefix_length, verbose);
 }
 
@@ -0,0 +1,265 @@
+/*
+ * ipaddrcheck_gawk.c: address checks as a gawk extension
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 or later as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Log processing scripts would otherwise call system("ipaddrcheck ...")
+ * for every record. With
+ *
+ *   @load "ipaddrcheck"
+ *
+ * they get these functions instead:
+ *
+ *   ip_valid(s)           4 or 6 if s is a valid address or prefix
+ *                         of that family, 0 if it is not
+ *   ip_classify(s)        the classes and properties of s, a bitmask of
+ *                         the IP_* variables below, or -1 if s is not valid
+ *   ip_in_list(s, file)   1 if s lies within the prefixes listed in file,
+ *                         as with --in-list, or is one of the addresses of
+ *                         a list compiled with --host-list --compile, 0 if
+ *                         not or if s is not valid, -1 if the list could
+ *                         not be loaded. Lists are loaded once, on first use
+ *
+ * The bits of ip_classify are set as the variables IP_MULTICAST,
+ * IP_LOOPBACK, IP_LINK_LOCAL, IP_RFC1918, IP_THIS_NETWORK,
+ * IP_LIMITED_BROADCAST, IP_NETWORK, IP_BROADCAST, IP_HOST and
+ * IP_INTERFACE, to be tested with and().
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "gawkapi.h"
+
+#include "config.h"
+#include "ipaddrcheck_classify.h"
+#include "ipaddrcheck_host_set.h"
+#include "ipaddrcheck_prefix_set.h"
+
+/* A list by the path it was loaded from. A list that could not be
+   loaded is remembered too, rather than read again for every record. */
+typedef struct loaded_list
+{
+    char* path;
+    prefix_set* prefixes;
+    host_set* hosts;
+    struct loaded_list* next;
+} loaded_list;
+
+static const gawk_api_t* api;
+static awk_ext_id_t ext_id;
+static const char* ext_version = "ipaddrcheck extension: version " PACKAGE_VERSION;
+
+static awk_bool_t init_ipaddrcheck(void);
+static awk_bool_t (*init_func)(void) = init_ipaddrcheck;
+
+int plugin_is_GPL_compatible;
+
+static loaded_list* loaded_lists = NULL;
+
+/* Parse a string argument, the parsers want it in a buffer of their own */
+static int prefix_argument(int index, ip_prefix* prefix)
+{
+    char prefix_str[PREFIX_STR_MAX];
+    awk_value_t value;
+
+    if( !get_argument(index, AWK_STRING, &value) || (value.str_value.len >= sizeof(prefix_str)) )
+    {
+        return RESULT_FAILURE;
+    }
+    memcpy(prefix_str, value.str_value.str, value.str_value.len);
+    prefix_str[value.str_value.len] = '\0';
+
+    return ip_prefix_from_str(prefix_str, prefix);
+}
+
+static awk_value_t* do_ip_valid(int nargs, awk_value_t* result, struct awk_ext_func* unused)
+{
+    ip_prefix prefix;
+
+    if( prefix_argument(0, &prefix) != RESULT_SUCCESS )
+    {
+        return make_number(0, result);
+    }
+    return make_number((prefix.proto == CIDR_IPV4) ? 4 : 6, result);
+}
+
+static awk_value_t* do_ip_classify(int nargs, awk_value_t* result, struct awk_ext_func* unused)
+{
+    ip_prefix prefix;
+
+    if( prefix_argument(0, &prefix) != RESULT_SUCCESS )
+    {
+        return make_number(-1, result);
+    }
+    return make_number(ip_prefix_properties(&prefix), result);
+}
+
+/* Compiled host lists start with a magic number, anything else is a list of prefixes */
+static int is_compiled_host_list(const char* path)
+{
+    char magic[sizeof(HOST_SET_MAGIC) - 1];
+    FILE* file = fopen(path, "r");
+    int result = 0;
+
+    if( file == NULL )
+    {
+        return 0;
+    }
+    result = (fread(magic, 1, sizeof(magic), file) == sizeof(magic)) &&
+             (memcmp(magic, HOST_SET_MAGIC, sizeof(magic)) == 0);
+    fclose(file);
+
+    return result;
+}
+
+static loaded_list* find_list(const char* path)
+{
+    loaded_list* list = NULL;
+
+    for( list = loaded_lists; list != NULL; list = list->next )
+    {
+        if( strcmp(list->path, path) == 0 )
+        {
+            return list;
+        }
+    }
+
+    list = calloc(1, sizeof(loaded_list));
+    if( list == NULL )
+    {
+        return NULL;
+    }
+    list->path = strdup(path);
+    if( list->path == NULL )
+    {
+        free(list);
+        return NULL;
+    }
+
+    /* The loaders explain on standard error why they fail */
+    if( is_compiled_host_list(path) )
+    {
+        list->hosts = host_set_load(path, 0);
+    }
+    else
+    {
+        list->prefixes = prefix_set_load(path, 0);
+    }
+
+    list->next = loaded_lists;
+    loaded_lists = list;
+
+    return list;
+}
+
+static awk_value_t* do_ip_in_list(int nargs, awk_value_t* result, struct awk_ext_func* unused)
+{
+    awk_value_t path;
+    loaded_list* list = NULL;
+    ip_prefix prefix;
+
+    if( !get_argument(1, AWK_STRING, &path) )
+    {
+        update_ERRNO_string("ip_in_list: the second argument must be a file name");
+        return make_number(-1, result);
+    }
+
+    list = find_list(path.str_value.str);
+    if( (list == NULL) || ((list->prefixes == NULL) && (list->hosts == NULL)) )
+    {
+        update_ERRNO_string("ip_in_list: could not load the list");
+        return make_number(-1, result);
+    }
+
+    if( prefix_argument(0, &prefix) != RESULT_SUCCESS )
+    {
+        return make_number(0, result);
+    }
+    if( list->hosts != NULL )
+    {
+        /* A host list only holds single addresses */
+        return make_number((prefix.pflen == ip_bits(prefix.proto)) &&
+                           host_set_contains(list->hosts, prefix.proto, prefix.addr), result);
+    }
+    return make_number(prefix_set_contains(list->prefixes, &prefix), result);
+}
+
+static void free_lists(void* data, int exit_status)
+{
+    while( loaded_lists != NULL )
+    {
+        loaded_list* next = loaded_lists->next;
+
+        prefix_set_free(loaded_lists->prefixes);
+        host_set_free(loaded_lists->hosts);
+        free(loaded_lists->path);
+        free(loaded_lists);
+        loaded_lists = next;
+    }
+}
+
+/* Make the bits of ip_classify() known to scripts */
+static awk_bool_t init_ipaddrcheck(void)
+{
+    static const struct
+    {
+        const char* name;
+        unsigned int bit;
+    } constants[] =
+    {
+        { "IP_MULTICAST",         ADDRESS_CLASS_MULTICAST },
+        { "IP_LOOPBACK",          ADDRESS_CLASS_LOOPBACK },
+        { "IP_LINK_LOCAL",        ADDRESS_CLASS_LINK_LOCAL },
+        { "IP_RFC1918",           ADDRESS_CLASS_RFC1918 },
+        { "IP_THIS_NETWORK",      ADDRESS_CLASS_THIS_NETWORK },
+        { "IP_LIMITED_BROADCAST", ADDRESS_CLASS_LIMITED_BROADCAST },
+        { "IP_NETWORK",           ADDRESS_PROPERTY_NETWORK },
+        { "IP_BROADCAST",         ADDRESS_PROPERTY_BROADCAST },
+        { "IP_HOST",              ADDRESS_PROPERTY_HOST },
+        { "IP_INTERFACE",         ADDRESS_PROPERTY_INTERFACE }
+    };
+    size_t i = 0;
+
+    for( i = 0; i < sizeof(constants) / sizeof(constants[0]); i++ )
+    {
+        awk_value_t value;
+
+        if( !sym_update(constants[i].name, make_number(constants[i].bit, &value)) )
+        {
+            warning(ext_id, "ipaddrcheck: could not set %s", constants[i].name);
+            return awk_false;
+        }
+    }
+    awk_atexit(free_lists, NULL);
+
+    return awk_true;
+}
+
+static awk_ext_func_t func_table[] =
+{
+    { "ip_valid",    do_ip_valid,    1, 1, awk_false, NULL },
+    { "ip_classify", do_ip_classify, 1, 1, awk_false, NULL },
+    { "ip_in_list",  do_ip_in_list,  2, 2, awk_false, NULL },
+};
+
+dl_load_func(func_table, ipaddrcheck, "")
@@ -0,0 +1,1107 @@
+/*
+ * ipaddrcheck_host_set.c: compressed static sets of single addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* mmap(), mkstemp(), fchmod() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ipaddrcheck_host_set.h"
+
+#define ALIGN_UP(value) (((value) + HOST_SET_ALIGNMENT - 1) & ~(uint64_t)(HOST_SET_ALIGNMENT - 1))
+
+/*
+ * 128-bit arithmetic
+ */
+
+static ip_value ip_value_sub(ip_value left, ip_value right)
+{
+    ip_value result;
+    result.lo = left.lo - right.lo;
+    result.hi = left.hi - right.hi - (left.lo < right.lo);
+    return result;
+}
+
+static ip_value ip_value_shr(ip_value value, int shift)
+{
+    if( shift >= 64 )
+    {
+        value.lo = value.hi >> (shift - 64);
+        value.hi = 0;
+    }
+    else if( shift > 0 )
+    {
+        value.lo = (value.lo >> shift) | (value.hi << (64 - shift));
+        value.hi >>= shift;
+    }
+    return value;
+}
+
+static int ip_value_bit_length(ip_value value)
+{
+    if( value.hi != 0 )
+    {
+        return 128 - __builtin_clzll(value.hi);
+    }
+    if( value.lo != 0 )
+    {
+        return 64 - __builtin_clzll(value.lo);
+    }
+    return 0;
+}
+
+/* Written without branches, they would be unpredictable in binary searches */
+static inline int ip_value_le(ip_value left, ip_value right)
+{
+    return (left.hi < right.hi) | ((left.hi == right.hi) & (left.lo <= right.lo));
+}
+
+static ip_value ip_value_xor(ip_value left, ip_value right)
+{
+    left.hi ^= right.hi;
+    left.lo ^= right.lo;
+    return left;
+}
+
+static int ip_value_qsort_cmp(const void* left, const void* right)
+{
+    return ip_value_cmp(*(const ip_value*)left, *(const ip_value*)right);
+}
+
+/*
+ * Bit data
+ */
+
+/* Read 1 to 64 bits starting at a bit position */
+static inline uint64_t read_bits(const uint64_t* words, uint64_t position, int width)
+{
+    uint64_t index = position >> 6;
+    int shift = (int)(position & 63);
+    uint64_t value = words[index] >> shift;
+
+    if( shift + width > 64 )
+    {
+        value |= words[index + 1] << (64 - shift);
+    }
+    if( width < 64 )
+    {
+        value &= ((uint64_t)1 << width) - 1;
+    }
+    return value;
+}
+
+/* Store 1 to 64 bits into zeroed bit data */
+static void write_bits(uint64_t* words, uint64_t position, uint64_t value, int width)
+{
+    uint64_t index = position >> 6;
+    int shift = (int)(position & 63);
+
+    words[index] |= value << shift;
+    if( shift + width > 64 )
+    {
+        words[index + 1] |= value >> (64 - shift);
+    }
+}
+
+/* Lower part of the i-th distance in a block */
+static inline ip_value read_low(const uint64_t* words, uint64_t position, int width)
+{
+    ip_value value = { 0, 0 };
+
+    if( width > 64 )
+    {
+        value.lo = read_bits(words, position, 64);
+        value.hi = read_bits(words, position + 64, width - 64);
+    }
+    else if( width > 0 )
+    {
+        value.lo = read_bits(words, position, width);
+    }
+    return value;
+}
+
+/* Bytes of a word replaced by the number of set bits in them. This does not
+   need a popcount instruction, which generic builds cannot assume. */
+static inline uint64_t byte_counts(uint64_t word)
+{
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    return (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+}
+
+static inline int popcount64(uint64_t word)
+{
+    return (int)((byte_counts(word) * 0x0101010101010101ULL) >> 56);
+}
+
+/* Position of the k-th (counting from one) set bit of a word that has at least k */
+static inline int select_bit(uint64_t word, int k)
+{
+    /* Byte i of sums is the number of set bits in bytes 0 to i,
+       the high bit of every byte of ge is set where that is at least k */
+    uint64_t sums = byte_counts(word) * 0x0101010101010101ULL;
+    uint64_t ge = ((sums | 0x8080808080808080ULL) - (uint64_t)k * 0x0101010101010101ULL) & 0x8080808080808080ULL;
+    int shift = __builtin_ctzll(ge) - 7;
+    uint64_t byte = (word >> shift) & 0xff;
+
+    if( shift > 0 )
+    {
+        k -= (int)((sums >> (shift - 8)) & 0xff);
+    }
+    for( ; k > 1; k-- )
+    {
+        byte &= byte - 1;
+    }
+    return shift + __builtin_ctzll(byte);
+}
+
+/* Bucket of an address that lies between the first and the last block */
+static inline uint64_t ef_list_bucket(const ef_list* list, ip_value address)
+{
+    return ip_value_shr(address, list->bucket_shift).lo & (((uint64_t)1 << list->bucket_bits) - 1);
+}
+
+/*
+ * Encoding
+ */
+
+/* Pick the width of the lower parts for a block: the largest one with
+   count << width not exceeding the largest distance, as in Elias-Fano coding */
+static void ef_block_layout(const ip_value* values, size_t count, int* low_bits, int* high_bits)
+{
+    ip_value range = ip_value_sub(values[count - 1], values[0]);
+    int width = ip_value_bit_length(range) - ip_value_bit_length((ip_value){ 0, count }) + 1;
+
+    if( width < 0 )
+    {
+        width = 0;
+    }
+    while( (width > 0) && (ip_value_shr(range, width).lo < count) && (ip_value_shr(range, width).hi == 0) )
+    {
+        width--;
+    }
+
+    *low_bits = width;
+    *high_bits = (int)(ip_value_shr(range, width).lo + count);
+}
+
+static uint64_t ef_block_count(uint64_t count)
+{
+    return (count + HOST_SET_BLOCK_SIZE - 1) / HOST_SET_BLOCK_SIZE;
+}
+
+/* Number of data bits of a list */
+static uint64_t ef_list_bits(const ip_value* values, size_t count)
+{
+    uint64_t bits = 0;
+    size_t first = 0;
+
+    for( first = 0; first < count; first += HOST_SET_BLOCK_SIZE )
+    {
+        size_t n = (count - first < HOST_SET_BLOCK_SIZE) ? count - first : HOST_SET_BLOCK_SIZE;
+        int low_bits = 0;
+        int high_bits = 0;
+
+        ef_block_layout(values + first, n, &low_bits, &high_bits);
+        bits += (uint64_t)high_bits + (uint64_t)n * low_bits;
+    }
+    return bits;
+}
+
+static void ef_list_encode(const ip_value* values, size_t count, ef_block* blocks, uint64_t* words)
+{
+    uint64_t position = 0;
+    size_t first = 0;
+
+    for( first = 0; first < count; first += HOST_SET_BLOCK_SIZE )
+    {
+        ef_block* block = &blocks[first / HOST_SET_BLOCK_SIZE];
+        size_t n = (count - first < HOST_SET_BLOCK_SIZE) ? count - first : HOST_SET_BLOCK_SIZE;
+        int low_bits = 0;
+        int high_bits = 0;
+        size_t i = 0;
+
+        ef_block_layout(values + first, n, &low_bits, &high_bits);
+        block->first = values[first];
+        block->offset = position;
+        block->high_bits = (uint16_t)high_bits;
+        block->low_bits = (uint8_t)low_bits;
+
+        for( i = 0; i < n; i++ )
+        {
+            ip_value distance = ip_value_sub(values[first + i], values[first]);
+            ip_value low = ip_value_low_mask(low_bits);
+            uint64_t low_position = position + high_bits + (uint64_t)i * low_bits;
+
+            low.hi &= distance.hi;
+            low.lo &= distance.lo;
+            write_bits(words, position + ip_value_shr(distance, low_bits).lo + i, 1, 1);
+            if( low_bits > 64 )
+            {
+                write_bits(words, low_position, low.lo, 64);
+                write_bits(words, low_position + 64, low.hi, low_bits - 64);
+            }
+            else if( low_bits > 0 )
+            {
+                write_bits(words, low_position, low.lo, low_bits);
+            }
+        }
+
+        position += (uint64_t)high_bits + (uint64_t)n * low_bits;
+    }
+}
+
+/* Sort and drop duplicates, returns the new count */
+static size_t sort_unique(ip_value* values, size_t count)
+{
+    size_t i = 0;
+    size_t unique = 0;
+
+    if( count == 0 )
+    {
+        return 0;
+    }
+
+    qsort(values, count, sizeof(ip_value), ip_value_qsort_cmp);
+    for( i = 1; i < count; i++ )
+    {
+        if( !ip_value_eq(values[i], values[unique]) )
+        {
+            values[++unique] = values[i];
+        }
+    }
+    return unique + 1;
+}
+
+/*
+ * File images
+ */
+
+static const host_set_section* find_section(const host_set_header* header, uint32_t type)
+{
+    uint32_t i = 0;
+
+    for( i = 0; i < header->section_count; i++ )
+    {
+        if( header->sections[i].type == type )
+        {
+            return &header->sections[i];
+        }
+    }
+    return NULL;
+}
+
+/* Point a list to its sections, checking that all blocks lie within the data */
+static int ef_list_attach(ef_list* list, int proto, const uint8_t* storage, const host_set_header* header,
+                          uint64_t count, uint32_t blocks_type, uint32_t words_type)
+{
+    const host_set_section* blocks = find_section(header, blocks_type);
+    const host_set_section* words = find_section(header, words_type);
+    uint64_t total_bits = 0;
+    uint64_t i = 0;
+
+    list->proto = proto;
+    list->count = count;
+    list->block_count = ef_block_count(count);
+
+    if( (blocks == NULL) || (words == NULL) ||
+        (blocks->size / sizeof(ef_block) != list->block_count) || (blocks->size % sizeof(ef_block) != 0) ||
+        (words->size % sizeof(uint64_t) != 0) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    list->blocks = (const ef_block*)(storage + blocks->offset);
+    list->words = (const uint64_t*)(storage + words->offset);
+    list->word_count = words->size / sizeof(uint64_t);
+    total_bits = words->size * 8;
+
+    for( i = 0; i < list->block_count; i++ )
+    {
+        const ef_block* block = &list->blocks[i];
+        uint64_t n = (i + 1 < list->block_count) ? HOST_SET_BLOCK_SIZE : count - i * HOST_SET_BLOCK_SIZE;
+
+        if( (block->low_bits > ip_bits(proto)) || (block->high_bits < n) ||
+            (block->offset > total_bits) ||
+            (total_bits - block->offset < block->high_bits + n * block->low_bits) )
+        {
+            return(RESULT_FAILURE);
+        }
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Build the bucket table of a list */
+static int ef_list_index(ef_list* list)
+{
+    int width = ip_bits(list->proto);
+    int shared = 0;
+    uint64_t bucket_count = 0;
+    uint64_t block = 0;
+    uint64_t bucket = 0;
+
+    list->buckets = NULL;
+    list->bucket_bits = 0;
+    list->bucket_shift = 0;
+    if( list->block_count < 2 )
+    {
+        return(RESULT_SUCCESS);
+    }
+    if( list->block_count > UINT32_MAX )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    /* Bits shared by the first and the last block are shared by all of them */
+    shared = width - ip_value_bit_length(ip_value_xor(list->blocks[0].first, list->blocks[list->block_count - 1].first));
+    list->bucket_bits = ip_value_bit_length((ip_value){ 0, list->block_count });
+    if( list->bucket_bits > width - shared )
+    {
+        list->bucket_bits = width - shared;
+    }
+    list->bucket_shift = width - shared - list->bucket_bits;
+    bucket_count = (uint64_t)1 << list->bucket_bits;
+
+    list->buckets = malloc((bucket_count + 1) * sizeof(uint32_t));
+    if( list->buckets == NULL )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    for( bucket = 0; bucket <= bucket_count; bucket++ )
+    {
+        while( (block < list->block_count) && (ef_list_bucket(list, list->blocks[block].first) < bucket) )
+        {
+            block++;
+        }
+        list->buckets[bucket] = (uint32_t)block;
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+static int host_set_attach(host_set* set, void* storage, size_t size)
+{
+    const host_set_header* header = storage;
+    const host_set_section* filter = NULL;
+    uint32_t i = 0;
+
+    if( (size < sizeof(host_set_header)) ||
+        (memcmp(header->magic, HOST_SET_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->version != HOST_SET_VERSION) ||
+        (header->section_count > HOST_SET_MAX_SECTIONS) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    for( i = 0; i < header->section_count; i++ )
+    {
+        const host_set_section* section = &header->sections[i];
+
+        if( (section->offset % HOST_SET_ALIGNMENT != 0) ||
+            (section->offset > size) || (section->size > size - section->offset) )
+        {
+            return(RESULT_FAILURE);
+        }
+    }
+
+    if( (ef_list_attach(&set->ipv4, CIDR_IPV4, storage, header, header->ipv4_count,
+                        HOST_SET_IPV4_BLOCKS, HOST_SET_IPV4_WORDS) != RESULT_SUCCESS) ||
+        (ef_list_attach(&set->ipv6, CIDR_IPV6, storage, header, header->ipv6_count,
+                        HOST_SET_IPV6_BLOCKS, HOST_SET_IPV6_WORDS) != RESULT_SUCCESS) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    filter = find_section(header, HOST_SET_FILTER);
+    set->has_filter = (filter != NULL);
+    if( set->has_filter &&
+        (fuse_filter_attach(&set->filter, (const uint8_t*)storage + filter->offset, filter->size) != RESULT_SUCCESS) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    if( (ef_list_index(&set->ipv4) != RESULT_SUCCESS) || (ef_list_index(&set->ipv6) != RESULT_SUCCESS) )
+    {
+        free(set->ipv4.buckets);
+        set->ipv4.buckets = NULL;
+        return(RESULT_INT_ERROR);
+    }
+
+    set->storage = storage;
+    set->storage_size = size;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Append the sections of a family to the header, returns the end of the last one */
+static uint64_t add_sections(host_set_header* header, uint64_t offset, uint32_t first_type,
+                             uint64_t count, uint64_t bits)
+{
+    uint64_t sizes[2];
+    int i = 0;
+
+    sizes[0] = ef_block_count(count) * sizeof(ef_block);
+    sizes[1] = ((bits + 63) / 64) * sizeof(uint64_t);
+
+    for( i = 0; i < 2; i++ )
+    {
+        host_set_section* section = &header->sections[header->section_count++];
+
+        offset = ALIGN_UP(offset);
+        section->type = first_type + i;
+        section->offset = offset;
+        section->size = sizes[i];
+        offset += sizes[i];
+    }
+    return offset;
+}
+
+/* Build a filter over the addresses of both families */
+static int host_set_build_filter(fuse_filter* filter, const ip_value* ipv4, size_t ipv4_count,
+                                 const ip_value* ipv6, size_t ipv6_count, int filter_bits)
+{
+    uint64_t* keys = malloc((ipv4_count + ipv6_count + 1) * sizeof(uint64_t));
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    if( keys == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    for( i = 0; i < ipv4_count; i++ )
+    {
+        keys[i] = filter_key_address(CIDR_IPV4, ipv4[i]);
+    }
+    for( i = 0; i < ipv6_count; i++ )
+    {
+        keys[ipv4_count + i] = filter_key_address(CIDR_IPV6, ipv6[i]);
+    }
+
+    result = fuse_filter_build(filter, keys, ipv4_count + ipv6_count, filter_bits);
+    free(keys);
+
+    return(result);
+}
+
+/*
+ * Build a set from unsorted addresses, which may contain duplicates.
+ * The arrays are sorted in place. With filter_bits, a filter with
+ * fingerprints of that many bits is built too.
+ */
+host_set* host_set_build(ip_value* ipv4, size_t ipv4_count, ip_value* ipv6, size_t ipv6_count, int filter_bits)
+{
+    host_set* set = calloc(1, sizeof(host_set));
+    host_set_header header;
+    fuse_filter filter;
+    uint8_t* storage = NULL;
+    uint64_t size = 0;
+
+    if( set == NULL )
+    {
+        return NULL;
+    }
+
+    ipv4_count = sort_unique(ipv4, ipv4_count);
+    ipv6_count = sort_unique(ipv6, ipv6_count);
+
+    memset(&filter, 0, sizeof(filter));
+    if( (filter_bits > 0) &&
+        (host_set_build_filter(&filter, ipv4, ipv4_count, ipv6, ipv6_count, filter_bits) != RESULT_SUCCESS) )
+    {
+        free(set);
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HOST_SET_MAGIC, sizeof(header.magic));
+    header.version = HOST_SET_VERSION;
+    header.ipv4_count = ipv4_count;
+    header.ipv6_count = ipv6_count;
+    size = add_sections(&header, sizeof(header), HOST_SET_IPV4_BLOCKS, ipv4_count, ef_list_bits(ipv4, ipv4_count));
+    size = add_sections(&header, size, HOST_SET_IPV6_BLOCKS, ipv6_count, ef_list_bits(ipv6, ipv6_count));
+    if( filter.words != NULL )
+    {
+        host_set_section* section = &header.sections[header.section_count++];
+
+        section->type = HOST_SET_FILTER;
+        section->offset = ALIGN_UP(size);
+        section->size = sizeof(fuse_filter_params) + fuse_filter_word_count(&filter.params) * sizeof(uint64_t);
+        size = section->offset + section->size;
+    }
+    size = ALIGN_UP(size);
+
+    storage = calloc(1, size);
+    if( storage == NULL )
+    {
+        fuse_filter_free(&filter);
+        free(set);
+        return NULL;
+    }
+    memcpy(storage, &header, sizeof(header));
+    if( filter.words != NULL )
+    {
+        const host_set_section* section = &header.sections[header.section_count - 1];
+
+        memcpy(storage + section->offset, &filter.params, sizeof(fuse_filter_params));
+        memcpy(storage + section->offset + sizeof(fuse_filter_params), filter.words,
+               section->size - sizeof(fuse_filter_params));
+        fuse_filter_free(&filter);
+    }
+
+    ef_list_encode(ipv4, ipv4_count,
+                   (ef_block*)(storage + header.sections[0].offset),
+                   (uint64_t*)(storage + header.sections[1].offset));
+    ef_list_encode(ipv6, ipv6_count,
+                   (ef_block*)(storage + header.sections[2].offset),
+                   (uint64_t*)(storage + header.sections[3].offset));
+
+    if( host_set_attach(set, storage, size) != RESULT_SUCCESS )
+    {
+        free(storage);
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+static int add_value(ip_value** values, size_t* count, size_t* capacity, ip_value value)
+{
+    if( *count == *capacity )
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        ip_value* new_values = realloc(*values, new_capacity * sizeof(ip_value));
+        if( new_values == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        *values = new_values;
+        *capacity = new_capacity;
+    }
+    (*values)[(*count)++] = value;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Build a set from a list of addresses, one per line */
+static host_set* host_set_load_list(const char* path, int filter_bits)
+{
+    list_reader reader;
+    ip_value* values[2] = { NULL, NULL };
+    size_t counts[2] = { 0, 0 };
+    size_t capacities[2] = { 0, 0 };
+    host_set* set = NULL;
+    int errors = 0;
+    char* line = NULL;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* address_str = list_next_field(&line);
+        ip_prefix address;
+        int family = 0;
+
+        if( (ip_prefix_from_str(address_str, &address) != RESULT_SUCCESS) ||
+            (address.pflen != ip_bits(address.proto)) )
+        {
+            list_reader_error(&reader, "\"%s\" is not a single address", address_str);
+            errors++;
+            continue;
+        }
+
+        family = (address.proto == CIDR_IPV4) ? 0 : 1;
+        if( add_value(&values[family], &counts[family], &capacities[family], address.addr) != RESULT_SUCCESS )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+    }
+
+    list_reader_close(&reader);
+
+    if( errors == 0 )
+    {
+        set = host_set_build(values[0], counts[0], values[1], counts[1], filter_bits);
+        if( set == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+    }
+
+    free(values[0]);
+    free(values[1]);
+
+    return set;
+}
+
+/* Map a compiled file into memory, the set is used in place */
+static host_set* host_set_map(const char* path)
+{
+    host_set* set = calloc(1, sizeof(host_set));
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    int result = RESULT_SUCCESS;
+    int fd = -1;
+
+    if( set == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if( (fd < 0) || (fstat(fd, &status) != 0) )
+    {
+        fprintf(stderr, "Error: could not open %s: %s\n", path, strerror(errno));
+    }
+    else if( (status.st_size <= 0) ||
+             ((mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) )
+    {
+        fprintf(stderr, "Error: could not map %s: %s\n", path, strerror(errno));
+    }
+    else if( (result = host_set_attach(set, mapping, (size_t)status.st_size)) != RESULT_SUCCESS )
+    {
+        if( result == RESULT_FAILURE )
+        {
+            fprintf(stderr, "Error: %s is not a valid compiled host list\n", path);
+        }
+        else
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+        munmap(mapping, (size_t)status.st_size);
+        mapping = MAP_FAILED;
+    }
+
+    if( fd >= 0 )
+    {
+        close(fd);
+    }
+    if( mapping == MAP_FAILED )
+    {
+        free(set);
+        return NULL;
+    }
+
+    posix_madvise(mapping, (size_t)status.st_size, POSIX_MADV_RANDOM);
+    set->mapped = 1;
+
+    return set;
+}
+
+/*
+ * Load a set from a compiled file, recognized by its magic number,
+ * or from a list of addresses. Compiled files keep the filter they were
+ * built with, filter_bits only applies to lists.
+ */
+host_set* host_set_load(const char* path, int filter_bits)
+{
+    if( strcmp(path, "-") != 0 )
+    {
+        char magic[sizeof(HOST_SET_MAGIC) - 1];
+        FILE* file = fopen(path, "rb");
+        size_t length = 0;
+
+        if( file == NULL )
+        {
+            fprintf(stderr, "Error: could not open %s: %s\n", path, strerror(errno));
+            return NULL;
+        }
+        length = fread(magic, 1, sizeof(magic), file);
+        fclose(file);
+
+        if( (length == sizeof(magic)) && (memcmp(magic, HOST_SET_MAGIC, sizeof(magic)) == 0) )
+        {
+            return host_set_map(path);
+        }
+    }
+
+    return host_set_load_list(path, filter_bits);
+}
+
+/*
+ * Write the compiled form of a set. The file is replaced atomically,
+ * so that processes that have the old one mapped are not disturbed.
+ */
+int host_set_save(const host_set* set, const char* path)
+{
+    size_t length = strlen(path);
+    char* temp_path = malloc(length + sizeof(".XXXXXX"));
+    const uint8_t* data = set->storage;
+    size_t left = set->storage_size;
+    int failed = 0;
+    int fd = -1;
+
+    if( temp_path == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return(RESULT_INT_ERROR);
+    }
+    memcpy(temp_path, path, length);
+    memcpy(temp_path + length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    fd = mkstemp(temp_path);
+    if( fd < 0 )
+    {
+        fprintf(stderr, "Error: could not create %s: %s\n", temp_path, strerror(errno));
+        free(temp_path);
+        return(RESULT_INT_ERROR);
+    }
+
+    while( left > 0 )
+    {
+        ssize_t written = write(fd, data, left);
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            break;
+        }
+        data += written;
+        left -= (size_t)written;
+    }
+
+    failed = (left > 0) || (fchmod(fd, 0644) != 0);
+    failed = (close(fd) != 0) || failed;
+    if( failed || (rename(temp_path, path) != 0) )
+    {
+        fprintf(stderr, "Error: could not write %s: %s\n", path, strerror(errno));
+        unlink(temp_path);
+        free(temp_path);
+        return(RESULT_INT_ERROR);
+    }
+
+    free(temp_path);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Lookups
+ */
+
+/*
+ * Find an address in a list, setting rank to the number of members
+ * smaller than the address
+ */
+static int ef_list_find(const ef_list* list, ip_value address, uint64_t* rank)
+{
+    const ef_block* block = list->blocks;
+    uint64_t length = 0;
+    uint64_t index = 0;
+    uint64_t base = 0;
+    uint64_t n = 0;
+    uint64_t position = 0;
+    uint64_t end = 0;
+    uint64_t zeros = 0;
+    uint64_t high_max = 0;
+    uint64_t i = 0;
+    ip_value distance;
+    ip_value high;
+    ip_value low;
+
+    *rank = 0;
+    if( (list->count == 0) || (ip_value_cmp(address, list->blocks[0].first) < 0) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    /* The last block that starts at or before the address: one of those
+       from the last block of the previous bucket to the last of this one */
+    if( list->buckets == NULL )
+    {
+        length = list->block_count;
+    }
+    else if( ip_value_le(list->blocks[list->block_count - 1].first, address) )
+    {
+        block = list->blocks + list->block_count - 1;
+        length = 1;
+    }
+    else
+    {
+        uint64_t bucket = ef_list_bucket(list, address);
+        uint64_t start = list->buckets[bucket];
+
+        start = (start > 0) ? start - 1 : 0;
+        block = list->blocks + start;
+        length = list->buckets[bucket + 1] - start;
+    }
+    while( length > 1 )
+    {
+        uint64_t half = length / 2;
+        block += ip_value_le(block[half].first, address) ? half : 0;
+        length -= half;
+    }
+
+    index = (uint64_t)(block - list->blocks);
+    base = index * HOST_SET_BLOCK_SIZE;
+    n = (index + 1 < list->block_count) ? HOST_SET_BLOCK_SIZE : list->count - base;
+    high_max = block->high_bits - n;
+
+    distance = ip_value_sub(address, block->first);
+    high = ip_value_shr(distance, block->low_bits);
+    if( (high.hi != 0) || (high.lo > high_max) )
+    {
+        /* Past the last address of the block */
+        *rank = base + n;
+        return(RESULT_FAILURE);
+    }
+    low = ip_value_low_mask(block->low_bits);
+    low.hi &= distance.hi;
+    low.lo &= distance.lo;
+
+    /* Skip the addresses with a smaller upper part: they end at the high.lo-th zero */
+    position = block->offset;
+    end = block->offset + block->high_bits;
+    zeros = high.lo;
+    while( zeros > 0 )
+    {
+        int width = (end - position < 64) ? (int)(end - position) : 64;
+        uint64_t word = ~read_bits(list->words, position, width);
+        uint64_t count = 0;
+
+        if( width < 64 )
+        {
+            word &= ((uint64_t)1 << width) - 1;
+        }
+        count = (uint64_t)popcount64(word);
+        if( count >= zeros )
+        {
+            position += (uint64_t)select_bit(word, (int)zeros) + 1;
+            break;
+        }
+        zeros -= count;
+        position += (uint64_t)width;
+        if( position >= end )
+        {
+            /* Malformed block */
+            *rank = base + n;
+            return(RESULT_FAILURE);
+        }
+    }
+
+    /* Then compare the lower parts of the addresses with the same upper part,
+       the run of ones that starts here */
+    i = position - block->offset - high.lo;
+    while( position < end )
+    {
+        int width = (end - position < 64) ? (int)(end - position) : 64;
+        uint64_t ones = read_bits(list->words, position, width);
+        uint64_t run = (ones == UINT64_MAX) ? 64 : (uint64_t)__builtin_ctzll(~ones);
+        uint64_t last = (i + run < n) ? i + run : n;
+
+        for( ; i < last; i++ )
+        {
+            int order = ip_value_cmp(read_low(list->words, end + i * block->low_bits, block->low_bits), low);
+            if( order >= 0 )
+            {
+                *rank = base + i;
+                return (order == 0) ? RESULT_SUCCESS : RESULT_FAILURE;
+            }
+        }
+        if( run < (uint64_t)width )
+        {
+            break;
+        }
+        position += (uint64_t)width;
+    }
+
+    *rank = base + i;
+    return(RESULT_FAILURE);
+}
+
+static const ef_list* host_set_list(const host_set* set, int proto)
+{
+    return (proto == CIDR_IPV4) ? &set->ipv4 : &set->ipv6;
+}
+
+/* Check the filter first, if there is one, and count the outcome in stats unless it is NULL */
+int host_set_lookup(const host_set* set, int proto, ip_value address, filter_stats* stats)
+{
+    uint64_t rank = 0;
+    int passed = !set->has_filter ||
+                 (fuse_filter_contains(&set->filter, filter_key_address(proto, address)) == RESULT_SUCCESS);
+    int found = passed && (ef_list_find(host_set_list(set, proto), address, &rank) == RESULT_SUCCESS);
+
+    filter_stats_count(stats, set->has_filter, passed, found);
+
+    return found ? RESULT_SUCCESS : RESULT_FAILURE;
+}
+
+/*
+ * Look up many addresses at once, in groups whose lookups advance
+ * in lockstep: the filter slots, then the buckets, then the first
+ * blocks of all the addresses of a group are prefetched before
+ * any of them is read, so that their cache misses overlap.
+ */
+void host_set_lookup_batch(const host_set* set, const ip_prefix* addresses, size_t count,
+                           int* results, filter_stats* stats)
+{
+    uint64_t keys[HOST_SET_BATCH_SIZE];
+    int passed[HOST_SET_BATCH_SIZE];
+    size_t start = 0;
+    size_t i = 0;
+
+    for( start = 0; start < count; start += HOST_SET_BATCH_SIZE )
+    {
+        const ip_prefix* group = addresses + start;
+        size_t length = (count - start < HOST_SET_BATCH_SIZE) ? count - start : HOST_SET_BATCH_SIZE;
+
+        if( set->has_filter )
+        {
+            for( i = 0; i < length; i++ )
+            {
+                keys[i] = filter_key_address(group[i].proto, group[i].addr);
+                fuse_filter_prefetch(&set->filter, keys[i]);
+            }
+        }
+        for( i = 0; i < length; i++ )
+        {
+            const ef_list* list = host_set_list(set, group[i].proto);
+
+            passed[i] = !set->has_filter ||
+                        (fuse_filter_contains(&set->filter, keys[i]) == RESULT_SUCCESS);
+            if( passed[i] && (list->buckets != NULL) )
+            {
+                __builtin_prefetch(&list->buckets[ef_list_bucket(list, group[i].addr)]);
+            }
+        }
+        for( i = 0; i < length; i++ )
+        {
+            const ef_list* list = host_set_list(set, group[i].proto);
+
+            if( passed[i] && (list->buckets != NULL) )
+            {
+                uint64_t block = list->buckets[ef_list_bucket(list, group[i].addr)];
+                __builtin_prefetch(&list->blocks[(block > 0) ? block - 1 : 0]);
+            }
+        }
+        for( i = 0; i < length; i++ )
+        {
+            uint64_t rank = 0;
+            int found = passed[i] &&
+                        (ef_list_find(host_set_list(set, group[i].proto), group[i].addr, &rank) == RESULT_SUCCESS);
+
+            filter_stats_count(stats, set->has_filter, passed[i], found);
+            results[start + i] = found ? RESULT_SUCCESS : RESULT_FAILURE;
+        }
+    }
+}
+
+int host_set_contains(const host_set* set, int proto, ip_value address)
+{
+    return host_set_lookup(set, proto, address, NULL);
+}
+
+/* Number of members of the same family smaller than the address */
+uint64_t host_set_rank(const host_set* set, int proto, ip_value address)
+{
+    uint64_t rank = 0;
+
+    ef_list_find(host_set_list(set, proto), address, &rank);
+
+    return rank;
+}
+
+static void ef_list_print_report(const ef_list* list, const char* name, FILE* stream)
+{
+    size_t address_bytes = (list->proto == CIDR_IPV4) ? 4 : 16;
+    uint64_t bytes = list->block_count * sizeof(ef_block) + list->word_count * sizeof(uint64_t);
+
+    fprintf(stream, "\n%s:\n", name);
+    fprintf(stream, "  Addresses:         %" PRIu64 "\n", list->count);
+    fprintf(stream, "  Blocks:            %" PRIu64 "\n", list->block_count);
+    fprintf(stream, "  Block bytes:       %" PRIu64 "\n", list->block_count * (uint64_t)sizeof(ef_block));
+    fprintf(stream, "  Bit data bytes:    %" PRIu64 "\n", list->word_count * (uint64_t)sizeof(uint64_t));
+    if( list->buckets != NULL )
+    {
+        fprintf(stream, "  Bucket bytes:      %" PRIu64 " (built on load)\n",
+                (((uint64_t)1 << list->bucket_bits) + 1) * (uint64_t)sizeof(uint32_t));
+    }
+    fprintf(stream, "  Uncompressed:      %" PRIu64 " bytes\n", list->count * (uint64_t)address_bytes);
+    if( list->count > 0 )
+    {
+        fprintf(stream, "  Bits per address:  %.2f\n", (double)bytes * 8 / list->count);
+    }
+}
+
+void host_set_print_report(const host_set* set, FILE* stream)
+{
+    uint64_t count = set->ipv4.count + set->ipv6.count;
+
+    fprintf(stream, "Addresses:           %" PRIu64 "\n", count);
+    fprintf(stream, "Memory:              %zu bytes", set->storage_size);
+    if( count > 0 )
+    {
+        fprintf(stream, ", %.2f bits per address", (double)set->storage_size * 8 / count);
+    }
+    fprintf(stream, "%s\n", set->mapped ? " (mapped)" : "");
+    if( set->has_filter )
+    {
+        size_t filter_bytes = fuse_filter_word_count(&set->filter.params) * sizeof(uint64_t);
+
+        fprintf(stream, "Filter:              %zu bytes, %u-bit fingerprints", filter_bytes,
+                set->filter.params.fingerprint_bits);
+        if( count > 0 )
+        {
+            fprintf(stream, ", %.2f bits per address", (double)filter_bytes * 8 / count);
+        }
+        fprintf(stream, "\n");
+    }
+
+    ef_list_print_report(&set->ipv4, "IPv4", stream);
+    ef_list_print_report(&set->ipv6, "IPv6", stream);
+}
+
+void host_set_free(host_set* set)
+{
+    if( set == NULL )
+    {
+        return;
+    }
+
+    free(set->ipv4.buckets);
+    free(set->ipv6.buckets);
+    if( set->mapped )
+    {
+        munmap(set->storage, set->storage_size);
+    }
+    else
+    {
+        free(set->storage);
+    }
+    free(set);
+}
@@ -0,0 +1,127 @@
+/*
+ * ipaddrcheck_host_set.h: compressed static sets of single addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_HOST_SET_H
+#define IPADDRCHECK_HOST_SET_H
+
+#include "ipaddrcheck_filter.h"
+
+/* Addresses per Elias-Fano block */
+#define HOST_SET_BLOCK_SIZE 128
+
+/* Addresses looked up together by host_set_lookup_batch */
+#define HOST_SET_BATCH_SIZE 16
+
+/*
+ * Compiled host list files start with a header that locates the sections,
+ * all integers are in the byte order of the machine that wrote the file.
+ * Every section starts at a multiple of HOST_SET_ALIGNMENT, so the file
+ * can be mapped into memory and used as it is.
+ */
+#define HOST_SET_MAGIC         "IPHOSTS\n"
+#define HOST_SET_VERSION       1
+#define HOST_SET_MAX_SECTIONS  16
+#define HOST_SET_ALIGNMENT     64
+
+/* Section types, for each family: block descriptors and bit data,
+   then the optional filter: its parameters followed by its fingerprints */
+#define HOST_SET_IPV4_BLOCKS   1
+#define HOST_SET_IPV4_WORDS    2
+#define HOST_SET_IPV6_BLOCKS   3
+#define HOST_SET_IPV6_WORDS    4
+#define HOST_SET_FILTER        5
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+} host_set_section;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t ipv4_count;
+    uint64_t ipv6_count;
+    host_set_section sections[HOST_SET_MAX_SECTIONS];
+} host_set_header;
+
+/*
+ * Up to HOST_SET_BLOCK_SIZE sorted addresses, stored as their distance from
+ * the first one with Elias-Fano coding: the low low_bits bits of every
+ * distance are stored as they are, the rest in unary, as a bit vector
+ * in which the i-th address sets the bit (distance >> low_bits) + i.
+ * The upper bit vector comes first, then the lower parts.
+ */
+typedef struct
+{
+    ip_value first;
+    uint64_t offset;     /* bit position of the block in the bit data */
+    uint16_t high_bits;  /* length of the upper bit vector */
+    uint8_t low_bits;
+    uint8_t reserved[5];
+} ef_block;
+
+/*
+ * Sorted addresses of one family. Blocks are found by a binary search
+ * over their first addresses, narrowed down by a bucket table built on load
+ * and indexed by the bucket_bits bits that follow the prefix shared
+ * by all blocks: bucket b holds the blocks from buckets[b] to buckets[b + 1].
+ */
+typedef struct
+{
+    int proto;
+    uint64_t count;
+    uint64_t block_count;
+    const ef_block* blocks;
+    const uint64_t* words;
+    uint64_t word_count;
+    uint32_t* buckets;
+    int bucket_shift;
+    int bucket_bits;
+} ef_list;
+
+typedef struct
+{
+    ef_list ipv4;
+    ef_list ipv6;
+    fuse_filter filter;   /* checked before the lists if has_filter is set */
+    int has_filter;
+    void* storage;        /* the compiled file image */
+    size_t storage_size;
+    int mapped;           /* storage is a memory mapping, not an allocation */
+} host_set;
+
+host_set* host_set_build(ip_value* ipv4, size_t ipv4_count, ip_value* ipv6, size_t ipv6_count, int filter_bits);
+host_set* host_set_load(const char* path, int filter_bits);
+int host_set_save(const host_set* set, const char* path);
+int host_set_lookup(const host_set* set, int proto, ip_value address, filter_stats* stats);
+void host_set_lookup_batch(const host_set* set, const ip_prefix* addresses, size_t count,
+                           int* results, filter_stats* stats);
+int host_set_contains(const host_set* set, int proto, ip_value address);
+uint64_t host_set_rank(const host_set* set, int proto, ip_value address);
+void host_set_print_report(const host_set* set, FILE* stream);
+void host_set_free(host_set* set);
+
+#endif /* IPADDRCHECK_HOST_SET_H */
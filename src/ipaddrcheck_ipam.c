@@ -0,0 +1,803 @@
+/*
+ * ipaddrcheck_ipam.c: free space and usage of address pools
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* strdup() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+
+#include "ipaddrcheck_ipam.h"
+
+/* A pool of ::/0 has blocks of 129 different lengths */
+#define FREE_SPACE_MAX_DEPTH (IPV6_BITS + 1)
+
+/*
+ * Sets of block depths
+ */
+
+static inline void free_lengths_clear(uint64_t* lengths)
+{
+    int i = 0;
+
+    for( i = 0; i < FREE_LENGTH_WORDS; i++ )
+    {
+        lengths[i] = 0;
+    }
+}
+
+static inline int free_lengths_test(const uint64_t* lengths, int depth)
+{
+    return (int)((lengths[depth >> 6] >> (depth & 63)) & 1);
+}
+
+/* The deepest of the depths in the set that are not deeper than depth, -1 if there are none */
+static int free_lengths_deepest(const uint64_t* lengths, int depth)
+{
+    int word = 0;
+
+    for( word = depth >> 6; word >= 0; word-- )
+    {
+        uint64_t bits = lengths[word];
+
+        if( (word == (depth >> 6)) && ((depth & 63) < 63) )
+        {
+            bits &= ((uint64_t)2 << (depth & 63)) - 1;
+        }
+        if( bits != 0 )
+        {
+            return word * 64 + 63 - __builtin_clzll(bits);
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Nodes
+ */
+
+static inline int free_node_is_leaf(const free_node* node)
+{
+    return node->children[0] == 0;
+}
+
+static void free_node_make_free(free_node* node, int depth)
+{
+    node->children[0] = 0;
+    node->children[1] = 0;
+    free_lengths_clear(node->free_lengths);
+    node->free_lengths[depth >> 6] = (uint64_t)1 << (depth & 63);
+}
+
+/* Zero if the nodes could not be allocated */
+static uint32_t free_space_new_node(free_space* space)
+{
+    if( space->unused_nodes != 0 )
+    {
+        uint32_t index = space->unused_nodes;
+        space->unused_nodes = space->nodes[index].children[0];
+        return index;
+    }
+
+    if( space->node_count == space->capacity )
+    {
+        size_t capacity = space->capacity * 2;
+        free_node* nodes = NULL;
+
+        if( capacity > UINT32_MAX )
+        {
+            capacity = UINT32_MAX;
+        }
+        if( capacity == space->capacity )
+        {
+            fprintf(stderr, "Error: too many allocations in the pool!\n");
+            return 0;
+        }
+        nodes = realloc(space->nodes, capacity * sizeof(free_node));
+        if( nodes == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            return 0;
+        }
+        space->nodes = nodes;
+        space->capacity = capacity;
+    }
+
+    return (uint32_t)space->node_count++;
+}
+
+/* Give back the nodes below a node */
+static void free_space_prune(free_space* space, uint32_t index)
+{
+    int i = 0;
+
+    for( i = 0; i < 2; i++ )
+    {
+        uint32_t child = space->nodes[index].children[i];
+
+        if( child != 0 )
+        {
+            free_space_prune(space, child);
+            space->nodes[child].children[0] = space->unused_nodes;
+            space->unused_nodes = child;
+        }
+        space->nodes[index].children[i] = 0;
+    }
+}
+
+/* Turn a node into a leaf that is allocated in its entirety */
+static void free_space_make_used(free_space* space, uint32_t index)
+{
+    free_space_prune(space, index);
+    free_lengths_clear(space->nodes[index].free_lengths);
+}
+
+/* Split a free leaf into its two free halves */
+static int free_space_split(free_space* space, uint32_t index, int depth)
+{
+    uint32_t left = free_space_new_node(space);
+    uint32_t right = (left != 0) ? free_space_new_node(space) : 0;
+
+    if( right == 0 )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    free_node_make_free(&space->nodes[left], depth + 1);
+    free_node_make_free(&space->nodes[right], depth + 1);
+    space->nodes[index].children[0] = left;
+    space->nodes[index].children[1] = right;
+    free_lengths_clear(space->nodes[index].free_lengths);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Recompute the free lengths of the nodes on a path from the bottom up,
+ * merging halves that have become the same, as the buddy system does
+ */
+static void free_space_update(free_space* space, const uint32_t* path, int length)
+{
+    int depth = 0;
+    int i = 0;
+
+    for( depth = length - 1; depth >= 0; depth-- )
+    {
+        free_node* node = &space->nodes[path[depth]];
+        const free_node* left = &space->nodes[node->children[0]];
+        const free_node* right = &space->nodes[node->children[1]];
+
+        if( free_node_is_leaf(left) && free_node_is_leaf(right) &&
+            (free_lengths_test(left->free_lengths, depth + 1) == free_lengths_test(right->free_lengths, depth + 1)) )
+        {
+            if( free_lengths_test(left->free_lengths, depth + 1) )
+            {
+                free_space_prune(space, path[depth]);
+                free_node_make_free(node, depth);
+            }
+            else
+            {
+                free_space_make_used(space, path[depth]);
+            }
+            continue;
+        }
+
+        for( i = 0; i < FREE_LENGTH_WORDS; i++ )
+        {
+            node->free_lengths[i] = left->free_lengths[i] | right->free_lengths[i];
+        }
+    }
+}
+
+/*
+ * Pools
+ */
+
+free_space* free_space_new(const ip_prefix* pool)
+{
+    free_space* space = calloc(1, sizeof(free_space));
+
+    if( space != NULL )
+    {
+        space->capacity = 64;
+        space->nodes = malloc(space->capacity * sizeof(free_node));
+    }
+    if( (space == NULL) || (space->nodes == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        free(space);
+        return NULL;
+    }
+
+    space->pool = *pool;
+    space->pool.addr = ip_prefix_first(pool);
+    space->node_count = 1;
+    free_node_make_free(&space->nodes[0], 0);
+
+    return space;
+}
+
+/*
+ * Mark a prefix as allocated. Returns RESULT_FAILURE if it does not
+ * overlap the pool, overlapping allocations are not an error.
+ */
+int free_space_reserve(free_space* space, const ip_prefix* prefix)
+{
+    const ip_prefix* pool = &space->pool;
+    uint32_t path[FREE_SPACE_MAX_DEPTH];
+    uint32_t index = 0;
+    int depth = 0;
+
+    if( prefix->proto != pool->proto )
+    {
+        return(RESULT_FAILURE);
+    }
+    if( ip_prefix_contains(prefix, pool) == RESULT_SUCCESS )
+    {
+        free_space_make_used(space, 0);
+        return(RESULT_SUCCESS);
+    }
+    if( ip_prefix_contains(pool, prefix) != RESULT_SUCCESS )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    for( depth = 0; depth < prefix->pflen - pool->pflen; depth++ )
+    {
+        path[depth] = index;
+        if( free_node_is_leaf(&space->nodes[index]) )
+        {
+            if( !free_lengths_test(space->nodes[index].free_lengths, depth) )
+            {
+                /* Inside an earlier allocation */
+                return(RESULT_SUCCESS);
+            }
+            if( free_space_split(space, index, depth) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+        }
+        index = space->nodes[index].children[ip_value_bit(prefix->addr, ip_bits(pool->proto), pool->pflen + depth)];
+    }
+
+    free_space_make_used(space, index);
+    free_space_update(space, path, depth);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Allocate a free prefix of the given length. Returns RESULT_FAILURE
+ * if there is no room left for one.
+ *
+ * Either strategy takes a single walk down the tree, guided by the
+ * free lengths of the nodes: the lowest prefix comes from the leftmost
+ * subtree with a free block at least as large, the best fit from
+ * the leftmost one with a free block of the smallest such size.
+ */
+int free_space_allocate(free_space* space, int pflen, int strategy, ip_prefix* result)
+{
+    const ip_prefix* pool = &space->pool;
+    uint32_t path[FREE_SPACE_MAX_DEPTH];
+    uint32_t index = 0;
+    int target = pflen - pool->pflen;
+    int fit = 0;
+    int depth = 0;
+
+    if( (target < 0) || (pflen > ip_bits(pool->proto)) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    fit = free_lengths_deepest(space->nodes[0].free_lengths, target);
+    if( fit < 0 )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    result->proto = pool->proto;
+    result->addr = pool->addr;
+    result->pflen = pflen;
+
+    while( !free_node_is_leaf(&space->nodes[index]) )
+    {
+        const free_node* left = &space->nodes[space->nodes[index].children[0]];
+        int go_left = (strategy == ALLOCATE_BEST_FIT) ? free_lengths_test(left->free_lengths, fit)
+                                                      : (free_lengths_deepest(left->free_lengths, target) >= 0);
+
+        path[depth] = index;
+        index = space->nodes[index].children[go_left ? 0 : 1];
+        if( !go_left )
+        {
+            ip_value_set_bit(&result->addr, ip_bits(pool->proto), pool->pflen + depth);
+        }
+        depth++;
+    }
+
+    /* A free block at least as large as the one requested: take its lowest part */
+    for( ; depth < target; depth++ )
+    {
+        path[depth] = index;
+        if( free_space_split(space, index, depth) != RESULT_SUCCESS )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        index = space->nodes[index].children[0];
+    }
+
+    free_space_make_used(space, index);
+    free_space_update(space, path, depth);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Build the free space of a pool, with the prefixes listed in a file,
+ * if any, allocated. Allocations that do not overlap the pool are ignored,
+ * so that one list can serve many pools.
+ */
+free_space* free_space_load(const ip_prefix* pool, const char* allocations_path)
+{
+    free_space* space = free_space_new(pool);
+    ip_prefix* allocations = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    if( (space == NULL) || (allocations_path == NULL) )
+    {
+        return space;
+    }
+
+    allocations = prefix_list_load(allocations_path, &count);
+    if( allocations == NULL )
+    {
+        free_space_free(space);
+        return NULL;
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        if( free_space_reserve(space, &allocations[i]) == RESULT_INT_ERROR )
+        {
+            free(allocations);
+            free_space_free(space);
+            return NULL;
+        }
+    }
+    free(allocations);
+
+    return space;
+}
+
+void free_space_free(free_space* space)
+{
+    if( space == NULL )
+    {
+        return;
+    }
+
+    free(space->nodes);
+    free(space);
+}
+
+/*
+ * Subnet plans
+ */
+
+/*
+ * Load subnet requests, "<length> [label]" lines, for a parent prefix.
+ * Returns NULL if the file has errors, all of them are reported.
+ */
+plan_request* plan_requests_load(const char* path, const ip_prefix* parent, size_t* count)
+{
+    list_reader reader;
+    plan_request* requests = NULL;
+    size_t capacity = 0;
+    int errors = 0;
+    char* line = NULL;
+
+    *count = 0;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* length_str = list_next_field(&line);
+        int pflen = prefix_length_from_str(length_str);
+
+        while( isspace((unsigned char)*line) )
+        {
+            line++;
+        }
+
+        if( (pflen < parent->pflen) || (pflen > ip_bits(parent->proto)) )
+        {
+            list_reader_error(&reader, "\"%s\" is not a prefix length between /%d and /%d",
+                              length_str, parent->pflen, ip_bits(parent->proto));
+            errors++;
+            continue;
+        }
+
+        if( *count == capacity )
+        {
+            plan_request* new_requests = NULL;
+            capacity = capacity ? capacity * 2 : 1024;
+            new_requests = realloc(requests, capacity * sizeof(plan_request));
+            if( new_requests == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+                errors++;
+                break;
+            }
+            requests = new_requests;
+        }
+
+        requests[*count].pflen = pflen;
+        requests[*count].index = *count;
+        requests[*count].label = (*line != '\0') ? strdup(line) : NULL;
+        if( (*line != '\0') && (requests[*count].label == NULL) )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+        (*count)++;
+    }
+
+    list_reader_close(&reader);
+
+    if( errors > 0 )
+    {
+        plan_requests_free(requests, *count);
+        *count = 0;
+        return NULL;
+    }
+
+    /* An empty list is not an error */
+    if( requests == NULL )
+    {
+        requests = malloc(sizeof(plan_request));
+        if( requests == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+    }
+
+    return requests;
+}
+
+/* The largest subnets first, in the order they were requested among equals */
+static int plan_request_size_cmp(const void* left, const void* right)
+{
+    const plan_request* l = left;
+    const plan_request* r = right;
+
+    if( l->pflen != r->pflen )
+    {
+        return (l->pflen < r->pflen) ? -1 : 1;
+    }
+    return (l->index < r->index) ? -1 : (l->index > r->index);
+}
+
+static int plan_request_index_cmp(const void* left, const void* right)
+{
+    const plan_request* l = left;
+    const plan_request* r = right;
+
+    return (l->index < r->index) ? -1 : (l->index > r->index);
+}
+
+/*
+ * Give every request a prefix within the parent, leaving them
+ * in the order they were requested. Returns RESULT_FAILURE if they
+ * do not all fit.
+ *
+ * Once the largest subnets go first, each one starts where the one
+ * before ended: every block size divides the sizes of all the blocks
+ * before it, so the running offset is always aligned, and the plan
+ * packs the requests without holes.
+ */
+int subnet_plan(const ip_prefix* parent, plan_request* requests, size_t count)
+{
+    int width = ip_bits(parent->proto);
+    ip_value parent_mask = ip_host_mask(parent->proto, parent->pflen);
+    ip_value first = ip_prefix_first(parent);
+    ip_value offset = { 0, 0 };
+    int full = 0;
+    size_t i = 0;
+
+    qsort(requests, count, sizeof(plan_request), plan_request_size_cmp);
+
+    for( i = 0; i < count; i++ )
+    {
+        int host_bits = width - requests[i].pflen;
+        ip_value end = offset;
+
+        /* Does the offset still lie within the parent? */
+        if( full || ((offset.hi & ~parent_mask.hi) != 0) || ((offset.lo & ~parent_mask.lo) != 0) )
+        {
+            qsort(requests, count, sizeof(plan_request), plan_request_index_cmp);
+            return(RESULT_FAILURE);
+        }
+
+        requests[i].prefix.proto = parent->proto;
+        requests[i].prefix.pflen = requests[i].pflen;
+        requests[i].prefix.addr.hi = first.hi | offset.hi;
+        requests[i].prefix.addr.lo = first.lo | offset.lo;
+
+        /* Past the block, a carry out of the top bit means the whole space is taken */
+        if( host_bits >= 64 )
+        {
+            end.hi += (host_bits < IPV6_BITS) ? (uint64_t)1 << (host_bits - 64) : 0;
+            full = (host_bits == IPV6_BITS) || (end.hi < offset.hi);
+        }
+        else
+        {
+            end.lo += (uint64_t)1 << host_bits;
+            end.hi += (end.lo < offset.lo);
+            full = (end.hi < offset.hi);
+        }
+        offset = end;
+    }
+
+    qsort(requests, count, sizeof(plan_request), plan_request_index_cmp);
+
+    return(RESULT_SUCCESS);
+}
+
+void plan_requests_free(plan_request* requests, size_t count)
+{
+    size_t i = 0;
+
+    if( requests == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        free(requests[i].label);
+    }
+    free(requests);
+}
+
+/*
+ * Usage of DHCP ranges
+ */
+
+/* Parse a range of IPv4 addresses, "<first>-<last>", with ip_range_from_str() like is_ipv4_range() */
+static int lease_pool_from_str(const list_reader* reader, const char* range_str, lease_pool* pool)
+{
+    ip_range range;
+
+    switch( ip_range_from_str(range_str, CIDR_IPV4, &range) )
+    {
+        case RANGE_VALID:
+            pool->first = (uint32_t)range.first.lo;
+            pool->last = (uint32_t)range.last.lo;
+            return(RESULT_SUCCESS);
+        case RANGE_BAD_FIRST:
+            list_reader_error(reader, "%.*s is not a valid IPv4 address", (int)range.first_length, range_str);
+            break;
+        case RANGE_BAD_LAST:
+            list_reader_error(reader, "%s is not a valid IPv4 address", range_str + range.first_length + 1);
+            break;
+        case RANGE_REVERSED:
+            list_reader_error(reader, "the first address of %s is greater than the last", range_str);
+            break;
+        default:
+            list_reader_error(reader, "\"%s\" is not a pair of hyphen-separated IPv4 addresses", range_str);
+            break;
+    }
+
+    return(RESULT_FAILURE);
+}
+
+static int lease_pool_cmp(const void* left, const void* right)
+{
+    const lease_pool* l = left;
+    const lease_pool* r = right;
+
+    return (l->first < r->first) ? -1 : (l->first > r->first);
+}
+
+/*
+ * Load DHCP ranges, "<first>-<last> [label]" lines, with no leases in them yet.
+ * Returns NULL if the file has errors or the ranges overlap.
+ */
+pool_usage* pool_usage_load(const char* path)
+{
+    list_reader reader;
+    pool_usage* usage = NULL;
+    size_t capacity = 0;
+    int errors = 0;
+    char* line = NULL;
+    size_t i = 0;
+
+    usage = calloc(1, sizeof(pool_usage));
+    if( usage == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return NULL;
+    }
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        free(usage);
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        lease_pool pool;
+
+        memset(&pool, 0, sizeof(pool));
+        if( lease_pool_from_str(&reader, list_next_field(&line), &pool) != RESULT_SUCCESS )
+        {
+            errors++;
+            continue;
+        }
+
+        while( isspace((unsigned char)*line) )
+        {
+            line++;
+        }
+
+        if( usage->count == capacity )
+        {
+            lease_pool* new_pools = NULL;
+            capacity = capacity ? capacity * 2 : 1024;
+            new_pools = realloc(usage->pools, capacity * sizeof(lease_pool));
+            if( new_pools == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+                errors++;
+                break;
+            }
+            usage->pools = new_pools;
+        }
+
+        /* Addresses past the last one of the range leave the rest of the last word clear */
+        pool.leased = calloc(((size_t)(pool.last - pool.first) >> 6) + 1, sizeof(uint64_t));
+        pool.label = (*line != '\0') ? strdup(line) : NULL;
+        usage->pools[usage->count] = pool;
+        usage->count++;
+        if( (pool.leased == NULL) || ((*line != '\0') && (pool.label == NULL)) )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+    }
+
+    list_reader_close(&reader);
+
+    if( errors == 0 )
+    {
+        qsort(usage->pools, usage->count, sizeof(lease_pool), lease_pool_cmp);
+
+        for( i = 1; i < usage->count; i++ )
+        {
+            if( usage->pools[i].first <= usage->pools[i - 1].last )
+            {
+                char first_str[PREFIX_STR_MAX];
+                char second_str[PREFIX_STR_MAX];
+                ip_value first = { 0, usage->pools[i - 1].first };
+                ip_value second = { 0, usage->pools[i].first };
+
+                fprintf(stderr, "Error: the ranges starting at %s and %s in %s overlap!\n",
+                        ip_addr_to_str(CIDR_IPV4, first, first_str),
+                        ip_addr_to_str(CIDR_IPV4, second, second_str), path);
+                errors++;
+            }
+        }
+    }
+
+    if( errors == 0 )
+    {
+        usage->starts = malloc((usage->count > 0 ? usage->count : 1) * sizeof(uint32_t));
+        if( usage->starts == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+        }
+    }
+
+    if( errors > 0 )
+    {
+        pool_usage_free(usage);
+        return NULL;
+    }
+
+    for( i = 0; i < usage->count; i++ )
+    {
+        usage->starts[i] = usage->pools[i].first;
+    }
+
+    return usage;
+}
+
+/* Mark a lease in the range it belongs to, found by binary search over the first addresses */
+void pool_usage_add_lease(pool_usage* usage, uint32_t address)
+{
+    const uint32_t* starts = usage->starts;
+    lease_pool* pool = NULL;
+    size_t low = 0;
+    size_t high = usage->count;
+    uint32_t offset = 0;
+    uint64_t bit = 0;
+
+    /* The number of ranges that start at or before the address */
+    while( low < high )
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if( starts[middle] <= address )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if( (low == 0) || (address > usage->pools[low - 1].last) )
+    {
+        usage->out_of_pool++;
+        return;
+    }
+
+    pool = &usage->pools[low - 1];
+    offset = address - pool->first;
+    bit = (uint64_t)1 << (offset & 63);
+    if( pool->leased[offset >> 6] & bit )
+    {
+        pool->duplicates++;
+    }
+    else
+    {
+        pool->leased[offset >> 6] |= bit;
+        pool->used++;
+    }
+}
+
+void pool_usage_free(pool_usage* usage)
+{
+    size_t i = 0;
+
+    if( usage == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < usage->count; i++ )
+    {
+        free(usage->pools[i].leased);
+        free(usage->pools[i].label);
+    }
+    free(usage->pools);
+    free(usage->starts);
+    free(usage);
+}
@@ -0,0 +1,102 @@
+/*
+ * ipaddrcheck_ipam.h: free space and usage of address pools
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_IPAM_H
+#define IPADDRCHECK_IPAM_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* Allocation strategies */
+#define ALLOCATE_LOWEST    0  /* the free prefix with the lowest address */
+#define ALLOCATE_BEST_FIT  1  /* one carved from the smallest free block it fits in */
+
+/* Bits for every prefix length from the pool's own to /128 */
+#define FREE_LENGTH_WORDS  3
+
+/*
+ * A node of the buddy tree of a pool: the node at depth d stands for
+ * one of the aligned blocks of the pool with prefix length pool + d.
+ * A leaf is a block that is entirely free or entirely allocated,
+ * the children of a node are its two halves.
+ *
+ * free_lengths has bit n set if the subtree holds a free block
+ * of length pool + n, so a lookup can tell which half to descend into
+ * without looking further.
+ */
+typedef struct
+{
+    uint32_t children[2];  /* zero in a leaf, the root is never a child */
+    uint64_t free_lengths[FREE_LENGTH_WORDS];
+} free_node;
+
+typedef struct
+{
+    ip_prefix pool;
+    free_node* nodes;
+    size_t node_count;
+    size_t capacity;
+    uint32_t unused_nodes;  /* freed nodes, chained through children[0] */
+} free_space;
+
+/* A subnet requested from a plan, and the prefix it is given */
+typedef struct
+{
+    int pflen;
+    char* label;       /* the rest of the request line, NULL if there is none */
+    size_t index;      /* position in the list of requests */
+    ip_prefix prefix;
+} plan_request;
+
+/* A DHCP range and the leases found in it */
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+    char* label;        /* the rest of the range line, NULL if there is none */
+    uint64_t* leased;   /* a bit for every address of the range */
+    uint64_t used;
+    uint64_t duplicates;
+} lease_pool;
+
+/* Ranges sorted by their first address, and the leases that fit none of them */
+typedef struct
+{
+    lease_pool* pools;
+    uint32_t* starts;   /* first addresses of the ranges, searched for every lease */
+    size_t count;
+    uint64_t out_of_pool;
+} pool_usage;
+
+free_space* free_space_new(const ip_prefix* pool);
+free_space* free_space_load(const ip_prefix* pool, const char* allocations_path);
+int free_space_reserve(free_space* space, const ip_prefix* prefix);
+int free_space_allocate(free_space* space, int pflen, int strategy, ip_prefix* result);
+void free_space_free(free_space* space);
+
+plan_request* plan_requests_load(const char* path, const ip_prefix* parent, size_t* count);
+int subnet_plan(const ip_prefix* parent, plan_request* requests, size_t count);
+void plan_requests_free(plan_request* requests, size_t count);
+
+pool_usage* pool_usage_load(const char* path);
+void pool_usage_add_lease(pool_usage* usage, uint32_t address);
+void pool_usage_free(pool_usage* usage);
+
+#endif /* IPADDRCHECK_IPAM_H */
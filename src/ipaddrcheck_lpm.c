@@ -0,0 +1,563 @@
+/*
+ * ipaddrcheck_lpm.c: longest prefix match tables
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* strdup() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+
+#include "ipaddrcheck_lpm.h"
+
+#define TBL24_SIZE     (1 << 24)
+#define TBL8_SIZE      256
+#define TBL24_EXTENDED 0x80000000U
+
+/* Byte of an IPv6 address, counting from the most significant one */
+static inline unsigned int ip_value_byte(ip_value value, int index)
+{
+    if( index < 8 )
+    {
+        return (unsigned int)(value.hi >> (56 - 8 * index)) & 0xff;
+    }
+    return (unsigned int)(value.lo >> (56 - 8 * (index - 8))) & 0xff;
+}
+
+/* Insertion order: shorter prefixes first, so that longer ones
+   simply overwrite the slots they share with them */
+static int lpm_entry_cmp(const void* left, const void* right)
+{
+    const lpm_entry* left_entry = left;
+    const lpm_entry* right_entry = right;
+
+    if( left_entry->prefix.pflen != right_entry->prefix.pflen )
+    {
+        return (left_entry->prefix.pflen < right_entry->prefix.pflen) ? -1 : 1;
+    }
+    return ip_prefix_cmp(&left_entry->prefix, &right_entry->prefix);
+}
+
+static int lpm_insert_ipv4(lpm_table* table, uint32_t addr, int pflen, uint32_t value)
+{
+    size_t first = 0;
+    size_t count = 0;
+    size_t i = 0;
+    uint32_t* slots = NULL;
+
+    if( pflen <= 24 )
+    {
+        /* No slot can be extended yet since all longer prefixes come later */
+        slots = table->tbl24;
+        first = addr >> 8;
+        count = (size_t)1 << (24 - pflen);
+    }
+    else
+    {
+        uint32_t index = addr >> 8;
+        uint32_t group = 0;
+
+        if( table->tbl24[index] & TBL24_EXTENDED )
+        {
+            group = table->tbl24[index] & ~TBL24_EXTENDED;
+        }
+        else
+        {
+            if( table->tbl8_groups == table->tbl8_capacity )
+            {
+                size_t capacity = table->tbl8_capacity ? table->tbl8_capacity * 2 : 64;
+                uint32_t* tbl8 = realloc(table->tbl8, capacity * TBL8_SIZE * sizeof(uint32_t));
+                if( tbl8 == NULL )
+                {
+                    return(RESULT_INT_ERROR);
+                }
+                table->tbl8 = tbl8;
+                table->tbl8_capacity = capacity;
+            }
+
+            /* The new group inherits the match of its /24 */
+            group = (uint32_t)table->tbl8_groups++;
+            for( i = 0; i < TBL8_SIZE; i++ )
+            {
+                table->tbl8[(size_t)group * TBL8_SIZE + i] = table->tbl24[index];
+            }
+            table->tbl24[index] = TBL24_EXTENDED | group;
+        }
+
+        slots = table->tbl8 + (size_t)group * TBL8_SIZE;
+        first = addr & 0xff;
+        count = (size_t)1 << (32 - pflen);
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        slots[first + i] = value;
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+static int lpm_new_trie_node(lpm_table* table, uint32_t* node)
+{
+    if( table->trie_nodes == table->trie_capacity )
+    {
+        size_t capacity = table->trie_capacity ? table->trie_capacity * 2 : 64;
+        uint32_t* children = realloc(table->trie_children, capacity * LPM_STRIDE_SLOTS * sizeof(uint32_t));
+        uint32_t* values = NULL;
+        if( children == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        table->trie_children = children;
+
+        values = realloc(table->trie_values, capacity * LPM_STRIDE_SLOTS * sizeof(uint32_t));
+        if( values == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        table->trie_values = values;
+        table->trie_capacity = capacity;
+    }
+
+    *node = (uint32_t)table->trie_nodes++;
+    memset(table->trie_children + (size_t)*node * LPM_STRIDE_SLOTS, 0, LPM_STRIDE_SLOTS * sizeof(uint32_t));
+    memset(table->trie_values + (size_t)*node * LPM_STRIDE_SLOTS, 0, LPM_STRIDE_SLOTS * sizeof(uint32_t));
+
+    return(RESULT_SUCCESS);
+}
+
+static int lpm_insert_ipv6(lpm_table* table, ip_value addr, int pflen, uint32_t value)
+{
+    uint32_t node = 0;
+    int level = 0;
+    int last_level = 0;
+    unsigned int remaining = 0;
+    unsigned int first = 0;
+    unsigned int i = 0;
+
+    if( pflen == 0 )
+    {
+        table->ipv6_default = value;
+        return(RESULT_SUCCESS);
+    }
+
+    /* Node 0 is the root, so zero also works as "no child" */
+    if( (table->trie_nodes == 0) && (lpm_new_trie_node(table, &node) != RESULT_SUCCESS) )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    /* Walk down to the stride where the prefix ends */
+    last_level = (pflen - 1) / LPM_STRIDE_BITS;
+    for( level = 0; level < last_level; level++ )
+    {
+        size_t slot = (size_t)node * LPM_STRIDE_SLOTS + ip_value_byte(addr, level);
+        if( table->trie_children[slot] == 0 )
+        {
+            uint32_t child = 0;
+            if( lpm_new_trie_node(table, &child) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+            table->trie_children[slot] = child;
+        }
+        node = table->trie_children[slot];
+    }
+
+    /* Expand the prefix to every slot of the stride it covers */
+    remaining = (unsigned int)(pflen - last_level * LPM_STRIDE_BITS);
+    first = ip_value_byte(addr, last_level) & (0xff << (LPM_STRIDE_BITS - remaining)) & 0xff;
+    for( i = 0; i < (1U << (LPM_STRIDE_BITS - remaining)); i++ )
+    {
+        table->trie_values[(size_t)node * LPM_STRIDE_SLOTS + first + i] = value;
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Build a table from an array of entries without duplicate prefixes.
+ * The table takes ownership of the array and the labels.
+ */
+lpm_table* lpm_table_build(lpm_entry* entries, size_t entry_count)
+{
+    lpm_table* table = calloc(1, sizeof(lpm_table));
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    if( table == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return NULL;
+    }
+
+    qsort(entries, entry_count, sizeof(lpm_entry), lpm_entry_cmp);
+    table->entries = entries;
+    table->entry_count = entry_count;
+
+    for( i = 0; (i < entry_count) && (result == RESULT_SUCCESS); i++ )
+    {
+        const ip_prefix* prefix = &entries[i].prefix;
+        uint32_t value = (uint32_t)(i + 1);
+
+        if( prefix->proto == CIDR_IPV4 )
+        {
+            if( table->tbl24 == NULL )
+            {
+                table->tbl24 = calloc(TBL24_SIZE, sizeof(uint32_t));
+                if( table->tbl24 == NULL )
+                {
+                    result = RESULT_INT_ERROR;
+                    break;
+                }
+            }
+            result = lpm_insert_ipv4(table, (uint32_t)prefix->addr.lo, prefix->pflen, value);
+        }
+        else
+        {
+            result = lpm_insert_ipv6(table, prefix->addr, prefix->pflen, value);
+        }
+    }
+
+    if( result != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        lpm_table_free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+/* Load a table file made of "<prefix> <label>" lines.
+ * All malformed lines are reported before giving up.
+ */
+lpm_table* lpm_table_load(const char* path)
+{
+    list_reader reader;
+    lpm_entry* entries = NULL;
+    size_t entry_count = 0;
+    size_t capacity = 0;
+    int errors = 0;
+    char* line = NULL;
+    size_t i = 0;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* cursor = line;
+        char* prefix_str = list_next_field(&cursor);
+        ip_prefix prefix;
+
+        while( isspace((unsigned char)*cursor) )
+        {
+            cursor++;
+        }
+
+        if( list_reader_prefix(&reader, prefix_str, &prefix) != RESULT_SUCCESS )
+        {
+            errors++;
+            continue;
+        }
+        if( *cursor == '\0' )
+        {
+            list_reader_error(&reader, "missing label for %s", prefix_str);
+            errors++;
+            continue;
+        }
+
+        if( entry_count == capacity )
+        {
+            lpm_entry* new_entries = NULL;
+            capacity = capacity ? capacity * 2 : 1024;
+            new_entries = realloc(entries, capacity * sizeof(lpm_entry));
+            if( new_entries == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+                errors++;
+                break;
+            }
+            entries = new_entries;
+        }
+
+        entries[entry_count].prefix = prefix;
+        entries[entry_count].label = strdup(cursor);
+        entries[entry_count].line_number = reader.line_number;
+        entries[entry_count].value = 0;
+        if( entries[entry_count].label == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+        entry_count++;
+    }
+
+    list_reader_close(&reader);
+
+    /* Duplicates end up next to each other once sorted */
+    if( errors == 0 )
+    {
+        qsort(entries, entry_count, sizeof(lpm_entry), lpm_entry_cmp);
+        for( i = 1; i < entry_count; i++ )
+        {
+            if( ip_prefix_cmp(&entries[i - 1].prefix, &entries[i].prefix) == 0 )
+            {
+                char prefix_str[PREFIX_STR_MAX];
+                int first_line = entries[i - 1].line_number;
+                int second_line = entries[i].line_number;
+                fprintf(stderr, "Error: %s line %d: duplicate prefix %s (first defined on line %d)\n",
+                        path, (first_line > second_line) ? first_line : second_line,
+                        ip_prefix_to_str(&entries[i].prefix, prefix_str),
+                        (first_line > second_line) ? second_line : first_line);
+                errors++;
+            }
+        }
+    }
+
+    if( errors > 0 )
+    {
+        for( i = 0; i < entry_count; i++ )
+        {
+            free(entries[i].label);
+        }
+        free(entries);
+        return NULL;
+    }
+
+    return lpm_table_build(entries, entry_count);
+}
+
+/* Find the longest prefix that covers the address, NULL if there is none */
+const lpm_entry* lpm_lookup(const lpm_table* table, const ip_prefix* address)
+{
+    uint32_t value = 0;
+
+    if( address->proto == CIDR_IPV4 )
+    {
+        uint32_t addr = (uint32_t)address->addr.lo;
+
+        if( table->tbl24 == NULL )
+        {
+            return NULL;
+        }
+
+        value = table->tbl24[addr >> 8];
+        if( value & TBL24_EXTENDED )
+        {
+            value = table->tbl8[(size_t)(value & ~TBL24_EXTENDED) * TBL8_SIZE + (addr & 0xff)];
+        }
+    }
+    else
+    {
+        uint32_t node = 0;
+        int level = 0;
+
+        value = table->ipv6_default;
+        for( level = 0; (level < IPV6_BITS / LPM_STRIDE_BITS) && (table->trie_nodes > 0); level++ )
+        {
+            size_t slot = (size_t)node * LPM_STRIDE_SLOTS + ip_value_byte(address->addr, level);
+            if( table->trie_values[slot] != 0 )
+            {
+                value = table->trie_values[slot];
+            }
+            node = table->trie_children[slot];
+            if( node == 0 )
+            {
+                break;
+            }
+        }
+    }
+
+    return (value != 0) ? &table->entries[value - 1] : NULL;
+}
+
+/* Lookup state of one address of a batch */
+typedef struct
+{
+    size_t slot;     /* the slot to read next */
+    uint32_t value;  /* the longest match so far */
+    int level;       /* tbl24 or tbl8, or the trie level, LPM_LOOKUP_DONE when finished */
+} lpm_lookup_state;
+
+#define LPM_LOOKUP_DONE -1
+
+static inline void lpm_prefetch_slot(const lpm_table* table, const ip_prefix* address, const lpm_lookup_state* state)
+{
+    if( address->proto == CIDR_IPV4 )
+    {
+        __builtin_prefetch((state->level == 0) ? &table->tbl24[state->slot] : &table->tbl8[state->slot]);
+    }
+    else
+    {
+        __builtin_prefetch(&table->trie_values[state->slot]);
+        __builtin_prefetch(&table->trie_children[state->slot]);
+    }
+}
+
+/*
+ * Read the slot prefetched for an address, and if the lookup
+ * is not finished yet, find and prefetch the one after it
+ */
+static inline int lpm_lookup_step(const lpm_table* table, const ip_prefix* address, lpm_lookup_state* state)
+{
+    if( address->proto == CIDR_IPV4 )
+    {
+        uint32_t value = (state->level == 0) ? table->tbl24[state->slot] : table->tbl8[state->slot];
+
+        if( (state->level == 0) && (value & TBL24_EXTENDED) )
+        {
+            state->slot = (size_t)(value & ~TBL24_EXTENDED) * TBL8_SIZE + (address->addr.lo & 0xff);
+            state->level = 1;
+        }
+        else
+        {
+            state->value = value;
+            state->level = LPM_LOOKUP_DONE;
+        }
+    }
+    else
+    {
+        uint32_t node = table->trie_children[state->slot];
+
+        if( table->trie_values[state->slot] != 0 )
+        {
+            state->value = table->trie_values[state->slot];
+        }
+        state->level++;
+        if( (node == 0) || (state->level == IPV6_BITS / LPM_STRIDE_BITS) )
+        {
+            state->level = LPM_LOOKUP_DONE;
+        }
+        else
+        {
+            state->slot = (size_t)node * LPM_STRIDE_SLOTS + ip_value_byte(address->addr, state->level);
+        }
+    }
+
+    if( state->level == LPM_LOOKUP_DONE )
+    {
+        return(RESULT_FAILURE);
+    }
+    lpm_prefetch_slot(table, address, state);
+
+    return(RESULT_SUCCESS);
+}
+
+/* Look up at most LPM_BATCH_SIZE addresses together */
+static void lpm_lookup_group(const lpm_table* table, const ip_prefix* addresses, size_t count,
+                             const lpm_entry** results)
+{
+    lpm_lookup_state states[LPM_BATCH_SIZE];
+    size_t pending = 0;
+    size_t i = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        lpm_lookup_state* state = &states[i];
+
+        state->level = 0;
+        if( addresses[i].proto == CIDR_IPV4 )
+        {
+            state->value = 0;
+            state->slot = (size_t)((uint32_t)addresses[i].addr.lo >> 8);
+            if( table->tbl24 == NULL )
+            {
+                state->level = LPM_LOOKUP_DONE;
+            }
+        }
+        else
+        {
+            state->value = table->ipv6_default;
+            state->slot = ip_value_byte(addresses[i].addr, 0);
+            if( table->trie_nodes == 0 )
+            {
+                state->level = LPM_LOOKUP_DONE;
+            }
+        }
+        if( state->level != LPM_LOOKUP_DONE )
+        {
+            lpm_prefetch_slot(table, &addresses[i], state);
+            pending++;
+        }
+    }
+
+    /* Every round reads one slot of each unfinished lookup,
+       by which time the prefetch issued in the round before has had
+       the whole round to complete */
+    while( pending > 0 )
+    {
+        pending = 0;
+        for( i = 0; i < count; i++ )
+        {
+            if( (states[i].level != LPM_LOOKUP_DONE) &&
+                (lpm_lookup_step(table, &addresses[i], &states[i]) == RESULT_SUCCESS) )
+            {
+                pending++;
+            }
+        }
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        results[i] = (states[i].value != 0) ? &table->entries[states[i].value - 1] : NULL;
+    }
+}
+
+/*
+ * Look up many addresses at once. The lookups of a group advance
+ * in lockstep and the memory each one needs next is prefetched
+ * before any of them reads it, so that their cache misses overlap
+ * instead of following one another.
+ */
+void lpm_lookup_batch(const lpm_table* table, const ip_prefix* addresses, size_t count,
+                      const lpm_entry** results)
+{
+    size_t start = 0;
+
+    for( start = 0; start < count; start += LPM_BATCH_SIZE )
+    {
+        size_t length = (count - start < LPM_BATCH_SIZE) ? count - start : LPM_BATCH_SIZE;
+        lpm_lookup_group(table, addresses + start, length, results + start);
+    }
+}
+
+void lpm_table_free(lpm_table* table)
+{
+    size_t i = 0;
+
+    if( table == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < table->entry_count; i++ )
+    {
+        free(table->entries[i].label);
+    }
+    free(table->entries);
+    free(table->tbl24);
+    free(table->tbl8);
+    free(table->trie_children);
+    free(table->trie_values);
+    free(table);
+}
@@ -0,0 +1,78 @@
+/*
+ * ipaddrcheck_lpm.h: longest prefix match tables
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_LPM_H
+#define IPADDRCHECK_LPM_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* A prefix with its label and the line of the table it came from */
+typedef struct
+{
+    ip_prefix prefix;
+    char* label;
+    int line_number;
+    int value;        /* for the builder of the table, e.g. the verdict of a compiled policy */
+} lpm_entry;
+
+/*
+ * IPv4 prefixes are stored in a DIR-24-8 table:
+ * the top 24 bits of an address index tbl24 directly,
+ * and prefixes longer than /24 get a 256-entry tbl8 group
+ * for the last octet, so a lookup takes at most two memory accesses.
+ *
+ * IPv6 prefixes are stored in a multibit trie with 8-bit strides,
+ * prefixes that end in the middle of a stride are expanded
+ * to all slots they cover.
+ *
+ * Table slots hold entry index + 1, zero means no match.
+ */
+typedef struct
+{
+    lpm_entry* entries;
+    size_t entry_count;
+
+    uint32_t* tbl24;
+    uint32_t* tbl8;
+    size_t tbl8_groups;
+    size_t tbl8_capacity;
+
+    uint32_t* trie_children;
+    uint32_t* trie_values;
+    size_t trie_nodes;
+    size_t trie_capacity;
+    uint32_t ipv6_default;
+} lpm_table;
+
+#define LPM_STRIDE_BITS  8
+#define LPM_STRIDE_SLOTS 256
+
+/* Addresses looked up together by lpm_lookup_batch */
+#define LPM_BATCH_SIZE   16
+
+lpm_table* lpm_table_build(lpm_entry* entries, size_t entry_count);
+lpm_table* lpm_table_load(const char* path);
+const lpm_entry* lpm_lookup(const lpm_table* table, const ip_prefix* address);
+void lpm_lookup_batch(const lpm_table* table, const ip_prefix* addresses, size_t count,
+                      const lpm_entry** results);
+void lpm_table_free(lpm_table* table);
+
+#endif /* IPADDRCHECK_LPM_H */
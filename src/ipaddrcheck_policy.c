@@ -0,0 +1,814 @@
+/*
+ * ipaddrcheck_policy.c: ordered permit/deny address policies
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* strdup() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include "ipaddrcheck_classify.h"
+#include "ipaddrcheck_policy.h"
+
+#define POLICY_UNDECIDED -1
+#define POLICY_CLASS_PREFIXES 3
+
+/*
+ * Built-in address classes
+ */
+
+/* Does the address or prefix of either family belong to a class? */
+static int ip_has_class(CIDR* address, unsigned int address_class)
+{
+    ip_prefix prefix;
+
+    if( (ip_prefix_from_cidr(address, &prefix) == RESULT_SUCCESS) &&
+        (ip_prefix_classes(&prefix) & address_class) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    return(RESULT_FAILURE);
+}
+
+static int class_multicast(CIDR* address)
+{
+    return ip_has_class(address, ADDRESS_CLASS_MULTICAST);
+}
+
+static int class_ipv6_loopback(CIDR* address)
+{
+    if( (cidr_get_proto(address) == CIDR_IPV6) && ip_has_class(address, ADDRESS_CLASS_LOOPBACK) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    return(RESULT_FAILURE);
+}
+
+static int class_loopback(CIDR* address)
+{
+    return ip_has_class(address, ADDRESS_CLASS_LOOPBACK);
+}
+
+static int class_link_local(CIDR* address)
+{
+    return ip_has_class(address, ADDRESS_CLASS_LINK_LOCAL);
+}
+
+static int class_ipv4_this_network(CIDR* address)
+{
+    return ip_has_class(address, ADDRESS_CLASS_THIS_NETWORK);
+}
+
+static int class_ipv4_limited_broadcast(CIDR* address)
+{
+    return ip_has_class(address, ADDRESS_CLASS_LIMITED_BROADCAST);
+}
+
+/* Every class is given both as a predicate, for first-match evaluation,
+   and as the prefixes it consists of, for compilation. */
+static const struct
+{
+    const char* name;
+    int (*matches)(CIDR* address);
+    const char* prefixes[POLICY_CLASS_PREFIXES];
+} policy_classes[] =
+{
+    { "any",                    is_valid_address,             { "0.0.0.0/0", "::/0" } },
+    { "ipv4",                   is_ipv4,                      { "0.0.0.0/0" } },
+    { "ipv6",                   is_ipv6,                      { "::/0" } },
+    { "multicast",              class_multicast,              { IPV4_MULTICAST, IPV6_MULTICAST } },
+    { "ipv4-multicast",         is_ipv4_multicast,            { IPV4_MULTICAST } },
+    { "ipv6-multicast",         is_ipv6_multicast,            { IPV6_MULTICAST } },
+    { "loopback",               class_loopback,               { IPV4_LOOPBACK, IPV6_LOOPBACK } },
+    { "ipv4-loopback",          is_ipv4_loopback,             { IPV4_LOOPBACK } },
+    { "ipv6-loopback",          class_ipv6_loopback,          { IPV6_LOOPBACK } },
+    { "link-local",             class_link_local,             { IPV4_LINKLOCAL, IPV6_LINKLOCAL } },
+    { "ipv4-link-local",        is_ipv4_link_local,           { IPV4_LINKLOCAL } },
+    { "ipv6-link-local",        is_ipv6_link_local,           { IPV6_LINKLOCAL } },
+    { "rfc1918",                is_ipv4_rfc1918,              { IPV4_RFC1918_A, IPV4_RFC1918_B, IPV4_RFC1918_C } },
+    { "ipv4-this-network",      class_ipv4_this_network,      { IPV4_THIS } },
+    { "ipv4-limited-broadcast", class_ipv4_limited_broadcast, { IPV4_LIMITED_BROADCAST } },
+    { NULL,                     NULL,                         { NULL } }
+};
+
+#define POLICY_CLASS_COUNT (sizeof(policy_classes) / sizeof(policy_classes[0]))
+
+/* The prefixes of every class, parsed once for all compilations */
+static ip_prefix policy_class_prefixes[POLICY_CLASS_COUNT][POLICY_CLASS_PREFIXES];
+static int policy_class_prefix_counts[POLICY_CLASS_COUNT];
+static pthread_once_t policy_class_prefixes_once = PTHREAD_ONCE_INIT;
+
+static void parse_policy_class_prefixes(void)
+{
+    int i = 0;
+    int j = 0;
+
+    for( i = 0; policy_classes[i].name != NULL; i++ )
+    {
+        for( j = 0; (j < POLICY_CLASS_PREFIXES) && (policy_classes[i].prefixes[j] != NULL); j++ )
+        {
+            char prefix_str[PREFIX_STR_MAX];
+            ip_prefix* prefix = &policy_class_prefixes[i][policy_class_prefix_counts[i]];
+
+            strcpy(prefix_str, policy_classes[i].prefixes[j]);
+            /* Cannot fail with the constants above */
+            if( ip_prefix_from_str(prefix_str, prefix) == RESULT_SUCCESS )
+            {
+                policy_class_prefix_counts[i]++;
+            }
+        }
+    }
+}
+
+const char* policy_verdict_name(int verdict)
+{
+    return (verdict == POLICY_PERMIT) ? "permit" : "deny";
+}
+
+/*
+ * Rule lists
+ */
+
+address_policy* policy_new(void)
+{
+    address_policy* policy = calloc(1, sizeof(address_policy));
+    if( policy == NULL )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+    }
+    return policy;
+}
+
+/* Append a "<permit|deny> <prefix|class>" rule,
+ * problems are reported against the current line of the reader, if any.
+ */
+int policy_add_rule(address_policy* policy, char* verdict_str, char* match_str, const list_reader* reader)
+{
+    policy_rule rule;
+    int i = 0;
+
+    if( strcmp(verdict_str, "permit") == 0 )
+    {
+        rule.verdict = POLICY_PERMIT;
+    }
+    else if( strcmp(verdict_str, "deny") == 0 )
+    {
+        rule.verdict = POLICY_DENY;
+    }
+    else
+    {
+        if( reader != NULL )
+        {
+            list_reader_error(reader, "\"%s\" is not a valid verdict, must be \"permit\" or \"deny\"", verdict_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    if( match_str == NULL )
+    {
+        if( reader != NULL )
+        {
+            list_reader_error(reader, "missing prefix or address class after \"%s\"", verdict_str);
+        }
+        return(RESULT_FAILURE);
+    }
+
+    rule.line_number = (reader != NULL) ? reader->line_number : 0;
+    rule.cidr = NULL;
+    rule.class_index = -1;
+
+    for( i = 0; policy_classes[i].name != NULL; i++ )
+    {
+        if( strcmp(match_str, policy_classes[i].name) == 0 )
+        {
+            rule.class_index = i;
+            break;
+        }
+    }
+
+    if( rule.class_index < 0 )
+    {
+        if( ip_prefix_from_str(match_str, &rule.prefix) != RESULT_SUCCESS )
+        {
+            if( reader != NULL )
+            {
+                list_reader_error(reader, "\"%s\" is not a valid prefix or address class", match_str);
+            }
+            return(RESULT_FAILURE);
+        }
+        if( ip_prefix_is_network(&rule.prefix) != RESULT_SUCCESS )
+        {
+            if( reader != NULL )
+            {
+                char network_str[PREFIX_STR_MAX];
+                rule.prefix.addr = ip_prefix_first(&rule.prefix);
+                list_reader_error(reader, "%s is a host address, not a network address. Did you mean %s?",
+                                  match_str, ip_prefix_to_str(&rule.prefix, network_str));
+            }
+            return(RESULT_FAILURE);
+        }
+        rule.cidr = cidr_from_str(match_str);
+    }
+
+    if( policy->rule_count == policy->rule_capacity )
+    {
+        size_t capacity = policy->rule_capacity ? policy->rule_capacity * 2 : 64;
+        policy_rule* rules = realloc(policy->rules, capacity * sizeof(policy_rule));
+        if( rules == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            cidr_free(rule.cidr);
+            return(RESULT_INT_ERROR);
+        }
+        policy->rules = rules;
+        policy->rule_capacity = capacity;
+    }
+    policy->rules[policy->rule_count++] = rule;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Load a policy file, all malformed lines are reported before giving up */
+address_policy* policy_load(const char* path)
+{
+    list_reader reader;
+    address_policy* policy = NULL;
+    int errors = 0;
+    char* line = NULL;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    policy = policy_new();
+    if( policy == NULL )
+    {
+        list_reader_close(&reader);
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* verdict_str = list_next_field(&line);
+        char* match_str = list_next_field(&line);
+        char* extra_str = list_next_field(&line);
+
+        if( policy_add_rule(policy, verdict_str, match_str, &reader) != RESULT_SUCCESS )
+        {
+            errors++;
+        }
+        else if( extra_str != NULL )
+        {
+            list_reader_error(&reader, "unexpected \"%s\" after %s", extra_str, match_str);
+            errors++;
+        }
+    }
+
+    list_reader_close(&reader);
+
+    if( errors > 0 )
+    {
+        policy_free(policy);
+        return NULL;
+    }
+
+    return policy;
+}
+
+/* Evaluate the rules one by one, the way the policy is written */
+int policy_first_match(const address_policy* policy, CIDR* address)
+{
+    size_t i = 0;
+
+    for( i = 0; i < policy->rule_count; i++ )
+    {
+        const policy_rule* rule = &policy->rules[i];
+
+        if( rule->class_index >= 0 )
+        {
+            if( policy_classes[rule->class_index].matches(address) == RESULT_SUCCESS )
+            {
+                return rule->verdict;
+            }
+        }
+        else if( cidr_contains(rule->cidr, address) == 0 )
+        {
+            return rule->verdict;
+        }
+    }
+
+    return POLICY_DENY;
+}
+
+/*
+ * Compilation
+ *
+ * Rules are inserted in order into a binary trie. A node that gets a verdict
+ * is final, so the prefix of a later rule only claims the parts of its subtree
+ * that no earlier rule has claimed. The leaves with verdicts then make up
+ * a partition of the address space into non-overlapping prefixes,
+ * which a longest prefix match table looks up in one step.
+ *
+ * Every node also sums up its subtree: the verdicts in it, whether any part
+ * is still unclaimed, and the last rule to claim a part with each verdict.
+ * A rule never descends into a subtree that is already fully claimed,
+ * so inserting all of them takes time proportional to the rule count
+ * times the prefix length, and the summary of the node a rule lands on
+ * tells what the earlier rules left for it.
+ */
+
+/* Bits of policy_node.verdicts besides the verdicts themselves */
+#define POLICY_UNCLAIMED  (1 << 2)
+
+typedef struct
+{
+    uint32_t child[2];
+    int verdict;
+    int verdicts;     /* a bit for every verdict below, and POLICY_UNCLAIMED */
+    int rules[2];     /* last rule with each verdict below, -1 if there is none */
+} policy_node;
+
+typedef struct
+{
+    policy_node* nodes;
+    size_t node_count;
+    size_t node_capacity;
+    lpm_entry* entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} policy_trie;
+
+/* Roots of the IPv4 and IPv6 tries, zero can't be anyone's child */
+#define POLICY_IPV4_ROOT 0
+#define POLICY_IPV6_ROOT 1
+
+static int policy_new_node(policy_trie* trie, int verdict, int rule, uint32_t* node)
+{
+    policy_node* new_node = NULL;
+
+    if( trie->node_count == trie->node_capacity )
+    {
+        size_t capacity = trie->node_capacity ? trie->node_capacity * 2 : 1024;
+        policy_node* nodes = realloc(trie->nodes, capacity * sizeof(policy_node));
+        if( nodes == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        trie->nodes = nodes;
+        trie->node_capacity = capacity;
+    }
+
+    *node = (uint32_t)trie->node_count++;
+    new_node = &trie->nodes[*node];
+    new_node->child[0] = 0;
+    new_node->child[1] = 0;
+    new_node->verdict = verdict;
+    new_node->rules[POLICY_DENY] = -1;
+    new_node->rules[POLICY_PERMIT] = -1;
+    if( verdict == POLICY_UNDECIDED )
+    {
+        new_node->verdicts = POLICY_UNCLAIMED;
+    }
+    else
+    {
+        new_node->verdicts = 1 << verdict;
+        new_node->rules[verdict] = rule;
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Sum up the children of an undecided node, a missing child is unclaimed space */
+static void policy_update(policy_trie* trie, uint32_t node)
+{
+    policy_node* current = &trie->nodes[node];
+    int bit = 0;
+    int verdict = 0;
+
+    if( current->verdict != POLICY_UNDECIDED )
+    {
+        return;
+    }
+
+    current->verdicts = 0;
+    current->rules[POLICY_DENY] = -1;
+    current->rules[POLICY_PERMIT] = -1;
+    for( bit = 0; bit < 2; bit++ )
+    {
+        const policy_node* child = &trie->nodes[current->child[bit]];
+
+        if( current->child[bit] == 0 )
+        {
+            current->verdicts |= POLICY_UNCLAIMED;
+            continue;
+        }
+        current->verdicts |= child->verdicts;
+        for( verdict = POLICY_DENY; verdict <= POLICY_PERMIT; verdict++ )
+        {
+            if( child->rules[verdict] > current->rules[verdict] )
+            {
+                current->rules[verdict] = child->rules[verdict];
+            }
+        }
+    }
+}
+
+/* Give the verdict to every part of the subtree that doesn't have one yet */
+static int policy_claim(policy_trie* trie, uint32_t node, int verdict, int rule)
+{
+    int bit = 0;
+
+    if( !(trie->nodes[node].verdicts & POLICY_UNCLAIMED) )
+    {
+        return(RESULT_SUCCESS);
+    }
+
+    if( (trie->nodes[node].child[0] == 0) && (trie->nodes[node].child[1] == 0) )
+    {
+        trie->nodes[node].verdict = verdict;
+        trie->nodes[node].verdicts = 1 << verdict;
+        trie->nodes[node].rules[verdict] = rule;
+        return(RESULT_SUCCESS);
+    }
+
+    for( bit = 0; bit < 2; bit++ )
+    {
+        if( trie->nodes[node].child[bit] == 0 )
+        {
+            uint32_t child = 0;
+            if( policy_new_node(trie, verdict, rule, &child) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+            trie->nodes[node].child[bit] = child;
+        }
+        else if( policy_claim(trie, trie->nodes[node].child[bit], verdict, rule) != RESULT_SUCCESS )
+        {
+            return(RESULT_INT_ERROR);
+        }
+    }
+    policy_update(trie, node);
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Insert the prefix of a rule. previous is set to the summary of what the
+ * earlier rules claimed of it: its verdicts bits and the last rule for each.
+ */
+static int policy_insert(policy_trie* trie, const ip_prefix* prefix, int verdict, int rule,
+                         policy_node* previous)
+{
+    uint32_t path[IPV6_BITS + 1];
+    uint32_t node = (prefix->proto == CIDR_IPV4) ? POLICY_IPV4_ROOT : POLICY_IPV6_ROOT;
+    int width = ip_bits(prefix->proto);
+    int depth = 0;
+
+    for( depth = 0; depth < prefix->pflen; depth++ )
+    {
+        int bit = ip_value_bit(prefix->addr, width, depth);
+
+        /* Shadowed by an earlier rule */
+        if( trie->nodes[node].verdict != POLICY_UNDECIDED )
+        {
+            *previous = trie->nodes[node];
+            return(RESULT_SUCCESS);
+        }
+
+        path[depth] = node;
+        if( trie->nodes[node].child[bit] == 0 )
+        {
+            uint32_t child = 0;
+            if( policy_new_node(trie, POLICY_UNDECIDED, -1, &child) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+            trie->nodes[node].child[bit] = child;
+        }
+        node = trie->nodes[node].child[bit];
+    }
+
+    *previous = trie->nodes[node];
+    if( policy_claim(trie, node, verdict, rule) != RESULT_SUCCESS )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    while( depth > 0 )
+    {
+        depth--;
+        policy_update(trie, path[depth]);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/*
+ * Insert all prefixes of a rule, previous sums up what the earlier rules
+ * claimed of all of them
+ */
+static int policy_insert_rule(policy_trie* trie, const address_policy* policy, size_t index,
+                              policy_node* previous)
+{
+    const policy_rule* rule = &policy->rules[index];
+    int j = 0;
+
+    if( rule->class_index < 0 )
+    {
+        return policy_insert(trie, &rule->prefix, rule->verdict, (int)index, previous);
+    }
+
+    pthread_once(&policy_class_prefixes_once, parse_policy_class_prefixes);
+
+    previous->verdicts = 0;
+    previous->rules[POLICY_DENY] = -1;
+    previous->rules[POLICY_PERMIT] = -1;
+    for( j = 0; j < policy_class_prefix_counts[rule->class_index]; j++ )
+    {
+        policy_node part;
+        int verdict = 0;
+
+        if( policy_insert(trie, &policy_class_prefixes[rule->class_index][j], rule->verdict, (int)index,
+                          &part) != RESULT_SUCCESS )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        previous->verdicts |= part.verdicts;
+        for( verdict = POLICY_DENY; verdict <= POLICY_PERMIT; verdict++ )
+        {
+            if( part.rules[verdict] > previous->rules[verdict] )
+            {
+                previous->rules[verdict] = part.rules[verdict];
+            }
+        }
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+static int policy_trie_init(policy_trie* trie)
+{
+    uint32_t root = 0;
+
+    memset(trie, 0, sizeof(policy_trie));
+    if( (policy_new_node(trie, POLICY_UNDECIDED, -1, &root) != RESULT_SUCCESS) ||
+        (policy_new_node(trie, POLICY_UNDECIDED, -1, &root) != RESULT_SUCCESS) )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Merge sibling leaves that share a verdict, bottom up */
+static void policy_merge(policy_trie* trie, uint32_t node)
+{
+    policy_node* current = &trie->nodes[node];
+    uint32_t left = current->child[0];
+    uint32_t right = current->child[1];
+
+    if( (left == 0) || (right == 0) )
+    {
+        if( left != 0 )
+        {
+            policy_merge(trie, left);
+        }
+        if( right != 0 )
+        {
+            policy_merge(trie, right);
+        }
+        return;
+    }
+
+    policy_merge(trie, left);
+    policy_merge(trie, right);
+
+    /* Recursion doesn't allocate, so the pointer is still valid */
+    if( (trie->nodes[left].verdict != POLICY_UNDECIDED) &&
+        (trie->nodes[left].verdict == trie->nodes[right].verdict) )
+    {
+        current->verdict = trie->nodes[left].verdict;
+        current->child[0] = 0;
+        current->child[1] = 0;
+    }
+}
+
+static int policy_emit(policy_trie* trie, uint32_t node, int proto, ip_value addr, int depth)
+{
+    const policy_node* current = &trie->nodes[node];
+    int bit = 0;
+
+    if( current->verdict != POLICY_UNDECIDED )
+    {
+        lpm_entry* entry = NULL;
+
+        if( trie->entry_count == trie->entry_capacity )
+        {
+            size_t capacity = trie->entry_capacity ? trie->entry_capacity * 2 : 1024;
+            lpm_entry* entries = realloc(trie->entries, capacity * sizeof(lpm_entry));
+            if( entries == NULL )
+            {
+                return(RESULT_INT_ERROR);
+            }
+            trie->entries = entries;
+            trie->entry_capacity = capacity;
+        }
+
+        entry = &trie->entries[trie->entry_count];
+        entry->prefix.proto = proto;
+        entry->prefix.addr = addr;
+        entry->prefix.pflen = depth;
+        entry->line_number = 0;
+        entry->value = current->verdict;
+        entry->label = strdup(policy_verdict_name(current->verdict));
+        if( entry->label == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        trie->entry_count++;
+
+        return(RESULT_SUCCESS);
+    }
+
+    for( bit = 0; bit < 2; bit++ )
+    {
+        if( current->child[bit] != 0 )
+        {
+            ip_value child_addr = addr;
+            if( bit )
+            {
+                ip_value_set_bit(&child_addr, ip_bits(proto), depth);
+            }
+            if( policy_emit(trie, current->child[bit], proto, child_addr, depth + 1) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+        }
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Compile the policy into a table that maps every prefix of the partition
+   to "permit" or "deny", with the verdict as the value of the entry as well.
+   Addresses without a match are denied. */
+lpm_table* policy_compile(const address_policy* policy)
+{
+    policy_trie trie;
+    policy_node previous;
+    ip_value zero = { 0, 0 };
+    int result = RESULT_SUCCESS;
+    size_t i = 0;
+
+    result = policy_trie_init(&trie);
+
+    for( i = 0; (i < policy->rule_count) && (result == RESULT_SUCCESS); i++ )
+    {
+        result = policy_insert_rule(&trie, policy, i, &previous);
+    }
+
+    if( result == RESULT_SUCCESS )
+    {
+        policy_merge(&trie, POLICY_IPV4_ROOT);
+        policy_merge(&trie, POLICY_IPV6_ROOT);
+        result = policy_emit(&trie, POLICY_IPV4_ROOT, CIDR_IPV4, zero, 0);
+    }
+    if( result == RESULT_SUCCESS )
+    {
+        result = policy_emit(&trie, POLICY_IPV6_ROOT, CIDR_IPV6, zero, 0);
+    }
+
+    free(trie.nodes);
+
+    if( result != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        for( i = 0; i < trie.entry_count; i++ )
+        {
+            free(trie.entries[i].label);
+        }
+        free(trie.entries);
+        return NULL;
+    }
+
+    return lpm_table_build(trie.entries, trie.entry_count);
+}
+
+/*
+ * Find the rules that can never match: once the earlier rules are in the trie,
+ * the rules that claim nothing are covered by them, and the verdicts they
+ * claimed there tell redundant rules from shadowed ones.
+ */
+int policy_analyze(const address_policy* policy, policy_rule_analysis* results)
+{
+    policy_trie trie;
+    policy_node previous;
+    int result = RESULT_SUCCESS;
+    size_t i = 0;
+
+    result = policy_trie_init(&trie);
+
+    for( i = 0; (i < policy->rule_count) && (result == RESULT_SUCCESS); i++ )
+    {
+        int verdict = policy->rules[i].verdict;
+
+        result = policy_insert_rule(&trie, policy, i, &previous);
+        if( result != RESULT_SUCCESS )
+        {
+            break;
+        }
+
+        if( previous.verdicts & POLICY_UNCLAIMED )
+        {
+            results[i].status = POLICY_RULE_EFFECTIVE;
+            results[i].covering_rule = -1;
+        }
+        else if( previous.verdicts == (1 << verdict) )
+        {
+            results[i].status = POLICY_RULE_REDUNDANT;
+            results[i].covering_rule = previous.rules[verdict];
+        }
+        else
+        {
+            results[i].status = POLICY_RULE_SHADOWED;
+            results[i].covering_rule = previous.rules[!verdict];
+        }
+    }
+
+    free(trie.nodes);
+
+    if( result != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return(RESULT_INT_ERROR);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* The prefix or class a rule matches, as it would be written in a policy file */
+const char* policy_rule_match_str(const policy_rule* rule, char* buffer)
+{
+    if( rule->class_index >= 0 )
+    {
+        return policy_classes[rule->class_index].name;
+    }
+    return ip_prefix_to_str(&rule->prefix, buffer);
+}
+
+const char* policy_rule_status_name(int status)
+{
+    return (status == POLICY_RULE_SHADOWED) ? "shadowed" :
+           (status == POLICY_RULE_REDUNDANT) ? "redundant" : "effective";
+}
+
+/* Load a policy file straight into its lookup table form */
+lpm_table* policy_load_compiled(const char* path)
+{
+    address_policy* policy = policy_load(path);
+    lpm_table* table = NULL;
+
+    if( policy == NULL )
+    {
+        return NULL;
+    }
+
+    table = policy_compile(policy);
+    policy_free(policy);
+
+    return table;
+}
+
+void policy_free(address_policy* policy)
+{
+    size_t i = 0;
+
+    if( policy == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < policy->rule_count; i++ )
+    {
+        cidr_free(policy->rules[i].cidr);
+    }
+    free(policy->rules);
+    free(policy);
+}
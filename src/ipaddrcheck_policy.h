@@ -0,0 +1,75 @@
+/*
+ * ipaddrcheck_policy.h: ordered permit/deny address policies
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_POLICY_H
+#define IPADDRCHECK_POLICY_H
+
+#include "ipaddrcheck_lpm.h"
+
+#define POLICY_DENY    0
+#define POLICY_PERMIT  1
+
+/* A policy rule matches either a prefix or one of the built-in
+   address classes ("multicast", "rfc1918"...), the latter are
+   checked with the same functions as the corresponding options. */
+typedef struct
+{
+    int verdict;
+    int line_number;
+    ip_prefix prefix;
+    CIDR* cidr;
+    int class_index;  /* -1 for prefix rules */
+} policy_rule;
+
+/* Rules in the order they are given, the first matching rule wins
+   and addresses that match no rule are denied. */
+typedef struct
+{
+    policy_rule* rules;
+    size_t rule_count;
+    size_t rule_capacity;
+} address_policy;
+
+/* What the earlier rules of a policy leave for a rule */
+#define POLICY_RULE_EFFECTIVE  0  /* it is the first match for some addresses */
+#define POLICY_RULE_REDUNDANT  1  /* earlier rules with the same verdict cover it */
+#define POLICY_RULE_SHADOWED   2  /* earlier rules cover it, some with the other verdict */
+
+typedef struct
+{
+    int status;
+    int covering_rule;  /* the last earlier rule over it with the verdict
+                           that decides the status, -1 for effective rules */
+} policy_rule_analysis;
+
+address_policy* policy_new(void);
+int policy_add_rule(address_policy* policy, char* verdict_str, char* match_str, const list_reader* reader);
+address_policy* policy_load(const char* path);
+int policy_first_match(const address_policy* policy, CIDR* address);
+lpm_table* policy_compile(const address_policy* policy);
+int policy_analyze(const address_policy* policy, policy_rule_analysis* results);
+const char* policy_rule_match_str(const policy_rule* rule, char* buffer);
+const char* policy_rule_status_name(int status);
+lpm_table* policy_load_compiled(const char* path);
+const char* policy_verdict_name(int verdict);
+void policy_free(address_policy* policy);
+
+#endif /* IPADDRCHECK_POLICY_H */
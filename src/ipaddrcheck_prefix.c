@@ -0,0 +1,880 @@
+/*
+ * ipaddrcheck_prefix.c: native address representation and list file reader
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* getline() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "ipaddrcheck_prefix.h"
+
+/*
+ * Conversion between libcidr and native representations
+ */
+
+/* Convert a parsed address to its native form */
+int ip_prefix_from_cidr(CIDR* address, ip_prefix* prefix)
+{
+    int proto = cidr_get_proto(address);
+
+    if( proto == CIDR_IPV4 )
+    {
+        struct in_addr in_addr;
+        cidr_to_inaddr(address, &in_addr);
+
+        prefix->addr.hi = 0;
+        prefix->addr.lo = ntohl(in_addr.s_addr);
+    }
+    else if( proto == CIDR_IPV6 )
+    {
+        struct in6_addr in6_addr;
+        int i = 0;
+        cidr_to_in6addr(address, &in6_addr);
+
+        prefix->addr.hi = 0;
+        prefix->addr.lo = 0;
+        for( i = 0; i < 8; i++ )
+        {
+            prefix->addr.hi = (prefix->addr.hi << 8) | in6_addr.s6_addr[i];
+            prefix->addr.lo = (prefix->addr.lo << 8) | in6_addr.s6_addr[i + 8];
+        }
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+
+    prefix->proto = proto;
+    prefix->pflen = cidr_get_pflen(address);
+
+    return(RESULT_SUCCESS);
+}
+
+static int ip_value_from_str(int proto, const char* address_str, const char** end, ip_value* value);
+
+/*
+ * Parse an address or prefix in its usual notation without going through
+ * libcidr and the format regexes, which dominate the time of reading long
+ * lists. It accepts a subset of what ip_prefix_from_cidr_str() does, with
+ * the same result; anything else is left to that.
+ */
+int ip_prefix_from_native_str(const char* address_str, ip_prefix* prefix)
+{
+    const char* end = NULL;
+    int proto = (strchr(address_str, ':') != NULL) ? CIDR_IPV6 : CIDR_IPV4;
+    int length = 0;
+    int digits = 0;
+
+    if( ip_value_from_str(proto, address_str, &end, &prefix->addr) != RESULT_SUCCESS )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    prefix->proto = proto;
+    prefix->pflen = ip_bits(proto);
+    if( *end == '\0' )
+    {
+        return(RESULT_SUCCESS);
+    }
+    if( *end != '/' )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    for( end++; (*end >= '0') && (*end <= '9') && (digits < 3); end++, digits++ )
+    {
+        if( (digits > 0) && (length == 0) )
+        {
+            return(RESULT_FAILURE);
+        }
+        length = length * 10 + (*end - '0');
+    }
+    if( (digits == 0) || (*end != '\0') || (length > ip_bits(proto)) )
+    {
+        return(RESULT_FAILURE);
+    }
+    prefix->pflen = length;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Parse an address or prefix with libcidr and the format checks
+   the command line applies to its argument */
+int ip_prefix_from_cidr_str(char* address_str, ip_prefix* prefix)
+{
+    int result = RESULT_FAILURE;
+    CIDR* address = cidr_from_str(address_str);
+
+    if( (is_valid_address(address) == RESULT_SUCCESS) &&
+        ((is_any_cidr(address_str) == RESULT_SUCCESS) || (is_any_single(address_str) == RESULT_SUCCESS)) &&
+        !duplicate_double_colons(address_str) )
+    {
+        result = ip_prefix_from_cidr(address, prefix);
+    }
+
+    cidr_free(address);
+
+    return(result);
+}
+
+/* Parse an address or prefix with the same format checks the command line
+   applies to its argument, and convert it to the native form. The usual
+   notation is parsed natively, only the rest goes through libcidr. */
+int ip_prefix_from_str(char* address_str, ip_prefix* prefix)
+{
+    if( ip_prefix_from_native_str(address_str, prefix) == RESULT_SUCCESS )
+    {
+        return(RESULT_SUCCESS);
+    }
+    return ip_prefix_from_cidr_str(address_str, prefix);
+}
+
+/* Parse a prefix length such as "29" or "/29", -1 if it is not one */
+int prefix_length_from_str(const char* length_str)
+{
+    int length = 0;
+    int digits = 0;
+
+    if( *length_str == '/' )
+    {
+        length_str++;
+    }
+    for( ; (*length_str >= '0') && (*length_str <= '9') && (digits < 3); length_str++, digits++ )
+    {
+        length = length * 10 + (*length_str - '0');
+    }
+
+    if( (digits == 0) || (*length_str != '\0') || (length > IPV6_BITS) )
+    {
+        return -1;
+    }
+    return length;
+}
+
+/*
+ * Parse a dotted-quad IPv4 address without going through libcidr,
+ * for inputs with millions of addresses. It accepts the same addresses
+ * as is_ipv4_single(): four decimal octets without leading zeros.
+ * end is set to the first character after the address.
+ */
+int ipv4_value_from_str(const char* address_str, const char** end, uint32_t* value)
+{
+    uint32_t address = 0;
+    int octet_count = 0;
+
+    for( octet_count = 0; octet_count < 4; octet_count++ )
+    {
+        unsigned int octet = 0;
+        int digits = 0;
+
+        if( octet_count > 0 )
+        {
+            if( *address_str != '.' )
+            {
+                return(RESULT_FAILURE);
+            }
+            address_str++;
+        }
+
+        for( ; (*address_str >= '0') && (*address_str <= '9'); address_str++, digits++ )
+        {
+            if( (digits > 0) && (octet == 0) )
+            {
+                return(RESULT_FAILURE);
+            }
+            octet = octet * 10 + (unsigned int)(*address_str - '0');
+            if( octet > 255 )
+            {
+                return(RESULT_FAILURE);
+            }
+        }
+        if( digits == 0 )
+        {
+            return(RESULT_FAILURE);
+        }
+
+        address = (address << 8) | octet;
+    }
+
+    *end = address_str;
+    *value = address;
+
+    return(RESULT_SUCCESS);
+}
+
+static int hex_digit_value(char c)
+{
+    if( (c >= '0') && (c <= '9') )
+    {
+        return c - '0';
+    }
+    if( (c >= 'a') && (c <= 'f') )
+    {
+        return c - 'a' + 10;
+    }
+    if( (c >= 'A') && (c <= 'F') )
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Parse an IPv6 address in the colon-separated hexadecimal form
+ * without going through libcidr: up to eight groups of one to four
+ * hex digits, at most one of which may be replaced by "::".
+ * Embedded IPv4 notation is not accepted, just like in is_ipv6_single().
+ * end is set to the first character after the address.
+ */
+int ipv6_value_from_str(const char* address_str, const char** end, ip_value* value)
+{
+    uint16_t groups[8];
+    int count = 0;
+    int gap = -1;
+    int i = 0;
+
+    if( *address_str == ':' )
+    {
+        if( address_str[1] != ':' )
+        {
+            return(RESULT_FAILURE);
+        }
+        gap = 0;
+        address_str += 2;
+    }
+
+    while( (gap < 0) || (hex_digit_value(*address_str) >= 0) )
+    {
+        unsigned int group = 0;
+        int digits = 0;
+        int digit = 0;
+
+        for( ; (digit = hex_digit_value(*address_str)) >= 0; address_str++, digits++ )
+        {
+            if( digits == 4 )
+            {
+                return(RESULT_FAILURE);
+            }
+            group = (group << 4) | (unsigned int)digit;
+        }
+        if( (digits == 0) || (count == 8) )
+        {
+            return(RESULT_FAILURE);
+        }
+        groups[count++] = (uint16_t)group;
+
+        if( *address_str != ':' )
+        {
+            break;
+        }
+        if( address_str[1] == ':' )
+        {
+            if( gap >= 0 )
+            {
+                return(RESULT_FAILURE);
+            }
+            gap = count;
+            address_str += 2;
+        }
+        else
+        {
+            address_str++;
+            if( hex_digit_value(*address_str) < 0 )
+            {
+                return(RESULT_FAILURE);
+            }
+        }
+    }
+
+    /* "::" stands for at least one zero group */
+    if( (gap < 0) ? (count != 8) : (count > 7) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    value->hi = 0;
+    value->lo = 0;
+    for( i = 0; i < 8; i++ )
+    {
+        uint64_t group = 0;
+        if( (gap < 0) || (i < gap) )
+        {
+            group = groups[i];
+        }
+        else if( i >= gap + (8 - count) )
+        {
+            group = groups[i - (8 - count)];
+        }
+
+        if( i < 4 )
+        {
+            value->hi = (value->hi << 16) | group;
+        }
+        else
+        {
+            value->lo = (value->lo << 16) | group;
+        }
+    }
+
+    *end = address_str;
+
+    return(RESULT_SUCCESS);
+}
+
+static int ip_value_from_str(int proto, const char* address_str, const char** end, ip_value* value)
+{
+    if( proto == CIDR_IPV4 )
+    {
+        uint32_t address = 0;
+        if( ipv4_value_from_str(address_str, end, &address) != RESULT_SUCCESS )
+        {
+            return(RESULT_FAILURE);
+        }
+        value->hi = 0;
+        value->lo = address;
+        return(RESULT_SUCCESS);
+    }
+    return ipv6_value_from_str(address_str, end, value);
+}
+
+/*
+ * Parse a hyphen-separated range of two addresses of the given protocol
+ * in a single pass, without copying its parts anywhere.
+ * Returns one of the RANGE_* codes; range->first_length is set
+ * whenever the hyphen was found, so that callers can point at
+ * the offending address.
+ */
+int ip_range_from_str(const char* range_str, int proto, ip_range* range)
+{
+    const char* hyphen = NULL;
+    const char* end = NULL;
+    const char* allowed = (proto == CIDR_IPV4) ? "0123456789." : "0123456789abcdefABCDEF:";
+
+    range->proto = proto;
+    range->first_length = 0;
+
+    /* The common case: two valid addresses separated by a hyphen */
+    if( (ip_value_from_str(proto, range_str, &hyphen, &range->first) == RESULT_SUCCESS) &&
+        (*hyphen == '-') )
+    {
+        range->first_length = (size_t)(hyphen - range_str);
+        if( (ip_value_from_str(proto, hyphen + 1, &end, &range->last) == RESULT_SUCCESS) &&
+            (*end == '\0') )
+        {
+            if( ip_value_cmp(range->first, range->last) > 0 )
+            {
+                return RANGE_REVERSED;
+            }
+            return RANGE_VALID;
+        }
+    }
+
+    /* Find out what exactly is wrong with it */
+    hyphen = strchr(range_str, '-');
+    if( (hyphen == NULL) || (hyphen == range_str) || (hyphen[1] == '\0') ||
+        (strchr(hyphen + 1, '-') != NULL) ||
+        (strspn(range_str, allowed) != (size_t)(hyphen - range_str)) ||
+        (strspn(hyphen + 1, allowed) != strlen(hyphen + 1)) )
+    {
+        return RANGE_MALFORMED;
+    }
+
+    range->first_length = (size_t)(hyphen - range_str);
+    if( (ip_value_from_str(proto, range_str, &end, &range->first) != RESULT_SUCCESS) ||
+        (end != hyphen) )
+    {
+        return RANGE_BAD_FIRST;
+    }
+    return RANGE_BAD_LAST;
+}
+
+/* Are both ends of the range within the same prefix of the given length? */
+int ip_range_within_prefix(const ip_range* range, int pflen)
+{
+    if( ip_value_common_bits(range->first, range->last, ip_bits(range->proto)) >= pflen )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Does the prefix have no host bits set (cf. is_any_net())? */
+int ip_prefix_is_network(const ip_prefix* prefix)
+{
+    ip_value mask = ip_host_mask(prefix->proto, prefix->pflen);
+
+    if( ((prefix->addr.hi & mask.hi) == 0) && ((prefix->addr.lo & mask.lo) == 0) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Is the inner prefix (or address) entirely within the outer one? */
+int ip_prefix_contains(const ip_prefix* outer, const ip_prefix* inner)
+{
+    ip_value mask = ip_host_mask(outer->proto, outer->pflen);
+
+    if( (outer->proto == inner->proto) &&
+        (outer->pflen <= inner->pflen) &&
+        ((outer->addr.hi & ~mask.hi) == (inner->addr.hi & ~mask.hi)) &&
+        ((outer->addr.lo & ~mask.lo) == (inner->addr.lo & ~mask.lo)) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Do two prefixes share any address? Either one then contains the other. */
+int ip_prefix_overlaps(const ip_prefix* left, const ip_prefix* right)
+{
+    if( (ip_prefix_contains(left, right) == RESULT_SUCCESS) ||
+        (ip_prefix_contains(right, left) == RESULT_SUCCESS) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Do two addresses lie within the same prefix of the given length? */
+int ip_prefix_same_subnet(const ip_prefix* left, const ip_prefix* right, int pflen)
+{
+    ip_value mask;
+
+    if( (left->proto != right->proto) || (pflen > ip_bits(left->proto)) )
+    {
+        return(RESULT_FAILURE);
+    }
+
+    mask = ip_host_mask(left->proto, pflen);
+    if( (((left->addr.hi ^ right->addr.hi) & ~mask.hi) == 0) &&
+        (((left->addr.lo ^ right->addr.lo) & ~mask.lo) == 0) )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Total order: IPv4 before IPv6, then by address, then shorter prefixes first */
+int ip_prefix_cmp(const ip_prefix* left, const ip_prefix* right)
+{
+    int result = 0;
+
+    if( left->proto != right->proto )
+    {
+        return (left->proto == CIDR_IPV4) ? -1 : 1;
+    }
+
+    result = ip_value_cmp(left->addr, right->addr);
+    if( result != 0 )
+    {
+        return result;
+    }
+
+    return (left->pflen > right->pflen) - (left->pflen < right->pflen);
+}
+
+void ip_count_add(ip_count* count, ip_value value)
+{
+    uint64_t lo = count->value.lo + value.lo;
+    uint64_t carry = (lo < value.lo) ? 1 : 0;
+    uint64_t hi = count->value.hi + value.hi + carry;
+
+    if( (hi < value.hi) || ((hi == value.hi) && carry) )
+    {
+        count->top++;
+    }
+    count->value.hi = hi;
+    count->value.lo = lo;
+}
+
+void ip_count_add_small(ip_count* count, uint64_t value)
+{
+    ip_value addend = { 0, value };
+    ip_count_add(count, addend);
+}
+
+/* The caller makes sure the count does not go below zero */
+void ip_count_sub_small(ip_count* count, uint64_t value)
+{
+    if( count->value.lo < value )
+    {
+        if( count->value.hi == 0 )
+        {
+            count->top--;
+        }
+        count->value.hi--;
+    }
+    count->value.lo -= value;
+}
+
+/* Format a count in decimal, the buffer must be at least COUNT_STR_MAX bytes long */
+char* ip_count_to_str(const ip_count* count, char* buffer)
+{
+    /* Most significant first, 32 bits each, divided by 10^9 at a time */
+    uint32_t words[5];
+    uint32_t chunks[5];
+    int chunk_count = 0;
+    int nonzero = 1;
+    char* end = buffer;
+    int i = 0;
+
+    words[0] = (uint32_t)count->top;
+    words[1] = (uint32_t)(count->value.hi >> 32);
+    words[2] = (uint32_t)count->value.hi;
+    words[3] = (uint32_t)(count->value.lo >> 32);
+    words[4] = (uint32_t)count->value.lo;
+
+    while( nonzero )
+    {
+        uint64_t remainder = 0;
+
+        nonzero = 0;
+        for( i = 0; i < 5; i++ )
+        {
+            uint64_t current = (remainder << 32) | words[i];
+            words[i] = (uint32_t)(current / 1000000000);
+            remainder = current % 1000000000;
+            nonzero |= (words[i] != 0);
+        }
+        chunks[chunk_count++] = (uint32_t)remainder;
+    }
+
+    end += sprintf(end, "%u", (unsigned int)chunks[chunk_count - 1]);
+    for( i = chunk_count - 2; i >= 0; i-- )
+    {
+        end += sprintf(end, "%09u", (unsigned int)chunks[i]);
+    }
+
+    return buffer;
+}
+
+/* Format an address, the buffer must be at least PREFIX_STR_MAX bytes long */
+char* ip_addr_to_str(int proto, ip_value addr, char* buffer)
+{
+    if( proto == CIDR_IPV4 )
+    {
+        struct in_addr in_addr;
+        in_addr.s_addr = htonl((uint32_t)addr.lo);
+        inet_ntop(AF_INET, &in_addr, buffer, PREFIX_STR_MAX);
+    }
+    else
+    {
+        struct in6_addr in6_addr;
+        int i = 0;
+        for( i = 0; i < 8; i++ )
+        {
+            in6_addr.s6_addr[i] = (uint8_t)(addr.hi >> (56 - 8 * i));
+            in6_addr.s6_addr[i + 8] = (uint8_t)(addr.lo >> (56 - 8 * i));
+        }
+        inet_ntop(AF_INET6, &in6_addr, buffer, PREFIX_STR_MAX);
+    }
+
+    return buffer;
+}
+
+/* Format a prefix in CIDR notation, the buffer must be at least PREFIX_STR_MAX bytes long */
+char* ip_prefix_to_str(const ip_prefix* prefix, char* buffer)
+{
+    ip_addr_to_str(prefix->proto, prefix->addr, buffer);
+    sprintf(buffer + strlen(buffer), "/%d", prefix->pflen);
+
+    return buffer;
+}
+
+/*
+ * Split an address range into the smallest number of prefixes,
+ * from the lowest to the highest
+ */
+void ip_range_to_prefixes(int proto, ip_value first, ip_value last, ip_prefix_callback callback, void* context)
+{
+    int width = ip_bits(proto);
+    ip_prefix prefix;
+
+    prefix.proto = proto;
+
+    for( ;; )
+    {
+        /* The largest block that starts at the first address and ends within the range */
+        int host_bits = 0;
+        ip_value block_last;
+
+        if( first.lo != 0 )
+        {
+            host_bits = __builtin_ctzll(first.lo);
+        }
+        else if( first.hi != 0 )
+        {
+            host_bits = 64 + __builtin_ctzll(first.hi);
+        }
+        else
+        {
+            host_bits = IPV6_BITS;
+        }
+        if( host_bits > width )
+        {
+            host_bits = width;
+        }
+
+        for( ;; )
+        {
+            ip_value mask = ip_value_low_mask(host_bits);
+            block_last.hi = first.hi | mask.hi;
+            block_last.lo = first.lo | mask.lo;
+            if( ip_value_cmp(block_last, last) <= 0 )
+            {
+                break;
+            }
+            host_bits--;
+        }
+
+        prefix.addr = first;
+        prefix.pflen = width - host_bits;
+        callback(&prefix, context);
+
+        if( ip_value_eq(block_last, last) )
+        {
+            break;
+        }
+        first = ip_value_next(block_last);
+    }
+}
+
+/*
+ * List files
+ */
+
+/* Open a list file, "-" stands for standard input */
+int list_reader_open(list_reader* reader, const char* name)
+{
+    reader->name = name;
+    reader->line_number = 0;
+    reader->line = NULL;
+    reader->line_size = 0;
+
+    if( strcmp(name, "-") == 0 )
+    {
+        reader->file = stdin;
+    }
+    else
+    {
+        reader->file = fopen(name, "r");
+        if( reader->file == NULL )
+        {
+            fprintf(stderr, "Error: could not open %s: %s\n", name, strerror(errno));
+            return(RESULT_FAILURE);
+        }
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Return the next significant line with surrounding whitespace removed,
+   or NULL at the end of the file. The line is valid until the next call. */
+char* list_reader_next(list_reader* reader)
+{
+    while( getline(&reader->line, &reader->line_size, reader->file) != -1 )
+    {
+        char* start = reader->line;
+        char* end = start + strlen(start);
+
+        reader->line_number++;
+
+        while( isspace((unsigned char)*start) )
+        {
+            start++;
+        }
+        while( (end > start) && isspace((unsigned char)end[-1]) )
+        {
+            end--;
+        }
+        *end = '\0';
+
+        if( (*start != '\0') && (*start != '#') )
+        {
+            return start;
+        }
+    }
+
+    return NULL;
+}
+
+/* Split off the next whitespace-separated field, NULL if there are none left */
+char* list_next_field(char** cursor)
+{
+    char* start = *cursor;
+    char* end = NULL;
+
+    while( isspace((unsigned char)*start) )
+    {
+        start++;
+    }
+    if( *start == '\0' )
+    {
+        *cursor = start;
+        return NULL;
+    }
+
+    end = start;
+    while( (*end != '\0') && !isspace((unsigned char)*end) )
+    {
+        end++;
+    }
+    if( *end != '\0' )
+    {
+        *end = '\0';
+        end++;
+    }
+    *cursor = end;
+
+    return start;
+}
+
+/* Report a problem with the current line */
+void list_reader_error(const list_reader* reader, const char* format, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "Error: %s line %d: ", reader->name, reader->line_number);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+/* Parse a prefix from the current line, it must not have host bits set */
+int list_reader_prefix(const list_reader* reader, char* prefix_str, ip_prefix* prefix)
+{
+    if( ip_prefix_from_str(prefix_str, prefix) != RESULT_SUCCESS )
+    {
+        list_reader_error(reader, "\"%s\" is not a valid prefix", prefix_str);
+        return(RESULT_FAILURE);
+    }
+    if( ip_prefix_is_network(prefix) != RESULT_SUCCESS )
+    {
+        char network_str[PREFIX_STR_MAX];
+        ip_prefix network = *prefix;
+        network.addr = ip_prefix_first(prefix);
+        list_reader_error(reader, "%s is a host address, not a network address. Did you mean %s?",
+                          prefix_str, ip_prefix_to_str(&network, network_str));
+        return(RESULT_FAILURE);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+void list_reader_close(list_reader* reader)
+{
+    if( (reader->file != NULL) && (reader->file != stdin) )
+    {
+        fclose(reader->file);
+    }
+    reader->file = NULL;
+    free(reader->line);
+    reader->line = NULL;
+}
+
+/*
+ * Load a list of prefixes, one per line, anything after the first field
+ * is ignored. Returns NULL if the file has errors, all of them are reported.
+ */
+ip_prefix* prefix_list_load(const char* path, size_t* count)
+{
+    list_reader reader;
+    ip_prefix* prefixes = NULL;
+    size_t capacity = 0;
+    int errors = 0;
+    char* line = NULL;
+
+    *count = 0;
+
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        ip_prefix prefix;
+
+        if( list_reader_prefix(&reader, list_next_field(&line), &prefix) != RESULT_SUCCESS )
+        {
+            errors++;
+            continue;
+        }
+
+        if( *count == capacity )
+        {
+            ip_prefix* new_prefixes = NULL;
+            capacity = capacity ? capacity * 2 : 1024;
+            new_prefixes = realloc(prefixes, capacity * sizeof(ip_prefix));
+            if( new_prefixes == NULL )
+            {
+                fprintf(stderr, "Error: could not allocate memory!\n");
+                errors++;
+                break;
+            }
+            prefixes = new_prefixes;
+        }
+
+        prefixes[(*count)++] = prefix;
+    }
+
+    list_reader_close(&reader);
+
+    if( errors > 0 )
+    {
+        free(prefixes);
+        *count = 0;
+        return NULL;
+    }
+
+    /* An empty list is not an error */
+    if( prefixes == NULL )
+    {
+        prefixes = malloc(sizeof(ip_prefix));
+        if( prefixes == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+    }
+
+    return prefixes;
+}
@@ -0,0 +1,261 @@
+/*
+ * ipaddrcheck_prefix.h: native address representation and list file reader
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_PREFIX_H
+#define IPADDRCHECK_PREFIX_H
+
+#include <stdint.h>
+#include "ipaddrcheck_functions.h"
+
+#define IPV4_BITS 32
+#define IPV6_BITS 128
+
+/* Enough for the longest IPv6 address text (45 characters),
+   a slash, a three-digit prefix length and the terminating null byte. */
+#define PREFIX_STR_MAX 50
+
+/* An address as an unsigned 128-bit integer.
+   IPv4 addresses occupy the lowest 32 bits. */
+typedef struct
+{
+    uint64_t hi;
+    uint64_t lo;
+} ip_value;
+
+/* An address or prefix converted from its libcidr form,
+   so that lookup structures can work with plain integers. */
+typedef struct
+{
+    int proto;        /* CIDR_IPV4 or CIDR_IPV6 */
+    ip_value addr;
+    int pflen;
+} ip_prefix;
+
+/* Enough for 2^128 in decimal and the terminating null byte */
+#define COUNT_STR_MAX 40
+
+/* An address count. The whole IPv6 address space holds 2^128 addresses,
+   one more than an ip_value can hold, hence the extra top word. */
+typedef struct
+{
+    uint64_t top;
+    ip_value value;
+} ip_count;
+
+/* Results of ip_range_from_str() */
+#define RANGE_VALID       0
+#define RANGE_MALFORMED   1   /* not a pair of hyphen-separated addresses */
+#define RANGE_BAD_FIRST   2   /* the first address is invalid */
+#define RANGE_BAD_LAST    3   /* the last address is invalid */
+#define RANGE_REVERSED    4   /* the first address is greater than the last */
+
+/* A hyphen-separated address range, e.g. 192.0.2.1-192.0.2.10 */
+typedef struct
+{
+    int proto;
+    ip_value first;
+    ip_value last;
+    size_t first_length;  /* characters before the hyphen */
+} ip_range;
+
+/* Called for every prefix produced by ip_range_to_prefixes() */
+typedef void (*ip_prefix_callback)(const ip_prefix* prefix, void* context);
+
+/* Reader for line-oriented list files.
+   Empty lines and lines starting with '#' are skipped. */
+typedef struct
+{
+    FILE* file;
+    const char* name;
+    int line_number;
+    char* line;
+    size_t line_size;
+} list_reader;
+
+/* Address width of a protocol in bits */
+static inline int ip_bits(int proto)
+{
+    return (proto == CIDR_IPV4) ? IPV4_BITS : IPV6_BITS;
+}
+
+static inline int ip_value_cmp(ip_value left, ip_value right)
+{
+    if( left.hi != right.hi )
+    {
+        return (left.hi < right.hi) ? -1 : 1;
+    }
+    if( left.lo != right.lo )
+    {
+        return (left.lo < right.lo) ? -1 : 1;
+    }
+    return 0;
+}
+
+static inline int ip_value_eq(ip_value left, ip_value right)
+{
+    return (left.hi == right.hi) && (left.lo == right.lo);
+}
+
+/* Value of the bit at the given position, counting from the most significant
+   bit of an address of the given width (i.e. bit 0 is the first prefix bit). */
+static inline int ip_value_bit(ip_value value, int width, int position)
+{
+    int shift = width - 1 - position;
+    if( shift >= 64 )
+    {
+        return (int)((value.hi >> (shift - 64)) & 1);
+    }
+    return (int)((value.lo >> shift) & 1);
+}
+
+/* Set the bit at the given position, counted the same way as in ip_value_bit() */
+static inline void ip_value_set_bit(ip_value* value, int width, int position)
+{
+    int shift = width - 1 - position;
+    if( shift >= 64 )
+    {
+        value->hi |= (uint64_t)1 << (shift - 64);
+    }
+    else
+    {
+        value->lo |= (uint64_t)1 << shift;
+    }
+}
+
+/* Mask with the lowest bit_count bits set */
+static inline ip_value ip_value_low_mask(int bit_count)
+{
+    ip_value mask;
+    if( bit_count <= 0 )
+    {
+        mask.hi = 0;
+        mask.lo = 0;
+    }
+    else if( bit_count < 64 )
+    {
+        mask.hi = 0;
+        mask.lo = ((uint64_t)1 << bit_count) - 1;
+    }
+    else if( bit_count == 64 )
+    {
+        mask.hi = 0;
+        mask.lo = UINT64_MAX;
+    }
+    else if( bit_count < 128 )
+    {
+        mask.hi = ((uint64_t)1 << (bit_count - 64)) - 1;
+        mask.lo = UINT64_MAX;
+    }
+    else
+    {
+        mask.hi = UINT64_MAX;
+        mask.lo = UINT64_MAX;
+    }
+    return mask;
+}
+
+/* Host part mask of a prefix, i.e. the bits not covered by its prefix length */
+static inline ip_value ip_host_mask(int proto, int pflen)
+{
+    return ip_value_low_mask(ip_bits(proto) - pflen);
+}
+
+/* First address of a prefix */
+static inline ip_value ip_prefix_first(const ip_prefix* prefix)
+{
+    ip_value mask = ip_host_mask(prefix->proto, prefix->pflen);
+    ip_value first;
+    first.hi = prefix->addr.hi & ~mask.hi;
+    first.lo = prefix->addr.lo & ~mask.lo;
+    return first;
+}
+
+/* Last address of a prefix */
+static inline ip_value ip_prefix_last(const ip_prefix* prefix)
+{
+    ip_value mask = ip_host_mask(prefix->proto, prefix->pflen);
+    ip_value last;
+    last.hi = prefix->addr.hi | mask.hi;
+    last.lo = prefix->addr.lo | mask.lo;
+    return last;
+}
+
+/* Next address, wraps around after the last one */
+static inline ip_value ip_value_next(ip_value value)
+{
+    value.lo++;
+    if( value.lo == 0 )
+    {
+        value.hi++;
+    }
+    return value;
+}
+
+/* Number of leading bits two addresses of the given width have in common */
+static inline int ip_value_common_bits(ip_value left, ip_value right, int width)
+{
+    uint64_t hi = left.hi ^ right.hi;
+    uint64_t lo = left.lo ^ right.lo;
+
+    if( hi != 0 )
+    {
+        return __builtin_clzll(hi) - (IPV6_BITS - width);
+    }
+    if( lo != 0 )
+    {
+        return 64 + __builtin_clzll(lo) - (IPV6_BITS - width);
+    }
+    return width;
+}
+
+int ip_prefix_from_cidr(CIDR* address, ip_prefix* prefix);
+int ip_prefix_from_native_str(const char* address_str, ip_prefix* prefix);
+int ip_prefix_from_cidr_str(char* address_str, ip_prefix* prefix);
+int ip_prefix_from_str(char* address_str, ip_prefix* prefix);
+int prefix_length_from_str(const char* length_str);
+int ipv4_value_from_str(const char* address_str, const char** end, uint32_t* value);
+int ipv6_value_from_str(const char* address_str, const char** end, ip_value* value);
+int ip_range_from_str(const char* range_str, int proto, ip_range* range);
+int ip_range_within_prefix(const ip_range* range, int pflen);
+int ip_prefix_is_network(const ip_prefix* prefix);
+int ip_prefix_contains(const ip_prefix* outer, const ip_prefix* inner);
+int ip_prefix_overlaps(const ip_prefix* left, const ip_prefix* right);
+int ip_prefix_same_subnet(const ip_prefix* left, const ip_prefix* right, int pflen);
+int ip_prefix_cmp(const ip_prefix* left, const ip_prefix* right);
+char* ip_addr_to_str(int proto, ip_value addr, char* buffer);
+char* ip_prefix_to_str(const ip_prefix* prefix, char* buffer);
+void ip_range_to_prefixes(int proto, ip_value first, ip_value last, ip_prefix_callback callback, void* context);
+
+void ip_count_add(ip_count* count, ip_value value);
+void ip_count_add_small(ip_count* count, uint64_t value);
+void ip_count_sub_small(ip_count* count, uint64_t value);
+char* ip_count_to_str(const ip_count* count, char* buffer);
+
+int list_reader_open(list_reader* reader, const char* name);
+char* list_reader_next(list_reader* reader);
+char* list_next_field(char** cursor);
+void list_reader_error(const list_reader* reader, const char* format, ...);
+int list_reader_prefix(const list_reader* reader, char* prefix_str, ip_prefix* prefix);
+void list_reader_close(list_reader* reader);
+
+ip_prefix* prefix_list_load(const char* path, size_t* count);
+
+#endif /* IPADDRCHECK_PREFIX_H */
@@ -0,0 +1,786 @@
+/*
+ * ipaddrcheck_prefix_set.c: compact prefix sets for membership checks
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "ipaddrcheck_prefix_set.h"
+
+#define SLOT_EMPTY  UINT32_MAX
+#define SLOT_FULL   (UINT32_MAX - 1)
+
+#define NODE_LEAF   0x80
+#define NODE_SKIP   0x7f
+
+/* The slot table never takes more than two bytes per prefix */
+#define MAX_STRIDE  16
+
+typedef struct
+{
+    const ip_prefix* keys;
+    size_t* left_sizes;
+    size_t left_count;
+    size_t left_next;
+    prefix_trie* trie;
+    size_t position;
+} trie_builder;
+
+/*
+ * Left-aligned key helpers
+ */
+
+static ip_value key_from_prefix(const ip_prefix* prefix)
+{
+    ip_value key = prefix->addr;
+
+    if( prefix->proto == CIDR_IPV4 )
+    {
+        key.hi = prefix->addr.lo << 32;
+        key.lo = 0;
+    }
+
+    return key;
+}
+
+static ip_value key_shift_left(ip_value key, int count)
+{
+    ip_value shifted;
+
+    if( count == 0 )
+    {
+        shifted = key;
+    }
+    else if( count < 64 )
+    {
+        shifted.hi = (key.hi << count) | (key.lo >> (64 - count));
+        shifted.lo = key.lo << count;
+    }
+    else if( count < 128 )
+    {
+        shifted.hi = key.lo << (count - 64);
+        shifted.lo = 0;
+    }
+    else
+    {
+        shifted.hi = 0;
+        shifted.lo = 0;
+    }
+
+    return shifted;
+}
+
+/* count bits (1 to 64) starting at the given position, right-aligned */
+static inline uint64_t key_bits(ip_value key, int position, int count)
+{
+    return key_shift_left(key, position).hi >> (64 - count);
+}
+
+static inline int key_bit(ip_value key, int position)
+{
+    return ip_value_bit(key, IPV6_BITS, position);
+}
+
+/* Only the first count bits of a key */
+static ip_value key_mask(ip_value key, int count)
+{
+    ip_value mask = ip_value_low_mask(IPV6_BITS - count);
+
+    key.hi &= ~mask.hi;
+    key.lo &= ~mask.lo;
+    return key;
+}
+
+/* Length of the common leading part of two keys */
+static int key_common_bits(ip_value left, ip_value right)
+{
+    uint64_t hi = left.hi ^ right.hi;
+    uint64_t lo = left.lo ^ right.lo;
+
+    if( hi != 0 )
+    {
+        return __builtin_clzll(hi);
+    }
+    if( lo != 0 )
+    {
+        return 64 + __builtin_clzll(lo);
+    }
+    return IPV6_BITS;
+}
+
+static int key_cmp(const void* left, const void* right)
+{
+    const ip_prefix* l = left;
+    const ip_prefix* r = right;
+    int result = ip_value_cmp(l->addr, r->addr);
+
+    if( result == 0 )
+    {
+        result = l->pflen - r->pflen;
+    }
+
+    return result;
+}
+
+/*
+ * Sort the keys and reduce them to the smallest set of prefixes
+ * that covers the same addresses, returns the new count
+ */
+static size_t normalize_keys(ip_prefix* keys, size_t count)
+{
+    size_t top = 0;
+    size_t i = 0;
+
+    qsort(keys, count, sizeof(ip_prefix), key_cmp);
+
+    for( i = 0; i < count; i++ )
+    {
+        /* Sorted by first address, covering prefixes come first */
+        if( (top > 0) &&
+            (keys[top - 1].pflen <= keys[i].pflen) &&
+            (key_common_bits(keys[top - 1].addr, keys[i].addr) >= keys[top - 1].pflen) )
+        {
+            continue;
+        }
+
+        keys[top++] = keys[i];
+
+        /* Merge siblings into their parent, as far up as it goes */
+        while( (top > 1) &&
+               (keys[top - 1].pflen > 0) &&
+               (keys[top - 1].pflen == keys[top - 2].pflen) &&
+               (key_common_bits(keys[top - 1].addr, keys[top - 2].addr) == keys[top - 1].pflen - 1) )
+        {
+            top--;
+            keys[top - 1].pflen--;
+        }
+    }
+
+    return top;
+}
+
+/*
+ * Serialization
+ */
+
+static int skip_bytes(int skip)
+{
+    return (skip + 7) / 8;
+}
+
+static int varint_size(size_t value)
+{
+    int size = 1;
+
+    while( value >= 0x80 )
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+/* First key in the range with the given bit set, the range shares all bits before it */
+static size_t split_keys(const ip_prefix* keys, size_t lo, size_t hi, int bit)
+{
+    while( lo < hi )
+    {
+        size_t middle = lo + (hi - lo) / 2;
+        if( key_bit(keys[middle].addr, bit) )
+        {
+            hi = middle;
+        }
+        else
+        {
+            lo = middle + 1;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Size of the subtrie for a range of keys, remembering the sizes
+ * of left subtries in preorder for trie_emit().
+ * Normalized keys never cover each other, so a range of several keys
+ * always branches before the end of the shortest one.
+ */
+static size_t trie_measure(trie_builder* builder, size_t lo, size_t hi, int depth)
+{
+    const ip_prefix* keys = builder->keys;
+    size_t index = 0;
+    size_t left = 0;
+    size_t right = 0;
+    size_t middle = 0;
+    int branch = 0;
+
+    if( hi - lo == 1 )
+    {
+        return 1 + skip_bytes(keys[lo].pflen - depth);
+    }
+
+    branch = key_common_bits(keys[lo].addr, keys[hi - 1].addr);
+    middle = split_keys(keys, lo, hi, branch);
+
+    index = builder->left_count++;
+    left = trie_measure(builder, lo, middle, branch + 1);
+    right = trie_measure(builder, middle, hi, branch + 1);
+    builder->left_sizes[index] = left;
+
+    return 1 + skip_bytes(branch - depth) + varint_size(left) + left + right;
+}
+
+static void emit_bits(trie_builder* builder, ip_value key, int position, int count)
+{
+    uint8_t* out = builder->trie->nodes + builder->position;
+    int i = 0;
+
+    for( i = 0; i < count; i += 8 )
+    {
+        int chunk = (count - i < 8) ? (count - i) : 8;
+        *out++ = (uint8_t)(key_bits(key, position + i, chunk) << (8 - chunk));
+    }
+
+    builder->position += skip_bytes(count);
+}
+
+static void trie_emit(trie_builder* builder, size_t lo, size_t hi, int depth, int level)
+{
+    const ip_prefix* keys = builder->keys;
+    prefix_trie* trie = builder->trie;
+    size_t middle = 0;
+    size_t left = 0;
+    int branch = 0;
+
+    if( hi - lo == 1 )
+    {
+        trie->nodes[builder->position++] = (uint8_t)(NODE_LEAF | (keys[lo].pflen - depth));
+        emit_bits(builder, keys[lo].addr, depth, keys[lo].pflen - depth);
+        trie->leaf_count++;
+        trie->depth_histogram[level + 1]++;
+        return;
+    }
+
+    branch = key_common_bits(keys[lo].addr, keys[hi - 1].addr);
+    middle = split_keys(keys, lo, hi, branch);
+    left = builder->left_sizes[builder->left_next++];
+
+    trie->nodes[builder->position++] = (uint8_t)(branch - depth);
+    emit_bits(builder, keys[lo].addr, depth, branch - depth);
+    while( left >= 0x80 )
+    {
+        trie->nodes[builder->position++] = (uint8_t)(0x80 | (left & 0x7f));
+        left >>= 7;
+    }
+    trie->nodes[builder->position++] = (uint8_t)left;
+    trie->internal_count++;
+
+    trie_emit(builder, lo, middle, branch + 1, level + 1);
+    trie_emit(builder, middle, hi, branch + 1, level + 1);
+}
+
+static size_t slot_of(const prefix_trie* trie, ip_value key)
+{
+    return (trie->stride > 0) ? (size_t)key_bits(key, trie->root_bits, trie->stride) : 0;
+}
+
+/* End of the range of keys that share a slot, the subtrie of that slot */
+static size_t slot_range_end(const prefix_trie* trie, const ip_prefix* keys, size_t start, size_t count)
+{
+    size_t slot = slot_of(trie, keys[start].addr);
+    size_t end = start + 1;
+
+    while( (end < count) && (slot_of(trie, keys[end].addr) == slot) )
+    {
+        end++;
+    }
+
+    return end;
+}
+
+/* Build the trie of normalized keys */
+static int prefix_trie_build(prefix_trie* trie, const ip_prefix* keys, size_t count, int width)
+{
+    trie_builder builder;
+    int slot_bits = 0;
+    size_t total = 0;
+    size_t i = 0;
+    int pass = 0;
+
+    memset(&builder, 0, sizeof(builder));
+    builder.keys = keys;
+    builder.trie = trie;
+    trie->stored_count = count;
+
+    if( count > 0 )
+    {
+        trie->root_bits = key_common_bits(keys[0].addr, keys[count - 1].addr);
+        for( i = 0; i < count; i++ )
+        {
+            if( keys[i].pflen < trie->root_bits )
+            {
+                trie->root_bits = keys[i].pflen;
+            }
+        }
+        trie->root_prefix = keys[0].addr;
+        if( trie->root_bits < IPV6_BITS )
+        {
+            ip_value mask = ip_value_low_mask(IPV6_BITS - trie->root_bits);
+            trie->root_prefix.hi &= ~mask.hi;
+            trie->root_prefix.lo &= ~mask.lo;
+        }
+    }
+
+    while( (trie->stride < MAX_STRIDE) && (trie->root_bits + trie->stride < width) &&
+           (((size_t)1 << (trie->stride + 1)) <= count / 2) )
+    {
+        trie->stride++;
+    }
+    slot_bits = trie->root_bits + trie->stride;
+
+    trie->slot_count = (size_t)1 << trie->stride;
+    trie->slots = malloc(trie->slot_count * sizeof(uint32_t));
+    builder.left_sizes = malloc((count + 1) * sizeof(size_t));
+    if( (trie->slots == NULL) || (builder.left_sizes == NULL) )
+    {
+        free(builder.left_sizes);
+        return(RESULT_INT_ERROR);
+    }
+    for( i = 0; i < trie->slot_count; i++ )
+    {
+        trie->slots[i] = SLOT_EMPTY;
+    }
+
+    /* Measure all subtries first, then write them out */
+    for( pass = 0; pass < 2; pass++ )
+    {
+        i = 0;
+        while( i < count )
+        {
+            size_t slot = slot_of(trie, keys[i].addr);
+            size_t end = 0;
+
+            if( keys[i].pflen <= slot_bits )
+            {
+                if( pass == 1 )
+                {
+                    size_t span = (size_t)1 << (slot_bits - keys[i].pflen);
+                    size_t j = 0;
+                    for( j = 0; j < span; j++ )
+                    {
+                        trie->slots[slot + j] = SLOT_FULL;
+                    }
+                    trie->full_slots += span;
+                    trie->depth_histogram[0]++;
+                }
+                i++;
+                continue;
+            }
+
+            end = slot_range_end(trie, keys, i, count);
+            if( pass == 0 )
+            {
+                total += trie_measure(&builder, i, end, slot_bits);
+            }
+            else
+            {
+                trie->slots[slot] = (uint32_t)builder.position;
+                trie_emit(&builder, i, end, slot_bits, 0);
+            }
+            i = end;
+        }
+
+        if( pass == 0 )
+        {
+            if( total >= SLOT_FULL )
+            {
+                fprintf(stderr, "Error: too many prefixes for a single set\n");
+                free(builder.left_sizes);
+                return(RESULT_INT_ERROR);
+            }
+            trie->node_bytes = total;
+            trie->nodes = malloc(total + 1);
+            if( trie->nodes == NULL )
+            {
+                free(builder.left_sizes);
+                return(RESULT_INT_ERROR);
+            }
+        }
+    }
+
+    for( i = 0; i < trie->slot_count; i++ )
+    {
+        if( trie->slots[i] == SLOT_EMPTY )
+        {
+            trie->empty_slots++;
+        }
+    }
+
+    free(builder.left_sizes);
+
+    return(RESULT_SUCCESS);
+}
+
+/* Does the subtrie at the given node cover the whole prefix? */
+static int subtrie_covers(const uint8_t* node, ip_value key, int pflen, int depth)
+{
+    for( ;; )
+    {
+        int header = *node++;
+        int skip = header & NODE_SKIP;
+        int i = 0;
+
+        if( depth + skip > pflen )
+        {
+            return 0;
+        }
+        for( i = 0; i < skip; i += 8 )
+        {
+            int chunk = (skip - i < 8) ? (skip - i) : 8;
+            if( (uint64_t)(*node++ >> (8 - chunk)) != key_bits(key, depth + i, chunk) )
+            {
+                return 0;
+            }
+        }
+        depth += skip;
+
+        if( header & NODE_LEAF )
+        {
+            return 1;
+        }
+
+        /* No internal node is fully covered */
+        if( depth >= pflen )
+        {
+            return 0;
+        }
+        else
+        {
+            size_t left = 0;
+            int shift = 0;
+            uint8_t byte = 0;
+
+            do
+            {
+                byte = *node++;
+                left |= (size_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while( byte & 0x80 );
+
+            if( key_bit(key, depth) )
+            {
+                node += left;
+            }
+            depth++;
+        }
+    }
+}
+
+static int prefix_trie_covers(const prefix_trie* trie, ip_value key, int pflen)
+{
+    int slot_bits = trie->root_bits + trie->stride;
+    uint32_t slot = 0;
+
+    if( (trie->stored_count == 0) || (pflen < trie->root_bits) ||
+        (key_common_bits(key, trie->root_prefix) < trie->root_bits) )
+    {
+        return 0;
+    }
+
+    /* A short prefix spans several slots, they must all be full */
+    if( pflen < slot_bits )
+    {
+        size_t span = (size_t)1 << (slot_bits - pflen);
+        size_t first = slot_of(trie, key) & ~(span - 1);
+        size_t i = 0;
+
+        for( i = first; i < first + span; i++ )
+        {
+            if( trie->slots[i] != SLOT_FULL )
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    slot = trie->slots[slot_of(trie, key)];
+    if( slot == SLOT_EMPTY )
+    {
+        return 0;
+    }
+    if( slot == SLOT_FULL )
+    {
+        return 1;
+    }
+
+    return subtrie_covers(trie->nodes + slot, key, pflen, slot_bits);
+}
+
+static void prefix_trie_free(prefix_trie* trie)
+{
+    free(trie->slots);
+    free(trie->nodes);
+}
+
+/*
+ * Prefix sets
+ */
+
+/* Build the filter over the stored prefixes of both families */
+static int prefix_set_build_filter(prefix_set* set, const ip_prefix* ipv4_keys, size_t ipv4_count,
+                                   const ip_prefix* ipv6_keys, size_t ipv6_count, int filter_bits)
+{
+    uint64_t* filter_keys = malloc((ipv4_count + ipv6_count + 1) * sizeof(uint64_t));
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    if( filter_keys == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    for( i = 0; i < ipv4_count + ipv6_count; i++ )
+    {
+        const ip_prefix* key = (i < ipv4_count) ? &ipv4_keys[i] : &ipv6_keys[i - ipv4_count];
+        int family = (key->proto == CIDR_IPV4) ? 0 : 1;
+
+        filter_keys[i] = filter_key_prefix(key->proto, key->addr, key->pflen);
+        set->filter_lengths[family][key->pflen >> 6] |= (uint64_t)1 << (key->pflen & 63);
+    }
+
+    result = fuse_filter_build(&set->filter, filter_keys, ipv4_count + ipv6_count, filter_bits);
+    set->has_filter = (result == RESULT_SUCCESS);
+    free(filter_keys);
+
+    return(result);
+}
+
+/*
+ * Build a set from a list of prefixes, the list can be freed afterwards.
+ * With filter_bits, a filter with fingerprints of that many bits is built too.
+ */
+prefix_set* prefix_set_build(ip_prefix* prefixes, size_t count, int filter_bits)
+{
+    prefix_set* set = calloc(1, sizeof(prefix_set));
+    ip_prefix* keys = malloc((count + 1) * sizeof(ip_prefix));
+    size_t ipv4_count = 0;
+    size_t ipv6_count = 0;
+    size_t ipv6_start = 0;
+    size_t i = 0;
+    int result = RESULT_SUCCESS;
+
+    if( (set == NULL) || (keys == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        free(set);
+        free(keys);
+        return NULL;
+    }
+
+    set->prefix_count = count;
+
+    /* IPv4 keys at the start, IPv6 keys at the end */
+    for( i = 0; i < count; i++ )
+    {
+        ip_prefix key = prefixes[i];
+        key.addr = key_from_prefix(&prefixes[i]);
+        if( key.proto == CIDR_IPV4 )
+        {
+            keys[ipv4_count++] = key;
+        }
+        else
+        {
+            keys[count - ++ipv6_count] = key;
+        }
+    }
+
+    ipv6_start = count - ipv6_count;
+    ipv4_count = normalize_keys(keys, ipv4_count);
+    ipv6_count = normalize_keys(keys + ipv6_start, ipv6_count);
+
+    result = prefix_trie_build(&set->ipv4, keys, ipv4_count, IPV4_BITS);
+    if( result == RESULT_SUCCESS )
+    {
+        result = prefix_trie_build(&set->ipv6, keys + ipv6_start, ipv6_count, IPV6_BITS);
+    }
+    if( (result == RESULT_SUCCESS) && (filter_bits > 0) )
+    {
+        result = prefix_set_build_filter(set, keys, ipv4_count, keys + ipv6_start, ipv6_count, filter_bits);
+    }
+    free(keys);
+
+    if( result != RESULT_SUCCESS )
+    {
+        if( result == RESULT_INT_ERROR )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+        }
+        prefix_set_free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+/* Load a set from a file of prefixes, one per line */
+prefix_set* prefix_set_load(const char* path, int filter_bits)
+{
+    size_t count = 0;
+    ip_prefix* prefixes = prefix_list_load(path, &count);
+    prefix_set* set = NULL;
+
+    if( prefixes == NULL )
+    {
+        return NULL;
+    }
+
+    set = prefix_set_build(prefixes, count, filter_bits);
+    free(prefixes);
+
+    return set;
+}
+
+/* Can a stored prefix cover the key? Probes every stored length up to pflen */
+static int prefix_set_filter_passes(const prefix_set* set, int proto, ip_value key, int pflen)
+{
+    const uint64_t* lengths = set->filter_lengths[(proto == CIDR_IPV4) ? 0 : 1];
+    int word = 0;
+
+    for( word = 0; word <= (pflen >> 6); word++ )
+    {
+        uint64_t bits = lengths[word];
+
+        if( word == (pflen >> 6) )
+        {
+            bits &= UINT64_MAX >> (63 - (pflen & 63));
+        }
+        while( bits != 0 )
+        {
+            int length = word * 64 + __builtin_ctzll(bits);
+
+            if( fuse_filter_contains(&set->filter,
+                                     filter_key_prefix(proto, key_mask(key, length), length)) == RESULT_SUCCESS )
+            {
+                return 1;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Check the filter first, if there is one, and count the outcome in stats unless it is NULL */
+int prefix_set_lookup(const prefix_set* set, const ip_prefix* prefix, filter_stats* stats)
+{
+    const prefix_trie* trie = (prefix->proto == CIDR_IPV4) ? &set->ipv4 : &set->ipv6;
+    ip_value key = key_from_prefix(prefix);
+    int passed = !set->has_filter || prefix_set_filter_passes(set, prefix->proto, key, prefix->pflen);
+    int found = passed && prefix_trie_covers(trie, key, prefix->pflen);
+
+    filter_stats_count(stats, set->has_filter, passed, found);
+
+    if( found )
+    {
+        return(RESULT_SUCCESS);
+    }
+    else
+    {
+        return(RESULT_FAILURE);
+    }
+}
+
+/* Is every address of the prefix (or a single address) in the set? */
+int prefix_set_contains(const prefix_set* set, const ip_prefix* prefix)
+{
+    return prefix_set_lookup(set, prefix, NULL);
+}
+
+/* Memory used by the lookup structure proper */
+size_t prefix_set_bytes(const prefix_set* set)
+{
+    return (set->ipv4.slot_count + set->ipv6.slot_count) * sizeof(uint32_t) +
+           set->ipv4.node_bytes + set->ipv6.node_bytes;
+}
+
+static void prefix_trie_print_report(const prefix_trie* trie, const char* name, FILE* stream)
+{
+    int depth = 0;
+
+    fprintf(stream, "\n%s:\n", name);
+    fprintf(stream, "  Stored prefixes:   %zu\n", trie->stored_count);
+    fprintf(stream, "  Root prefix bits:  %d\n", trie->root_bits);
+    fprintf(stream, "  Root stride bits:  %d\n", trie->stride);
+    fprintf(stream, "  Root slots:        %zu (%zu empty, %zu full)\n",
+            trie->slot_count, trie->empty_slots, trie->full_slots);
+    fprintf(stream, "  Internal nodes:    %zu\n", trie->internal_count);
+    fprintf(stream, "  Leaf nodes:        %zu\n", trie->leaf_count);
+    fprintf(stream, "  Slot bytes:        %zu\n", trie->slot_count * sizeof(uint32_t));
+    fprintf(stream, "  Node bytes:        %zu\n", trie->node_bytes);
+
+    if( trie->stored_count > 0 )
+    {
+        fprintf(stream, "  Lookup depth:      nodes visited  prefixes\n");
+        for( depth = 0; depth <= PREFIX_TRIE_MAX_DEPTH; depth++ )
+        {
+            if( trie->depth_histogram[depth] > 0 )
+            {
+                fprintf(stream, "                     %13d  %zu\n", depth, trie->depth_histogram[depth]);
+            }
+        }
+    }
+}
+
+void prefix_set_print_report(const prefix_set* set, FILE* stream)
+{
+    size_t bytes = prefix_set_bytes(set);
+
+    fprintf(stream, "Prefixes:            %zu (%zu after merging covered and adjacent ones)\n",
+            set->prefix_count, set->ipv4.stored_count + set->ipv6.stored_count);
+    fprintf(stream, "Memory:              %zu bytes", bytes);
+    if( set->prefix_count > 0 )
+    {
+        fprintf(stream, ", %.2f bytes per prefix", (double)bytes / set->prefix_count);
+    }
+    fprintf(stream, "\n");
+
+    if( set->has_filter )
+    {
+        size_t filter_bytes = fuse_filter_word_count(&set->filter.params) * sizeof(uint64_t);
+
+        fprintf(stream, "Filter:              %zu bytes, %u-bit fingerprints\n", filter_bytes,
+                set->filter.params.fingerprint_bits);
+    }
+
+    prefix_trie_print_report(&set->ipv4, "IPv4", stream);
+    prefix_trie_print_report(&set->ipv6, "IPv6", stream);
+}
+
+void prefix_set_free(prefix_set* set)
+{
+    if( set == NULL )
+    {
+        return;
+    }
+
+    prefix_trie_free(&set->ipv4);
+    prefix_trie_free(&set->ipv6);
+    fuse_filter_free(&set->filter);
+    free(set);
+}
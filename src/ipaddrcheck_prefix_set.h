@@ -0,0 +1,90 @@
+/*
+ * ipaddrcheck_prefix_set.h: compact prefix sets for membership checks
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_PREFIX_SET_H
+#define IPADDRCHECK_PREFIX_SET_H
+
+#include "ipaddrcheck_filter.h"
+
+/* Longest possible lookup path: one node per branch and the leaf */
+#define PREFIX_TRIE_MAX_DEPTH (IPV6_BITS + 1)
+
+/*
+ * A level- and path-compressed binary trie serialized to a byte string.
+ *
+ * Prefixes covered by other prefixes are dropped and adjacent ones
+ * are merged first, so every leaf is a member prefix and no internal node
+ * is fully covered. The root is level-compressed: after the bits common
+ * to all prefixes, the next "stride" bits index a slot table that points
+ * to a subtrie for every slot (or marks the slot as empty or full).
+ *
+ * Subtries are stored in preorder. A node is a header byte
+ * (high bit set for leaves, the low seven bits are the number of skipped
+ * bits), the skipped bits themselves packed into bytes, and for internal
+ * nodes the size of the left subtrie as a LEB128 number,
+ * the left child comes right after its parent.
+ *
+ * Addresses are kept left-aligned, so that IPv4 and IPv6 tries
+ * count bits the same way.
+ */
+typedef struct
+{
+    ip_value root_prefix;
+    int root_bits;
+    int stride;
+    uint32_t* slots;
+    size_t slot_count;
+    uint8_t* nodes;
+    size_t node_bytes;
+
+    /* Only for the memory report */
+    size_t stored_count;
+    size_t internal_count;
+    size_t leaf_count;
+    size_t full_slots;
+    size_t empty_slots;
+    size_t depth_histogram[PREFIX_TRIE_MAX_DEPTH + 1];
+} prefix_trie;
+
+/*
+ * The optional filter holds the stored prefixes. A lookup probes it
+ * once for every prefix length that occurs in the family of the address,
+ * filter_lengths has a bit for each of them.
+ */
+typedef struct
+{
+    prefix_trie ipv4;
+    prefix_trie ipv6;
+    size_t prefix_count;
+    fuse_filter filter;
+    int has_filter;
+    uint64_t filter_lengths[2][3];
+} prefix_set;
+
+prefix_set* prefix_set_build(ip_prefix* prefixes, size_t count, int filter_bits);
+prefix_set* prefix_set_load(const char* path, int filter_bits);
+int prefix_set_lookup(const prefix_set* set, const ip_prefix* prefix, filter_stats* stats);
+int prefix_set_contains(const prefix_set* set, const ip_prefix* prefix);
+size_t prefix_set_bytes(const prefix_set* set);
+void prefix_set_print_report(const prefix_set* set, FILE* stream);
+void prefix_set_free(prefix_set* set);
+
+#endif /* IPADDRCHECK_PREFIX_SET_H */
@@ -0,0 +1,371 @@
+/*
+ * ipaddrcheck_python.c: address checks as a CPython extension module
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Python code would otherwise run the ipaddrcheck program for every value.
+ * With "import ipaddrcheck" it gets these functions instead, which take
+ * addresses and prefixes as str or bytes:
+ *
+ *   valid(s)               4 or 6 if s is a valid address or prefix of
+ *                          that family, 0 if it is not
+ *   classify(s)            the family, classes and properties of s, a bitmask
+ *                          of the constants below, 0 if s is not valid
+ *   contains(prefix, s)    True if the address or prefix s lies entirely
+ *                          within prefix, False if not or if either is
+ *                          not valid
+ *   valid_batch(items)     valid() of every item, one byte each
+ *   classify_batch(items)  classify() of every item, as unsigned 16-bit
+ *                          integers in native byte order, to be read with
+ *                          memoryview(...).cast("H") or array.array("H", ...)
+ *
+ * The batch functions take any sequence and release the GIL while they
+ * work, so that several threads can check batches at the same time.
+ *
+ * The bits of classify() are the constants IPV4, IPV6, MULTICAST, LOOPBACK,
+ * LINK_LOCAL, RFC1918, THIS_NETWORK, LIMITED_BROADCAST, NETWORK, BROADCAST,
+ * HOST and INTERFACE.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include "ipaddrcheck_classify.h"
+
+/* The family of a valid address, above the ADDRESS_PROPERTY_* bits,
+   so that a valid address never classifies as 0 */
+#define ADDRESS_FAMILY_IPV4  0x400
+#define ADDRESS_FAMILY_IPV6  0x800
+
+/* Addresses parsed and classified at a time by classify_batch() */
+#define CLASSIFY_CHUNK_SIZE 256
+
+/* Items of a batch, pointing into the str and bytes objects themselves */
+typedef struct
+{
+    const char** strs;
+    Py_ssize_t* lengths;
+    Py_ssize_t count;
+} item_list;
+
+typedef void (*batch_function)(const item_list* items, unsigned char* results);
+
+/* The text of a str or bytes object, without copying it */
+static int item_text(PyObject* item, const char** str, Py_ssize_t* length)
+{
+    if( PyUnicode_Check(item) )
+    {
+        *str = PyUnicode_AsUTF8AndSize(item, length);
+        return (*str != NULL) ? 0 : -1;
+    }
+    if( PyBytes_Check(item) )
+    {
+        *str = PyBytes_AS_STRING(item);
+        *length = PyBytes_GET_SIZE(item);
+        return 0;
+    }
+    PyErr_Format(PyExc_TypeError, "expected str or bytes, not %.200s", Py_TYPE(item)->tp_name);
+    return -1;
+}
+
+/* Parse an address or prefix, the parsers want it null-terminated
+   in a buffer of their own. Called without the GIL. */
+static int parse_item(const char* str, Py_ssize_t length, ip_prefix* prefix)
+{
+    char prefix_str[PREFIX_STR_MAX];
+
+    if( (length >= (Py_ssize_t)sizeof(prefix_str)) || (memchr(str, '\0', length) != NULL) )
+    {
+        return RESULT_FAILURE;
+    }
+    memcpy(prefix_str, str, length);
+    prefix_str[length] = '\0';
+
+    return ip_prefix_from_str(prefix_str, prefix);
+}
+
+static unsigned int family_bit(const ip_prefix* prefix)
+{
+    return (prefix->proto == CIDR_IPV4) ? ADDRESS_FAMILY_IPV4 : ADDRESS_FAMILY_IPV6;
+}
+
+static void valid_batch_function(const item_list* items, unsigned char* results)
+{
+    ip_prefix prefix;
+    Py_ssize_t i = 0;
+
+    for( i = 0; i < items->count; i++ )
+    {
+        if( parse_item(items->strs[i], items->lengths[i], &prefix) != RESULT_SUCCESS )
+        {
+            results[i] = 0;
+        }
+        else
+        {
+            results[i] = (prefix.proto == CIDR_IPV4) ? 4 : 6;
+        }
+    }
+}
+
+/* Parse a chunk of items and classify its IPv4 addresses together,
+   laid out for the vector kernels, as --classify does */
+static void classify_chunk(const char** strs, const Py_ssize_t* lengths, size_t count, uint16_t* properties)
+{
+    ip_prefix prefix;
+    uint32_t ipv4_addrs[CLASSIFY_CHUNK_SIZE] = { 0 };
+    uint8_t ipv4_pflens[CLASSIFY_CHUNK_SIZE] = { 0 };
+    uint16_t ipv4_properties[CLASSIFY_CHUNK_SIZE];
+    size_t ipv4_positions[CLASSIFY_CHUNK_SIZE];
+    size_t ipv4_count = 0;
+    size_t i = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        if( parse_item(strs[i], lengths[i], &prefix) != RESULT_SUCCESS )
+        {
+            properties[i] = 0;
+        }
+        else if( prefix.proto == CIDR_IPV4 )
+        {
+            ipv4_addrs[ipv4_count] = (uint32_t)prefix.addr.lo;
+            ipv4_pflens[ipv4_count] = (uint8_t)prefix.pflen;
+            ipv4_positions[ipv4_count++] = i;
+        }
+        else
+        {
+            properties[i] = (uint16_t)(ADDRESS_FAMILY_IPV6 | ip_prefix_properties(&prefix));
+        }
+    }
+
+    ipv4_properties_batch(ipv4_addrs, ipv4_pflens, ipv4_count, ipv4_properties);
+    for( i = 0; i < ipv4_count; i++ )
+    {
+        properties[ipv4_positions[i]] = (uint16_t)(ADDRESS_FAMILY_IPV4 | ipv4_properties[i]);
+    }
+}
+
+static void classify_batch_function(const item_list* items, unsigned char* results)
+{
+    uint16_t properties[CLASSIFY_CHUNK_SIZE];
+    Py_ssize_t start = 0;
+
+    for( start = 0; start < items->count; start += CLASSIFY_CHUNK_SIZE )
+    {
+        size_t count = (size_t)(items->count - start);
+
+        if( count > CLASSIFY_CHUNK_SIZE )
+        {
+            count = CLASSIFY_CHUNK_SIZE;
+        }
+        classify_chunk(items->strs + start, items->lengths + start, count, properties);
+        /* The bytes object gives no alignment guarantee for 16-bit stores */
+        memcpy(results + start * sizeof(uint16_t), properties, count * sizeof(uint16_t));
+    }
+}
+
+/*
+ * Run a batch function over a sequence, with result_size bytes of the
+ * returned bytes object for every item. The items are copied into a tuple
+ * first: it keeps them alive, and the sequence the same, while other
+ * threads run.
+ */
+static PyObject* run_batch(PyObject* sequence, size_t result_size, batch_function function)
+{
+    PyObject* tuple = NULL;
+    PyObject* results = NULL;
+    item_list items = { NULL, NULL, 0 };
+    Py_ssize_t i = 0;
+
+    tuple = PySequence_Tuple(sequence);
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    items.count = PyTuple_GET_SIZE(tuple);
+    items.strs = PyMem_New(const char*, items.count + 1);
+    items.lengths = PyMem_New(Py_ssize_t, items.count + 1);
+    if( (items.strs == NULL) || (items.lengths == NULL) )
+    {
+        PyErr_NoMemory();
+        goto cleanup;
+    }
+    for( i = 0; i < items.count; i++ )
+    {
+        if( item_text(PyTuple_GET_ITEM(tuple, i), &items.strs[i], &items.lengths[i]) < 0 )
+        {
+            goto cleanup;
+        }
+    }
+
+    results = PyBytes_FromStringAndSize(NULL, items.count * result_size);
+    if( results == NULL )
+    {
+        goto cleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    function(&items, (unsigned char*)PyBytes_AS_STRING(results));
+    Py_END_ALLOW_THREADS
+
+cleanup:
+    PyMem_Free(items.strs);
+    PyMem_Free(items.lengths);
+    Py_DECREF(tuple);
+
+    return results;
+}
+
+static PyObject* python_valid(PyObject* module, PyObject* arg)
+{
+    const char* str = NULL;
+    Py_ssize_t length = 0;
+    ip_prefix prefix;
+
+    if( item_text(arg, &str, &length) < 0 )
+    {
+        return NULL;
+    }
+    if( parse_item(str, length, &prefix) != RESULT_SUCCESS )
+    {
+        return PyLong_FromLong(0);
+    }
+    return PyLong_FromLong((prefix.proto == CIDR_IPV4) ? 4 : 6);
+}
+
+static PyObject* python_classify(PyObject* module, PyObject* arg)
+{
+    const char* str = NULL;
+    Py_ssize_t length = 0;
+    ip_prefix prefix;
+
+    if( item_text(arg, &str, &length) < 0 )
+    {
+        return NULL;
+    }
+    if( parse_item(str, length, &prefix) != RESULT_SUCCESS )
+    {
+        return PyLong_FromLong(0);
+    }
+    return PyLong_FromLong(family_bit(&prefix) | ip_prefix_properties(&prefix));
+}
+
+static PyObject* python_contains(PyObject* module, PyObject* args)
+{
+    PyObject* outer_arg = NULL;
+    PyObject* inner_arg = NULL;
+    const char* outer_str = NULL;
+    const char* inner_str = NULL;
+    Py_ssize_t outer_length = 0;
+    Py_ssize_t inner_length = 0;
+    ip_prefix outer;
+    ip_prefix inner;
+
+    if( !PyArg_ParseTuple(args, "OO:contains", &outer_arg, &inner_arg) ||
+        (item_text(outer_arg, &outer_str, &outer_length) < 0) ||
+        (item_text(inner_arg, &inner_str, &inner_length) < 0) )
+    {
+        return NULL;
+    }
+    if( (parse_item(outer_str, outer_length, &outer) != RESULT_SUCCESS) ||
+        (parse_item(inner_str, inner_length, &inner) != RESULT_SUCCESS) )
+    {
+        Py_RETURN_FALSE;
+    }
+    return PyBool_FromLong(ip_prefix_contains(&outer, &inner) == RESULT_SUCCESS);
+}
+
+static PyObject* python_valid_batch(PyObject* module, PyObject* arg)
+{
+    return run_batch(arg, 1, valid_batch_function);
+}
+
+static PyObject* python_classify_batch(PyObject* module, PyObject* arg)
+{
+    return run_batch(arg, sizeof(uint16_t), classify_batch_function);
+}
+
+static PyMethodDef ipaddrcheck_methods[] =
+{
+    { "valid", python_valid, METH_O,
+      "valid(s) -> 4 or 6 if s is a valid address or prefix of that family, 0 if not" },
+    { "classify", python_classify, METH_O,
+      "classify(s) -> bitmask of the family, classes and properties of s, 0 if not valid" },
+    { "contains", python_contains, METH_VARARGS,
+      "contains(prefix, s) -> whether the address or prefix s lies within prefix" },
+    { "valid_batch", python_valid_batch, METH_O,
+      "valid_batch(items) -> bytes with valid() of every item" },
+    { "classify_batch", python_classify_batch, METH_O,
+      "classify_batch(items) -> bytes with classify() of every item as native unsigned 16-bit integers" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef ipaddrcheck_module =
+{
+    PyModuleDef_HEAD_INIT,
+    "ipaddrcheck",
+    "IPv4 and IPv6 address checks of ipaddrcheck",
+    -1,
+    ipaddrcheck_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_ipaddrcheck(void)
+{
+    static const struct
+    {
+        const char* name;
+        long bit;
+    } constants[] =
+    {
+        { "IPV4",              ADDRESS_FAMILY_IPV4 },
+        { "IPV6",              ADDRESS_FAMILY_IPV6 },
+        { "MULTICAST",         ADDRESS_CLASS_MULTICAST },
+        { "LOOPBACK",          ADDRESS_CLASS_LOOPBACK },
+        { "LINK_LOCAL",        ADDRESS_CLASS_LINK_LOCAL },
+        { "RFC1918",           ADDRESS_CLASS_RFC1918 },
+        { "THIS_NETWORK",      ADDRESS_CLASS_THIS_NETWORK },
+        { "LIMITED_BROADCAST", ADDRESS_CLASS_LIMITED_BROADCAST },
+        { "NETWORK",           ADDRESS_PROPERTY_NETWORK },
+        { "BROADCAST",         ADDRESS_PROPERTY_BROADCAST },
+        { "HOST",              ADDRESS_PROPERTY_HOST },
+        { "INTERFACE",         ADDRESS_PROPERTY_INTERFACE }
+    };
+    PyObject* module = NULL;
+    size_t i = 0;
+
+    module = PyModule_Create(&ipaddrcheck_module);
+    if( module == NULL )
+    {
+        return NULL;
+    }
+    for( i = 0; i < sizeof(constants) / sizeof(constants[0]); i++ )
+    {
+        if( PyModule_AddIntConstant(module, constants[i].name, constants[i].bit) < 0 )
+        {
+            Py_DECREF(module);
+            return NULL;
+        }
+    }
+
+    return module;
+}
@@ -0,0 +1,492 @@
+/*
+ * ipaddrcheck_reload.c: lookup tables that can be replaced while in use
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* sigaction(), clock_gettime(), pipe() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "ipaddrcheck_reload.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/* How often the watcher retries freeing old tables
+   that readers were still using, in milliseconds */
+#define RECLAIM_INTERVAL 100
+
+#define CONTROL_RELOAD 'r'
+#define CONTROL_STATS  's'
+#define CONTROL_QUIT   'q'
+
+/*
+ * Handles
+ */
+
+int lpm_handle_init(lpm_handle* handle, lpm_table* table)
+{
+    memset(handle, 0, sizeof(lpm_handle));
+
+    if( pthread_mutex_init(&handle->writer_lock, NULL) != 0 )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    handle->table = table;
+    handle->epoch = 1;
+    handle->version = 1;
+
+    return(RESULT_SUCCESS);
+}
+
+/* Claim a reader slot, -1 if all are taken */
+int lpm_handle_register_reader(lpm_handle* handle)
+{
+    int i = 0;
+
+    for( i = 0; i < LPM_HANDLE_MAX_READERS; i++ )
+    {
+        if( __atomic_exchange_n(&handle->readers[i].registered, 1, __ATOMIC_ACQ_REL) == 0 )
+        {
+            __atomic_store_n(&handle->readers[i].epoch, 0, __ATOMIC_RELEASE);
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void lpm_handle_unregister_reader(lpm_handle* handle, int reader)
+{
+    __atomic_store_n(&handle->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&handle->readers[reader].registered, 0, __ATOMIC_RELEASE);
+}
+
+/* Enter a read section, the table stays valid until lpm_handle_read_end().
+ *
+ * The slot is written before the table pointer is loaded, so a writer
+ * that doesn't see the slot yet has already swapped the pointer
+ * and this reader can only get the new table.
+ */
+const lpm_table* lpm_handle_read_begin(lpm_handle* handle, int reader)
+{
+    uint64_t epoch = __atomic_load_n(&handle->epoch, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&handle->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&handle->table, __ATOMIC_SEQ_CST);
+}
+
+void lpm_handle_read_end(lpm_handle* handle, int reader)
+{
+    __atomic_store_n(&handle->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Free retired tables that no reader can still be using,
+   returns the number of tables left waiting */
+size_t lpm_handle_reclaim(lpm_handle* handle)
+{
+    uint64_t oldest = UINT64_MAX;
+    size_t kept = 0;
+    size_t i = 0;
+
+    pthread_mutex_lock(&handle->writer_lock);
+
+    for( i = 0; i < LPM_HANDLE_MAX_READERS; i++ )
+    {
+        uint64_t epoch = __atomic_load_n(&handle->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if( (epoch != 0) && (epoch < oldest) )
+        {
+            oldest = epoch;
+        }
+    }
+
+    /* Readers that entered at the retire epoch or later got the new table */
+    for( i = 0; i < handle->retired_count; i++ )
+    {
+        if( handle->retired[i].retire_epoch <= oldest )
+        {
+            lpm_table_free(handle->retired[i].table);
+        }
+        else
+        {
+            handle->retired[kept++] = handle->retired[i];
+        }
+    }
+    /* The watcher thread checks the count without the lock */
+    __atomic_store_n(&handle->retired_count, kept, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&handle->writer_lock);
+
+    return kept;
+}
+
+/* Replace the table, the old one is freed once readers are done with it */
+int lpm_handle_publish(lpm_handle* handle, lpm_table* table)
+{
+    lpm_table* old_table = NULL;
+    int result = RESULT_SUCCESS;
+
+    pthread_mutex_lock(&handle->writer_lock);
+
+    if( handle->retired_count == handle->retired_capacity )
+    {
+        size_t capacity = handle->retired_capacity ? handle->retired_capacity * 2 : 4;
+        lpm_retired_table* retired = realloc(handle->retired, capacity * sizeof(lpm_retired_table));
+        if( retired == NULL )
+        {
+            result = RESULT_INT_ERROR;
+        }
+        else
+        {
+            handle->retired = retired;
+            handle->retired_capacity = capacity;
+        }
+    }
+
+    if( result == RESULT_SUCCESS )
+    {
+        old_table = __atomic_exchange_n(&handle->table, table, __ATOMIC_SEQ_CST);
+        handle->retired[handle->retired_count].table = old_table;
+        handle->retired[handle->retired_count].retire_epoch = __atomic_add_fetch(&handle->epoch, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&handle->retired_count, handle->retired_count + 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&handle->version, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&handle->writer_lock);
+
+    if( result == RESULT_SUCCESS )
+    {
+        lpm_handle_reclaim(handle);
+    }
+
+    return(result);
+}
+
+/* Build a new table from the file and publish it,
+   the current table stays in place if the file has errors */
+int lpm_handle_reload(lpm_handle* handle, const char* path, lpm_table_loader loader)
+{
+    struct timespec start;
+    struct timespec end;
+    lpm_table* table = NULL;
+    uint64_t duration = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    table = loader(path);
+    if( table == NULL )
+    {
+        __atomic_add_fetch(&handle->failed_reloads, 1, __ATOMIC_RELAXED);
+        return(RESULT_FAILURE);
+    }
+
+    if( lpm_handle_publish(handle, table) != RESULT_SUCCESS )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        lpm_table_free(table);
+        __atomic_add_fetch(&handle->failed_reloads, 1, __ATOMIC_RELAXED);
+        return(RESULT_INT_ERROR);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    duration = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+    __atomic_store_n(&handle->last_reload_ns, duration, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&handle->reloads, 1, __ATOMIC_RELAXED);
+
+    return(RESULT_SUCCESS);
+}
+
+void lpm_handle_print_stats(lpm_handle* handle, FILE* stream)
+{
+    fprintf(stream, "Table version:     %" PRIu64 "\n", __atomic_load_n(&handle->version, __ATOMIC_RELAXED));
+    fprintf(stream, "Reloads:           %" PRIu64 "\n", __atomic_load_n(&handle->reloads, __ATOMIC_RELAXED));
+    fprintf(stream, "Failed reloads:    %" PRIu64 "\n", __atomic_load_n(&handle->failed_reloads, __ATOMIC_RELAXED));
+    fprintf(stream, "Last reload time:  %.3f ms\n", __atomic_load_n(&handle->last_reload_ns, __ATOMIC_RELAXED) / 1e6);
+    fprintf(stream, "Lookups:           %" PRIu64 "\n", __atomic_load_n(&handle->lookups, __ATOMIC_RELAXED));
+}
+
+/* Free everything, there must be no readers left */
+void lpm_handle_destroy(lpm_handle* handle)
+{
+    size_t i = 0;
+
+    for( i = 0; i < handle->retired_count; i++ )
+    {
+        lpm_table_free(handle->retired[i].table);
+    }
+    free(handle->retired);
+    lpm_table_free(handle->table);
+    pthread_mutex_destroy(&handle->writer_lock);
+}
+
+/*
+ * Watcher
+ *
+ * Signals are process-wide, so there can only be one watcher at a time.
+ * Signal handlers and inotify events only wake up the watcher thread,
+ * all the work happens there.
+ */
+
+static int watcher_control_fd = -1;
+
+static void watcher_signal_handler(int signal_number)
+{
+    int saved_errno = errno;
+    char command = (signal_number == SIGHUP) ? CONTROL_RELOAD : CONTROL_STATS;
+    ssize_t written = write(watcher_control_fd, &command, 1);
+
+    (void)written;
+    errno = saved_errno;
+}
+
+static void watcher_reload(lpm_watcher* watcher)
+{
+    if( lpm_handle_reload(watcher->handle, watcher->path, watcher->loader) == RESULT_SUCCESS )
+    {
+        if( watcher->verbose )
+        {
+            fprintf(stderr, "Reloaded %s, table version %" PRIu64 "\n", watcher->path,
+                    __atomic_load_n(&watcher->handle->version, __ATOMIC_RELAXED));
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Error: could not reload %s, keeping table version %" PRIu64 "\n", watcher->path,
+                __atomic_load_n(&watcher->handle->version, __ATOMIC_RELAXED));
+    }
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* Was the watched file among the changed ones? */
+static int watcher_file_changed(lpm_watcher* watcher)
+{
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    const char* name = strrchr(watcher->path, '/');
+    int changed = 0;
+    ssize_t length = 0;
+
+    name = (name != NULL) ? name + 1 : watcher->path;
+
+    while( (length = read(watcher->inotify_fd, &buffer, sizeof(buffer))) > 0 )
+    {
+        ssize_t offset = 0;
+        while( offset < length )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer.bytes + offset);
+            if( (event->len > 0) && (strcmp(event->name, name) == 0) )
+            {
+                changed = 1;
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+#endif
+
+static void* watcher_thread(void* argument)
+{
+    lpm_watcher* watcher = argument;
+    struct pollfd fds[2];
+    nfds_t fd_count = 1;
+    int running = 1;
+
+    fds[0].fd = watcher->control_pipe[0];
+    fds[0].events = POLLIN;
+    if( watcher->inotify_fd >= 0 )
+    {
+        fds[1].fd = watcher->inotify_fd;
+        fds[1].events = POLLIN;
+        fd_count = 2;
+    }
+
+    while( running && !__atomic_load_n(&watcher->quit, __ATOMIC_ACQUIRE) )
+    {
+        size_t retired_count = __atomic_load_n(&watcher->handle->retired_count, __ATOMIC_ACQUIRE);
+        int timeout = (retired_count > 0) ? RECLAIM_INTERVAL : -1;
+
+        if( poll(fds, fd_count, timeout) < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            break;
+        }
+
+        if( fds[0].revents & POLLIN )
+        {
+            char command = 0;
+            if( read(watcher->control_pipe[0], &command, 1) == 1 )
+            {
+                switch( command )
+                {
+                    case CONTROL_RELOAD:
+                        watcher_reload(watcher);
+                        break;
+                    case CONTROL_STATS:
+                        lpm_handle_print_stats(watcher->handle, stderr);
+                        break;
+                    case CONTROL_QUIT:
+                        running = 0;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+#ifdef HAVE_SYS_INOTIFY_H
+        if( (fd_count > 1) && (fds[1].revents & POLLIN) && watcher_file_changed(watcher) )
+        {
+            watcher_reload(watcher);
+        }
+#endif
+
+        lpm_handle_reclaim(watcher->handle);
+    }
+
+    return NULL;
+}
+
+/* Give the signals back to their previous handlers and close everything,
+   once the watcher thread has stopped or if it never started */
+static void watcher_release(lpm_watcher* watcher)
+{
+    sigaction(SIGHUP, &watcher->saved_hup_action, NULL);
+    sigaction(SIGUSR1, &watcher->saved_usr1_action, NULL);
+
+    watcher_control_fd = -1;
+    close(watcher->control_pipe[0]);
+    close(watcher->control_pipe[1]);
+    if( watcher->inotify_fd >= 0 )
+    {
+        close(watcher->inotify_fd);
+    }
+}
+
+/* Start reloading the table of the handle from the file
+   whenever it changes or on SIGHUP */
+int lpm_watcher_start(lpm_watcher* watcher, lpm_handle* handle, const char* path,
+                      lpm_table_loader loader, int verbose)
+{
+    struct sigaction action;
+
+    watcher->handle = handle;
+    watcher->path = path;
+    watcher->loader = loader;
+    watcher->verbose = verbose;
+    watcher->inotify_fd = -1;
+    watcher->quit = 0;
+
+    if( pipe(watcher->control_pipe) != 0 )
+    {
+        fprintf(stderr, "Error: could not create a pipe: %s\n", strerror(errno));
+        return(RESULT_INT_ERROR);
+    }
+    /* Signal handlers must never block */
+    fcntl(watcher->control_pipe[1], F_SETFL, O_NONBLOCK);
+
+#ifdef HAVE_SYS_INOTIFY_H
+    {
+        /* Watch the directory rather than the file,
+           so that files replaced with rename() are noticed too */
+        const char* name = strrchr(path, '/');
+        char* directory = NULL;
+        size_t directory_length = (name != NULL) ? (size_t)(name - path) : 0;
+
+        directory = malloc(directory_length + 2);
+        if( directory != NULL )
+        {
+            if( name == NULL )
+            {
+                strcpy(directory, ".");
+            }
+            else if( directory_length == 0 )
+            {
+                strcpy(directory, "/");
+            }
+            else
+            {
+                memcpy(directory, path, directory_length);
+                directory[directory_length] = '\0';
+            }
+
+            watcher->inotify_fd = inotify_init1(IN_NONBLOCK);
+            if( (watcher->inotify_fd >= 0) &&
+                (inotify_add_watch(watcher->inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) )
+            {
+                fprintf(stderr, "Warning: cannot watch %s for changes: %s\n", directory, strerror(errno));
+                close(watcher->inotify_fd);
+                watcher->inotify_fd = -1;
+            }
+            free(directory);
+        }
+    }
+#endif
+
+    watcher_control_fd = watcher->control_pipe[1];
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watcher_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, &watcher->saved_hup_action);
+    sigaction(SIGUSR1, &action, &watcher->saved_usr1_action);
+
+    if( pthread_create(&watcher->thread, NULL, watcher_thread, watcher) != 0 )
+    {
+        fprintf(stderr, "Error: could not start the reload thread\n");
+        watcher_release(watcher);
+        return(RESULT_INT_ERROR);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Stop the watcher thread, which must have been started, and wait for it */
+void lpm_watcher_stop(lpm_watcher* watcher)
+{
+    char command = CONTROL_QUIT;
+    ssize_t written = 0;
+
+    /* If the pipe is full, the thread has commands to wake up for anyway
+       and sees the flag once it has read one */
+    __atomic_store_n(&watcher->quit, 1, __ATOMIC_RELEASE);
+    written = write(watcher->control_pipe[1], &command, 1);
+    (void)written;
+
+    pthread_join(watcher->thread, NULL);
+    watcher_release(watcher);
+}
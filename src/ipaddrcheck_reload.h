@@ -0,0 +1,110 @@
+/*
+ * ipaddrcheck_reload.h: lookup tables that can be replaced while in use
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_RELOAD_H
+#define IPADDRCHECK_RELOAD_H
+
+#include <pthread.h>
+#include <signal.h>
+#include "ipaddrcheck_lpm.h"
+
+#define LPM_HANDLE_MAX_READERS 64
+
+/* Builds a new table from a file, e.g. lpm_table_load() */
+typedef lpm_table* (*lpm_table_loader)(const char* path);
+
+/* Each reader slot has a cache line of its own,
+   so readers never write to a line another reader uses. */
+typedef struct
+{
+    uint64_t epoch;     /* zero outside of read sections */
+    int registered;
+    char padding[64 - sizeof(uint64_t) - sizeof(int)];
+} lpm_reader_slot;
+
+typedef struct
+{
+    lpm_table* table;
+    uint64_t retire_epoch;
+} lpm_retired_table;
+
+/*
+ * A table shared between query threads and a reloading thread.
+ *
+ * Readers record the global epoch in their slot before loading
+ * the table pointer and clear it when they are done, they never lock.
+ * The writer builds a replacement table on the side, swaps the pointer
+ * atomically and advances the epoch; the old table is freed once
+ * no reader is left in a read section that started before the swap.
+ */
+typedef struct
+{
+    lpm_table* table;
+    uint64_t epoch;
+    lpm_reader_slot readers[LPM_HANDLE_MAX_READERS];
+
+    /* Writer side, protected by writer_lock */
+    pthread_mutex_t writer_lock;
+    lpm_retired_table* retired;
+    size_t retired_count;     /* also read atomically without the lock */
+    size_t retired_capacity;
+
+    /* Statistics, updated atomically */
+    uint64_t version;
+    uint64_t reloads;
+    uint64_t failed_reloads;
+    uint64_t last_reload_ns;
+    uint64_t lookups;
+} lpm_handle;
+
+/* Reloads the table of a handle when its file changes (if supported),
+   on SIGHUP, and prints statistics on SIGUSR1. */
+typedef struct
+{
+    lpm_handle* handle;
+    const char* path;
+    lpm_table_loader loader;
+    pthread_t thread;
+    int control_pipe[2];
+    int inotify_fd;
+    int verbose;
+    int quit;       /* set atomically by lpm_watcher_stop() */
+    /* What the signals did before, put back when the watcher stops */
+    struct sigaction saved_hup_action;
+    struct sigaction saved_usr1_action;
+} lpm_watcher;
+
+int lpm_handle_init(lpm_handle* handle, lpm_table* table);
+int lpm_handle_register_reader(lpm_handle* handle);
+void lpm_handle_unregister_reader(lpm_handle* handle, int reader);
+const lpm_table* lpm_handle_read_begin(lpm_handle* handle, int reader);
+void lpm_handle_read_end(lpm_handle* handle, int reader);
+int lpm_handle_publish(lpm_handle* handle, lpm_table* table);
+size_t lpm_handle_reclaim(lpm_handle* handle);
+int lpm_handle_reload(lpm_handle* handle, const char* path, lpm_table_loader loader);
+void lpm_handle_print_stats(lpm_handle* handle, FILE* stream);
+void lpm_handle_destroy(lpm_handle* handle);
+
+int lpm_watcher_start(lpm_watcher* watcher, lpm_handle* handle, const char* path,
+                      lpm_table_loader loader, int verbose);
+void lpm_watcher_stop(lpm_watcher* watcher);
+
+#endif /* IPADDRCHECK_RELOAD_H */
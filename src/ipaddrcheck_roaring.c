@@ -0,0 +1,883 @@
+/*
+ * ipaddrcheck_roaring.c: compressed bitmap sets of IPv4 addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "ipaddrcheck_roaring.h"
+
+#define BITMAP_BYTES (CONTAINER_BITMAP_WORDS * sizeof(uint64_t))
+
+/*
+ * Bitmaps
+ */
+
+static void bitmap_set_range(uint64_t* words, uint32_t first, uint32_t last)
+{
+    uint32_t first_word = first >> 6;
+    uint32_t last_word = last >> 6;
+    uint64_t first_mask = UINT64_MAX << (first & 63);
+    uint64_t last_mask = UINT64_MAX >> (63 - (last & 63));
+    uint32_t i = 0;
+
+    if( first_word == last_word )
+    {
+        words[first_word] |= first_mask & last_mask;
+        return;
+    }
+
+    words[first_word] |= first_mask;
+    for( i = first_word + 1; i < last_word; i++ )
+    {
+        words[i] = UINT64_MAX;
+    }
+    words[last_word] |= last_mask;
+}
+
+static uint32_t bitmap_cardinality(const uint64_t* words)
+{
+    uint32_t cardinality = 0;
+    int i = 0;
+
+    for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+    {
+        cardinality += __builtin_popcountll(words[i]);
+    }
+
+    return cardinality;
+}
+
+static uint32_t bitmap_run_count(const uint64_t* words)
+{
+    uint32_t runs = 0;
+    uint64_t carry = 0;
+    int i = 0;
+
+    /* A run starts at every set bit whose predecessor is clear */
+    for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+    {
+        runs += __builtin_popcountll(words[i] & ~((words[i] << 1) | carry));
+        carry = words[i] >> 63;
+    }
+
+    return runs;
+}
+
+/* Find the first run of set bits at or after the position */
+static int bitmap_next_run(const uint64_t* words, uint32_t position, uint32_t* first, uint32_t* last)
+{
+    uint32_t i = position >> 6;
+    uint64_t word = 0;
+
+    if( position >= 65536 )
+    {
+        return 0;
+    }
+
+    word = words[i] & (UINT64_MAX << (position & 63));
+    while( word == 0 )
+    {
+        if( ++i == CONTAINER_BITMAP_WORDS )
+        {
+            return 0;
+        }
+        word = words[i];
+    }
+    *first = i * 64 + __builtin_ctzll(word);
+
+    word = ~words[i] & (UINT64_MAX << (*first & 63));
+    while( word == 0 )
+    {
+        if( ++i == CONTAINER_BITMAP_WORDS )
+        {
+            *last = 65535;
+            return 1;
+        }
+        word = ~words[i];
+    }
+    *last = i * 64 + __builtin_ctzll(word) - 1;
+
+    return 1;
+}
+
+/*
+ * Containers
+ */
+
+static void container_free(roaring_container* container)
+{
+    /* All members of the union are the same pointer */
+    free(container->data.values);
+    container->data.values = NULL;
+}
+
+static void container_fill_bitmap(const roaring_container* container, uint64_t* words)
+{
+    uint32_t i = 0;
+
+    switch( container->type )
+    {
+        case CONTAINER_BITMAP:
+            memcpy(words, container->data.words, BITMAP_BYTES);
+            break;
+        case CONTAINER_ARRAY:
+            memset(words, 0, BITMAP_BYTES);
+            for( i = 0; i < container->size; i++ )
+            {
+                uint16_t value = container->data.values[i];
+                words[value >> 6] |= (uint64_t)1 << (value & 63);
+            }
+            break;
+        default:
+            memset(words, 0, BITMAP_BYTES);
+            for( i = 0; i < container->size; i++ )
+            {
+                bitmap_set_range(words, container->data.runs[2 * i], container->data.runs[2 * i + 1]);
+            }
+            break;
+    }
+}
+
+/* Store a bitmap in the smallest container form */
+static int container_from_bitmap(roaring_container* container, const uint64_t* words)
+{
+    uint32_t cardinality = bitmap_cardinality(words);
+    uint32_t runs = bitmap_run_count(words);
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    container->cardinality = cardinality;
+    container->data.values = NULL;
+
+    if( (runs * 2 <= cardinality) && (runs * 4 < BITMAP_BYTES) )
+    {
+        container->type = CONTAINER_RUN;
+        container->size = runs;
+        container->capacity = runs;
+        container->data.runs = malloc((runs * 2 + 1) * sizeof(uint16_t));
+        if( container->data.runs == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        while( bitmap_next_run(words, last + (i > 0), &first, &last) )
+        {
+            container->data.runs[2 * i] = (uint16_t)first;
+            container->data.runs[2 * i + 1] = (uint16_t)last;
+            i++;
+            if( last == 65535 )
+            {
+                break;
+            }
+        }
+    }
+    else if( cardinality <= CONTAINER_ARRAY_MAX )
+    {
+        container->type = CONTAINER_ARRAY;
+        container->size = cardinality;
+        container->capacity = cardinality;
+        container->data.values = malloc((cardinality + 1) * sizeof(uint16_t));
+        if( container->data.values == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+        {
+            uint64_t word = words[i];
+            while( word != 0 )
+            {
+                container->data.values[count++] = (uint16_t)(i * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+    else
+    {
+        container->type = CONTAINER_BITMAP;
+        container->size = 0;
+        container->capacity = 0;
+        container->data.words = malloc(BITMAP_BYTES);
+        if( container->data.words == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        memcpy(container->data.words, words, BITMAP_BYTES);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+static int container_to_bitmap(roaring_container* container)
+{
+    uint64_t* words = malloc(BITMAP_BYTES);
+
+    if( words == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    container_fill_bitmap(container, words);
+    container_free(container);
+    container->type = CONTAINER_BITMAP;
+    container->size = 0;
+    container->capacity = 0;
+    container->data.words = words;
+
+    return(RESULT_SUCCESS);
+}
+
+static int array_insert(roaring_container* container, uint16_t value)
+{
+    uint32_t lo = 0;
+    uint32_t hi = container->size;
+
+    /* Sorted input only ever appends */
+    if( (container->size > 0) && (container->data.values[container->size - 1] < value) )
+    {
+        lo = container->size;
+    }
+    else
+    {
+        while( lo < hi )
+        {
+            uint32_t middle = (lo + hi) / 2;
+            if( container->data.values[middle] < value )
+            {
+                lo = middle + 1;
+            }
+            else
+            {
+                hi = middle;
+            }
+        }
+        if( (lo < container->size) && (container->data.values[lo] == value) )
+        {
+            return(RESULT_SUCCESS);
+        }
+    }
+
+    if( container->size == container->capacity )
+    {
+        uint32_t capacity = container->capacity ? container->capacity * 2 : 4;
+        uint16_t* values = realloc(container->data.values, capacity * sizeof(uint16_t));
+        if( values == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        container->data.values = values;
+        container->capacity = capacity;
+    }
+
+    memmove(container->data.values + lo + 1, container->data.values + lo,
+            (container->size - lo) * sizeof(uint16_t));
+    container->data.values[lo] = value;
+    container->size++;
+    container->cardinality++;
+
+    return(RESULT_SUCCESS);
+}
+
+static int container_add_range(roaring_container* container, uint32_t first, uint32_t last)
+{
+    uint32_t count = last - first + 1;
+    uint32_t i = 0;
+
+    if( count == 65536 )
+    {
+        uint16_t* runs = malloc(2 * sizeof(uint16_t));
+        if( runs == NULL )
+        {
+            return(RESULT_INT_ERROR);
+        }
+        container_free(container);
+        runs[0] = 0;
+        runs[1] = 65535;
+        container->type = CONTAINER_RUN;
+        container->size = 1;
+        container->capacity = 1;
+        container->cardinality = 65536;
+        container->data.runs = runs;
+        return(RESULT_SUCCESS);
+    }
+
+    if( (container->type == CONTAINER_ARRAY) && (container->size + count <= CONTAINER_ARRAY_MAX) )
+    {
+        for( i = first; i <= last; i++ )
+        {
+            if( array_insert(container, (uint16_t)i) != RESULT_SUCCESS )
+            {
+                return(RESULT_INT_ERROR);
+            }
+        }
+        return(RESULT_SUCCESS);
+    }
+
+    if( (container->type != CONTAINER_BITMAP) && (container_to_bitmap(container) != RESULT_SUCCESS) )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    /* Only count the words that change */
+    for( i = first >> 6; i <= (last >> 6); i++ )
+    {
+        container->cardinality -= __builtin_popcountll(container->data.words[i]);
+    }
+    bitmap_set_range(container->data.words, first, last);
+    for( i = first >> 6; i <= (last >> 6); i++ )
+    {
+        container->cardinality += __builtin_popcountll(container->data.words[i]);
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+static int container_copy(const roaring_container* source, roaring_container* copy)
+{
+    size_t bytes = 0;
+
+    *copy = *source;
+    switch( source->type )
+    {
+        case CONTAINER_BITMAP:
+            bytes = BITMAP_BYTES;
+            break;
+        case CONTAINER_ARRAY:
+            bytes = source->size * sizeof(uint16_t);
+            copy->capacity = source->size;
+            break;
+        default:
+            bytes = source->size * 2 * sizeof(uint16_t);
+            copy->capacity = source->size;
+            break;
+    }
+
+    copy->data.values = malloc(bytes + 1);
+    if( copy->data.values == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+    memcpy(copy->data.values, source->data.values, bytes);
+
+    return(RESULT_SUCCESS);
+}
+
+/* Sorted array merge, for when both sides are small */
+static int array_combine(const roaring_container* left, const roaring_container* right,
+                         int operation, roaring_container* result)
+{
+    const uint16_t* a = left->data.values;
+    const uint16_t* b = right->data.values;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint32_t count = 0;
+    uint16_t* values = malloc((left->size + right->size + 1) * sizeof(uint16_t));
+
+    if( values == NULL )
+    {
+        return(RESULT_INT_ERROR);
+    }
+
+    while( (i < left->size) || (j < right->size) )
+    {
+        if( (j == right->size) || ((i < left->size) && (a[i] < b[j])) )
+        {
+            if( operation != SET_INTERSECTION )
+            {
+                values[count++] = a[i];
+            }
+            i++;
+        }
+        else if( (i == left->size) || (b[j] < a[i]) )
+        {
+            if( (operation == SET_UNION) || (operation == SET_SYMMETRIC_DIFFERENCE) )
+            {
+                values[count++] = b[j];
+            }
+            j++;
+        }
+        else
+        {
+            if( (operation == SET_UNION) || (operation == SET_INTERSECTION) )
+            {
+                values[count++] = a[i];
+            }
+            i++;
+            j++;
+        }
+    }
+
+    result->key = left->key;
+    result->type = CONTAINER_ARRAY;
+    result->cardinality = count;
+    result->size = count;
+    result->capacity = left->size + right->size;
+    result->data.values = values;
+
+    return(RESULT_SUCCESS);
+}
+
+static int container_combine(const roaring_container* left, const roaring_container* right,
+                             int operation, roaring_container* result)
+{
+    uint64_t a[CONTAINER_BITMAP_WORDS];
+    uint64_t b[CONTAINER_BITMAP_WORDS];
+    int i = 0;
+
+    if( (left->type == CONTAINER_ARRAY) && (right->type == CONTAINER_ARRAY) &&
+        (((operation != SET_UNION) && (operation != SET_SYMMETRIC_DIFFERENCE)) ||
+         (left->size + right->size <= CONTAINER_ARRAY_MAX)) )
+    {
+        return array_combine(left, right, operation, result);
+    }
+
+    container_fill_bitmap(left, a);
+    container_fill_bitmap(right, b);
+
+    switch( operation )
+    {
+        case SET_UNION:
+            for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+            {
+                a[i] |= b[i];
+            }
+            break;
+        case SET_INTERSECTION:
+            for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+            {
+                a[i] &= b[i];
+            }
+            break;
+        case SET_SYMMETRIC_DIFFERENCE:
+            for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+            {
+                a[i] ^= b[i];
+            }
+            break;
+        default:
+            for( i = 0; i < CONTAINER_BITMAP_WORDS; i++ )
+            {
+                a[i] &= ~b[i];
+            }
+            break;
+    }
+
+    result->key = left->key;
+    return container_from_bitmap(result, a);
+}
+
+/* Call back for every run within a container, addresses are relative to the container */
+static void container_runs(const roaring_container* container, ipv4_range_callback callback, void* context)
+{
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t i = 0;
+
+    switch( container->type )
+    {
+        case CONTAINER_BITMAP:
+            while( bitmap_next_run(container->data.words, (i++ > 0) ? last + 1 : 0, &first, &last) )
+            {
+                callback(first, last, context);
+                if( last == 65535 )
+                {
+                    break;
+                }
+            }
+            break;
+        case CONTAINER_ARRAY:
+            while( i < container->size )
+            {
+                first = container->data.values[i];
+                last = first;
+                while( (++i < container->size) && (container->data.values[i] == last + 1) )
+                {
+                    last++;
+                }
+                callback(first, last, context);
+            }
+            break;
+        default:
+            for( i = 0; i < container->size; i++ )
+            {
+                callback(container->data.runs[2 * i], container->data.runs[2 * i + 1], context);
+            }
+            break;
+    }
+}
+
+/*
+ * Sets
+ */
+
+ipv4_set* ipv4_set_new(void)
+{
+    return calloc(1, sizeof(ipv4_set));
+}
+
+/* Container for a key, created if there isn't one */
+static roaring_container* ipv4_set_container(ipv4_set* set, uint16_t key)
+{
+    size_t lo = 0;
+    size_t hi = set->count;
+
+    if( (set->count > 0) && (set->containers[set->count - 1].key < key) )
+    {
+        lo = set->count;
+    }
+    else
+    {
+        while( lo < hi )
+        {
+            size_t middle = (lo + hi) / 2;
+            if( set->containers[middle].key < key )
+            {
+                lo = middle + 1;
+            }
+            else
+            {
+                hi = middle;
+            }
+        }
+        if( (lo < set->count) && (set->containers[lo].key == key) )
+        {
+            return &set->containers[lo];
+        }
+    }
+
+    if( set->count == set->capacity )
+    {
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        roaring_container* containers = realloc(set->containers, capacity * sizeof(roaring_container));
+        if( containers == NULL )
+        {
+            return NULL;
+        }
+        set->containers = containers;
+        set->capacity = capacity;
+    }
+
+    memmove(set->containers + lo + 1, set->containers + lo, (set->count - lo) * sizeof(roaring_container));
+    memset(&set->containers[lo], 0, sizeof(roaring_container));
+    set->containers[lo].key = key;
+    set->containers[lo].type = CONTAINER_ARRAY;
+    set->count++;
+
+    return &set->containers[lo];
+}
+
+int ipv4_set_add_range(ipv4_set* set, uint32_t first, uint32_t last)
+{
+    uint32_t key = 0;
+
+    for( key = first >> 16; key <= (last >> 16); key++ )
+    {
+        roaring_container* container = ipv4_set_container(set, (uint16_t)key);
+        uint32_t lo = (key == (first >> 16)) ? (first & 0xffff) : 0;
+        uint32_t hi = (key == (last >> 16)) ? (last & 0xffff) : 0xffff;
+
+        if( (container == NULL) || (container_add_range(container, lo, hi) != RESULT_SUCCESS) )
+        {
+            return(RESULT_INT_ERROR);
+        }
+    }
+
+    return(RESULT_SUCCESS);
+}
+
+/* Union, intersection, difference or symmetric difference of two sets, as a new set */
+ipv4_set* ipv4_set_combine(const ipv4_set* left, const ipv4_set* right, int operation)
+{
+    ipv4_set* result = ipv4_set_new();
+    size_t i = 0;
+    size_t j = 0;
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    result->capacity = left->count + right->count + 1;
+    result->containers = malloc(result->capacity * sizeof(roaring_container));
+    if( result->containers == NULL )
+    {
+        free(result);
+        return NULL;
+    }
+
+    while( (i < left->count) || (j < right->count) )
+    {
+        roaring_container* container = &result->containers[result->count];
+        int status = RESULT_SUCCESS;
+
+        container->data.values = NULL;
+        container->cardinality = 0;
+
+        if( (j == right->count) || ((i < left->count) && (left->containers[i].key < right->containers[j].key)) )
+        {
+            if( operation != SET_INTERSECTION )
+            {
+                status = container_copy(&left->containers[i], container);
+            }
+            i++;
+        }
+        else if( (i == left->count) || (right->containers[j].key < left->containers[i].key) )
+        {
+            if( (operation == SET_UNION) || (operation == SET_SYMMETRIC_DIFFERENCE) )
+            {
+                status = container_copy(&right->containers[j], container);
+            }
+            j++;
+        }
+        else
+        {
+            status = container_combine(&left->containers[i], &right->containers[j], operation, container);
+            i++;
+            j++;
+        }
+
+        if( status != RESULT_SUCCESS )
+        {
+            container_free(container);
+            ipv4_set_free(result);
+            return NULL;
+        }
+
+        if( container->cardinality > 0 )
+        {
+            result->count++;
+        }
+        else
+        {
+            container_free(container);
+        }
+    }
+
+    return result;
+}
+
+/* Convert every container to its smallest form */
+void ipv4_set_optimize(ipv4_set* set)
+{
+    size_t i = 0;
+
+    for( i = 0; i < set->count; i++ )
+    {
+        roaring_container* container = &set->containers[i];
+        roaring_container optimized;
+
+        if( container->type == CONTAINER_RUN )
+        {
+            continue;
+        }
+
+        optimized.key = container->key;
+        if( container->type == CONTAINER_BITMAP )
+        {
+            if( container_from_bitmap(&optimized, container->data.words) != RESULT_SUCCESS )
+            {
+                container_free(&optimized);
+                continue;
+            }
+        }
+        else
+        {
+            /* Arrays only get shorter as runs */
+            uint32_t runs = 0;
+            uint32_t j = 0;
+            for( j = 0; j < container->size; j++ )
+            {
+                if( (j == 0) || (container->data.values[j] != container->data.values[j - 1] + 1) )
+                {
+                    runs++;
+                }
+            }
+            if( runs * 2 >= container->size )
+            {
+                continue;
+            }
+
+            optimized.type = CONTAINER_RUN;
+            optimized.cardinality = container->cardinality;
+            optimized.size = 0;
+            optimized.capacity = runs;
+            optimized.data.runs = malloc(runs * 2 * sizeof(uint16_t));
+            if( optimized.data.runs == NULL )
+            {
+                continue;
+            }
+            for( j = 0; j < container->size; j++ )
+            {
+                uint16_t value = container->data.values[j];
+                if( (j == 0) || (value != container->data.values[j - 1] + 1) )
+                {
+                    optimized.data.runs[2 * optimized.size] = value;
+                    optimized.size++;
+                }
+                optimized.data.runs[2 * optimized.size - 1] = value;
+            }
+        }
+
+        container_free(container);
+        *container = optimized;
+    }
+}
+
+int ipv4_set_contains(const ipv4_set* set, uint32_t address)
+{
+    uint16_t key = (uint16_t)(address >> 16);
+    uint16_t value = (uint16_t)address;
+    const roaring_container* container = NULL;
+    size_t lo = 0;
+    size_t hi = set->count;
+
+    while( lo < hi )
+    {
+        size_t middle = (lo + hi) / 2;
+        if( set->containers[middle].key < key )
+        {
+            lo = middle + 1;
+        }
+        else
+        {
+            hi = middle;
+        }
+    }
+    if( (lo == set->count) || (set->containers[lo].key != key) )
+    {
+        return(RESULT_FAILURE);
+    }
+    container = &set->containers[lo];
+
+    if( container->type == CONTAINER_BITMAP )
+    {
+        return ((container->data.words[value >> 6] >> (value & 63)) & 1) ? RESULT_SUCCESS : RESULT_FAILURE;
+    }
+
+    /* Both arrays and runs are sorted, find the last element not above the value */
+    lo = 0;
+    hi = container->size;
+    while( lo < hi )
+    {
+        size_t middle = (lo + hi) / 2;
+        uint16_t element = (container->type == CONTAINER_ARRAY) ?
+                           container->data.values[middle] : container->data.runs[2 * middle];
+        if( element <= value )
+        {
+            lo = middle + 1;
+        }
+        else
+        {
+            hi = middle;
+        }
+    }
+    if( lo == 0 )
+    {
+        return(RESULT_FAILURE);
+    }
+    if( container->type == CONTAINER_ARRAY )
+    {
+        return (container->data.values[lo - 1] == value) ? RESULT_SUCCESS : RESULT_FAILURE;
+    }
+    return (container->data.runs[2 * (lo - 1) + 1] >= value) ? RESULT_SUCCESS : RESULT_FAILURE;
+}
+
+uint64_t ipv4_set_cardinality(const ipv4_set* set)
+{
+    uint64_t cardinality = 0;
+    size_t i = 0;
+
+    for( i = 0; i < set->count; i++ )
+    {
+        cardinality += set->containers[i].cardinality;
+    }
+
+    return cardinality;
+}
+
+typedef struct
+{
+    uint32_t base;
+    int pending;
+    uint32_t first;
+    uint32_t last;
+    ipv4_range_callback callback;
+    void* context;
+} range_merger;
+
+/* Join runs that continue across container boundaries */
+static void merge_run(uint32_t first, uint32_t last, void* context)
+{
+    range_merger* merger = context;
+
+    first += merger->base;
+    last += merger->base;
+
+    if( merger->pending && (merger->last + 1 == first) )
+    {
+        merger->last = last;
+        return;
+    }
+
+    if( merger->pending )
+    {
+        merger->callback(merger->first, merger->last, merger->context);
+    }
+    merger->pending = 1;
+    merger->first = first;
+    merger->last = last;
+}
+
+/* Call back for every maximal range of consecutive addresses, in ascending order */
+void ipv4_set_ranges(const ipv4_set* set, ipv4_range_callback callback, void* context)
+{
+    range_merger merger;
+    size_t i = 0;
+
+    memset(&merger, 0, sizeof(merger));
+    merger.callback = callback;
+    merger.context = context;
+
+    for( i = 0; i < set->count; i++ )
+    {
+        merger.base = (uint32_t)set->containers[i].key << 16;
+        container_runs(&set->containers[i], merge_run, &merger);
+    }
+
+    if( merger.pending )
+    {
+        callback(merger.first, merger.last, context);
+    }
+}
+
+void ipv4_set_free(ipv4_set* set)
+{
+    size_t i = 0;
+
+    if( set == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < set->count; i++ )
+    {
+        container_free(&set->containers[i]);
+    }
+    free(set->containers);
+    free(set);
+}
@@ -0,0 +1,82 @@
+/*
+ * ipaddrcheck_roaring.h: compressed bitmap sets of IPv4 addresses
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_ROARING_H
+#define IPADDRCHECK_ROARING_H
+
+#include "ipaddrcheck_prefix.h"
+
+/* Set operations */
+#define SET_UNION                 1
+#define SET_INTERSECTION          2
+#define SET_DIFFERENCE            3
+#define SET_SYMMETRIC_DIFFERENCE  4
+
+/* Container types */
+#define CONTAINER_ARRAY    0
+#define CONTAINER_BITMAP   1
+#define CONTAINER_RUN      2
+
+/* Arrays longer than this take more space than a bitmap */
+#define CONTAINER_ARRAY_MAX    4096
+#define CONTAINER_BITMAP_WORDS 1024
+
+/*
+ * The addresses of a set that share the high 16 bits,
+ * stored in whichever form is the smallest:
+ * a sorted array of the low 16 bits, a 65536-bit bitmap,
+ * or a sorted list of [first, last] runs.
+ */
+typedef struct
+{
+    uint16_t key;
+    int type;
+    uint32_t cardinality;
+    uint32_t size;       /* array elements or runs */
+    uint32_t capacity;
+    union
+    {
+        uint16_t* values;
+        uint64_t* words;
+        uint16_t* runs;  /* first, last, first, last... */
+    } data;
+} roaring_container;
+
+/* A roaring bitmap: containers sorted by key, empty ones are never kept */
+typedef struct
+{
+    roaring_container* containers;
+    size_t count;
+    size_t capacity;
+} ipv4_set;
+
+typedef void (*ipv4_range_callback)(uint32_t first, uint32_t last, void* context);
+
+ipv4_set* ipv4_set_new(void);
+int ipv4_set_add_range(ipv4_set* set, uint32_t first, uint32_t last);
+ipv4_set* ipv4_set_combine(const ipv4_set* left, const ipv4_set* right, int operation);
+void ipv4_set_optimize(ipv4_set* set);
+int ipv4_set_contains(const ipv4_set* set, uint32_t address);
+uint64_t ipv4_set_cardinality(const ipv4_set* set);
+void ipv4_set_ranges(const ipv4_set* set, ipv4_range_callback callback, void* context);
+void ipv4_set_free(ipv4_set* set);
+
+#endif /* IPADDRCHECK_ROARING_H */
@@ -0,0 +1,502 @@
+/*
+ * ipaddrcheck_set.c: set algebra on address and prefix lists
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "ipaddrcheck_set.h"
+
+/* Previous address, the caller makes sure the value is not zero */
+static ip_value ip_value_prev(ip_value value)
+{
+    if( value.lo == 0 )
+    {
+        value.hi--;
+    }
+    value.lo--;
+    return value;
+}
+
+static ip_value ip_value_min(ip_value left, ip_value right)
+{
+    return (ip_value_cmp(left, right) <= 0) ? left : right;
+}
+
+static ip_value ip_value_sub(ip_value left, ip_value right)
+{
+    ip_value result;
+    result.lo = left.lo - right.lo;
+    result.hi = left.hi - right.hi - ((left.lo < right.lo) ? 1 : 0);
+    return result;
+}
+
+static ip_value ip_value_shift_right(ip_value value, int shift)
+{
+    if( shift >= 128 )
+    {
+        value.hi = 0;
+        value.lo = 0;
+    }
+    else if( shift >= 64 )
+    {
+        value.lo = value.hi >> (shift - 64);
+        value.hi = 0;
+    }
+    else if( shift > 0 )
+    {
+        value.lo = (value.lo >> shift) | (value.hi << (64 - shift));
+        value.hi >>= shift;
+    }
+    return value;
+}
+
+static int ip_value_cmp_qsort(const void* left, const void* right)
+{
+    return ip_value_cmp(*(const ip_value*)left, *(const ip_value*)right);
+}
+
+static int interval_cmp(const void* left, const void* right)
+{
+    const ip_interval* l = (const ip_interval*)left;
+    const ip_interval* r = (const ip_interval*)right;
+
+    return ip_value_cmp(l->first, r->first);
+}
+
+/* Whether an address belongs to the result of an operation,
+   given whether it belongs to the left and the right operand */
+static int set_operation_member(int operation, int in_left, int in_right)
+{
+    switch( operation )
+    {
+        case SET_UNION:
+            return in_left || in_right;
+        case SET_INTERSECTION:
+            return in_left && in_right;
+        case SET_DIFFERENCE:
+            return in_left && !in_right;
+        case SET_SYMMETRIC_DIFFERENCE:
+            return in_left != in_right;
+        default:
+            return 0;
+    }
+}
+
+interval_list* interval_list_new(int proto)
+{
+    interval_list* list = calloc(1, sizeof(interval_list));
+    if( list != NULL )
+    {
+        list->proto = proto;
+    }
+    return list;
+}
+
+int interval_list_add(interval_list* list, ip_value first, ip_value last)
+{
+    if( list->count == list->capacity )
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        ip_interval* intervals = realloc(list->intervals, capacity * sizeof(ip_interval));
+        if( intervals == NULL )
+        {
+            return RESULT_INT_ERROR;
+        }
+        list->intervals = intervals;
+        list->capacity = capacity;
+    }
+
+    list->intervals[list->count].first = first;
+    list->intervals[list->count].last = last;
+    list->count++;
+
+    return RESULT_SUCCESS;
+}
+
+/* Sort the intervals and merge the ones that overlap or touch */
+void interval_list_normalize(interval_list* list)
+{
+    size_t i = 0;
+    size_t count = 0;
+
+    if( list->count == 0 )
+    {
+        return;
+    }
+
+    qsort(list->intervals, list->count, sizeof(ip_interval), interval_cmp);
+
+    for( i = 1; i < list->count; i++ )
+    {
+        ip_interval* current = &list->intervals[count];
+        const ip_interval* next = &list->intervals[i];
+
+        /* The address after the last one of the family wraps around to zero,
+           which can only be the start of an interval that sorts first */
+        if( (ip_value_cmp(next->first, current->last) <= 0) ||
+            ip_value_eq(next->first, ip_value_next(current->last)) )
+        {
+            if( ip_value_cmp(next->last, current->last) > 0 )
+            {
+                current->last = next->last;
+            }
+        }
+        else
+        {
+            list->intervals[++count] = *next;
+        }
+    }
+    list->count = count + 1;
+}
+
+/*
+ * Combine two normalized lists in a single sweep over the address space.
+ * The space is cut into segments at every interval boundary of either operand;
+ * within a segment membership in both operands is constant, so the segment
+ * either belongs to the result as a whole or not at all.
+ * Runs in O(n + m) and produces a normalized list.
+ */
+interval_list* interval_list_combine(const interval_list* left, const interval_list* right, int operation)
+{
+    interval_list* result = interval_list_new(left->proto);
+    ip_value max = ip_value_low_mask(ip_bits(left->proto));
+    ip_value cursor = { 0, 0 };
+    size_t i = 0;
+    size_t j = 0;
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    for( ;; )
+    {
+        int in_left = 0;
+        int in_right = 0;
+        ip_value left_end = max;
+        ip_value right_end = max;
+        ip_value end;
+
+        if( i < left->count )
+        {
+            in_left = ip_value_cmp(cursor, left->intervals[i].first) >= 0;
+            left_end = in_left ? left->intervals[i].last : ip_value_prev(left->intervals[i].first);
+        }
+        if( j < right->count )
+        {
+            in_right = ip_value_cmp(cursor, right->intervals[j].first) >= 0;
+            right_end = in_right ? right->intervals[j].last : ip_value_prev(right->intervals[j].first);
+        }
+        end = ip_value_min(left_end, right_end);
+
+        if( set_operation_member(operation, in_left, in_right) )
+        {
+            if( (result->count > 0) &&
+                ip_value_eq(ip_value_next(result->intervals[result->count - 1].last), cursor) )
+            {
+                result->intervals[result->count - 1].last = end;
+            }
+            else if( interval_list_add(result, cursor, end) != RESULT_SUCCESS )
+            {
+                interval_list_free(result);
+                return NULL;
+            }
+        }
+
+        if( ip_value_eq(end, max) )
+        {
+            break;
+        }
+        if( in_left && ip_value_eq(end, left_end) )
+        {
+            i++;
+        }
+        if( in_right && ip_value_eq(end, right_end) )
+        {
+            j++;
+        }
+        cursor = ip_value_next(end);
+    }
+
+    return result;
+}
+
+/* The minimal set of prefixes that covers the list exactly */
+void interval_list_prefixes(const interval_list* list, ip_prefix_callback callback, void* context)
+{
+    size_t i = 0;
+
+    for( i = 0; i < list->count; i++ )
+    {
+        ip_range_to_prefixes(list->proto, list->intervals[i].first, list->intervals[i].last, callback, context);
+    }
+}
+
+void interval_list_free(interval_list* list)
+{
+    if( list == NULL )
+    {
+        return;
+    }
+    free(list->intervals);
+    free(list);
+}
+
+address_counter* address_counter_new(int proto)
+{
+    address_counter* counter = calloc(1, sizeof(address_counter));
+
+    if( (counter != NULL) && ((counter->intervals = interval_list_new(proto)) == NULL) )
+    {
+        free(counter);
+        counter = NULL;
+    }
+    return counter;
+}
+
+static int address_counter_reserve(address_counter* counter, ip_value address)
+{
+    if( counter->reserved_count == counter->reserved_capacity )
+    {
+        size_t capacity = counter->reserved_capacity ? counter->reserved_capacity * 2 : 16;
+        ip_value* reserved = realloc(counter->reserved, capacity * sizeof(ip_value));
+        if( reserved == NULL )
+        {
+            return RESULT_INT_ERROR;
+        }
+        counter->reserved = reserved;
+        counter->reserved_capacity = capacity;
+    }
+    counter->reserved[counter->reserved_count++] = address;
+
+    return RESULT_SUCCESS;
+}
+
+/*
+ * Add a subnet. Its network address cannot be assigned to a host
+ * (cf. is_ipv4_host() and is_ipv6_host()), nor can the IPv4 broadcast
+ * address (cf. is_ipv4_broadcast()), except in /31, /32, /127 and /128
+ * subnets, where every address is usable.
+ */
+int address_counter_add_prefix(address_counter* counter, const ip_prefix* prefix)
+{
+    ip_value first = ip_prefix_first(prefix);
+    ip_value last = ip_prefix_last(prefix);
+
+    if( interval_list_add(counter->intervals, first, last) != RESULT_SUCCESS )
+    {
+        return RESULT_INT_ERROR;
+    }
+    if( prefix->pflen < ip_bits(prefix->proto) - 1 )
+    {
+        if( address_counter_reserve(counter, first) != RESULT_SUCCESS )
+        {
+            return RESULT_INT_ERROR;
+        }
+        if( (prefix->proto == CIDR_IPV4) && (address_counter_reserve(counter, last) != RESULT_SUCCESS) )
+        {
+            return RESULT_INT_ERROR;
+        }
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/* Add a range, all of whose addresses are usable */
+int address_counter_add_range(address_counter* counter, ip_value first, ip_value last)
+{
+    return interval_list_add(counter->intervals, first, last);
+}
+
+/* Whole prefixes with the given number of host bits in an interval */
+static void count_units(ip_interval interval, int host_bits, ip_count* units)
+{
+    ip_value mask = ip_value_low_mask(host_bits);
+    int first_aligned = ((interval.first.hi & mask.hi) == 0) && ((interval.first.lo & mask.lo) == 0);
+    int last_aligned = ((interval.last.hi & mask.hi) == mask.hi) && ((interval.last.lo & mask.lo) == mask.lo);
+    ip_value blocks = ip_value_sub(ip_value_shift_right(interval.last, host_bits),
+                                   ip_value_shift_right(interval.first, host_bits));
+
+    /* blocks is the distance between the prefixes of both ends,
+       which are whole if the interval starts and ends on their boundaries */
+    ip_count_add(units, blocks);
+    if( last_aligned )
+    {
+        ip_count_add_small(units, 1);
+    }
+    if( !first_aligned && ((units->top != 0) || (units->value.hi != 0) || (units->value.lo != 0)) )
+    {
+        ip_count_sub_small(units, 1);
+    }
+}
+
+/*
+ * Count the addresses, usable hosts and whole prefixes of unit_length
+ * (if it does not exceed the address width) in a single pass over
+ * the merged intervals, without enumerating anything.
+ * A reserved address only counts once, however many prefixes it belongs to.
+ */
+void address_counter_totals(address_counter* counter, int unit_length, address_totals* totals)
+{
+    interval_list* list = counter->intervals;
+    int width = ip_bits(list->proto);
+    size_t reserved = 0;
+    size_t i = 0;
+
+    memset(totals, 0, sizeof(address_totals));
+
+    interval_list_normalize(list);
+    for( i = 0; i < list->count; i++ )
+    {
+        ip_count_add(&totals->addresses, ip_value_sub(list->intervals[i].last, list->intervals[i].first));
+        ip_count_add_small(&totals->addresses, 1);
+
+        if( unit_length <= width )
+        {
+            ip_count units;
+            memset(&units, 0, sizeof(units));
+            count_units(list->intervals[i], width - unit_length, &units);
+            ip_count_add(&totals->units, units.value);
+            totals->units.top += units.top;
+        }
+    }
+
+    qsort(counter->reserved, counter->reserved_count, sizeof(ip_value), ip_value_cmp_qsort);
+    for( i = 0; i < counter->reserved_count; i++ )
+    {
+        if( (i == 0) || !ip_value_eq(counter->reserved[i], counter->reserved[i - 1]) )
+        {
+            reserved++;
+        }
+    }
+    totals->hosts = totals->addresses;
+    ip_count_sub_small(&totals->hosts, reserved);
+}
+
+void address_counter_free(address_counter* counter)
+{
+    if( counter == NULL )
+    {
+        return;
+    }
+    interval_list_free(counter->intervals);
+    free(counter->reserved);
+    free(counter);
+}
+
+/* Load a list of addresses and prefixes of both families, one per line */
+address_set* address_set_load(const char* path)
+{
+    list_reader reader;
+    address_set* set = calloc(1, sizeof(address_set));
+    int errors = 0;
+    char* line = NULL;
+
+    if( (set == NULL) ||
+        ((set->ipv4 = ipv4_set_new()) == NULL) ||
+        ((set->ipv6 = interval_list_new(CIDR_IPV6)) == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        address_set_free(set);
+        return NULL;
+    }
+    if( list_reader_open(&reader, path) != RESULT_SUCCESS )
+    {
+        address_set_free(set);
+        return NULL;
+    }
+
+    while( (line = list_reader_next(&reader)) != NULL )
+    {
+        char* prefix_str = list_next_field(&line);
+        ip_prefix prefix;
+        int status = RESULT_SUCCESS;
+
+        if( list_reader_prefix(&reader, prefix_str, &prefix) != RESULT_SUCCESS )
+        {
+            errors++;
+            continue;
+        }
+
+        if( prefix.proto == CIDR_IPV4 )
+        {
+            status = ipv4_set_add_range(set->ipv4, (uint32_t)ip_prefix_first(&prefix).lo,
+                                        (uint32_t)ip_prefix_last(&prefix).lo);
+        }
+        else
+        {
+            status = interval_list_add(set->ipv6, ip_prefix_first(&prefix), ip_prefix_last(&prefix));
+        }
+        if( status != RESULT_SUCCESS )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            errors++;
+            break;
+        }
+    }
+
+    list_reader_close(&reader);
+
+    if( errors > 0 )
+    {
+        address_set_free(set);
+        return NULL;
+    }
+
+    ipv4_set_optimize(set->ipv4);
+    interval_list_normalize(set->ipv6);
+
+    return set;
+}
+
+/* Apply a set operation to both families, as a new set */
+address_set* address_set_combine(const address_set* left, const address_set* right, int operation)
+{
+    address_set* result = calloc(1, sizeof(address_set));
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    result->ipv4 = ipv4_set_combine(left->ipv4, right->ipv4, operation);
+    result->ipv6 = interval_list_combine(left->ipv6, right->ipv6, operation);
+    if( (result->ipv4 == NULL) || (result->ipv6 == NULL) )
+    {
+        address_set_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+int address_set_is_empty(const address_set* set)
+{
+    return (set->ipv4->count == 0) && (set->ipv6->count == 0);
+}
+
+void address_set_free(address_set* set)
+{
+    if( set == NULL )
+    {
+        return;
+    }
+    ipv4_set_free(set->ipv4);
+    interval_list_free(set->ipv6);
+    free(set);
+}
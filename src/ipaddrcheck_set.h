@@ -0,0 +1,88 @@
+/*
+ * ipaddrcheck_set.h: set algebra on address and prefix lists
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef IPADDRCHECK_SET_H
+#define IPADDRCHECK_SET_H
+
+#include "ipaddrcheck_roaring.h"
+
+/* A closed range of addresses */
+typedef struct
+{
+    ip_value first;
+    ip_value last;
+} ip_interval;
+
+/* Intervals of a single address family. Once normalized, they are sorted
+   and neither overlap nor touch, so every address set has one form. */
+typedef struct
+{
+    int proto;
+    ip_interval* intervals;
+    size_t count;
+    size_t capacity;
+} interval_list;
+
+/* A set of addresses of both families: IPv4 in a compressed bitmap,
+   since those sets are often dense, IPv6 as a list of intervals. */
+typedef struct
+{
+    ipv4_set* ipv4;
+    interval_list* ipv6;
+} address_set;
+
+/* Addresses of one family gathered for counting. Prefixes also
+   contribute the addresses that cannot be assigned to hosts. */
+typedef struct
+{
+    interval_list* intervals;
+    ip_value* reserved;     /* network and IPv4 broadcast addresses */
+    size_t reserved_count;
+    size_t reserved_capacity;
+} address_counter;
+
+/* What address_counter_totals() counts */
+typedef struct
+{
+    ip_count addresses;
+    ip_count hosts;         /* addresses that are not reserved */
+    ip_count units;         /* whole prefixes of the unit length */
+} address_totals;
+
+interval_list* interval_list_new(int proto);
+int interval_list_add(interval_list* list, ip_value first, ip_value last);
+void interval_list_normalize(interval_list* list);
+interval_list* interval_list_combine(const interval_list* left, const interval_list* right, int operation);
+void interval_list_prefixes(const interval_list* list, ip_prefix_callback callback, void* context);
+void interval_list_free(interval_list* list);
+
+address_counter* address_counter_new(int proto);
+int address_counter_add_prefix(address_counter* counter, const ip_prefix* prefix);
+int address_counter_add_range(address_counter* counter, ip_value first, ip_value last);
+void address_counter_totals(address_counter* counter, int unit_length, address_totals* totals);
+void address_counter_free(address_counter* counter);
+
+address_set* address_set_load(const char* path);
+address_set* address_set_combine(const address_set* left, const address_set* right, int operation);
+int address_set_is_empty(const address_set* set);
+void address_set_free(address_set* set);
+
+#endif /* IPADDRCHECK_SET_H */
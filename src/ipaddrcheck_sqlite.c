@@ -0,0 +1,616 @@
+/*
+ * ipaddrcheck_sqlite.c: address functions and prefix tables for SQLite
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Loaded with .load ipaddrcheck (or sqlite3_load_extension), this adds
+ * deterministic functions that return NULL for NULL or malformed input:
+ *
+ *   ip_is_valid(s)           1 if s is a valid address or prefix, else 0
+ *   ip_is_rfc1918(s)         1 if s lies within the private IPv4 blocks
+ *   ip_canonical(s)          s in canonical form, "2001:DB8:0::1" becomes
+ *                            "2001:db8::1"
+ *   ip_contains(prefix, s)   1 if the address or prefix s lies entirely
+ *                            within prefix
+ *
+ * and a virtual table over a table file in the format of --lpm-table:
+ *
+ *   CREATE VIRTUAL TABLE routes USING ipaddrcheck_lpm('routes.txt');
+ *
+ * with columns prefix, label and line. Its hidden column address takes
+ * an address to look up, so that
+ *
+ *   SELECT * FROM routes WHERE address = '10.1.2.3';
+ *   SELECT * FROM routes('10.1.2.3');
+ *
+ * return the longest prefix that covers it, and a join on address does
+ * one lookup per row instead of a scan. ip_contains(prefix, s) on the
+ * table returns every prefix that covers s, also without a scan.
+ */
+
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+
+#include "ipaddrcheck_classify.h"
+#include "ipaddrcheck_lpm.h"
+
+/* Columns of the virtual table */
+#define COLUMN_PREFIX  0
+#define COLUMN_LABEL   1
+#define COLUMN_LINE    2
+#define COLUMN_ADDRESS 3
+
+/* Query plans */
+#define PLAN_SCAN          0
+#define PLAN_LONGEST_MATCH 1
+#define PLAN_CONTAINING    2
+
+typedef struct
+{
+    sqlite3_vtab base;
+    lpm_table* table;
+    /* The entries by family, prefix length and address, with the start
+       of each run of the same family and length */
+    const lpm_entry** sorted;
+    size_t run_start[2][IPV6_BITS + 2];
+    int length_count;   /* runs that are not empty, a binary search each */
+} lpm_vtab;
+
+typedef struct
+{
+    sqlite3_vtab_cursor base;
+    int plan;
+    const lpm_entry* matches[IPV6_BITS + 1];
+    size_t match_count;
+    size_t position;
+    char* address_str;
+} lpm_cursor;
+
+/* Parse an argument, the parsers want it in a buffer of their own */
+static int value_prefix(sqlite3_value* value, ip_prefix* prefix, char* prefix_str)
+{
+    const unsigned char* text = sqlite3_value_text(value);
+
+    if( (text == NULL) || (strlen((const char*)text) >= PREFIX_STR_MAX) )
+    {
+        return RESULT_FAILURE;
+    }
+    strcpy(prefix_str, (const char*)text);
+
+    return ip_prefix_from_str(prefix_str, prefix);
+}
+
+static void ip_is_valid_function(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    char prefix_str[PREFIX_STR_MAX];
+    ip_prefix prefix;
+
+    if( sqlite3_value_type(argv[0]) == SQLITE_NULL )
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_result_int(context, value_prefix(argv[0], &prefix, prefix_str) == RESULT_SUCCESS);
+}
+
+static void ip_is_rfc1918_function(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    char prefix_str[PREFIX_STR_MAX];
+    ip_prefix prefix;
+
+    if( value_prefix(argv[0], &prefix, prefix_str) != RESULT_SUCCESS )
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_result_int(context, (ip_prefix_classes(&prefix) & ADDRESS_CLASS_RFC1918) != 0);
+}
+
+static void ip_canonical_function(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    char prefix_str[PREFIX_STR_MAX];
+    char canonical_str[PREFIX_STR_MAX];
+    ip_prefix prefix;
+
+    if( value_prefix(argv[0], &prefix, prefix_str) != RESULT_SUCCESS )
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    /* Keep the prefix length only if there was one */
+    if( strchr(prefix_str, '/') != NULL )
+    {
+        ip_prefix_to_str(&prefix, canonical_str);
+    }
+    else
+    {
+        ip_addr_to_str(prefix.proto, prefix.addr, canonical_str);
+    }
+    sqlite3_result_text(context, canonical_str, -1, SQLITE_TRANSIENT);
+}
+
+static void ip_contains_function(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    char outer_str[PREFIX_STR_MAX];
+    char inner_str[PREFIX_STR_MAX];
+    ip_prefix outer;
+    ip_prefix inner;
+
+    if( (value_prefix(argv[0], &outer, outer_str) != RESULT_SUCCESS) ||
+        (value_prefix(argv[1], &inner, inner_str) != RESULT_SUCCESS) )
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_result_int(context, ip_prefix_contains(&outer, &inner) == RESULT_SUCCESS);
+}
+
+static int entry_cmp(const void* left, const void* right)
+{
+    const ip_prefix* left_prefix = &(*(const lpm_entry* const*)left)->prefix;
+    const ip_prefix* right_prefix = &(*(const lpm_entry* const*)right)->prefix;
+
+    if( left_prefix->proto != right_prefix->proto )
+    {
+        return (left_prefix->proto == CIDR_IPV4) ? -1 : 1;
+    }
+    if( left_prefix->pflen != right_prefix->pflen )
+    {
+        return (left_prefix->pflen < right_prefix->pflen) ? -1 : 1;
+    }
+    return ip_value_cmp(left_prefix->addr, right_prefix->addr);
+}
+
+static int family_index(int proto)
+{
+    return (proto == CIDR_IPV4) ? 0 : 1;
+}
+
+/* CREATE VIRTUAL TABLE name USING ipaddrcheck_lpm(path) */
+static int lpm_connect(sqlite3* db, void* aux, int argc, const char* const* argv,
+                       sqlite3_vtab** vtab, char** error)
+{
+    lpm_vtab* lpm = NULL;
+    char* path = NULL;
+    size_t i = 0;
+    int family = 0;
+    int pflen = 0;
+    size_t run = 0;
+    int result = SQLITE_OK;
+
+    if( argc != 4 )
+    {
+        *error = sqlite3_mprintf("ipaddrcheck_lpm takes the path of a table file");
+        return SQLITE_ERROR;
+    }
+
+    result = sqlite3_declare_vtab(db, "CREATE TABLE x(prefix TEXT, label TEXT, line INTEGER, address HIDDEN)");
+    if( result != SQLITE_OK )
+    {
+        return result;
+    }
+
+    lpm = sqlite3_malloc(sizeof(lpm_vtab));
+    if( lpm == NULL )
+    {
+        return SQLITE_NOMEM;
+    }
+    memset(lpm, 0, sizeof(lpm_vtab));
+
+    /* The argument comes as written, possibly quoted */
+    path = sqlite3_mprintf("%s", argv[3]);
+    if( path == NULL )
+    {
+        sqlite3_free(lpm);
+        return SQLITE_NOMEM;
+    }
+    if( ((path[0] == '\'') || (path[0] == '"')) && (strlen(path) >= 2) && (path[strlen(path) - 1] == path[0]) )
+    {
+        path[strlen(path) - 1] = '\0';
+        memmove(path, path + 1, strlen(path));
+    }
+
+    lpm->table = lpm_table_load(path);
+    if( lpm->table == NULL )
+    {
+        *error = sqlite3_mprintf("could not load %s", path);
+        sqlite3_free(path);
+        sqlite3_free(lpm);
+        return SQLITE_ERROR;
+    }
+    sqlite3_free(path);
+
+    lpm->sorted = sqlite3_malloc64((lpm->table->entry_count + 1) * sizeof(const lpm_entry*));
+    if( lpm->sorted == NULL )
+    {
+        lpm_table_free(lpm->table);
+        sqlite3_free(lpm);
+        return SQLITE_NOMEM;
+    }
+    for( i = 0; i < lpm->table->entry_count; i++ )
+    {
+        lpm->sorted[i] = &lpm->table->entries[i];
+    }
+    qsort(lpm->sorted, lpm->table->entry_count, sizeof(const lpm_entry*), entry_cmp);
+
+    for( family = 0; family < 2; family++ )
+    {
+        for( pflen = 0; pflen <= IPV6_BITS + 1; pflen++ )
+        {
+            lpm->run_start[family][pflen] = run;
+            while( (run < lpm->table->entry_count) &&
+                   (family_index(lpm->sorted[run]->prefix.proto) == family) &&
+                   (lpm->sorted[run]->prefix.pflen == pflen) )
+            {
+                run++;
+            }
+            if( run > lpm->run_start[family][pflen] )
+            {
+                lpm->length_count++;
+            }
+        }
+    }
+
+    *vtab = &lpm->base;
+
+    return SQLITE_OK;
+}
+
+static int lpm_disconnect(sqlite3_vtab* vtab)
+{
+    lpm_vtab* lpm = (lpm_vtab*)vtab;
+
+    sqlite3_free(lpm->sorted);
+    lpm_table_free(lpm->table);
+    sqlite3_free(lpm);
+
+    return SQLITE_OK;
+}
+
+/*
+ * An address to look up turns a scan into a single lookup, and containment
+ * into a binary search for each prefix length. The planner is told so.
+ */
+static int lpm_best_index(sqlite3_vtab* vtab, sqlite3_index_info* info)
+{
+    lpm_vtab* lpm = (lpm_vtab*)vtab;
+    int address_constraint = -1;
+    int contains_constraint = -1;
+    int i = 0;
+
+    for( i = 0; i < info->nConstraint; i++ )
+    {
+        const struct sqlite3_index_constraint* constraint = &info->aConstraint[i];
+
+        if( !constraint->usable )
+        {
+            continue;
+        }
+        if( (constraint->iColumn == COLUMN_ADDRESS) && (constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) &&
+            (address_constraint < 0) )
+        {
+            address_constraint = i;
+        }
+#ifdef SQLITE_INDEX_CONSTRAINT_FUNCTION
+        if( (constraint->iColumn == COLUMN_PREFIX) && (constraint->op == SQLITE_INDEX_CONSTRAINT_FUNCTION) &&
+            (contains_constraint < 0) )
+        {
+            contains_constraint = i;
+        }
+#endif
+    }
+
+    if( address_constraint >= 0 )
+    {
+        info->idxNum = PLAN_LONGEST_MATCH;
+        info->aConstraintUsage[address_constraint].argvIndex = 1;
+        info->aConstraintUsage[address_constraint].omit = 1;
+        info->estimatedCost = 1;
+        /* Fields that older libraries don't have */
+        if( sqlite3_libversion_number() >= 3008012 )
+        {
+            info->estimatedRows = 1;
+            info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+        }
+    }
+    else if( contains_constraint >= 0 )
+    {
+        info->idxNum = PLAN_CONTAINING;
+        info->aConstraintUsage[contains_constraint].argvIndex = 1;
+        info->aConstraintUsage[contains_constraint].omit = 1;
+        info->estimatedCost = lpm->length_count;
+        if( sqlite3_libversion_number() >= 3008012 )
+        {
+            info->estimatedRows = 4;
+        }
+    }
+    else
+    {
+        info->idxNum = PLAN_SCAN;
+        info->estimatedCost = (double)lpm->table->entry_count + 1;
+        if( sqlite3_libversion_number() >= 3008012 )
+        {
+            info->estimatedRows = (sqlite3_int64)lpm->table->entry_count;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+/* ip_contains(prefix, s) on the table can be answered by it */
+static int lpm_find_function(sqlite3_vtab* vtab, int argc, const char* name,
+                             void (**function)(sqlite3_context*, int, sqlite3_value**), void** arg)
+{
+#ifdef SQLITE_INDEX_CONSTRAINT_FUNCTION
+    if( (argc == 2) && (sqlite3_stricmp(name, "ip_contains") == 0) )
+    {
+        *function = ip_contains_function;
+        *arg = NULL;
+        return SQLITE_INDEX_CONSTRAINT_FUNCTION;
+    }
+#endif
+    return 0;
+}
+
+static int lpm_open(sqlite3_vtab* vtab, sqlite3_vtab_cursor** cursor)
+{
+    lpm_cursor* lpm_cur = sqlite3_malloc(sizeof(lpm_cursor));
+
+    if( lpm_cur == NULL )
+    {
+        return SQLITE_NOMEM;
+    }
+    memset(lpm_cur, 0, sizeof(lpm_cursor));
+    *cursor = &lpm_cur->base;
+
+    return SQLITE_OK;
+}
+
+static int lpm_close(sqlite3_vtab_cursor* cursor)
+{
+    lpm_cursor* lpm_cur = (lpm_cursor*)cursor;
+
+    sqlite3_free(lpm_cur->address_str);
+    sqlite3_free(lpm_cur);
+
+    return SQLITE_OK;
+}
+
+/* The entry of the given family, length and network address, if there is one */
+static const lpm_entry* find_entry(const lpm_vtab* lpm, int proto, int pflen, ip_value network)
+{
+    size_t low = lpm->run_start[family_index(proto)][pflen];
+    size_t high = lpm->run_start[family_index(proto)][pflen + 1];
+
+    while( low < high )
+    {
+        size_t middle = low + (high - low) / 2;
+        int order = ip_value_cmp(lpm->sorted[middle]->prefix.addr, network);
+
+        if( order == 0 )
+        {
+            return lpm->sorted[middle];
+        }
+        if( order < 0 )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return NULL;
+}
+
+static int lpm_filter(sqlite3_vtab_cursor* cursor, int plan, const char* plan_str,
+                      int argc, sqlite3_value** argv)
+{
+    lpm_cursor* lpm_cur = (lpm_cursor*)cursor;
+    const lpm_vtab* lpm = (const lpm_vtab*)cursor->pVtab;
+    char prefix_str[PREFIX_STR_MAX];
+    ip_prefix address;
+    int pflen = 0;
+
+    lpm_cur->plan = plan;
+    lpm_cur->match_count = 0;
+    lpm_cur->position = 0;
+    sqlite3_free(lpm_cur->address_str);
+    lpm_cur->address_str = NULL;
+
+    /* Malformed addresses match nothing */
+    if( (plan == PLAN_SCAN) || (value_prefix(argv[0], &address, prefix_str) != RESULT_SUCCESS) )
+    {
+        return SQLITE_OK;
+    }
+    lpm_cur->address_str = sqlite3_mprintf("%s", sqlite3_value_text(argv[0]));
+    if( lpm_cur->address_str == NULL )
+    {
+        return SQLITE_NOMEM;
+    }
+
+    if( plan == PLAN_LONGEST_MATCH )
+    {
+        const lpm_entry* entry = lpm_lookup(lpm->table, &address);
+
+        if( entry != NULL )
+        {
+            lpm_cur->matches[lpm_cur->match_count++] = entry;
+        }
+        return SQLITE_OK;
+    }
+
+    /* Longest first */
+    for( pflen = address.pflen; pflen >= 0; pflen-- )
+    {
+        ip_value mask = ip_host_mask(address.proto, pflen);
+        ip_value network = address.addr;
+        const lpm_entry* entry = NULL;
+
+        network.hi &= ~mask.hi;
+        network.lo &= ~mask.lo;
+        entry = find_entry(lpm, address.proto, pflen, network);
+        if( entry != NULL )
+        {
+            lpm_cur->matches[lpm_cur->match_count++] = entry;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+static int lpm_next(sqlite3_vtab_cursor* cursor)
+{
+    ((lpm_cursor*)cursor)->position++;
+    return SQLITE_OK;
+}
+
+static int lpm_eof(sqlite3_vtab_cursor* cursor)
+{
+    const lpm_cursor* lpm_cur = (const lpm_cursor*)cursor;
+    const lpm_vtab* lpm = (const lpm_vtab*)cursor->pVtab;
+
+    if( lpm_cur->plan == PLAN_SCAN )
+    {
+        return lpm_cur->position >= lpm->table->entry_count;
+    }
+    return lpm_cur->position >= lpm_cur->match_count;
+}
+
+static const lpm_entry* cursor_entry(const lpm_cursor* lpm_cur)
+{
+    const lpm_vtab* lpm = (const lpm_vtab*)lpm_cur->base.pVtab;
+
+    if( lpm_cur->plan == PLAN_SCAN )
+    {
+        return &lpm->table->entries[lpm_cur->position];
+    }
+    return lpm_cur->matches[lpm_cur->position];
+}
+
+static int lpm_column(sqlite3_vtab_cursor* cursor, sqlite3_context* context, int column)
+{
+    const lpm_cursor* lpm_cur = (const lpm_cursor*)cursor;
+    const lpm_entry* entry = cursor_entry(lpm_cur);
+    char prefix_str[PREFIX_STR_MAX];
+
+    switch( column )
+    {
+        case COLUMN_PREFIX:
+            sqlite3_result_text(context, ip_prefix_to_str(&entry->prefix, prefix_str), -1, SQLITE_TRANSIENT);
+            break;
+        case COLUMN_LABEL:
+            sqlite3_result_text(context, entry->label, -1, SQLITE_TRANSIENT);
+            break;
+        case COLUMN_LINE:
+            sqlite3_result_int(context, entry->line_number);
+            break;
+        default:
+            if( lpm_cur->address_str != NULL )
+            {
+                sqlite3_result_text(context, lpm_cur->address_str, -1, SQLITE_TRANSIENT);
+            }
+            else
+            {
+                sqlite3_result_null(context);
+            }
+            break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int lpm_rowid(sqlite3_vtab_cursor* cursor, sqlite_int64* rowid)
+{
+    const lpm_cursor* lpm_cur = (const lpm_cursor*)cursor;
+    const lpm_vtab* lpm = (const lpm_vtab*)cursor->pVtab;
+
+    *rowid = cursor_entry(lpm_cur) - lpm->table->entries;
+
+    return SQLITE_OK;
+}
+
+static sqlite3_module lpm_module =
+{
+    0,                  /* iVersion */
+    lpm_connect,        /* xCreate */
+    lpm_connect,        /* xConnect */
+    lpm_best_index,     /* xBestIndex */
+    lpm_disconnect,     /* xDisconnect */
+    lpm_disconnect,     /* xDestroy */
+    lpm_open,           /* xOpen */
+    lpm_close,          /* xClose */
+    lpm_filter,         /* xFilter */
+    lpm_next,           /* xNext */
+    lpm_eof,            /* xEof */
+    lpm_column,         /* xColumn */
+    lpm_rowid,          /* xRowid */
+    NULL,               /* xUpdate */
+    NULL,               /* xBegin */
+    NULL,               /* xSync */
+    NULL,               /* xCommit */
+    NULL,               /* xRollback */
+    lpm_find_function,  /* xFindFunction */
+    NULL,               /* xRename */
+    NULL,               /* xSavepoint */
+    NULL,               /* xRelease */
+    NULL                /* xRollbackTo */
+};
+
+#ifdef SQLITE_INNOCUOUS
+#define FUNCTION_FLAGS (SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS)
+#else
+#define FUNCTION_FLAGS (SQLITE_UTF8 | SQLITE_DETERMINISTIC)
+#endif
+
+/* Entry point, named after the file so that no name has to be given to load it */
+int sqlite3_ipaddrcheck_init(sqlite3* db, char** error, const sqlite3_api_routines* api)
+{
+    static const struct
+    {
+        const char* name;
+        int argc;
+        void (*function)(sqlite3_context*, int, sqlite3_value**);
+    } functions[] =
+    {
+        { "ip_is_valid",   1, ip_is_valid_function },
+        { "ip_is_rfc1918", 1, ip_is_rfc1918_function },
+        { "ip_canonical",  1, ip_canonical_function },
+        { "ip_contains",   2, ip_contains_function }
+    };
+    size_t i = 0;
+    int result = SQLITE_OK;
+
+    SQLITE_EXTENSION_INIT2(api);
+
+    for( i = 0; (i < sizeof(functions) / sizeof(functions[0])) && (result == SQLITE_OK); i++ )
+    {
+        result = sqlite3_create_function(db, functions[i].name, functions[i].argc, FUNCTION_FLAGS,
+                                         NULL, functions[i].function, NULL, NULL);
+    }
+    if( result == SQLITE_OK )
+    {
+        result = sqlite3_create_module(db, "ipaddrcheck_lpm", &lpm_module, NULL);
+    }
+
+    return result;
+}
@@ -0,0 +1,240 @@
+/*
+ * bench_lookup.c: one-at-a-time versus batched table lookups
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 or later as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Usage: bench_lookup [IPV4_PREFIXES [IPV6_PREFIXES [HOSTS [LOOKUPS]]]]
+ *
+ * The tables should be larger than the last level cache for the numbers
+ * to mean anything: tbl24 alone takes 64 MiB, an IPv6 trie node 2 KiB,
+ * and the defaults need a few hundred MiB for each kind of table.
+ */
+
+/* clock_gettime() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include "../src/ipaddrcheck_lpm.h"
+#include "../src/ipaddrcheck_host_set.h"
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static double now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/* Keep the compiler from dropping lookups whose results are never used */
+static volatile uintptr_t sink;
+
+static int entry_cmp(const void* left, const void* right)
+{
+    return ip_prefix_cmp(&((const lpm_entry*)left)->prefix, &((const lpm_entry*)right)->prefix);
+}
+
+static void report(const char* name, size_t lookups, double single, double batched)
+{
+    printf("%-14s %8.1f ns one at a time %8.1f ns batched  %5.2fx\n", name,
+           single * 1e9 / (double)lookups, batched * 1e9 / (double)lookups, single / batched);
+}
+
+static void bench_lpm(const lpm_table* table, const ip_prefix* addresses, size_t count, const char* name)
+{
+    const lpm_entry* results[LPM_BATCH_SIZE];
+    uintptr_t sum = 0;
+    double start = 0;
+    double single = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    start = now();
+    for( i = 0; i < count; i++ )
+    {
+        sum += (uintptr_t)lpm_lookup(table, &addresses[i]);
+    }
+    single = now() - start;
+
+    /* A batch at a time, the way the command line tool looks them up */
+    start = now();
+    for( i = 0; i < count; i += LPM_BATCH_SIZE )
+    {
+        size_t length = (count - i < LPM_BATCH_SIZE) ? count - i : LPM_BATCH_SIZE;
+
+        lpm_lookup_batch(table, addresses + i, length, results);
+        for( j = 0; j < length; j++ )
+        {
+            sum -= (uintptr_t)results[j];
+        }
+    }
+    report(name, count, single, now() - start);
+
+    sink = sum;
+}
+
+static void bench_host_set(const host_set* set, const ip_prefix* addresses, size_t count)
+{
+    int results[HOST_SET_BATCH_SIZE];
+    uintptr_t sum = 0;
+    double start = 0;
+    double single = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    start = now();
+    for( i = 0; i < count; i++ )
+    {
+        sum += (uintptr_t)host_set_contains(set, CIDR_IPV4, addresses[i].addr);
+    }
+    single = now() - start;
+
+    start = now();
+    for( i = 0; i < count; i += HOST_SET_BATCH_SIZE )
+    {
+        size_t length = (count - i < HOST_SET_BATCH_SIZE) ? count - i : HOST_SET_BATCH_SIZE;
+
+        host_set_lookup_batch(set, addresses + i, length, results, NULL);
+        for( j = 0; j < length; j++ )
+        {
+            sum -= (uintptr_t)results[j];
+        }
+    }
+    report("Host list", count, single, now() - start);
+
+    sink = sum;
+}
+
+int main(int argc, char** argv)
+{
+    size_t ipv4_count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 500000;
+    size_t ipv6_count = (argc > 2) ? strtoul(argv[2], NULL, 10) : 100000;
+    size_t host_count = (argc > 3) ? strtoul(argv[3], NULL, 10) : 20000000;
+    size_t lookups = (argc > 4) ? strtoul(argv[4], NULL, 10) : 2000000;
+    size_t entry_count = ipv4_count + ipv6_count;
+    lpm_entry* entries = calloc(entry_count > 0 ? entry_count : 1, sizeof(lpm_entry));
+    ip_value* hosts = malloc((host_count > 0 ? host_count : 1) * sizeof(ip_value));
+    uint64_t* networks = malloc((ipv6_count > 0 ? ipv6_count : 1) * sizeof(uint64_t));
+    ip_prefix* addresses = malloc((lookups > 0 ? lookups : 1) * sizeof(ip_prefix));
+    lpm_table* table = NULL;
+    host_set* set = NULL;
+    size_t unique_count = 0;
+    size_t i = 0;
+
+    if( (entries == NULL) || (hosts == NULL) || (networks == NULL) || (addresses == NULL) )
+    {
+        fprintf(stderr, "Error: could not allocate memory!\n");
+        return(EXIT_FAILURE);
+    }
+
+    /* IPv4 prefixes from /16 to /28, so that some need tbl8 groups,
+       and IPv6 /48s anywhere in 2000::/3 */
+    for( i = 0; i < entry_count; i++ )
+    {
+        ip_prefix* prefix = &entries[i].prefix;
+        uint64_t bits = next_random();
+
+        if( i < ipv4_count )
+        {
+            prefix->proto = CIDR_IPV4;
+            prefix->pflen = 16 + (int)(bits % 13);
+            prefix->addr.hi = 0;
+            prefix->addr.lo = (bits >> 32) & ~(((uint64_t)1 << (32 - prefix->pflen)) - 1);
+        }
+        else
+        {
+            prefix->proto = CIDR_IPV6;
+            prefix->pflen = 48;
+            prefix->addr.hi = ((bits & 0x1fffffffffffULL) | 0x200000000000ULL) << 16;
+            prefix->addr.lo = 0;
+            networks[i - ipv4_count] = prefix->addr.hi;
+        }
+    }
+
+    /* The table takes no duplicate prefixes */
+    qsort(entries, entry_count, sizeof(lpm_entry), entry_cmp);
+    for( i = 0; i < entry_count; i++ )
+    {
+        if( (unique_count > 0) && (ip_prefix_cmp(&entries[unique_count - 1].prefix, &entries[i].prefix) == 0) )
+        {
+            continue;
+        }
+        entries[unique_count] = entries[i];
+        entries[unique_count].label = malloc(1);
+        if( entries[unique_count].label == NULL )
+        {
+            fprintf(stderr, "Error: could not allocate memory!\n");
+            return(EXIT_FAILURE);
+        }
+        entries[unique_count].label[0] = '\0';
+        unique_count++;
+    }
+    table = lpm_table_build(entries, unique_count);
+
+    for( i = 0; i < host_count; i++ )
+    {
+        hosts[i].hi = 0;
+        hosts[i].lo = next_random() >> 32;
+    }
+    set = host_set_build(hosts, host_count, NULL, 0, 7);
+    free(hosts);
+
+    if( (table == NULL) || (set == NULL) )
+    {
+        return(EXIT_FAILURE);
+    }
+
+    for( i = 0; i < lookups; i++ )
+    {
+        addresses[i].proto = CIDR_IPV4;
+        addresses[i].pflen = 32;
+        addresses[i].addr.hi = 0;
+        addresses[i].addr.lo = next_random() >> 32;
+    }
+    bench_lpm(table, addresses, lookups, "IPv4 DIR-24-8");
+    bench_host_set(set, addresses, lookups);
+
+    /* Addresses within the prefixes, so that lookups go all the way down */
+    if( ipv6_count > 0 )
+    {
+        for( i = 0; i < lookups; i++ )
+        {
+            addresses[i].proto = CIDR_IPV6;
+            addresses[i].pflen = 128;
+            addresses[i].addr.hi = networks[next_random() % ipv6_count] | (next_random() & 0xffff);
+            addresses[i].addr.lo = next_random();
+        }
+        bench_lpm(table, addresses, lookups, "IPv6 trie");
+    }
+
+    lpm_table_free(table);
+    host_set_free(set);
+    free(networks);
+    free(addresses);
+
+    return(EXIT_SUCCESS);
+}
@@ -18,8 +18,26 @@
  *
  */
 
+/* sigaction() for the reload tests */
+#define _POSIX_C_SOURCE 200809L
+
 #include <check.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 #include "../src/ipaddrcheck_functions.h"
+#include "../src/ipaddrcheck_lpm.h"
+#include "../src/ipaddrcheck_policy.h"
+#include "../src/ipaddrcheck_reload.h"
+#include "../src/ipaddrcheck_prefix_set.h"
+#include "../src/ipaddrcheck_roaring.h"
+#include "../src/ipaddrcheck_set.h"
+#include "../src/ipaddrcheck_host_set.h"
+#include "../src/ipaddrcheck_filter.h"
+#include "../src/ipaddrcheck_ipam.h"
+#include "../src/ipaddrcheck_classify.h"
+#include "../src/ipaddrcheck_coverage.h"
+#include "../src/ipaddrcheck_expand.h"
 
 START_TEST (test_is_valid_address)
 {
@@ -433,6 +451,1345 @@ START_TEST (test_is_ipv6_range_prefix)
 }
 END_TEST
 
+START_TEST (test_lpm_lookup)
+{
+    char* table_prefixes[] = { "10.0.0.0/8", "10.1.0.0/16", "10.1.2.128/25",
+                               "2001:db8::/32", "2001:db8:1::/48", "2001:db8:1:8000::/49" };
+    int table_size = sizeof(table_prefixes) / sizeof(table_prefixes[0]);
+    lpm_entry* entries = calloc(table_size, sizeof(lpm_entry));
+    lpm_table* table;
+    ip_prefix address;
+    ip_prefix batch[40];
+    const lpm_entry* batch_entries[40];
+    char prefix_str[PREFIX_STR_MAX];
+    int i;
+
+    for( i = 0; i < table_size; i++ )
+    {
+        ck_assert_int_eq(ip_prefix_from_str(table_prefixes[i], &entries[i].prefix), RESULT_SUCCESS);
+        entries[i].label = malloc(strlen(table_prefixes[i]) + 1);
+        strcpy(entries[i].label, table_prefixes[i]);
+    }
+    table = lpm_table_build(entries, table_size);
+    ck_assert_ptr_ne(table, NULL);
+
+    ip_prefix_from_str("10.1.2.200", &address);
+    ck_assert_str_eq(ip_prefix_to_str(&lpm_lookup(table, &address)->prefix, prefix_str), "10.1.2.128/25");
+
+    ip_prefix_from_str("10.1.2.1", &address);
+    ck_assert_str_eq(lpm_lookup(table, &address)->label, "10.1.0.0/16");
+
+    ip_prefix_from_str("10.200.0.1", &address);
+    ck_assert_str_eq(lpm_lookup(table, &address)->label, "10.0.0.0/8");
+
+    ip_prefix_from_str("192.0.2.1", &address);
+    ck_assert_ptr_eq(lpm_lookup(table, &address), NULL);
+
+    ip_prefix_from_str("2001:db8:1:8000::1", &address);
+    ck_assert_str_eq(lpm_lookup(table, &address)->label, "2001:db8:1:8000::/49");
+
+    ip_prefix_from_str("2001:db8:1::1", &address);
+    ck_assert_str_eq(lpm_lookup(table, &address)->label, "2001:db8:1::/48");
+
+    ip_prefix_from_str("2001:db8:ffff::1", &address);
+    ck_assert_str_eq(lpm_lookup(table, &address)->label, "2001:db8::/32");
+
+    ip_prefix_from_str("2001:db9::1", &address);
+    ck_assert_ptr_eq(lpm_lookup(table, &address), NULL);
+
+    /* Batches span more than one group and mix the families */
+    for( i = 0; i < 40; i++ )
+    {
+        char* batch_addresses[] = { "10.1.2.200", "10.1.2.1", "192.0.2.1", "::",
+                                    "2001:db8:1:8000::1", "2001:db8:ffff::1", "2001:db9::1", "10.0.0.0" };
+        ip_prefix_from_str(batch_addresses[i % 8], &batch[i]);
+    }
+    lpm_lookup_batch(table, batch, 40, batch_entries);
+    for( i = 0; i < 40; i++ )
+    {
+        ck_assert_ptr_eq(batch_entries[i], lpm_lookup(table, &batch[i]));
+    }
+
+    lpm_table_free(table);
+}
+END_TEST
+
+START_TEST (test_policy_compile)
+{
+    /* Includes rules that are shadowed entirely or partially by earlier ones */
+    char* rules[][2] = {
+        { "deny",   "10.0.0.0/8" },
+        { "permit", "10.1.0.0/16" },
+        { "deny",   "multicast" },
+        { "permit", "rfc1918" },
+        { "deny",   "172.16.5.0/24" },
+        { "deny",   "loopback" },
+        { "permit", "192.0.2.0/25" },
+        { "deny",   "192.0.0.0/16" },
+        { "permit", "2001:db8::/32" },
+        { "deny",   "2001:db8:1::/48" },
+        { "deny",   "link-local" },
+        { "permit", "ipv6" },
+        { "permit", "128.0.0.0/1" }
+    };
+    /* Address patterns that hit the rules above, the rest is random */
+    const char* ipv4_bases[] = { "10.0.0.0", "10.1.0.0", "172.16.5.0", "192.168.1.0", "224.0.0.0",
+                                 "127.0.0.0", "192.0.2.0", "169.254.0.0", "0.0.0.0" };
+    const char* ipv6_bases[] = { "2001:db8::", "2001:db8:1::", "fe80::", "ff02::", "::", "3fff::" };
+    int rule_count = sizeof(rules) / sizeof(rules[0]);
+    address_policy* policy = policy_new();
+    lpm_table* table;
+    unsigned long long state = 12345;
+    int mismatches = 0;
+    int i;
+
+    for( i = 0; i < rule_count; i++ )
+    {
+        ck_assert_int_eq(policy_add_rule(policy, rules[i][0], rules[i][1], NULL), RESULT_SUCCESS);
+    }
+    table = policy_compile(policy);
+    ck_assert_ptr_ne(table, NULL);
+
+    for( i = 0; i < 20000; i++ )
+    {
+        char address_str[PREFIX_STR_MAX];
+        ip_prefix address;
+        CIDR* address_cidr;
+        const lpm_entry* entry;
+        int compiled_verdict;
+
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        if( i % 2 )
+        {
+            ip_prefix_from_str((char*)ipv4_bases[(state >> 60) % 9], &address);
+            address.addr.lo |= (state >> 16) & ((state >> 59) & 1 ? 0xffff : 0xffffffff);
+        }
+        else
+        {
+            ip_prefix_from_str((char*)ipv6_bases[(state >> 60) % 6], &address);
+            address.addr.hi |= (state >> 8) & 0xffffffffffULL;
+            address.addr.lo = state;
+            if( (state >> 58) % 7 == 0 )
+            {
+                address.addr.hi = 0;
+                address.addr.lo = 1;
+            }
+        }
+
+        address_cidr = cidr_from_str(ip_addr_to_str(address.proto, address.addr, address_str));
+        entry = lpm_lookup(table, &address);
+        compiled_verdict = (entry != NULL) ? entry->value : POLICY_DENY;
+        if( entry != NULL )
+        {
+            ck_assert_str_eq(entry->label, policy_verdict_name(entry->value));
+        }
+        if( compiled_verdict != policy_first_match(policy, address_cidr) )
+        {
+            mismatches++;
+        }
+        cidr_free(address_cidr);
+    }
+    ck_assert_int_eq(mismatches, 0);
+
+    ck_assert_int_eq(policy_add_rule(policy, "allow", "10.0.0.0/8", NULL), RESULT_FAILURE);
+    ck_assert_int_eq(policy_add_rule(policy, "deny", "10.0.0.1/8", NULL), RESULT_FAILURE);
+    ck_assert_int_eq(policy_add_rule(policy, "deny", "bogons", NULL), RESULT_FAILURE);
+
+    lpm_table_free(table);
+    policy_free(policy);
+}
+END_TEST
+
+START_TEST (test_lpm_handle_reload)
+{
+    lpm_table* tables[2];
+    lpm_handle handle;
+    int reader;
+    int i;
+
+    for( i = 0; i < 2; i++ )
+    {
+        lpm_entry* entry = calloc(1, sizeof(lpm_entry));
+        ip_prefix_from_str("10.0.0.0/8", &entry->prefix);
+        entry->label = malloc(2);
+        strcpy(entry->label, (i == 0) ? "a" : "b");
+        tables[i] = lpm_table_build(entry, 1);
+        ck_assert_ptr_ne(tables[i], NULL);
+    }
+
+    ck_assert_int_eq(lpm_handle_init(&handle, tables[0]), RESULT_SUCCESS);
+    reader = lpm_handle_register_reader(&handle);
+    ck_assert_int_ge(reader, 0);
+
+    /* A reader that is still using the old table keeps it alive */
+    ck_assert_ptr_eq(lpm_handle_read_begin(&handle, reader), tables[0]);
+    ck_assert_int_eq(lpm_handle_publish(&handle, tables[1]), RESULT_SUCCESS);
+    ck_assert_int_eq(lpm_handle_reclaim(&handle), 1);
+    lpm_handle_read_end(&handle, reader);
+    ck_assert_int_eq(lpm_handle_reclaim(&handle), 0);
+
+    /* New read sections get the new table and don't hold back reclamation */
+    ck_assert_ptr_eq(lpm_handle_read_begin(&handle, reader), tables[1]);
+    ck_assert_int_eq(lpm_handle_reclaim(&handle), 0);
+    lpm_handle_read_end(&handle, reader);
+    ck_assert_int_eq(handle.version, 2);
+
+    lpm_handle_unregister_reader(&handle, reader);
+    lpm_handle_destroy(&handle);
+}
+END_TEST
+
+static void write_lpm_table(const char* path, const char* contents)
+{
+    FILE* file = fopen(path, "w");
+    ck_assert_ptr_ne(file, NULL);
+    fputs(contents, file);
+    fclose(file);
+}
+
+static const char* lpm_handle_label(lpm_handle* handle, int reader, const char* address_str)
+{
+    char buffer[PREFIX_STR_MAX];
+    ip_prefix address;
+    const lpm_entry* entry = NULL;
+    const char* label = NULL;
+
+    strcpy(buffer, address_str);
+    ip_prefix_from_str(buffer, &address);
+    entry = lpm_lookup(lpm_handle_read_begin(handle, reader), &address);
+    label = (entry != NULL) ? entry->label : "";
+    lpm_handle_read_end(handle, reader);
+
+    return label;
+}
+
+static volatile sig_atomic_t previous_hup_count = 0;
+
+static void count_previous_hup(int signal_number)
+{
+    previous_hup_count++;
+}
+
+START_TEST (test_lpm_watcher_reload)
+{
+    const char* path = "check_lpm_watcher.txt";
+    struct sigaction previous;
+    struct sigaction restored;
+    lpm_watcher watcher;
+    lpm_handle handle;
+    struct timespec pause = { 0, 10000000 };
+    int reader;
+    int i;
+
+    write_lpm_table(path, "10.0.0.0/8 old\n");
+    ck_assert_int_eq(lpm_handle_init(&handle, lpm_table_load(path)), RESULT_SUCCESS);
+    reader = lpm_handle_register_reader(&handle);
+    ck_assert_str_eq(lpm_handle_label(&handle, reader, "10.1.2.3"), "old");
+
+    /* A handler the process had before the watcher */
+    memset(&previous, 0, sizeof(previous));
+    previous.sa_handler = count_previous_hup;
+    sigemptyset(&previous.sa_mask);
+    sigaction(SIGHUP, &previous, NULL);
+
+    ck_assert_int_eq(lpm_watcher_start(&watcher, &handle, path, lpm_table_load, 0), RESULT_SUCCESS);
+
+    /* SIGHUP goes to the watcher now and makes it load the new version */
+    write_lpm_table(path, "10.0.0.0/8 new\n10.1.0.0/16 site\n");
+    raise(SIGHUP);
+    for( i = 0; (i < 500) && (__atomic_load_n(&handle.version, __ATOMIC_ACQUIRE) < 2); i++ )
+    {
+        nanosleep(&pause, NULL);
+    }
+    ck_assert_int_ge(handle.version, 2);
+    ck_assert_str_eq(lpm_handle_label(&handle, reader, "10.1.2.3"), "site");
+    ck_assert_str_eq(lpm_handle_label(&handle, reader, "10.2.0.1"), "new");
+    ck_assert_int_eq(previous_hup_count, 0);
+
+    lpm_watcher_stop(&watcher);
+
+    /* The previous handler is back */
+    sigaction(SIGHUP, NULL, &restored);
+    ck_assert(restored.sa_handler == count_previous_hup);
+    raise(SIGHUP);
+    ck_assert_int_eq(previous_hup_count, 1);
+
+    signal(SIGHUP, SIG_DFL);
+    lpm_handle_unregister_reader(&handle, reader);
+    lpm_handle_destroy(&handle);
+    unlink(path);
+}
+END_TEST
+
+START_TEST (test_prefix_set)
+{
+    char* list[] = { "10.0.0.0/9", "10.128.0.0/9", "10.1.2.0/24", "192.0.2.1",
+                     "2001:db8::/32", "2001:db8:1::/48", "2001:db9:0:1::/64" };
+    char* members[] = { "10.5.5.5", "10.0.0.0/8", "192.0.2.1", "2001:db8:5::1",
+                        "2001:db8::/33", "2001:db9:0:1::5" };
+    char* non_members[] = { "11.0.0.1", "192.0.2.0/31", "192.0.2.2", "2001:db8::/31",
+                            "2001:db9:0:2::5", "::" };
+    int list_size = sizeof(list) / sizeof(list[0]);
+    ip_prefix prefixes[sizeof(list) / sizeof(list[0])];
+    prefix_set* set;
+    ip_prefix address;
+    int i;
+
+    for( i = 0; i < list_size; i++ )
+    {
+        ck_assert_int_eq(ip_prefix_from_str(list[i], &prefixes[i]), RESULT_SUCCESS);
+    }
+    set = prefix_set_build(prefixes, list_size, 0);
+    ck_assert_ptr_ne(set, NULL);
+
+    /* 10.0.0.0/9 and 10.128.0.0/9 are merged, covered prefixes are dropped */
+    ck_assert_int_eq(set->ipv4.stored_count, 2);
+    ck_assert_int_eq(set->ipv6.stored_count, 2);
+
+    for( i = 0; i < (int)(sizeof(members) / sizeof(members[0])); i++ )
+    {
+        ip_prefix_from_str(members[i], &address);
+        ck_assert_int_eq(prefix_set_contains(set, &address), RESULT_SUCCESS);
+    }
+    for( i = 0; i < (int)(sizeof(non_members) / sizeof(non_members[0])); i++ )
+    {
+        ip_prefix_from_str(non_members[i], &address);
+        ck_assert_int_eq(prefix_set_contains(set, &address), RESULT_FAILURE);
+    }
+
+    prefix_set_free(set);
+
+    /* An empty set contains nothing */
+    set = prefix_set_build(prefixes, 0, 0);
+    ck_assert_ptr_ne(set, NULL);
+    ck_assert_int_eq(prefix_set_contains(set, &address), RESULT_FAILURE);
+    prefix_set_free(set);
+}
+END_TEST
+
+static void count_range(uint32_t first, uint32_t last, void* context)
+{
+    (*(int*)context)++;
+}
+
+START_TEST (test_ipv4_set)
+{
+    ipv4_set* left = ipv4_set_new();
+    ipv4_set* right = ipv4_set_new();
+    ipv4_set* result;
+    uint32_t i;
+    int ranges = 0;
+
+    /* A full container, a short array and a bitmap */
+    ipv4_set_add_range(left, 0x0a000000, 0x0a00ffff);
+    ipv4_set_add_range(left, 0x0a010001, 0x0a010001);
+    ipv4_set_add_range(left, 0x0a010003, 0x0a010003);
+    ipv4_set_add_range(left, 0x0a010005, 0x0a010005);
+    for( i = 0; i < 10000; i += 2 )
+    {
+        ipv4_set_add_range(left, 0x0a020000 + i, 0x0a020000 + i);
+    }
+    ipv4_set_optimize(left);
+    ck_assert_int_eq(left->count, 3);
+    ck_assert_int_eq(left->containers[0].type, CONTAINER_RUN);
+    ck_assert_int_eq(left->containers[1].type, CONTAINER_ARRAY);
+    ck_assert_int_eq(left->containers[2].type, CONTAINER_BITMAP);
+    ck_assert_int_eq(ipv4_set_cardinality(left), 65536 + 3 + 5000);
+
+    ipv4_set_add_range(right, 0x0a008000, 0x0a01ffff);
+    ipv4_set_add_range(right, 0x0a020000, 0x0a0200ff);
+    ipv4_set_optimize(right);
+
+    result = ipv4_set_combine(left, right, SET_UNION);
+    ck_assert_int_eq(ipv4_set_cardinality(result), 2 * 65536 + 128 + 5000);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a01abcd), RESULT_SUCCESS);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a020101), RESULT_FAILURE);
+    /* 10.0.0.0-10.2.1.0, then every other address up to 10.2.39.14 */
+    ipv4_set_ranges(result, count_range, &ranges);
+    ck_assert_int_eq(ranges, 1 + 4871);
+    ipv4_set_free(result);
+
+    result = ipv4_set_combine(left, right, SET_INTERSECTION);
+    ck_assert_int_eq(ipv4_set_cardinality(result), 32768 + 3 + 128);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a007fff), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a008000), RESULT_SUCCESS);
+    ipv4_set_free(result);
+
+    result = ipv4_set_combine(left, right, SET_DIFFERENCE);
+    ck_assert_int_eq(ipv4_set_cardinality(result), 32768 + 5000 - 128);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a010002), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_set_contains(result, 0x0a020100), RESULT_SUCCESS);
+    ipv4_set_free(result);
+
+    ipv4_set_free(left);
+    ipv4_set_free(right);
+}
+END_TEST
+
+static interval_list* interval_list_of(int proto, const ip_interval* intervals, size_t count)
+{
+    interval_list* list = interval_list_new(proto);
+    size_t i;
+
+    for( i = 0; i < count; i++ )
+    {
+        interval_list_add(list, intervals[i].first, intervals[i].last);
+    }
+    interval_list_normalize(list);
+
+    return list;
+}
+
+START_TEST (test_interval_list)
+{
+    /* Overlapping, touching and unsorted intervals */
+    const ip_interval ipv4_left[] = {
+        { { 0, 20 }, { 0, 29 } },
+        { { 0, 0 }, { 0, 9 } },
+        { { 0, 5 }, { 0, 12 } },
+        { { 0, 13 }, { 0, 15 } }
+    };
+    const ip_interval ipv4_right[] = {
+        { { 0, 10 }, { 0, 24 } },
+        { { 0, 30 }, { 0, UINT32_MAX } }
+    };
+    /* The last address of the family, where the sweep has to stop */
+    const ip_interval ipv6_left[] = {
+        { { UINT64_MAX, 0 }, { UINT64_MAX, UINT64_MAX } }
+    };
+    const ip_interval ipv6_right[] = {
+        { { 0, 0 }, { 0, UINT64_MAX } },
+        { { UINT64_MAX, UINT64_MAX }, { UINT64_MAX, UINT64_MAX } }
+    };
+    interval_list* left = interval_list_of(CIDR_IPV4, ipv4_left, 4);
+    interval_list* right = interval_list_of(CIDR_IPV4, ipv4_right, 2);
+    interval_list* result;
+
+    ck_assert_int_eq(left->count, 2);
+    ck_assert_int_eq(left->intervals[0].last.lo, 15);
+
+    result = interval_list_combine(left, right, SET_UNION);
+    ck_assert_int_eq(result->count, 1);
+    ck_assert_int_eq(result->intervals[0].first.lo, 0);
+    ck_assert_int_eq(result->intervals[0].last.lo, UINT32_MAX);
+    interval_list_free(result);
+
+    result = interval_list_combine(left, right, SET_INTERSECTION);
+    ck_assert_int_eq(result->count, 2);
+    ck_assert_int_eq(result->intervals[0].first.lo, 10);
+    ck_assert_int_eq(result->intervals[0].last.lo, 15);
+    ck_assert_int_eq(result->intervals[1].first.lo, 20);
+    ck_assert_int_eq(result->intervals[1].last.lo, 24);
+    interval_list_free(result);
+
+    result = interval_list_combine(left, right, SET_DIFFERENCE);
+    ck_assert_int_eq(result->count, 2);
+    ck_assert_int_eq(result->intervals[0].last.lo, 9);
+    ck_assert_int_eq(result->intervals[1].first.lo, 25);
+    ck_assert_int_eq(result->intervals[1].last.lo, 29);
+    interval_list_free(result);
+
+    result = interval_list_combine(left, right, SET_SYMMETRIC_DIFFERENCE);
+    ck_assert_int_eq(result->count, 3);
+    ck_assert_int_eq(result->intervals[1].first.lo, 16);
+    ck_assert_int_eq(result->intervals[1].last.lo, 19);
+    ck_assert_int_eq(result->intervals[2].first.lo, 25);
+    ck_assert_int_eq(result->intervals[2].last.lo, UINT32_MAX);
+    interval_list_free(result);
+
+    interval_list_free(left);
+    interval_list_free(right);
+
+    left = interval_list_of(CIDR_IPV6, ipv6_left, 1);
+    right = interval_list_of(CIDR_IPV6, ipv6_right, 2);
+
+    result = interval_list_combine(left, right, SET_DIFFERENCE);
+    ck_assert_int_eq(result->count, 1);
+    ck_assert(result->intervals[0].last.hi == UINT64_MAX);
+    ck_assert(result->intervals[0].last.lo == UINT64_MAX - 1);
+    interval_list_free(result);
+
+    result = interval_list_combine(left, right, SET_SYMMETRIC_DIFFERENCE);
+    ck_assert_int_eq(result->count, 2);
+    ck_assert(result->intervals[0].last.lo == UINT64_MAX);
+    ck_assert(result->intervals[1].first.hi == UINT64_MAX);
+    ck_assert(result->intervals[1].first.lo == 0);
+    interval_list_free(result);
+
+    interval_list_free(left);
+    interval_list_free(right);
+}
+END_TEST
+
+START_TEST (test_host_set)
+{
+    ip_value ipv4[600];
+    ip_value ipv6[4];
+    host_set* set;
+    ip_value address = { 0, 0 };
+    size_t count = 0;
+    uint32_t i;
+
+    /* A run of consecutive addresses longer than a block, sparse ones
+       and duplicates */
+    for( i = 0; i < 300; i++ )
+    {
+        ipv4[count].hi = 0;
+        ipv4[count++].lo = 0x0a000000 + i;
+    }
+    for( i = 0; i < 290; i++ )
+    {
+        ipv4[count].hi = 0;
+        ipv4[count++].lo = 0xc0000000 + i * 1000;
+    }
+    for( i = 0; i < 10; i++ )
+    {
+        ipv4[count++] = ipv4[i * 7];
+    }
+
+    ipv6[0].hi = 0x20010db800000000ULL;
+    ipv6[0].lo = 1;
+    ipv6[1].hi = 0x20010db800000000ULL;
+    ipv6[1].lo = 2;
+    ipv6[2].hi = 0x20010db8ffff0000ULL;
+    ipv6[2].lo = 0;
+    ipv6[3].hi = UINT64_MAX;
+    ipv6[3].lo = UINT64_MAX;
+
+    set = host_set_build(ipv4, count, ipv6, 4, 0);
+    ck_assert(set != NULL);
+    ck_assert(set->ipv4.count == 590);
+    ck_assert(set->ipv4.block_count == 5);
+    ck_assert(set->ipv6.count == 4);
+
+    address.lo = 0x0a000000 + 299;
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV4, address), RESULT_SUCCESS);
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 299);
+    address.lo = 0x0a000000 + 300;
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV4, address), RESULT_FAILURE);
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 300);
+    address.lo = 0xc0000000 + 289 * 1000;
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV4, address), RESULT_SUCCESS);
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 589);
+    address.lo = 0xc0000000 + 1500;
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV4, address), RESULT_FAILURE);
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 302);
+    address.lo = 0xffffffff;
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 590);
+    address.lo = 0x09ffffff;
+    ck_assert(host_set_rank(set, CIDR_IPV4, address) == 0);
+
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV6, ipv6[3]), RESULT_SUCCESS);
+    ck_assert(host_set_rank(set, CIDR_IPV6, ipv6[3]) == 3);
+    address.hi = 0x20010db800000000ULL;
+    address.lo = 3;
+    ck_assert_int_eq(host_set_contains(set, CIDR_IPV6, address), RESULT_FAILURE);
+    ck_assert(host_set_rank(set, CIDR_IPV6, address) == 2);
+
+    host_set_free(set);
+}
+END_TEST
+
+
+START_TEST (test_fuse_filter)
+{
+    fuse_filter filter;
+    host_set* set;
+    filter_stats stats;
+    uint64_t* keys;
+    ip_value ipv4[1000];
+    ip_value address;
+    ip_prefix batch[100];
+    int found[100];
+    size_t count = 20000;
+    size_t i;
+    size_t passed = 0;
+
+    keys = malloc(count * sizeof(uint64_t));
+    ck_assert(keys != NULL);
+    address.hi = 0;
+    for( i = 0; i < count; i++ )
+    {
+        address.lo = i * 3;
+        keys[i] = filter_key_address(CIDR_IPV4, address);
+    }
+    ck_assert_int_eq(fuse_filter_build(&filter, keys, count, 8), RESULT_SUCCESS);
+
+    /* No false negatives, and about one in 256 false positives */
+    for( i = 0; i < count; i++ )
+    {
+        address.lo = i * 3;
+        ck_assert(fuse_filter_contains(&filter, filter_key_address(CIDR_IPV4, address)));
+        address.lo = i * 3 + 1;
+        passed += fuse_filter_contains(&filter, filter_key_address(CIDR_IPV4, address));
+    }
+    ck_assert(passed < count / 128);
+    fuse_filter_free(&filter);
+    free(keys);
+
+    /* Host sets answer the same with and without a filter */
+    for( i = 0; i < 1000; i++ )
+    {
+        ipv4[i].hi = 0;
+        ipv4[i].lo = 0x0a000000 + i * 5;
+    }
+    set = host_set_build(ipv4, 1000, NULL, 0, 8);
+    ck_assert(set != NULL);
+    ck_assert(set->has_filter);
+    memset(&stats, 0, sizeof(stats));
+    for( i = 0; i < 5000; i++ )
+    {
+        address.lo = 0x0a000000 + i;
+        ck_assert_int_eq(host_set_lookup(set, CIDR_IPV4, address, &stats),
+                         (i % 5 == 0) ? RESULT_SUCCESS : RESULT_FAILURE);
+    }
+    ck_assert(stats.lookups == 5000);
+    ck_assert(stats.hits == 1000);
+    ck_assert(stats.rejected + stats.false_positives == 4000);
+
+    for( i = 0; i < 100; i++ )
+    {
+        batch[i].proto = CIDR_IPV4;
+        batch[i].pflen = 32;
+        batch[i].addr.hi = 0;
+        batch[i].addr.lo = 0x0a000000 + i;
+    }
+    host_set_lookup_batch(set, batch, 100, found, NULL);
+    for( i = 0; i < 100; i++ )
+    {
+        ck_assert_int_eq(found[i], host_set_contains(set, CIDR_IPV4, batch[i].addr));
+    }
+    host_set_free(set);
+
+    /* Without a filter, the lookups that fail are plain misses */
+    set = host_set_build(ipv4, 1000, NULL, 0, 0);
+    ck_assert(set != NULL);
+    memset(&stats, 0, sizeof(stats));
+    host_set_lookup_batch(set, batch, 100, found, &stats);
+    ck_assert(!stats.filtered);
+    ck_assert(stats.hits == 20);
+    ck_assert(stats.misses == 80);
+    ck_assert(stats.rejected + stats.false_positives == 0);
+    host_set_free(set);
+}
+END_TEST
+
+/* Is an aligned block of a 4096-address pool entirely free? */
+static int pool_block_free(const char* used, int first, int size)
+{
+    int i;
+
+    for( i = first; i < first + size; i++ )
+    {
+        if( used[i] )
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+START_TEST (test_free_space)
+{
+    char used[4096];
+    free_space* space;
+    ip_prefix pool;
+    ip_prefix prefix;
+    uint64_t random_state = 12345;
+    int step;
+    int i;
+
+    memset(used, 0, sizeof(used));
+    ip_prefix_from_str("10.0.0.0/20", &pool);
+    space = free_space_new(&pool);
+    ck_assert(space != NULL);
+
+    /* Allocations outside of the pool are ignored, those covering it fill it */
+    ip_prefix_from_str("10.0.16.0/24", &prefix);
+    ck_assert_int_eq(free_space_reserve(space, &prefix), RESULT_FAILURE);
+    ip_prefix_from_str("2001:db8::/32", &prefix);
+    ck_assert_int_eq(free_space_reserve(space, &prefix), RESULT_FAILURE);
+
+    /* Check either strategy against a model of the pool, one address at a time */
+    for( step = 0; step < 3000; step++ )
+    {
+        int size_bits;
+        int size;
+        int expected = -1;
+        int expected_block = 0;
+        int result;
+
+        random_state = random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_bits = (int)((random_state >> 33) % 7);
+        size = 1 << size_bits;
+
+        if( step % 5 == 0 )
+        {
+            /* An allocation made elsewhere, possibly overlapping earlier ones */
+            int first = (int)((random_state >> 40) % 4096) & ~(size - 1);
+
+            prefix.proto = CIDR_IPV4;
+            prefix.addr.hi = 0;
+            prefix.addr.lo = 0x0a000000 + (uint64_t)first;
+            prefix.pflen = 32 - size_bits;
+            ck_assert_int_eq(free_space_reserve(space, &prefix), RESULT_SUCCESS);
+            memset(used + first, 1, size);
+            continue;
+        }
+
+        for( i = 0; i < 4096; i += size )
+        {
+            int block = size;
+
+            if( !pool_block_free(used, i, size) )
+            {
+                continue;
+            }
+            /* The largest free aligned block around it */
+            while( (block < 4096) && pool_block_free(used, i & ~(block * 2 - 1), block * 2) )
+            {
+                block *= 2;
+            }
+            if( (expected < 0) || ((step % 2 == 1) && (block < expected_block)) )
+            {
+                expected = i;
+                expected_block = block;
+            }
+            if( step % 2 == 0 )
+            {
+                break;
+            }
+        }
+
+        result = free_space_allocate(space, 32 - size_bits,
+                                     (step % 2 == 1) ? ALLOCATE_BEST_FIT : ALLOCATE_LOWEST, &prefix);
+        if( expected < 0 )
+        {
+            ck_assert_int_eq(result, RESULT_FAILURE);
+            continue;
+        }
+        ck_assert_int_eq(result, RESULT_SUCCESS);
+        ck_assert_int_eq(prefix.pflen, 32 - size_bits);
+        ck_assert_int_eq((int)(prefix.addr.lo - 0x0a000000), expected);
+        memset(used + expected, 1, size);
+    }
+
+    free_space_free(space);
+
+    ip_prefix_from_str("::/0", &pool);
+    space = free_space_new(&pool);
+    ck_assert_int_eq(free_space_allocate(space, 128, ALLOCATE_LOWEST, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(free_space_allocate(space, 0, ALLOCATE_LOWEST, &prefix), RESULT_FAILURE);
+    ck_assert_int_eq(free_space_allocate(space, 1, ALLOCATE_BEST_FIT, &prefix), RESULT_SUCCESS);
+    ck_assert(prefix.addr.hi == 0x8000000000000000ULL);
+    free_space_free(space);
+}
+END_TEST
+
+START_TEST (test_subnet_plan)
+{
+    int lengths[] = { 26, 24, 30, 30, 25, 24 };
+    plan_request requests[6];
+    ip_prefix parent;
+    char prefix_str[PREFIX_STR_MAX];
+    int i;
+    int j;
+
+    ip_prefix_from_str("10.1.0.0/22", &parent);
+    for( i = 0; i < 6; i++ )
+    {
+        requests[i].pflen = lengths[i];
+        requests[i].label = NULL;
+        requests[i].index = (size_t)i;
+    }
+    ck_assert_int_eq(subnet_plan(&parent, requests, 6), RESULT_SUCCESS);
+
+    /* Requests stay in order, get the largest blocks first and never overlap */
+    ck_assert_str_eq(ip_prefix_to_str(&requests[0].prefix, prefix_str), "10.1.2.128/26");
+    ck_assert_str_eq(ip_prefix_to_str(&requests[1].prefix, prefix_str), "10.1.0.0/24");
+    ck_assert_str_eq(ip_prefix_to_str(&requests[5].prefix, prefix_str), "10.1.1.0/24");
+    for( i = 0; i < 6; i++ )
+    {
+        ck_assert_int_eq(requests[i].index, i);
+        ck_assert_int_eq(ip_prefix_is_network(&requests[i].prefix), RESULT_SUCCESS);
+        ck_assert_int_eq(ip_prefix_contains(&parent, &requests[i].prefix), RESULT_SUCCESS);
+        for( j = 0; j < i; j++ )
+        {
+            ck_assert_int_eq(ip_prefix_contains(&requests[i].prefix, &requests[j].prefix), RESULT_FAILURE);
+            ck_assert_int_eq(ip_prefix_contains(&requests[j].prefix, &requests[i].prefix), RESULT_FAILURE);
+        }
+    }
+
+    /* One /26 more than fits, and the whole IPv6 space in two halves */
+    ip_prefix_from_str("10.1.0.0/24", &parent);
+    for( i = 0; i < 5; i++ )
+    {
+        requests[i].pflen = 26;
+        requests[i].index = (size_t)i;
+    }
+    ck_assert_int_eq(subnet_plan(&parent, requests, 4), RESULT_SUCCESS);
+    ck_assert_int_eq(subnet_plan(&parent, requests, 5), RESULT_FAILURE);
+
+    ip_prefix_from_str("::/0", &parent);
+    requests[0].pflen = 1;
+    requests[1].pflen = 1;
+    requests[2].pflen = 128;
+    ck_assert_int_eq(subnet_plan(&parent, requests, 2), RESULT_SUCCESS);
+    ck_assert_str_eq(ip_prefix_to_str(&requests[1].prefix, prefix_str), "8000::/1");
+    ck_assert_int_eq(subnet_plan(&parent, requests, 3), RESULT_FAILURE);
+}
+END_TEST
+
+START_TEST (test_pool_usage)
+{
+    uint64_t first_leased[1] = { 0 };
+    uint64_t second_leased[2] = { 0, 0 };
+    lease_pool pools[2];
+    uint32_t starts[2];
+    pool_usage usage;
+    const char* end;
+    uint32_t address;
+
+    ck_assert_int_eq(ipv4_value_from_str("192.0.2.10-192.0.2.20", &end, &address), RESULT_SUCCESS);
+    ck_assert_int_eq(address, 0xc000020a);
+    ck_assert_str_eq(end, "-192.0.2.20");
+    ck_assert_int_eq(ipv4_value_from_str("0.0.0.0", &end, &address), RESULT_SUCCESS);
+    ck_assert_int_eq(ipv4_value_from_str("255.255.255.255", &end, &address), RESULT_SUCCESS);
+    ck_assert_int_eq(address, 0xffffffff);
+    ck_assert_int_eq(ipv4_value_from_str("256.0.0.1", &end, &address), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_value_from_str("10.01.0.1", &end, &address), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_value_from_str("10.0.1", &end, &address), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_value_from_str("10..0.1", &end, &address), RESULT_FAILURE);
+    ck_assert_int_eq(ipv4_value_from_str("", &end, &address), RESULT_FAILURE);
+
+    /* 10.0.0.10-10.0.0.19 and 10.0.1.0-10.0.1.99 */
+    memset(pools, 0, sizeof(pools));
+    pools[0].first = 0x0a00000a;
+    pools[0].last = 0x0a000013;
+    pools[0].leased = first_leased;
+    pools[1].first = 0x0a000100;
+    pools[1].last = 0x0a000163;
+    pools[1].leased = second_leased;
+    starts[0] = pools[0].first;
+    starts[1] = pools[1].first;
+    usage.pools = pools;
+    usage.starts = starts;
+    usage.count = 2;
+    usage.out_of_pool = 0;
+
+    pool_usage_add_lease(&usage, 0x0a00000a);
+    pool_usage_add_lease(&usage, 0x0a000013);
+    pool_usage_add_lease(&usage, 0x0a00000a);
+    pool_usage_add_lease(&usage, 0x0a000163);
+    pool_usage_add_lease(&usage, 0x0a000140);
+    pool_usage_add_lease(&usage, 0x0a000140);
+    pool_usage_add_lease(&usage, 0x0a000140);
+
+    /* Before the first range, in the gap between them, after the last */
+    pool_usage_add_lease(&usage, 0x0a000009);
+    pool_usage_add_lease(&usage, 0x0a000014);
+    pool_usage_add_lease(&usage, 0x0a000164);
+    pool_usage_add_lease(&usage, 0xffffffff);
+
+    ck_assert_int_eq(pools[0].used, 2);
+    ck_assert_int_eq(pools[0].duplicates, 1);
+    ck_assert_int_eq(pools[1].used, 2);
+    ck_assert_int_eq(pools[1].duplicates, 2);
+    ck_assert_int_eq(usage.out_of_pool, 4);
+    ck_assert_int_eq(first_leased[0], 0x201);
+}
+END_TEST
+
+START_TEST (test_redundant_entries)
+{
+    char* texts[] = { "10.1.2.3", "10.1.0.0/16", "10.1.2.3/32", "10.1.2.2/31", "192.0.2.0/25",
+                      "192.0.2.128/25", "2001:db8::1", "2001:db8::/32", "2001:DB8:0::1", "::/0" };
+    uint32_t expected[] = { 1, COVERAGE_NONE, 1, 1, COVERAGE_NONE,
+                          COVERAGE_NONE, 9, 9, 9, COVERAGE_NONE };
+    group_entry entries[10];
+    size_t redundant_count;
+    size_t i;
+
+    for( i = 0; i < 10; i++ )
+    {
+        ck_assert_int_eq(ip_prefix_from_str(texts[i], &entries[i].prefix), RESULT_SUCCESS);
+        entries[i].text = texts[i];
+    }
+
+    /* Covered entries get the shortest entry over them, duplicates the first spelling */
+    ck_assert_int_eq(find_redundant_entries(entries, 10, &redundant_count), RESULT_SUCCESS);
+    ck_assert_int_eq(redundant_count, 6);
+    for( i = 0; i < 10; i++ )
+    {
+        ck_assert_int_eq(entries[i].covered_by, expected[i]);
+    }
+
+    /* Without the network over them, the second spelling of a host is the redundant one */
+    entries[1] = entries[2];
+    ck_assert_int_eq(find_redundant_entries(entries, 2, &redundant_count), RESULT_SUCCESS);
+    ck_assert_int_eq(redundant_count, 1);
+    ck_assert_int_eq(entries[0].covered_by, COVERAGE_NONE);
+    ck_assert_int_eq(entries[1].covered_by, 0);
+}
+END_TEST
+
+START_TEST (test_policy_analyze)
+{
+    char* rules[][2] = { { "permit", "10.0.0.0/8" }, { "deny", "10.1.0.0/16" },
+                         { "permit", "10.1.2.0/24" }, { "deny", "192.168.0.0/24" },
+                         { "deny", "192.168.1.0/24" }, { "deny", "192.168.0.0/23" },
+                         { "permit", "rfc1918" }, { "deny", "any" }, { "permit", "::/0" } };
+    int statuses[] = { POLICY_RULE_EFFECTIVE, POLICY_RULE_SHADOWED, POLICY_RULE_REDUNDANT,
+                       POLICY_RULE_EFFECTIVE, POLICY_RULE_EFFECTIVE, POLICY_RULE_REDUNDANT,
+                       POLICY_RULE_EFFECTIVE, POLICY_RULE_EFFECTIVE, POLICY_RULE_SHADOWED };
+    int covering[] = { -1, 0, 0, -1, -1, 4, -1, -1, 7 };
+    policy_rule_analysis results[9];
+    address_policy* policy = policy_new();
+    char match_str[PREFIX_STR_MAX];
+    int i;
+
+    for( i = 0; i < 9; i++ )
+    {
+        ck_assert_int_eq(policy_add_rule(policy, rules[i][0], rules[i][1], NULL), RESULT_SUCCESS);
+    }
+
+    /* The covering rule of a shadowed rule is the last one with the other verdict */
+    ck_assert_int_eq(policy_analyze(policy, results), RESULT_SUCCESS);
+    for( i = 0; i < 9; i++ )
+    {
+        ck_assert_int_eq(results[i].status, statuses[i]);
+        ck_assert_int_eq(results[i].covering_rule, covering[i]);
+    }
+    ck_assert_str_eq(policy_rule_match_str(&policy->rules[6], match_str), "rfc1918");
+    ck_assert_str_eq(policy_rule_match_str(&policy->rules[1], match_str), "10.1.0.0/16");
+
+    policy_free(policy);
+}
+END_TEST
+
+START_TEST (test_prefix_relations)
+{
+    ip_prefix net8;
+    ip_prefix net16;
+    ip_prefix other;
+    ip_prefix host;
+    ip_prefix ipv6;
+
+    ip_prefix_from_str("10.0.0.0/8", &net8);
+    ip_prefix_from_str("10.1.0.0/16", &net16);
+    ip_prefix_from_str("11.0.0.0/8", &other);
+    ip_prefix_from_str("10.1.2.3", &host);
+    ip_prefix_from_str("a01:0203::/16", &ipv6);
+
+    ck_assert_int_eq(ip_prefix_overlaps(&net8, &net16), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_overlaps(&net16, &net8), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_overlaps(&net16, &host), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_overlaps(&net8, &other), RESULT_FAILURE);
+    ck_assert_int_eq(ip_prefix_overlaps(&net8, &ipv6), RESULT_FAILURE);
+
+    ck_assert_int_eq(ip_prefix_same_subnet(&net16, &host, 16), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_same_subnet(&net16, &host, 17), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_same_subnet(&net16, &host, 23), RESULT_FAILURE);
+    ck_assert_int_eq(ip_prefix_same_subnet(&net8, &other, 7), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_same_subnet(&net8, &other, 8), RESULT_FAILURE);
+    ck_assert_int_eq(ip_prefix_same_subnet(&host, &host, 32), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_same_subnet(&host, &host, 33), RESULT_FAILURE);
+    ck_assert_int_eq(ip_prefix_same_subnet(&net8, &ipv6, 0), RESULT_FAILURE);
+}
+END_TEST
+
+START_TEST (test_native_parser)
+{
+    /* Inputs at the edges of both parsers, with the verdict of the native one */
+    static const struct
+    {
+        const char* input;
+        int native;
+    } cases[] =
+    {
+        { "192.0.2.1", 1 },          { "192.0.2.0/24", 1 },      { "0.0.0.0/0", 1 },
+        { "255.255.255.255/32", 1 }, { "010.0.0.1", 0 },         { "10.0.0.01", 0 },
+        { "10.0.0.0/08", 0 },        { "10.0.0.0/00", 0 },       { "10.0.0.0/033", 0 },
+        { "10.0.0.0/33", 0 },        { "10.0.0.256", 0 },        { "10.0.0", 0 },
+        { "10.0.0.0/", 0 },          { "10.0.0.0/24/24", 0 },    { " 10.0.0.1", 0 },
+        { "1::2:3:4:5:6:7", 1 },     { "1:2:3:4:5:6:7::", 1 },   { "::2:3:4:5:6:7:8", 1 },
+        { "1:2:3:4:5:6:7:8", 1 },    { "1:2:3:4:5:6:7:8:9", 0 }, { "1:2:3:4:5:6:7", 0 },
+        { "2001:DB8::1", 1 },        { "2001:dB8:0:0::/64", 1 }, { "2001:db8::/064", 0 },
+        { "2001:db8::/129", 0 },     { "2001:00db8::1", 0 },     { "1::2::3", 0 },
+        { ":1::", 0 },               { "1:::2", 0 },             { "::", 1 },
+        { "::1/128", 1 },            { "::ffff:192.0.2.1", 0 },  { "64:ff9b::192.0.2.1/96", 0 },
+        { "fe80::1%eth0", 0 },       { "fe80::1%1/64", 0 },      { "", 0 },
+        { "foo", 0 },                { "g::1", 0 }
+    };
+    size_t i = 0;
+
+    for( i = 0; i < sizeof(cases) / sizeof(cases[0]); i++ )
+    {
+        char input_str[PREFIX_STR_MAX];
+        ip_prefix native = { 0, { 0, 0 }, 0 };
+        ip_prefix fallback = { 0, { 0, 0 }, 0 };
+        ip_prefix parsed = { 0, { 0, 0 }, 0 };
+        int native_result = ip_prefix_from_native_str(cases[i].input, &native);
+        int fallback_result = 0;
+
+        strcpy(input_str, cases[i].input);
+        fallback_result = ip_prefix_from_cidr_str(input_str, &fallback);
+        ck_assert_int_eq(native_result, cases[i].native ? RESULT_SUCCESS : RESULT_FAILURE);
+
+        /* Whatever the native parser takes, the fallback takes the same way */
+        if( native_result == RESULT_SUCCESS )
+        {
+            ck_assert_int_eq(fallback_result, RESULT_SUCCESS);
+            ck_assert_int_eq(native.proto, fallback.proto);
+            ck_assert_int_eq(native.pflen, fallback.pflen);
+            ck_assert(ip_value_eq(native.addr, fallback.addr));
+        }
+
+        /* and the combination decides like the fallback alone */
+        ck_assert_int_eq(ip_prefix_from_str(input_str, &parsed), fallback_result);
+        if( fallback_result == RESULT_SUCCESS )
+        {
+            ck_assert(ip_prefix_cmp(&parsed, &fallback) == 0);
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_range_from_str)
+{
+    ip_range range;
+    const char* end = NULL;
+    ip_value value;
+
+    ck_assert_int_eq(ipv6_value_from_str("2001:db8::1", &end, &value), RESULT_SUCCESS);
+    ck_assert(value.hi == 0x20010db800000000ULL && value.lo == 1);
+    ck_assert_int_eq(ipv6_value_from_str("::", &end, &value), RESULT_SUCCESS);
+    ck_assert(value.hi == 0 && value.lo == 0 && *end == '\0');
+    ck_assert_int_eq(ipv6_value_from_str("1:2:3:4:5:6:7::", &end, &value), RESULT_SUCCESS);
+    ck_assert(value.hi == 0x0001000200030004ULL && value.lo == 0x0005000600070000ULL);
+    ck_assert_int_eq(ipv6_value_from_str("1:2:3:4:5:6:7:8::", &end, &value), RESULT_FAILURE);
+    ck_assert_int_eq(ipv6_value_from_str("1::2::3", &end, &value), RESULT_FAILURE);
+    ck_assert_int_eq(ipv6_value_from_str("1:2", &end, &value), RESULT_FAILURE);
+    ck_assert_int_eq(ipv6_value_from_str("12345::", &end, &value), RESULT_FAILURE);
+    ck_assert_int_eq(ipv6_value_from_str(":1::", &end, &value), RESULT_FAILURE);
+
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1-192.0.2.10", CIDR_IPV4, &range), RANGE_VALID);
+    ck_assert(range.first.lo == 0xc0000201 && range.last.lo == 0xc000020a);
+    ck_assert_int_eq(range.first_length, 9);
+    ck_assert_int_eq(ip_range_within_prefix(&range, 28), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_range_within_prefix(&range, 29), RESULT_FAILURE);
+
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1", CIDR_IPV4, &range), RANGE_MALFORMED);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1-", CIDR_IPV4, &range), RANGE_MALFORMED);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1-2-3", CIDR_IPV4, &range), RANGE_MALFORMED);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.a-192.0.2.3", CIDR_IPV4, &range), RANGE_MALFORMED);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.256-192.0.2.3", CIDR_IPV4, &range), RANGE_BAD_FIRST);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1-192.0.2.03", CIDR_IPV4, &range), RANGE_BAD_LAST);
+    ck_assert_int_eq(range.first_length, 9);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.9-192.0.2.3", CIDR_IPV4, &range), RANGE_REVERSED);
+
+    ck_assert_int_eq(ip_range_from_str("2001:db8::1-2001:db8::ffff", CIDR_IPV6, &range), RANGE_VALID);
+    ck_assert_int_eq(ip_range_within_prefix(&range, 112), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_range_within_prefix(&range, 113), RESULT_FAILURE);
+    ck_assert_int_eq(ip_range_from_str("::-ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", CIDR_IPV6, &range), RANGE_VALID);
+    ck_assert_int_eq(ip_range_within_prefix(&range, 1), RESULT_FAILURE);
+    ck_assert_int_eq(ip_range_from_str("2001:db8::1-2001:db8:::2", CIDR_IPV6, &range), RANGE_BAD_LAST);
+    ck_assert_int_eq(ip_range_from_str("2001:db8::2-2001:db8::1", CIDR_IPV6, &range), RANGE_REVERSED);
+    ck_assert_int_eq(ip_range_from_str("192.0.2.1-192.0.2.2", CIDR_IPV6, &range), RANGE_MALFORMED);
+}
+END_TEST
+
+START_TEST (test_address_count)
+{
+    address_counter* counter = address_counter_new(CIDR_IPV6);
+    address_totals totals;
+    ip_count count;
+    ip_prefix prefix;
+    ip_range range;
+    char buffer[COUNT_STR_MAX];
+
+    memset(&count, 0, sizeof(count));
+    ck_assert_str_eq(ip_count_to_str(&count, buffer), "0");
+    count.value.hi = UINT64_MAX;
+    count.value.lo = UINT64_MAX;
+    ip_count_add_small(&count, 1);
+    ck_assert_str_eq(ip_count_to_str(&count, buffer), "340282366920938463463374607431768211456");
+    ip_count_sub_small(&count, 2);
+    ck_assert_str_eq(ip_count_to_str(&count, buffer), "340282366920938463463374607431768211454");
+    count.top = 0;
+    count.value.hi = 0;
+    count.value.lo = 1000000000;
+    ck_assert_str_eq(ip_count_to_str(&count, buffer), "1000000000");
+
+    /* A /48 and one of its /64s, plus a range that ends in the next /48 */
+    ck_assert_int_eq(ip_prefix_from_str("2001:db8::/48", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("2001:db8::/64", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_range_from_str("2001:db8:1::-2001:db8:1:1::5", CIDR_IPV6, &range), RANGE_VALID);
+    ck_assert_int_eq(address_counter_add_range(counter, range.first, range.last), RESULT_SUCCESS);
+    address_counter_totals(counter, 64, &totals);
+    ck_assert_str_eq(ip_count_to_str(&totals.addresses, buffer), "1208944266358702884257798");
+    ck_assert_str_eq(ip_count_to_str(&totals.hosts, buffer), "1208944266358702884257797");
+    ck_assert_str_eq(ip_count_to_str(&totals.units, buffer), "65537");
+    address_counter_free(counter);
+
+    /* Network and broadcast addresses, but not of /31 and /32 */
+    counter = address_counter_new(CIDR_IPV4);
+    ck_assert_int_eq(ip_prefix_from_str("192.0.2.0/25", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("192.0.2.0/24", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("198.51.100.0/31", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("198.51.100.7/32", &prefix), RESULT_SUCCESS);
+    ck_assert_int_eq(address_counter_add_prefix(counter, &prefix), RESULT_SUCCESS);
+    address_counter_totals(counter, 25, &totals);
+    ck_assert_str_eq(ip_count_to_str(&totals.addresses, buffer), "259");
+    ck_assert_str_eq(ip_count_to_str(&totals.hosts, buffer), "256");
+    ck_assert_str_eq(ip_count_to_str(&totals.units, buffer), "2");
+    address_counter_free(counter);
+}
+END_TEST
+
+START_TEST (test_expand)
+{
+    FILE* stream = tmpfile();
+    expand_writer* writer = NULL;
+    ip_range range;
+    char output[512];
+    size_t length = 0;
+
+    ck_assert(stream != NULL);
+    writer = expand_writer_new(stream);
+    ck_assert(writer != NULL);
+
+    /* Across a /24 boundary */
+    ck_assert_int_eq(ip_range_from_str("192.0.2.254-192.0.3.1", CIDR_IPV4, &range), RANGE_VALID);
+    ck_assert_int_eq(expand_addresses(writer, CIDR_IPV4, range.first, range.last), RESULT_SUCCESS);
+    /* Across a group boundary, through a zero last group */
+    ck_assert_int_eq(ip_range_from_str("2001:db8::fffe-2001:db8::1:1", CIDR_IPV6, &range), RANGE_VALID);
+    ck_assert_int_eq(expand_addresses(writer, CIDR_IPV6, range.first, range.last), RESULT_SUCCESS);
+    /* Whole /30s only */
+    ck_assert_int_eq(ip_range_from_str("10.0.0.1-10.0.0.12", CIDR_IPV4, &range), RANGE_VALID);
+    ck_assert_int_eq(expand_prefixes(writer, CIDR_IPV4, range.first, range.last, 30), RESULT_SUCCESS);
+    /* Not even one whole /28 */
+    ck_assert_int_eq(expand_prefixes(writer, CIDR_IPV4, range.first, range.last, 28), RESULT_FAILURE);
+    /* Up to the end of the address space */
+    ck_assert_int_eq(ip_range_from_str("ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe-ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff",
+                                       CIDR_IPV6, &range), RANGE_VALID);
+    ck_assert_int_eq(expand_prefixes(writer, CIDR_IPV6, range.first, range.last, 128), RESULT_SUCCESS);
+    ck_assert_int_eq(expand_writer_flush(writer), RESULT_SUCCESS);
+
+    rewind(stream);
+    length = fread(output, 1, sizeof(output) - 1, stream);
+    output[length] = '\0';
+    ck_assert_str_eq(output,
+                     "192.0.2.254\n192.0.2.255\n192.0.3.0\n192.0.3.1\n"
+                     "2001:db8::fffe\n2001:db8::ffff\n2001:db8::1:0\n2001:db8::1:1\n"
+                     "10.0.0.4/30\n10.0.0.8/30\n"
+                     "ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe/128\nffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff/128\n");
+
+    expand_writer_free(writer);
+    fclose(stream);
+}
+END_TEST
+
+START_TEST (test_address_classes)
+{
+    static const struct
+    {
+        char* prefix_str;
+        unsigned int address_class;
+    } class_prefixes[] =
+    {
+        { IPV4_MULTICAST, ADDRESS_CLASS_MULTICAST },
+        { IPV4_LOOPBACK, ADDRESS_CLASS_LOOPBACK },
+        { IPV4_LINKLOCAL, ADDRESS_CLASS_LINK_LOCAL },
+        { IPV4_RFC1918_A, ADDRESS_CLASS_RFC1918 },
+        { IPV4_RFC1918_B, ADDRESS_CLASS_RFC1918 },
+        { IPV4_RFC1918_C, ADDRESS_CLASS_RFC1918 },
+        { IPV4_THIS, ADDRESS_CLASS_THIS_NETWORK },
+        { IPV4_LIMITED_BROADCAST, ADDRESS_CLASS_LIMITED_BROADCAST },
+        { IPV6_MULTICAST, ADDRESS_CLASS_MULTICAST },
+        { IPV6_LINKLOCAL, ADDRESS_CLASS_LINK_LOCAL },
+        { IPV6_LOOPBACK, ADDRESS_CLASS_LOOPBACK }
+    };
+    const int class_prefix_count = sizeof(class_prefixes) / sizeof(class_prefixes[0]);
+    const int lengths[] = { 3, 4, 8, 12, 16, 17, 24, 32 };
+    const uint32_t low_bits[] = { 0x0000, 0x0001, 0xfffe, 0xffff };
+    ip_prefix classes[11];
+    ip_prefix batch[3];
+    unsigned int batch_classes[3];
+    uint32_t bucket = 0;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+
+    for( k = 0; k < class_prefix_count; k++ )
+    {
+        ck_assert_int_eq(ip_prefix_from_str(class_prefixes[k].prefix_str, &classes[k]), RESULT_SUCCESS);
+    }
+
+    /* Every IPv4 bucket, both ends of it, and prefixes of various lengths */
+    for( bucket = 0; bucket < 0x10000; bucket++ )
+    {
+        for( i = 0; i < 4; i++ )
+        {
+            for( j = 0; j < 8; j++ )
+            {
+                ip_prefix prefix = { CIDR_IPV4, { 0, (bucket << 16) | low_bits[i] }, lengths[j] };
+                unsigned int expected = 0;
+
+                for( k = 0; k < class_prefix_count; k++ )
+                {
+                    if( (classes[k].proto == CIDR_IPV4) && ip_prefix_contains(&classes[k], &prefix) )
+                    {
+                        expected |= class_prefixes[k].address_class;
+                    }
+                }
+                ck_assert_uint_eq(ip_prefix_classes(&prefix), expected);
+            }
+        }
+    }
+
+    ck_assert_int_eq(ip_prefix_from_str("fe80::1", &batch[0]), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("fe80:0:0:1::1", &batch[1]), RESULT_SUCCESS);
+    ck_assert_int_eq(ip_prefix_from_str("::1", &batch[2]), RESULT_SUCCESS);
+    ip_prefix_classes_batch(batch, 3, batch_classes);
+    ck_assert_uint_eq(batch_classes[0], ADDRESS_CLASS_LINK_LOCAL);
+    ck_assert_uint_eq(batch_classes[1], 0);
+    ck_assert_uint_eq(batch_classes[2], ADDRESS_CLASS_LOOPBACK);
+    ck_assert_int_eq(ip_prefix_from_str("ff00::/7", &batch[0]), RESULT_SUCCESS);
+    ck_assert_uint_eq(ip_prefix_classes(&batch[0]), 0);
+    ck_assert_int_eq(ip_prefix_from_str("ff02::/16", &batch[0]), RESULT_SUCCESS);
+    ck_assert_uint_eq(ip_prefix_classes(&batch[0]), ADDRESS_CLASS_MULTICAST);
+
+    ck_assert_str_eq(address_class_name(ADDRESS_CLASS_RFC1918), "rfc1918");
+    ck_assert(address_class_name(ADDRESS_CLASS_RFC1918 | ADDRESS_CLASS_LOOPBACK) == NULL);
+}
+END_TEST
+
+START_TEST (test_ipv4_properties)
+{
+    /* Class boundaries and the ends of the address space, then random addresses */
+    static const uint32_t edges[] =
+    {
+        0x00000000, 0x00ffffff, 0x01000000, 0x0a000000, 0x0affffff, 0x7f000001, 0x7fffffff,
+        0xa9fe0000, 0xa9feffff, 0xac100000, 0xac1fffff, 0xac200000, 0xc0a80000, 0xc0a8ffff,
+        0xdfffffff, 0xe0000000, 0xefffffff, 0xf0000000, 0xfffffffe, 0xffffffff
+    };
+    const int edge_count = sizeof(edges) / sizeof(edges[0]);
+    /* Not a multiple of any vector width, so that the tail is covered too */
+    enum { ADDRESS_COUNT = 1013 };
+    uint32_t addrs[ADDRESS_COUNT];
+    uint8_t pflens[ADDRESS_COUNT];
+    uint16_t expected[ADDRESS_COUNT];
+    uint16_t properties[ADDRESS_COUNT];
+    /* Every kernel, not just the widest one, which leaves the others only its tail */
+    static const int kernels[] = { IPV4_KERNEL_SCALAR, IPV4_KERNEL_AVX2, IPV4_KERNEL_AVX512 };
+    int kernel_count = 0;
+    uint32_t seed = 12345;
+    int i = 0;
+    int k = 0;
+
+    for( i = 0; i < ADDRESS_COUNT; i++ )
+    {
+        seed = seed * 1103515245 + 12345;
+        addrs[i] = (i < edge_count * 33) ? edges[i / 33] : (seed ^ (seed << 13));
+        pflens[i] = (uint8_t)((i < edge_count * 33) ? (i % 33) : ((seed >> 8) % 33));
+    }
+
+    for( i = 0; i < ADDRESS_COUNT; i++ )
+    {
+        char address_str[PREFIX_STR_MAX];
+        ip_prefix prefix = { CIDR_IPV4, { 0, addrs[i] }, pflens[i] };
+        CIDR* address = NULL;
+        unsigned int bits = ip_prefix_classes(&prefix);
+
+        ip_prefix_to_str(&prefix, address_str);
+        address = cidr_from_str(address_str);
+        ck_assert(address != NULL);
+
+        if( is_ipv4_net(address) == RESULT_SUCCESS )
+        {
+            bits |= ADDRESS_PROPERTY_NETWORK;
+        }
+        if( is_ipv4_broadcast(address) == RESULT_SUCCESS )
+        {
+            bits |= ADDRESS_PROPERTY_BROADCAST;
+        }
+        if( is_ipv4_host(address) == RESULT_SUCCESS )
+        {
+            bits |= ADDRESS_PROPERTY_HOST;
+        }
+        if( is_valid_intf_address(address, address_str, LOOPBACK_ALLOWED) == RESULT_SUCCESS )
+        {
+            bits |= ADDRESS_PROPERTY_INTERFACE;
+        }
+        expected[i] = (uint16_t)bits;
+        cidr_free(address);
+    }
+
+    for( k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++ )
+    {
+        if( ipv4_properties_kernel_for_test(kernels[k]) != RESULT_SUCCESS )
+        {
+            continue;
+        }
+        kernel_count++;
+        memset(properties, 0xff, sizeof(properties));
+        ipv4_properties_batch(addrs, pflens, ADDRESS_COUNT, properties);
+        for( i = 0; i < ADDRESS_COUNT; i++ )
+        {
+            ck_assert_uint_eq(properties[i], expected[i]);
+        }
+    }
+    ipv4_properties_kernel_for_test(IPV4_KERNEL_BEST);
+    ck_assert_int_ge(kernel_count, 1);
+}
+END_TEST
+
+START_TEST (test_address_properties)
+{
+    char* addresses[] =
+    {
+        "2001:db8::/32", "2001:db8::1/32", "2001:db8::/127", "2001:db8::1/128", "::/0", "::1",
+        "::1/127", "::/128", "fe80::1/64", "fe80::/64", "ff02::1", "ff02::/16",
+        "192.0.2.0/24", "192.0.2.255/24", "192.0.2.1/24", "127.0.0.1/8", "255.255.255.255/32",
+        "0.0.0.1/8", "10.0.0.0/31", NULL
+    };
+    int i = 0;
+
+    for( i = 0; addresses[i] != NULL; i++ )
+    {
+        ip_prefix prefix;
+        CIDR* address = cidr_from_str(addresses[i]);
+        unsigned int expected = 0;
+
+        ck_assert_int_eq(ip_prefix_from_str(addresses[i], &prefix), RESULT_SUCCESS);
+        expected = ip_prefix_classes(&prefix);
+        if( (is_ipv4_net(address) == RESULT_SUCCESS) || (is_ipv6_net(address) == RESULT_SUCCESS) )
+        {
+            expected |= ADDRESS_PROPERTY_NETWORK;
+        }
+        if( is_ipv4_broadcast(address) == RESULT_SUCCESS )
+        {
+            expected |= ADDRESS_PROPERTY_BROADCAST;
+        }
+        if( is_any_host(address) == RESULT_SUCCESS )
+        {
+            expected |= ADDRESS_PROPERTY_HOST;
+        }
+        if( is_valid_intf_address(address, addresses[i], LOOPBACK_ALLOWED) == RESULT_SUCCESS )
+        {
+            expected |= ADDRESS_PROPERTY_INTERFACE;
+        }
+        ck_assert_uint_eq(ip_prefix_properties(&prefix), expected);
+        cidr_free(address);
+    }
+}
+END_TEST
 
 Suite *ipaddrcheck_suite(void)
 {
@@ -464,6 +1821,28 @@ Suite *ipaddrcheck_suite(void)
     tcase_add_test(tc_core, test_is_any_host);
     tcase_add_test(tc_core, test_is_any_net);
     tcase_add_test(tc_core, test_is_ipv4_range);
+    tcase_add_test(tc_core, test_lpm_lookup);
+    tcase_add_test(tc_core, test_policy_compile);
+    tcase_add_test(tc_core, test_lpm_handle_reload);
+    tcase_add_test(tc_core, test_lpm_watcher_reload);
+    tcase_add_test(tc_core, test_prefix_set);
+    tcase_add_test(tc_core, test_ipv4_set);
+    tcase_add_test(tc_core, test_interval_list);
+    tcase_add_test(tc_core, test_host_set);
+    tcase_add_test(tc_core, test_fuse_filter);
+    tcase_add_test(tc_core, test_free_space);
+    tcase_add_test(tc_core, test_subnet_plan);
+    tcase_add_test(tc_core, test_pool_usage);
+    tcase_add_test(tc_core, test_redundant_entries);
+    tcase_add_test(tc_core, test_policy_analyze);
+    tcase_add_test(tc_core, test_prefix_relations);
+    tcase_add_test(tc_core, test_native_parser);
+    tcase_add_test(tc_core, test_range_from_str);
+    tcase_add_test(tc_core, test_address_count);
+    tcase_add_test(tc_core, test_expand);
+    tcase_add_test(tc_core, test_address_classes);
+    tcase_add_test(tc_core, test_ipv4_properties);
+    tcase_add_test(tc_core, test_address_properties);
 
     suite_add_tcase(s, tc_core);
 
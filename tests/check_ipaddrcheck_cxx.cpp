@@ -0,0 +1,150 @@
+/*
+ * check_ipaddrcheck_cxx.cpp: unit tests of the C++ interface
+ *
+ * Copyright (C) 2018-2024 VyOS maintainers and contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 or later as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <check.h>
+#include "../src/ipaddrcheck.hpp"
+
+using namespace ipaddrcheck;
+using namespace ipaddrcheck::literals;
+
+/* Everything here is checked by the compiler, a failure does not build */
+static_assert("10.0.0.0/8"_ipv4.length() == 8, "length");
+static_assert("10.0.0.0/8"_ipv4.address().lo == 0x0a000000, "address");
+static_assert("192.0.2.1"_ipv4.length() == 32, "an address is a full-length prefix");
+static_assert("10.0.0.0/8"_ipv4.is_rfc1918(), "rfc1918");
+static_assert("172.16.0.0/12"_ipv4.is_rfc1918() && !"172.16.0.0/11"_ipv4.is_rfc1918(), "rfc1918 boundary");
+static_assert(!"192.0.2.1"_ipv4.is_rfc1918(), "not rfc1918");
+static_assert("127.0.0.1"_ipv4.is_loopback() && "::1"_ipv6.is_loopback(), "loopback");
+static_assert("ff02::1"_ipv6.is_multicast() && "224.0.0.5"_ipv4.is_multicast(), "multicast");
+static_assert("fe80::1"_ipv6.is_link_local() && !"fe80::/10"_ipv6.is_link_local(), "link-local");
+static_assert("10.0.0.0/8"_ipv4.contains("10.1.2.3"_ipv4) && !"10.0.0.0/8"_ipv4.contains("10.0.0.0/7"_ipv4),
+              "contains");
+static_assert("2001:db8::/32"_ipv6.contains("2001:DB8:0:0::1"_ipv6), "contains, IPv6");
+static_assert("192.0.2.0/24"_ipv4.is_network() && !"192.0.2.1/24"_ipv4.is_network(), "network");
+static_assert("192.0.2.255/24"_ipv4.properties() & ADDRESS_PROPERTY_BROADCAST, "broadcast");
+static_assert("192.0.2.1/24"_ipv4.is_interface() && !"224.0.0.1/4"_ipv4.is_interface(), "interface");
+static_assert("2001:db8::1/64"_ipv6.is_interface() && !"::1/128"_ipv6.is_interface(), "interface, IPv6");
+static_assert("10.0.0.0/8"_cidr.proto() == CIDR_IPV4 && "2001:db8::/32"_cidr.proto() == CIDR_IPV6, "family");
+static_assert("10.0.0.0/8"_cidr.contains("10.1.2.3"_cidr) && !"10.0.0.0/8"_cidr.contains("::1"_cidr),
+              "contains, either family");
+static_assert("10.0.0.0/8"_cidr == any_prefix("10.0.0.0/8"_ipv4), "equality");
+static_assert(!ipv4_prefix::parse("10.0.0.256"), "octet out of range");
+static_assert(!ipv4_prefix::parse("010.0.0.1") && !ipv4_prefix::parse("10.0.0.0/08"), "leading zeros");
+static_assert(!ipv4_prefix::parse("10.0.0.0/33") && !ipv4_prefix::parse("10.0.0.0/"), "prefix length");
+static_assert(!ipv6_prefix::parse("2001:db8::1::1") && !ipv6_prefix::parse("1:2:3:4:5:6:7:8:9"),
+              "IPv6 groups");
+static_assert(!ipv6_prefix::parse("::ffff:192.0.2.1") && !any_prefix::parse(""), "other notations");
+
+START_TEST (test_cxx_parse)
+{
+    /* The same verdicts and values as the parser of the program */
+    const char* inputs[] =
+    {
+        "192.0.2.1", "192.0.2.0/24", "0.0.0.0/0", "255.255.255.255", "10.0.0.256", "1.2.3",
+        "1.2.3.4.5", "01.2.3.4", "1.2.3.4/33", "1.2.3.4/", "1.2.3.4x",
+        "2001:db8::1", "2001:DB8::/32", "::", "::1", "::/0", "fe80::1%eth0", "1:2:3:4:5:6:7:8",
+        "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8", "1::2::3", "2001:db8::/129", "foo"
+    };
+
+    for( const char* input : inputs )
+    {
+        char input_str[PREFIX_STR_MAX];
+        ip_prefix native;
+        std::optional<any_prefix> parsed = any_prefix::parse(input);
+
+        strcpy(input_str, input);
+        ck_assert_int_eq(parsed.has_value(), ip_prefix_from_str(input_str, &native) == RESULT_SUCCESS);
+        if( parsed )
+        {
+            ip_prefix value = parsed->native();
+            ck_assert_int_eq(value.proto, native.proto);
+            ck_assert_int_eq(value.pflen, native.pflen);
+            ck_assert(ip_value_eq(value.addr, native.addr));
+            ck_assert(*any_prefix::from_native(native) == *parsed);
+        }
+    }
+
+    ck_assert_str_eq("2001:DB8:0::1/48"_ipv6.to_string().c_str(), "2001:db8::1/48");
+    ck_assert_str_eq("192.0.2.1"_cidr.to_string().c_str(), "192.0.2.1/32");
+    ck_assert(!ipv4_prefix::from_native("::1"_cidr.native()));
+}
+END_TEST
+
+START_TEST (test_cxx_properties)
+{
+    /* Classes and properties as the tables of ipaddrcheck_classify.c find them */
+    uint64_t seed = 1;
+    int i = 0;
+
+    for( i = 0; i < 100000; i++ )
+    {
+        ip_prefix native;
+        std::optional<any_prefix> value;
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if( i % 2 )
+        {
+            /* Mostly within the top bytes of the class prefixes */
+            static const uint32_t tops[] = { 0, 10, 127, 169, 172, 192, 224, 255 };
+            uint32_t addr = (tops[(seed >> 8) % 8] << 24) | ((uint32_t)(seed >> 32) & 0x00ffffff);
+            if( seed & 0x10 )
+            {
+                addr |= 0x00ffffff;
+            }
+            native = ip_prefix{ CIDR_IPV4, { 0, addr }, (int)((seed >> 16) % 33) };
+        }
+        else
+        {
+            static const uint64_t tops[] = { 0, 0xff02000000000000ULL, 0xfe80000000000000ULL,
+                                             0x20010db800000000ULL };
+            uint64_t lo = (seed & 0x20) ? 1 : (seed * 0x9e3779b97f4a7c15ULL);
+            native = ip_prefix{ CIDR_IPV6, { tops[(seed >> 8) % 4], lo }, (int)((seed >> 16) % 129) };
+        }
+
+        value = any_prefix::from_native(native);
+        ck_assert(value.has_value());
+        ck_assert_int_eq(value->properties(), ip_prefix_properties(&native));
+        ck_assert_int_eq(value->classes(), ip_prefix_classes(&native));
+    }
+}
+END_TEST
+
+Suite *ipaddrcheck_cxx_suite(void)
+{
+    Suite *s = suite_create("ipaddrcheck_cxx");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_cxx_parse);
+    tcase_add_test(tc_core, test_cxx_properties);
+
+    suite_add_tcase(s, tc_core);
+
+    return(s);
+}
+
+int main (void)
+{
+    int number_failed;
+    Suite *s = ipaddrcheck_cxx_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free (sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
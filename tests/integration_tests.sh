@@ -50,6 +50,8 @@ ipv4_cidr_negative=(
 
 ipv4_range_positive=(
     192.0.2.0-192.0.2.100
+    0.0.0.0-255.255.255.255
+    192.0.2.1-192.0.2.1
 )
 
 ipv4_range_negative=(
@@ -57,10 +59,15 @@ ipv4_range_negative=(
     192.0.2.0-
     192.0.2.200-192.0.2.100
     192.0.2.1-192.0.2.500
+    192.0.2.01-192.0.2.10
+    192.0.2.1-192.0.2.10-192.0.2.20
+    1.1.1.1111111111111111111111-2.2.2.2
 )
 
 ipv6_range_positive=(
     2001:db8::1-2001:db8::99
+    ::-ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff
+    2001:DB8:0:0:0:0:0:1-2001:db8::2
 )
 
 ipv6_range_negative=(
@@ -69,6 +76,10 @@ ipv6_range_negative=(
     2001:db8::99-2001:db8::1
     2001::db8::1:1-2001::db8::1::10
     2001:db8:pqrs::1-2001:db8:uvwx::100
+    :::-::1
+    2001:db8::12345-2001:db8::ffff
+    1:2:3:4:5:6:7:8::-1:2:3:4:5:6:7:9
+    2001:db8:0000000000000000000000000000000000000000000000:1-2001:db8::2
 )
 
 ipv6_single_positive=(
@@ -306,4 +317,430 @@ done
 assert_raises "$IPADDRCHECK --range-prefix-length 64 --is-ipv6-range 2001:db8::1-2001:db8::100" 0
 assert_raises "$IPADDRCHECK --range-prefix-length 64 --is-ipv6-range 2001:db8:aaaa::1-2001:db8:bbbb::1" 1
 
+# --lpm-table
+lpm_table=$(mktemp)
+cat > $lpm_table <<EOF
+# prefix      label
+10.0.0.0/8    corp
+10.1.0.0/16   site 1
+2001:db8::/32 doc
+EOF
+
+assert "$IPADDRCHECK --lpm-table $lpm_table 10.1.2.3" "10.1.2.3\t10.1.0.0/16\tsite 1"
+assert "$IPADDRCHECK --lpm-table $lpm_table 2001:db8::1" "2001:db8::1\t2001:db8::/32\tdoc"
+assert_raises "$IPADDRCHECK --lpm-table $lpm_table 10.1.2.3" 0
+assert_raises "$IPADDRCHECK --lpm-table $lpm_table 192.0.2.1" 1
+assert "echo -e '10.2.0.1\n192.0.2.1' | $IPADDRCHECK --lpm-table $lpm_table" "10.2.0.1\t10.0.0.0/8\tcorp\n192.0.2.1\t-\t-"
+assert "$IPADDRCHECK -V --lpm-table $lpm_table foo 2> /dev/null | head -n 1" "Malformed address foo"
+
+# --watch, --stats
+assert "echo -e '10.2.0.1\n192.0.2.1' | $IPADDRCHECK --lpm-table $lpm_table --watch --stats 2>&1 >/dev/null | grep -E 'version|Lookups'" \
+    "Table version:     1\nLookups:           2"
+assert "echo 10.1.2.3 | $IPADDRCHECK --lpm-table $lpm_table --watch" "10.1.2.3\t10.1.0.0/16\tsite 1"
+
+echo "10.0.0.1/8 corp" > $lpm_table
+assert_raises "$IPADDRCHECK --lpm-table $lpm_table 10.0.0.1" 2
+echo -e "10.0.0.0/8 corp\n10.0.0.0/8 corp" > $lpm_table
+assert_raises "$IPADDRCHECK --lpm-table $lpm_table 10.0.0.1" 2
+rm -f $lpm_table
+
+# --policy
+policy=$(mktemp)
+cat > $policy <<EOF
+deny   10.0.0.0/8
+permit 10.1.0.0/16
+deny   multicast
+permit ipv4
+EOF
+
+assert_raises "$IPADDRCHECK --policy $policy 192.0.2.1" 0
+assert_raises "$IPADDRCHECK --policy $policy 10.1.0.1" 1
+assert_raises "$IPADDRCHECK --policy $policy 224.0.0.1" 1
+assert_raises "$IPADDRCHECK --policy $policy 2001:db8::1" 1
+assert "echo -e '192.0.2.1\n10.1.0.1' | $IPADDRCHECK --policy $policy" "192.0.2.1\tpermit\n10.1.0.1\tdeny"
+
+echo "allow 10.0.0.0/8" > $policy
+assert_raises "$IPADDRCHECK --policy $policy 10.0.0.1" 2
+echo "deny bogons" > $policy
+assert_raises "$IPADDRCHECK --policy $policy 10.0.0.1" 2
+rm -f $policy
+
+# --in-list
+prefix_list=$(mktemp)
+cat > $prefix_list <<EOF
+10.0.0.0/9
+10.128.0.0/9
+192.0.2.1
+2001:db8::/32
+EOF
+
+assert_raises "$IPADDRCHECK --in-list $prefix_list 10.200.0.1" 0
+assert_raises "$IPADDRCHECK --in-list $prefix_list 10.0.0.0/8" 0
+assert_raises "$IPADDRCHECK --in-list $prefix_list 192.0.2.2" 1
+assert_raises "$IPADDRCHECK --in-list $prefix_list 2001:db8::/31" 1
+assert "echo -e '10.1.1.1\n11.1.1.1\n2001:db8::1' | $IPADDRCHECK --in-list $prefix_list" "10.1.1.1\n2001:db8::1"
+assert "$IPADDRCHECK --in-list $prefix_list --memory-report | head -n 1" \
+    "Prefixes:            4 (3 after merging covered and adjacent ones)"
+assert "echo -e '10.1.1.1\n11.1.1.1\n2001:db8::/48' | $IPADDRCHECK --in-list $prefix_list --filter-rate 0.01" "10.1.1.1\n2001:db8::/48"
+assert_raises "$IPADDRCHECK --in-list $prefix_list --filter-rate 0.01 192.0.2.1" 0
+assert "echo foo | $IPADDRCHECK -V --in-list $prefix_list 2> /dev/null" "Malformed address foo"
+
+echo "10.0.0.1/8" > $prefix_list
+assert_raises "$IPADDRCHECK --in-list $prefix_list 10.0.0.1" 2
+rm -f $prefix_list
+
+# --union, --intersect, --subtract, --symmetric-difference
+left_set=$(mktemp)
+right_set=$(mktemp)
+cat > $left_set <<EOF
+10.0.0.0/24
+10.0.1.0/24
+192.0.2.1
+192.0.2.2
+EOF
+cat > $right_set <<EOF
+10.0.0.128/25
+192.0.2.2
+192.0.2.3
+EOF
+
+assert "$IPADDRCHECK --union $left_set --union $right_set" "10.0.0.0/23\n192.0.2.1/32\n192.0.2.2/31"
+assert "$IPADDRCHECK --union $left_set --intersect $right_set" "10.0.0.128/25\n192.0.2.2/32"
+assert "$IPADDRCHECK --union $left_set --subtract $right_set" "10.0.0.0/25\n10.0.1.0/24\n192.0.2.1/32"
+assert "$IPADDRCHECK --union $right_set --subtract $left_set --list-addresses" "192.0.2.3"
+assert_raises "$IPADDRCHECK --union $left_set --subtract $left_set" 1
+assert_raises "$IPADDRCHECK --subtract $left_set --union $right_set" 2
+assert_raises "$IPADDRCHECK --intersect $left_set" 2
+
+assert "$IPADDRCHECK --union $left_set --symmetric-difference $right_set" \
+    "10.0.0.0/25\n10.0.1.0/24\n192.0.2.1/32\n192.0.2.3/32"
+
+cat > $right_set <<EOF
+2001:db8::/48
+2001:db8:1::/48
+EOF
+assert "$IPADDRCHECK --union $left_set --union $right_set --intersect $right_set" "2001:db8::/47"
+assert "$IPADDRCHECK --union $left_set --union $right_set | tail -n 1" "2001:db8::/47"
+
+cat > $left_set <<EOF
+2001:db8:0:8000::/49
+2001:db8:2::/48
+EOF
+assert "$IPADDRCHECK --union $left_set --union $right_set" "2001:db8::/47\n2001:db8:2::/48"
+assert "$IPADDRCHECK --union $left_set --symmetric-difference $right_set" \
+    "2001:db8::/49\n2001:db8:1::/48\n2001:db8:2::/48"
+
+echo "::/0" > $left_set
+echo "8000::/1" > $right_set
+assert "$IPADDRCHECK --union $left_set --subtract $right_set" "::/1"
+assert_raises "$IPADDRCHECK --union $left_set --symmetric-difference $left_set" 1
+
+echo "2001:db8::1/64" > $right_set
+assert_raises "$IPADDRCHECK --union $left_set --union $right_set" 2
+rm -f $left_set $right_set
+
+# --host-list, --compile
+host_list=$(mktemp)
+compiled_list=$(mktemp)
+cat > $host_list <<EOF
+# Known scanners
+192.0.2.1
+192.0.2.7
+2001:db8::1
+192.0.2.1
+EOF
+
+assert "$IPADDRCHECK --host-list $host_list 192.0.2.7" "192.0.2.7"
+assert_raises "$IPADDRCHECK --host-list $host_list 192.0.2.2" 1
+assert_raises "$IPADDRCHECK --host-list $host_list 192.0.2.0/24" 1
+assert "$IPADDRCHECK -V --host-list $host_list 192.0.2.0/24 2> /dev/null" "192.0.2.0/24 is not a single address"
+assert "echo -e '192.0.2.1\n192.0.2.2\n2001:db8::1' | $IPADDRCHECK --host-list $host_list" "192.0.2.1\n2001:db8::1"
+assert_raises "$IPADDRCHECK --host-list $host_list --compile $compiled_list" 0
+assert "$IPADDRCHECK --host-list $compiled_list 2001:db8::1" "2001:db8::1"
+assert_raises "$IPADDRCHECK --host-list $compiled_list 2001:db8::2" 1
+assert "$IPADDRCHECK --host-list $compiled_list --memory-report | head -n 1" "Addresses:           3"
+
+# --filter-rate
+assert "echo -e '192.0.2.1\n192.0.2.2\n2001:db8::1' | $IPADDRCHECK --host-list $host_list --filter-rate 0.004" "192.0.2.1\n2001:db8::1"
+assert_raises "$IPADDRCHECK --host-list $host_list --filter-rate 0.004 --compile $compiled_list" 0
+assert "$IPADDRCHECK --host-list $compiled_list --memory-report | grep Filter" \
+    "Filter:              24 bytes, 8-bit fingerprints, 64.00 bits per address"
+assert "echo -e '192.0.2.7\n192.0.2.8' | $IPADDRCHECK --host-list $compiled_list --stats 2>&1 >/dev/null | head -n 1" \
+    "Lookups:           2"
+assert "$IPADDRCHECK --host-list $compiled_list 192.0.2.7" "192.0.2.7"
+assert "echo -e '192.0.2.1\n192.0.2.8' | $IPADDRCHECK --host-list $host_list --stats 2>&1 >/dev/null" \
+    "Lookups:           2\nHits:              1\nMisses:            1"
+assert_raises "$IPADDRCHECK --host-list $host_list --filter-rate 0 192.0.2.1" 2
+assert_raises "$IPADDRCHECK --host-list $host_list --filter-rate 1.5 192.0.2.1" 2
+
+echo "192.0.2.0/24" > $host_list
+assert_raises "$IPADDRCHECK --host-list $host_list 192.0.2.1" 2
+head -c 100 $compiled_list > $host_list
+assert_raises "$IPADDRCHECK --host-list $host_list 192.0.2.1" 2
+rm -f $host_list $compiled_list
+
+# --next-free
+allocations=$(mktemp)
+cat > $allocations <<EOF
+10.0.0.0/29
+10.0.0.16/28
+10.0.1.0/24
+192.168.0.0/16
+EOF
+
+assert "$IPADDRCHECK --next-free 10.0.0.0/16 --allocations $allocations 29" "10.0.0.8/29"
+assert "$IPADDRCHECK --next-free 10.0.0.0/16 --allocations $allocations --how-many 3 /29" "10.0.0.8/29\n10.0.0.32/29\n10.0.0.40/29"
+assert "$IPADDRCHECK --next-free 10.0.0.0/16 --allocations $allocations --best-fit --how-many 3 30" "10.0.0.8/30\n10.0.0.12/30\n10.0.0.32/30"
+assert "echo -e '24\n25\n29' | $IPADDRCHECK --next-free 10.0.0.0/22 --allocations $allocations" "10.0.2.0/24\n10.0.0.128/25\n10.0.0.8/29"
+assert "$IPADDRCHECK --next-free 2001:db8::/32 --how-many 2 48" "2001:db8::/48\n2001:db8:1::/48"
+assert_raises "$IPADDRCHECK --next-free 10.0.0.0/30 --how-many 5 32" 1
+assert_raises "$IPADDRCHECK --next-free 10.0.0.0/16 --allocations $allocations 16" 1
+assert_raises "$IPADDRCHECK --next-free 10.0.0.0/16 33" 1
+assert "$IPADDRCHECK -V --next-free 10.0.0.0/16 33 2> /dev/null" "\"33\" is not a valid prefix length"
+assert "$IPADDRCHECK -V --next-free 10.0.0.0/31 --how-many 3 32 2> /dev/null" "10.0.0.0/32\n10.0.0.1/32\nNo free /32 left in 10.0.0.0/31"
+assert_raises "$IPADDRCHECK --next-free 10.0.0.1/16 24" 2
+assert_raises "$IPADDRCHECK --next-free 10.0.0.0/16 --how-many 0 24" 2
+echo "10.0.0.1/24" > $allocations
+assert_raises "$IPADDRCHECK --next-free 10.0.0.0/16 --allocations $allocations 24" 2
+rm -f $allocations
+
+# --plan
+plan=$(mktemp)
+cat > $plan <<EOF
+# Site 12
+26 lan
+24 servers
+30 uplink 1
+30 uplink 2
+25
+EOF
+
+assert "$IPADDRCHECK --plan $plan 10.1.0.0/16" \
+    "10.1.1.128/26\tlan\n10.1.0.0/24\tservers\n10.1.1.192/30\tuplink 1\n10.1.1.196/30\tuplink 2\n10.1.1.0/25"
+assert "echo -e '64\n48\n64' | $IPADDRCHECK --plan - 2001:db8::/32" "2001:db8:1::/64\n2001:db8::/48\n2001:db8:1:1::/64"
+assert_raises "$IPADDRCHECK --plan $plan 10.1.0.0/24" 1
+assert_raises "$IPADDRCHECK --plan $plan 10.1.0.1/16" 2
+assert_raises "$IPADDRCHECK --plan $plan 10.1.0.0/25" 2
+rm -f $plan
+
+# --pool-usage
+pools=$(mktemp)
+cat > $pools <<EOF
+# DHCP ranges
+10.0.1.0-10.0.1.255
+10.0.0.10-10.0.0.19 office
+192.0.2.5-192.0.2.5 printer
+EOF
+
+assert "echo -e '10.0.0.10 aa:bb:cc:dd:ee:ff\n10.0.0.11\n10.0.0.10\n10.0.0.20\n10.0.1.255\n192.0.2.5\n1.1.1.1' | $IPADDRCHECK --pool-usage $pools" \
+    "10.0.0.10-10.0.0.19\t10\t2\t8\t1\toffice\n10.0.1.0-10.0.1.255\t256\t1\t255\t0\n192.0.2.5-192.0.2.5\t1\t1\t0\t0\tprinter\nout-of-pool\t2"
+assert "echo -n | $IPADDRCHECK --pool-usage $pools - | tail -n 1" "out-of-pool\t0"
+assert_raises "echo 2001:db8::1 | $IPADDRCHECK --pool-usage $pools" 1
+assert "echo -e '10.0.0.10\nfoo' | $IPADDRCHECK --pool-usage $pools 2> /dev/null | tail -n 1" "out-of-pool\t0"
+assert_raises "echo 10.0.0.01-10.0.0.10 | $IPADDRCHECK --pool-usage - $pools" 2
+assert_raises "echo 10.0.0.20 | $IPADDRCHECK --pool-usage - $pools" 2
+assert_raises "echo 10.0.0.20-10.0.0.10 | $IPADDRCHECK --pool-usage - $pools" 2
+assert_raises "echo -e '10.0.0.1-10.0.0.10\n10.0.0.10-10.0.0.20' | $IPADDRCHECK --pool-usage - $pools" 2
+rm -f $pools
+
+# --redundant
+group=$(mktemp)
+cat > $group <<EOF
+# Servers
+10.1.0.0/16
+10.1.2.3
+10.1.2.3/32
+192.0.2.0/24
+2001:db8::1
+2001:DB8:0::1
+EOF
+
+assert "$IPADDRCHECK --redundant $group" "10.1.2.3\t10.1.0.0/16\n10.1.2.3/32\t10.1.0.0/16\n2001:DB8:0::1\t2001:db8::1"
+assert_raises "$IPADDRCHECK --redundant $group" 1
+assert "echo -e '10.0.0.0/8\n10.0.0.0/9' | $IPADDRCHECK --redundant -" "10.0.0.0/9\t10.0.0.0/8"
+assert_raises "echo -e '10.0.0.0/8\n11.0.0.0/8' | $IPADDRCHECK --redundant -" 0
+assert_raises "echo 10.0.0.1/8 | $IPADDRCHECK --redundant -" 2
+assert_raises "$IPADDRCHECK --redundant $group 10.0.0.1" 2
+rm -f $group
+
+# --shadowed
+acl=$(mktemp)
+cat > $acl <<EOF
+# Edge filter
+permit 10.0.0.0/8
+deny 10.1.0.0/16
+permit 10.1.2.0/24
+deny 192.168.0.0/24
+deny 192.168.1.0/24
+deny 192.168.0.0/23
+permit rfc1918
+EOF
+
+assert "$IPADDRCHECK --shadowed $acl" \
+    "3\tshadowed\tdeny 10.1.0.0/16\t2\n4\tredundant\tpermit 10.1.2.0/24\t2\n7\tredundant\tdeny 192.168.0.0/23\t6"
+assert_raises "$IPADDRCHECK --shadowed $acl" 1
+assert "echo -e 'deny ipv6\npermit 2001:db8::/32\npermit any' | $IPADDRCHECK --shadowed -" "2\tshadowed\tpermit 2001:db8::/32\t1"
+assert_raises "echo -e 'permit 10.0.0.0/9\npermit 10.128.0.0/9\ndeny any' | $IPADDRCHECK --shadowed -" 0
+assert_raises "echo 'allow 10.0.0.0/8' | $IPADDRCHECK --shadowed -" 2
+assert_raises "$IPADDRCHECK --shadowed $acl 10.0.0.1" 2
+rm -f $acl
+
+# Relations between two addresses
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8 10.1.2.3" 0
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8 10.1.0.0/16" 0
+assert_raises "$IPADDRCHECK --contains 10.1.0.0/16 10.0.0.0/8" 1
+assert_raises "$IPADDRCHECK --contains 192.0.2.1/24 192.0.2.254" 0
+assert_raises "$IPADDRCHECK --contains 2001:db8::/32 2001:db8:1::1" 0
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8 ::ffff:10.0.0.1" 1
+assert_raises "$IPADDRCHECK --overlaps 10.1.0.0/16 10.0.0.0/8" 0
+assert_raises "$IPADDRCHECK --overlaps 10.0.0.0/8 11.0.0.0/8" 1
+assert_raises "$IPADDRCHECK --same-subnet 192.0.2.1/24 192.0.2.254" 0
+assert_raises "$IPADDRCHECK --same-subnet 192.0.2.1/25 192.0.2.254" 1
+assert_raises "$IPADDRCHECK --same-subnet 10.0.0.1 10.0.1.1 /16" 0
+assert_raises "$IPADDRCHECK --same-subnet 10.0.0.1 10.0.1.1 24" 1
+assert_raises "$IPADDRCHECK --same-subnet 10.0.0.1 10.0.1.1 33" 2
+assert_raises "$IPADDRCHECK --equal 2001:DB8::1 2001:db8:0::1" 0
+assert_raises "$IPADDRCHECK --equal 10.0.0.1 10.0.0.1/32" 0
+assert_raises "$IPADDRCHECK --equal 10.0.0.1/24 10.0.0.2/24" 1
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8 foo" 1
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8" 2
+assert_raises "$IPADDRCHECK --contains 10.0.0.0/8 10.0.0.1 24" 2
+assert_raises "$IPADDRCHECK --contains --overlaps 10.0.0.0/8 10.0.0.0/9" 0
+assert "$IPADDRCHECK --verbose --contains 10.1.0.0/16 10.0.0.0/8" "10.1.0.0/16 does not contain 10.0.0.0/8"
+
+# Ranges from standard input
+assert_raises "printf '192.0.2.1-192.0.2.10\n10.0.0.1-10.0.0.2\n' | $IPADDRCHECK --is-ipv4-range" 0
+assert_raises "printf '192.0.2.1-192.0.2.10\n10.0.0.9-10.0.0.2\n' | $IPADDRCHECK --is-ipv4-range" 1
+assert_raises "printf '10.0.0.1-10.0.0.10\n10.0.1.1-10.0.2.1\n' | $IPADDRCHECK --range-prefix-length 24 --is-ipv4-range" 1
+assert_raises "printf '2001:db8::1-2001:db8::20\n::-::1\n' | $IPADDRCHECK --is-ipv6-range" 0
+assert "printf '192.0.2.1-192.0.2.10\n192.0.2.300-192.0.2.1\n' | $IPADDRCHECK --verbose --is-ipv4-range 2>&1" \
+    "Malformed range 192.0.2.300-192.0.2.1: 192.0.2.300 is not a valid IPv4 address"
+assert "$IPADDRCHECK --verbose --is-ipv6-range 2001:db8::1-2001:db8::x 2>&1" \
+    "Malformed range 2001:db8::1-2001:db8::x: must be a pair of hyphen-separated IPv6 addresses"
+assert "$IPADDRCHECK --verbose --is-ipv6-range 2001:db8::1-2001:db8:::2 2>&1" \
+    "Malformed range 2001:db8::1-2001:db8:::2: 2001:db8:::2 is not a valid IPv6 address"
+assert "$IPADDRCHECK --verbose --is-ipv6-range 2001:db8::9-2001:db8::2 2>&1" \
+    "Malformed IPv6 range 2001:db8::9-2001:db8::2: its first address is greater than the last"
+assert_raises "$IPADDRCHECK --range-prefix-length 129 --is-ipv6-range ::1-::2" 2
+
+# Address counts
+assert "$IPADDRCHECK --count 192.0.2.0/24" "ipv4\t256\t254"
+assert "$IPADDRCHECK --count 192.0.2.0/31" "ipv4\t2\t2"
+assert "$IPADDRCHECK --count 192.0.2.1" "ipv4\t1\t1"
+assert "$IPADDRCHECK --count 192.0.2.1-192.0.2.10" "ipv4\t10\t10"
+assert "$IPADDRCHECK --count 2001:db8::/127" "ipv6\t2\t2"
+assert "$IPADDRCHECK --count ::/0" "ipv6\t340282366920938463463374607431768211456\t340282366920938463463374607431768211455"
+assert "$IPADDRCHECK --count --count-unit /64 2001:db8::/48" "ipv6\t1208925819614629174706176\t1208925819614629174706175\t65536"
+assert "$IPADDRCHECK --count --count-unit 33 10.0.0.0/8" "ipv4\t16777216\t16777214\t-"
+assert "printf '192.0.2.0/25\n192.0.2.128/25\n192.0.2.0/24\n10.0.0.5-10.0.1.250\n2001:db8::/64\n2001:db8:0:1::/64\n' | $IPADDRCHECK --count --count-unit 24" \
+    "ipv4\t758\t754\t1\nipv6\t36893488147419103232\t36893488147419103230\t0"
+assert_raises "printf '# nothing\n' | $IPADDRCHECK --count" 1
+assert_raises "printf '192.0.2.1\nfoo\n' | $IPADDRCHECK --count" 1
+assert "printf '192.0.2.1\nfoo\n' | $IPADDRCHECK --count 2> /dev/null" ""
+assert_raises "$IPADDRCHECK --count 192.0.2.9-192.0.2.1" 1
+assert_raises "$IPADDRCHECK --count foo" 1
+assert_raises "$IPADDRCHECK --count --count-unit 129 ::/0" 2
+
+# Expansion into addresses and prefixes
+assert "$IPADDRCHECK --expand 192.0.2.0/30" "192.0.2.1\n192.0.2.2"
+assert "$IPADDRCHECK --expand 192.0.2.0/31" "192.0.2.0\n192.0.2.1"
+assert "$IPADDRCHECK --expand 192.0.2.9/32" "192.0.2.9"
+assert "$IPADDRCHECK --expand 192.0.2.254-192.0.3.1" "192.0.2.254\n192.0.2.255\n192.0.3.0\n192.0.3.1"
+assert "$IPADDRCHECK --expand 2001:db8::/126" "2001:db8::1\n2001:db8::2\n2001:db8::3"
+assert "$IPADDRCHECK --expand 2001:db8::/127" "2001:db8::\n2001:db8::1"
+assert "$IPADDRCHECK --expand 10.0.0.0/8 | wc -l" "16777214"
+assert "$IPADDRCHECK --expand 10.0.0.0/8 | sed -n '255p;16777214p'" "10.0.0.255\n10.255.255.254"
+assert "$IPADDRCHECK --expand-prefixes /26 192.0.2.0/24" "192.0.2.0/26\n192.0.2.64/26\n192.0.2.128/26\n192.0.2.192/26"
+assert "$IPADDRCHECK --expand-prefixes 64 2001:db8::/63" "2001:db8::/64\n2001:db8:0:1::/64"
+assert "printf '192.0.2.0/30\n10.0.0.5-10.0.0.6\n' | $IPADDRCHECK --expand" "192.0.2.1\n192.0.2.2\n10.0.0.5\n10.0.0.6"
+assert_raises "$IPADDRCHECK --expand 192.0.2.300/30" 1
+assert_raises "$IPADDRCHECK --expand-prefixes 64 192.0.2.0/24" 1
+assert_raises "$IPADDRCHECK --expand-prefixes 16 192.0.2.0/24" 1
+assert "$IPADDRCHECK -V --expand-prefixes 16 192.0.2.0/24" "192.0.2.0/24 has no prefixes of length 16"
+assert_raises "$IPADDRCHECK --expand-prefixes 24 10.0.0.5-10.0.0.6" 1
+assert_raises "$IPADDRCHECK --expand-prefixes 200 192.0.2.0/24" 2
+
+# Address classes
+assert "$IPADDRCHECK --classify 10.1.2.3" "10.1.2.3\trfc1918"
+assert "$IPADDRCHECK --classify 192.168.0.0/15" "192.168.0.0/15\t-"
+assert "$IPADDRCHECK --classify 255.255.255.255" "255.255.255.255\tlimited-broadcast"
+assert "printf '224.0.0.1\nfe80::1\nfe80:0:0:1::1\n::1\n0.0.0.0/8\n' | $IPADDRCHECK --classify" \
+    "224.0.0.1\tmulticast\nfe80::1\tlink-local\nfe80:0:0:1::1\t-\n::1\tloopback\n0.0.0.0/8\tthis-network"
+assert_raises "printf '8.8.8.8\nfoo\n' | $IPADDRCHECK --classify" 1
+assert_raises "$IPADDRCHECK --is-ipv4-rfc1918 172.16.0.0/12" 0
+assert_raises "$IPADDRCHECK --is-ipv4-rfc1918 172.16.0.0/11" 1
+assert_raises "$IPADDRCHECK --is-ipv6-link-local fe80::1/64" 0
+assert_raises "$IPADDRCHECK --is-ipv6-link-local fe80::1/63" 1
+
+# The bash builtin, if it was built with --enable-bash-builtin
+IPADDRCHECK_BUILTIN=../src/ipaddrcheck.so
+if [ -f $IPADDRCHECK_BUILTIN ] && enable -f $IPADDRCHECK_BUILTIN ipaddrcheck; then
+    assert "type -t ipaddrcheck" "builtin"
+    assert_raises "ipaddrcheck --is-ipv4 192.0.2.1" 0
+    assert_raises "ipaddrcheck --is-ipv4 2001:db8::1" 1
+    assert_raises "ipaddrcheck --is-ipv4" 2
+    assert_raises "ipaddrcheck --is-valid-intf-address 127.0.0.1/8" 1
+    assert_raises "ipaddrcheck --allow-loopback --is-valid-intf-address 127.0.0.1/8" 0
+    assert "ipaddrcheck -V --is-ipv4-host 10.0.0.0/8" "10.0.0.0/8 is an IPv4 network address, not a host address"
+    assert "printf '10.0.0.1\n::1\n' | ipaddrcheck --classify" "10.0.0.1\trfc1918\n::1\tloopback"
+    builtin_table=$(mktemp)
+    echo "10.0.0.0/8 corp" > $builtin_table
+    # Standard input is left as it was for the next command
+    assert "ipaddrcheck --classify < $builtin_table; echo 10.0.0.1 > $builtin_table.2; ipaddrcheck --classify < $builtin_table.2" \
+        "10.0.0.0/8\trfc1918\n10.0.0.1\trfc1918"
+    rm -f $builtin_table.2
+    assert_raises "echo 10.1.2.3 | ipaddrcheck --lpm-table $builtin_table --watch 2> /dev/null" 2
+    assert "echo 10.1.2.3 | ipaddrcheck --lpm-table $builtin_table --watch 2>&1" "Error: --watch is not available in the shell builtin!"
+    # The shell keeps its own SIGHUP handling
+    assert "trap 'echo hup' HUP; ipaddrcheck --lpm-table $builtin_table --watch <<< 10.1.2.3 2> /dev/null; kill -HUP \$BASHPID" "hup"
+    rm -f $builtin_table
+    enable -d ipaddrcheck
+fi
+
+# The gawk extension, if it was built with --enable-gawk-extension
+GAWK_EXTENSION_DIR=../src/gawk
+if [ -f $GAWK_EXTENSION_DIR/ipaddrcheck.so ] && command -v gawk > /dev/null; then
+    IP_AWK="AWKLIBPATH=$GAWK_EXTENSION_DIR gawk -l ipaddrcheck"
+    awk_list=$(mktemp)
+    printf '10.0.0.0/8\n2001:db8::/32\n' > $awk_list
+    assert "echo 192.0.2.1 2001:db8::1 foo | $IP_AWK '{ print ip_valid(\$1), ip_valid(\$2), ip_valid(\$3) }'" "4 6 0"
+    assert "echo 10.1.2.3 | $IP_AWK '{ print and(ip_classify(\$1), IP_RFC1918) != 0 }'" "1"
+    assert "echo 10.0.0.0/8 | $IP_AWK '{ print and(ip_classify(\$1), IP_HOST) != 0 }'" "0"
+    assert "echo bad | $IP_AWK '{ print ip_classify(\$1) }'" "-1"
+    assert "printf '10.1.2.3\n192.0.2.1\n2001:db8::1\n' | $IP_AWK 'ip_in_list(\$1, \"$awk_list\") == 1'" "10.1.2.3\n2001:db8::1"
+    assert "echo 10.1.2.3 | $IP_AWK '{ print ip_in_list(\$1, \"/nonexistent\") }' 2> /dev/null" "-1"
+    rm -f $awk_list
+fi
+
+# The SQLite extension, if it was built with --enable-sqlite-extension
+SQLITE_EXTENSION=../src/sqlite/ipaddrcheck
+if [ -f $SQLITE_EXTENSION.so ] && command -v sqlite3 > /dev/null; then
+    IP_SQL="sqlite3 -batch -separator ' ' :memory: '.load $SQLITE_EXTENSION'"
+    assert "$IP_SQL \"SELECT ip_is_valid('10.1.2.3'), ip_is_valid('foo'), ip_is_valid('2001:db8::/33')\"" "1 0 1"
+    assert "$IP_SQL \"SELECT ip_is_rfc1918('172.16.5.4'), ip_is_rfc1918('10.0.0.0/7'), ip_is_rfc1918('bad') IS NULL\"" "1 0 1"
+    assert "$IP_SQL \"SELECT ip_canonical('2001:DB8:0::1'), ip_canonical('2001:0db8::/32')\"" "2001:db8::1 2001:db8::/32"
+    assert "$IP_SQL \"SELECT ip_contains('10.0.0.0/8', '10.1.2.3'), ip_contains('10.0.0.0/8', '10.0.0.0/7')\"" "1 0"
+    sql_table=$(mktemp)
+    printf '10.0.0.0/8 corp\n10.1.0.0/16 site\n0.0.0.0/0 default\n' > $sql_table
+    IP_SQL_TABLE="$IP_SQL \"CREATE VIRTUAL TABLE routes USING ipaddrcheck_lpm('$sql_table')\""
+    assert "$IP_SQL_TABLE \"SELECT prefix, label FROM routes('10.1.2.3')\"" "10.1.0.0/16 site"
+    assert "$IP_SQL_TABLE \"SELECT prefix FROM routes WHERE address = '192.0.2.1'\"" "0.0.0.0/0"
+    assert "$IP_SQL_TABLE \"SELECT count(*) FROM routes WHERE ip_contains(prefix, '10.1.2.3')\"" "3"
+    assert "$IP_SQL_TABLE \"SELECT count(*) FROM routes\"" "3"
+    rm -f $sql_table
+fi
+
+# The Python module, if it was built with --enable-python-extension
+PYTHON_EXTENSION=../src/python
+if [ -f $PYTHON_EXTENSION/ipaddrcheck.so ] && command -v python3 > /dev/null; then
+    IP_PY="env PYTHONPATH=$PYTHON_EXTENSION python3 -c"
+    assert "$IP_PY 'import ipaddrcheck as m; print(m.valid(\"10.1.2.3\"), m.valid(b\"2001:db8::/33\"), m.valid(\"foo\"))'" "4 6 0"
+    assert "$IP_PY 'import ipaddrcheck as m; c = m.classify(\"10.1.2.3/24\"); print(c & m.IPV4 != 0, c & m.RFC1918 != 0, c & m.INTERFACE != 0)'" "True True True"
+    assert "$IP_PY 'import ipaddrcheck as m; print(m.classify(\"bad\"), m.classify(\"ff02::1\") & m.MULTICAST)'" "0 1"
+    assert "$IP_PY 'import ipaddrcheck as m; print(m.contains(\"10.0.0.0/8\", \"10.1.2.3\"), m.contains(\"10.0.0.0/8\", \"10.0.0.0/7\"))'" "True False"
+    assert "$IP_PY 'import ipaddrcheck as m; print(list(m.valid_batch([\"10.1.2.3\", b\"::1\", \"bad\"])))'" "[4, 6, 0]"
+    assert "$IP_PY 'import ipaddrcheck as m; items = [\"192.168.1.255/24\", \"bad\", \"::1\"]; print(list(memoryview(m.classify_batch(items)).cast(\"H\")) == [m.classify(i) for i in items])'" "True"
+    assert_raises "$IP_PY 'import ipaddrcheck as m; m.valid_batch([\"10.1.2.3\", 4])' 2> /dev/null" 1
+fi
+
 assert_end ipaddrcheck_integration